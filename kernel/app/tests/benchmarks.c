@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <kernel/thread.h>
+#include <kernel/vm.h>
 #include <platform.h>
 #include <arch/ops.h>
 #include <inttypes.h>
@@ -201,6 +202,42 @@ __NO_INLINE static void bench_sincos(void)
 
 #endif // WITH_LIB_LIBM
 
+__NO_INLINE static void bench_page_to_paddr(void)
+{
+    const size_t PAGES = 256;
+    struct list_node list = LIST_INITIAL_VALUE(list);
+
+    size_t allocated = pmm_alloc_pages(PAGES, 0, &list);
+    if (allocated == 0) {
+        printf("failed to allocate pages for page translation benchmark\n");
+        return;
+    }
+
+    uintptr_t sum = 0;
+    vm_page_t *p;
+    uint64_t count = arch_cycle_count();
+    for (uint i = 0; i < ITER; i++) {
+        list_for_every_entry(&list, p, vm_page_t, free.node) {
+            sum += (uintptr_t)paddr_to_vm_page(vm_page_to_paddr(p));
+        }
+    }
+    count = arch_cycle_count() - count;
+
+    printf("took %" PRIu64 " cycles to translate %zu pages to paddrs and back %u times, %" PRIu64 " cycles per round trip\n",
+           count, allocated, ITER, count / (allocated * ITER));
+
+    // check a round trip while we're here
+    list_for_every_entry(&list, p, vm_page_t, free.node) {
+        if (paddr_to_vm_page(vm_page_to_paddr(p)) != p) {
+            printf("page %p did not translate back to itself\n", p);
+            break;
+        }
+    }
+
+    pmm_free(&list);
+    (void)sum;
+}
+
 void benchmarks(void)
 {
     bench_set_overhead();
@@ -216,6 +253,8 @@ void benchmarks(void)
     bench_cset_uint64_t();
     bench_cset_wide();
 
+    bench_page_to_paddr();
+
 #if WITH_LIB_LIBM && !WITH_NO_FP
     bench_sincos();
 #endif
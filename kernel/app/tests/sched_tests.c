@@ -0,0 +1,142 @@
+// Copyright 2017 The Fuchsia Authors
+//
+// Use of this source code is governed by a MIT-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/MIT
+
+#include "tests.h"
+
+#include <assert.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <arch/ops.h>
+#include <kernel/event.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+#include <platform.h>
+
+#define WAKEUP_ROUNDS 1000
+
+/* measures the time from a waker signalling an event until the blocked
+ * thread is actually running, with one waiter per cpu under test */
+struct wakeup_waiter {
+    thread_t *thread;
+    event_t wake;
+    volatile lk_time_t signal_time;
+    lk_time_t total_latency;
+    lk_time_t max_latency;
+};
+
+struct wakeup_bench {
+    struct wakeup_waiter *waiters;
+    uint num_waiters;
+    volatile int acked;
+    volatile int exit;
+    event_t round_done;
+};
+
+static int wakeup_waiter_thread(void *arg)
+{
+    struct wakeup_bench *bench = arg;
+    struct wakeup_waiter *w = NULL;
+
+    for (uint i = 0; i < bench->num_waiters; i++) {
+        if (bench->waiters[i].thread == get_current_thread()) {
+            w = &bench->waiters[i];
+            break;
+        }
+    }
+    DEBUG_ASSERT(w);
+
+    for (;;) {
+        event_wait(&w->wake);
+        lk_time_t latency = current_time() - w->signal_time;
+
+        if (bench->exit)
+            break;
+
+        w->total_latency += latency;
+        if (latency > w->max_latency)
+            w->max_latency = latency;
+
+        if (atomic_add(&bench->acked, 1) + 1 == (int)bench->num_waiters)
+            event_signal(&bench->round_done, true);
+    }
+
+    return 0;
+}
+
+static void wakeup_latency_test(uint num_waiters)
+{
+    struct wakeup_bench bench = {};
+    bench.waiters = calloc(num_waiters, sizeof(struct wakeup_waiter));
+    if (!bench.waiters) {
+        printf("failed to allocate waiters\n");
+        return;
+    }
+    bench.num_waiters = num_waiters;
+    event_init(&bench.round_done, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+    /* create all the threads before resuming any of them, the waiters find
+     * their slot by looking up their own thread pointer */
+    for (uint i = 0; i < num_waiters; i++) {
+        event_init(&bench.waiters[i].wake, false, EVENT_FLAG_AUTOUNSIGNAL);
+        bench.waiters[i].thread = thread_create("wakeup waiter", &wakeup_waiter_thread, &bench,
+                                                DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    }
+    for (uint i = 0; i < num_waiters; i++)
+        thread_resume(bench.waiters[i].thread);
+
+    for (uint round = 0; round < WAKEUP_ROUNDS; round++) {
+        bench.acked = 0;
+        for (uint i = 0; i < num_waiters; i++) {
+            bench.waiters[i].signal_time = current_time();
+            event_signal(&bench.waiters[i].wake, false);
+        }
+        event_wait(&bench.round_done);
+    }
+
+    bench.exit = 1;
+    for (uint i = 0; i < num_waiters; i++) {
+        event_signal(&bench.waiters[i].wake, false);
+        thread_join(bench.waiters[i].thread, NULL, INFINITE_TIME);
+    }
+
+    lk_time_t total = 0;
+    lk_time_t max = 0;
+    for (uint i = 0; i < num_waiters; i++) {
+        total += bench.waiters[i].total_latency;
+        if (bench.waiters[i].max_latency > max)
+            max = bench.waiters[i].max_latency;
+        event_destroy(&bench.waiters[i].wake);
+    }
+    event_destroy(&bench.round_done);
+    free(bench.waiters);
+
+    printf("%2u waiters: avg wakeup-to-run %" PRIu64 " ns, max %" PRIu64 " ns\n",
+           num_waiters, total / ((lk_time_t)num_waiters * WAKEUP_ROUNDS), max);
+}
+
+int sched_tests(int argc, const cmd_args *argv)
+{
+    uint num_cpus = 0;
+    mp_cpu_mask_t active = mp_get_active_mask();
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (active & (1u << i))
+            num_cpus++;
+    }
+
+    printf("measuring wakeup-to-run latency, %u active cpus, %u rounds\n",
+           num_cpus, WAKEUP_ROUNDS);
+
+    /* scale the number of simultaneously woken threads with the cpu count,
+     * then oversubscribe so stealing and balancing get exercised too */
+    for (uint n = 1; n < num_cpus; n *= 2)
+        wakeup_latency_test(n);
+    wakeup_latency_test(num_cpus);
+    wakeup_latency_test(num_cpus * 2);
+
+    return 0;
+}
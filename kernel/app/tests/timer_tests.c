@@ -6,13 +6,16 @@
 
 #include "tests.h"
 
+#include <arch/ops.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/timer.h>
 #include <kernel/event.h>
 #include <kernel/thread.h>
 #include <platform.h>
+#include <rand.h>
 
 static enum handler_return timer_cb(struct timer* timer, lk_time_t now, void* arg)
 {
@@ -75,8 +78,85 @@ static void timer_test_all_cpus(void)
     printf("%u threads created, %u threads joined\n", max, joined);
 }
 
+#define ORDER_TIMERS 256
+
+struct order_state {
+    timer_t timers[ORDER_TIMERS];
+    lk_time_t fired[ORDER_TIMERS];
+    volatile int count;
+    event_t done;
+};
+
+static enum handler_return order_cb(struct timer* timer, lk_time_t now, void* arg)
+{
+    struct order_state* state = (struct order_state*)arg;
+    int n = atomic_add(&state->count, 1);
+    state->fired[n] = timer->scheduled_time;
+    if (n + 1 == ORDER_TIMERS - ORDER_TIMERS / 4)
+        event_signal(&state->done, false);
+
+    return INT_NO_RESCHEDULE;
+}
+
+static int timer_do_order_thread(void* arg)
+{
+    struct order_state* state = (struct order_state*)arg;
+    lk_time_t base = current_time() + LK_MSEC(10);
+
+    // arm timers with scrambled deadlines, several of them colliding
+    for (int i = 0; i < ORDER_TIMERS; i++) {
+        timer_initialize(&state->timers[i]);
+        lk_time_t deadline = base + LK_USEC(rand() % 64) * 10;
+        timer_set_oneshot(&state->timers[i], deadline, order_cb, state);
+    }
+    // cancel a quarter of them out of the middle of the queue
+    for (int i = 0; i < ORDER_TIMERS; i += 4)
+        timer_cancel(&state->timers[i]);
+
+    event_wait(&state->done);
+    return 0;
+}
+
+static void timer_test_order(void)
+{
+    struct order_state* state = calloc(1, sizeof(*state));
+    if (state == NULL) {
+        printf("failed to allocate state\n");
+        return;
+    }
+    event_init(&state->done, false, 0);
+
+    // keep everything on one cpu so the callbacks come out of a single queue
+    thread_t* t = thread_create("timer order", timer_do_order_thread, state,
+                                DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+    if (t == NULL) {
+        printf("failed to create thread\n");
+        free(state);
+        return;
+    }
+    thread_set_pinned_cpu(t, 0);
+    thread_resume(t);
+    thread_join(t, NULL, INFINITE_TIME);
+
+    // let any stragglers that should have been cancelled show themselves
+    thread_sleep_relative(LK_MSEC(10));
+
+    bool ok = (state->count == ORDER_TIMERS - ORDER_TIMERS / 4);
+    for (int i = 1; ok && i < state->count; i++) {
+        if (TIME_LT(state->fired[i], state->fired[i - 1]))
+            ok = false;
+    }
+    printf("%d timers fired in %s order\n", state->count, ok ? "deadline" : "WRONG");
+
+    event_destroy(&state->done);
+    free(state);
+}
+
 void timer_tests(void)
 {
     // timer fires on all cpus
     timer_test_all_cpus();
+
+    // timers fire in deadline order and cancelled timers stay quiet
+    timer_test_order();
 }
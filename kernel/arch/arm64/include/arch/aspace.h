@@ -30,6 +30,10 @@ struct arch_aspace {
     /* range of address space */
     vaddr_t base;
     size_t size;
+
+    /* number of block entries currently mapping more than a single page
+     * (the kernel's boot time mappings are not included) */
+    size_t large_pages;
 };
 
 __END_CDECLS
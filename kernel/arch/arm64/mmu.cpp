@@ -341,10 +341,68 @@ static bool page_table_is_clear(pte_t* page_table, uint page_size_shift) {
     return true;
 }
 
+// Replace the block entry at page_table[index] with a table of entries one
+// level down covering the same range with the same attributes, so that part
+// of the block can be unmapped or protected on its own.  Returns the new
+// table, or NULL if one could not be allocated.
+static pte_t* arm64_mmu_split_block(vaddr_t vaddr, vaddr_t index,
+                                    uint index_shift, uint page_size_shift,
+                                    pte_t* page_table, uint asid,
+                                    size_t* large_pages) {
+    pte_t pte = page_table[index];
+    DEBUG_ASSERT((pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK);
+
+    paddr_t paddr;
+    if (alloc_page_table(&paddr, page_size_shift) != NO_ERROR) {
+        TRACEF("failed to allocate page table to split block\n");
+        return NULL;
+    }
+    pte_t* next_page_table = static_cast<pte_t*>(paddr_to_kvaddr(paddr));
+
+    uint next_index_shift = index_shift - (page_size_shift - 3);
+    uint count = 1U << (page_size_shift - 3);
+    paddr_t block_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
+    pte_t attrs = pte & ~(MMU_PTE_OUTPUT_ADDR_MASK | MMU_PTE_DESCRIPTOR_MASK);
+    attrs |= (next_index_shift > page_size_shift) ? MMU_PTE_L012_DESCRIPTOR_BLOCK
+                                                  : MMU_PTE_L3_DESCRIPTOR_PAGE;
+    for (uint i = 0; i < count; i++)
+        next_page_table[i] = (block_paddr + ((paddr_t)i << next_index_shift)) | attrs;
+
+    __asm__ volatile("dmb ishst" ::
+                         : "memory");
+
+    // break-before-make: the block has to be gone from every tlb before the
+    // table replacing it becomes visible
+    LTRACEF("pte %p[%#" PRIxPTR "] = table %#" PRIxPTR " (was block)\n",
+            page_table, index, paddr);
+    page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
+    CF;
+    if (asid == MMU_ARM64_GLOBAL_ASID)
+        ARM64_TLBI(vaae1is, vaddr >> 12);
+    else
+        ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid << 48);
+    DSB;
+    page_table[index] = paddr | MMU_PTE_L012_DESCRIPTOR_TABLE;
+
+    *large_pages -= 1;
+    if (next_index_shift > page_size_shift)
+        *large_pages += count;
+
+    return next_page_table;
+}
+
+static bool pte_is_partial_block(pte_t pte, uint index_shift, uint page_size_shift,
+                                 size_t chunk_size) {
+    return index_shift > page_size_shift &&
+           (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_BLOCK &&
+           chunk_size != (1UL << index_shift);
+}
+
 static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
                                   size_t size,
                                   uint index_shift, uint page_size_shift,
-                                  pte_t* page_table, uint asid) {
+                                  pte_t* page_table, uint asid,
+                                  size_t* large_pages) {
     pte_t* next_page_table;
     vaddr_t index;
     size_t chunk_size;
@@ -368,6 +426,14 @@ static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
 
         pte = page_table[index];
 
+        // only part of a block is going away, so split it first.  if that
+        // fails the whole block is unmapped below and faulted back in later.
+        if (pte_is_partial_block(pte, index_shift, page_size_shift, chunk_size) &&
+            arm64_mmu_split_block(vaddr, index, index_shift, page_size_shift,
+                                  page_table, asid, large_pages)) {
+            pte = page_table[index];
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -375,7 +441,7 @@ static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
             arm64_mmu_unmap_pt(vaddr, vaddr_rem, chunk_size,
                                index_shift - (page_size_shift - 3),
                                page_size_shift,
-                               next_page_table, asid);
+                               next_page_table, asid, large_pages);
             if (chunk_size == block_size ||
                 page_table_is_clear(next_page_table, page_size_shift)) {
                 LTRACEF("pte %p[0x%lx] = 0 (was page table)\n", page_table, index);
@@ -387,6 +453,8 @@ static ssize_t arm64_mmu_unmap_pt(vaddr_t vaddr, vaddr_t vaddr_rel,
         } else if (pte) {
             LTRACEF("pte %p[0x%lx] = 0\n", page_table, index);
             page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
+            if (index_shift > page_size_shift)
+                *large_pages -= 1;
             CF;
             if (asid == MMU_ARM64_GLOBAL_ASID)
                 ARM64_TLBI(vaae1is, vaddr >> 12);
@@ -408,7 +476,8 @@ static ssize_t arm64_mmu_map_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
                                 paddr_t paddr_in,
                                 size_t size_in, pte_t attrs,
                                 uint index_shift, uint page_size_shift,
-                                pte_t* page_table, uint asid) {
+                                pte_t* page_table, uint asid,
+                                size_t* large_pages) {
     ssize_t ret;
     pte_t* next_page_table;
     vaddr_t index;
@@ -452,7 +521,8 @@ static ssize_t arm64_mmu_map_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
 
             ret = arm64_mmu_map_pt(vaddr, vaddr_rem, paddr, chunk_size, attrs,
                                    index_shift - (page_size_shift - 3),
-                                   page_size_shift, next_page_table, asid);
+                                   page_size_shift, next_page_table, asid,
+                                   large_pages);
             if (ret < 0)
                 goto err;
         } else {
@@ -464,9 +534,10 @@ static ssize_t arm64_mmu_map_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
             }
 
             pte = paddr | attrs;
-            if (index_shift > page_size_shift)
+            if (index_shift > page_size_shift) {
                 pte |= MMU_PTE_L012_DESCRIPTOR_BLOCK;
-            else
+                *large_pages += 1;
+            } else
                 pte |= MMU_PTE_L3_DESCRIPTOR_PAGE;
             pte |= MMU_PTE_ATTR_NON_GLOBAL;
             LTRACEF("pte %p[%#" PRIxPTR "] = %#" PRIx64 "\n",
@@ -484,7 +555,7 @@ static ssize_t arm64_mmu_map_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
 
 err:
     arm64_mmu_unmap_pt(vaddr_in, vaddr_rel_in, size_in - size,
-                       index_shift, page_size_shift, page_table, asid);
+                       index_shift, page_size_shift, page_table, asid, large_pages);
     DSB;
     return ERR_INTERNAL;
 }
@@ -492,7 +563,8 @@ err:
 static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
                                 size_t size_in, pte_t attrs,
                                 uint index_shift, uint page_size_shift,
-                                pte_t* page_table, uint asid) {
+                                pte_t* page_table, uint asid,
+                                size_t* large_pages) {
     int ret;
     pte_t* next_page_table;
     vaddr_t index;
@@ -525,6 +597,27 @@ static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
         index = vaddr_rel >> index_shift;
         pte = page_table[index];
 
+        // only part of a block is changing, so split it first.  if that
+        // fails, unmap the whole block rather than changing the permissions
+        // of pages outside the range; faults will bring them back.
+        if (pte_is_partial_block(pte, index_shift, page_size_shift, chunk_size)) {
+            if (arm64_mmu_split_block(vaddr, index, index_shift, page_size_shift,
+                                      page_table, asid, large_pages)) {
+                pte = page_table[index];
+            } else {
+                LTRACEF("pte %p[%#" PRIxPTR "] = 0 (was block)\n", page_table, index);
+                page_table[index] = MMU_PTE_DESCRIPTOR_INVALID;
+                *large_pages -= 1;
+                CF;
+                if (asid == MMU_ARM64_GLOBAL_ASID) {
+                    ARM64_TLBI(vaae1is, vaddr >> 12);
+                } else {
+                    ARM64_TLBI(vae1is, vaddr >> 12 | (vaddr_t)asid << 48);
+                }
+                pte = 0;
+            }
+        }
+
         if (index_shift > page_size_shift &&
             (pte & MMU_PTE_DESCRIPTOR_MASK) == MMU_PTE_L012_DESCRIPTOR_TABLE) {
             page_table_paddr = pte & MMU_PTE_OUTPUT_ADDR_MASK;
@@ -533,7 +626,7 @@ static int arm64_mmu_protect_pt(vaddr_t vaddr_in, vaddr_t vaddr_rel_in,
                                        attrs,
                                        index_shift - (page_size_shift - 3),
                                        page_size_shift,
-                                       next_page_table, asid);
+                                       next_page_table, asid, large_pages);
             if (ret != 0) {
                 goto err;
             }
@@ -573,7 +666,8 @@ err:
 static ssize_t arm64_mmu_map(vaddr_t vaddr, paddr_t paddr, size_t size, pte_t attrs,
                              vaddr_t vaddr_base, uint top_size_shift,
                              uint top_index_shift, uint page_size_shift,
-                             pte_t* top_page_table, uint asid) {
+                             pte_t* top_page_table, uint asid,
+                             size_t* large_pages) {
     vaddr_t vaddr_rel = vaddr - vaddr_base;
     vaddr_t vaddr_rel_max = 1UL << top_size_shift;
 
@@ -593,7 +687,8 @@ static ssize_t arm64_mmu_map(vaddr_t vaddr, paddr_t paddr, size_t size, pte_t at
     }
 
     ssize_t ret = arm64_mmu_map_pt(vaddr, vaddr_rel, paddr, size, attrs,
-                           top_index_shift, page_size_shift, top_page_table, asid);
+                           top_index_shift, page_size_shift, top_page_table, asid,
+                           large_pages);
     DSB;
     return ret;
 }
@@ -601,7 +696,8 @@ static ssize_t arm64_mmu_map(vaddr_t vaddr, paddr_t paddr, size_t size, pte_t at
 static ssize_t arm64_mmu_unmap(vaddr_t vaddr, size_t size,
                                vaddr_t vaddr_base, uint top_size_shift,
                                uint top_index_shift, uint page_size_shift,
-                               pte_t* top_page_table, uint asid) {
+                               pte_t* top_page_table, uint asid,
+                             size_t* large_pages) {
     vaddr_t vaddr_rel = vaddr - vaddr_base;
     vaddr_t vaddr_rel_max = 1UL << top_size_shift;
 
@@ -619,7 +715,8 @@ static ssize_t arm64_mmu_unmap(vaddr_t vaddr, size_t size,
     }
 
     ssize_t ret = arm64_mmu_unmap_pt(vaddr, vaddr_rel, size,
-                       top_index_shift, page_size_shift, top_page_table, asid);
+                       top_index_shift, page_size_shift, top_page_table, asid,
+                       large_pages);
     DSB;
     return ret;
 }
@@ -627,7 +724,8 @@ static ssize_t arm64_mmu_unmap(vaddr_t vaddr, size_t size,
 static status_t arm64_mmu_protect(vaddr_t vaddr, size_t size, pte_t attrs,
                              vaddr_t vaddr_base, uint top_size_shift,
                              uint top_index_shift, uint page_size_shift,
-                             pte_t* top_page_table, uint asid) {
+                             pte_t* top_page_table, uint asid,
+                             size_t* large_pages) {
     vaddr_t vaddr_rel = vaddr - vaddr_base;
     vaddr_t vaddr_rel_max = 1UL << top_size_shift;
 
@@ -647,7 +745,8 @@ static status_t arm64_mmu_protect(vaddr_t vaddr, size_t size, pte_t attrs,
     }
 
     status_t ret = arm64_mmu_protect_pt(vaddr, vaddr_rel, size, attrs,
-                           top_index_shift, page_size_shift, top_page_table, asid);
+                           top_index_shift, page_size_shift, top_page_table, asid,
+                           large_pages);
     DSB;
     return ret;
 }
@@ -682,13 +781,15 @@ status_t arch_mmu_map(arch_aspace_t* aspace, vaddr_t vaddr, paddr_t paddr, const
                             mmu_flags_to_pte_attr(flags),
                             ~0UL << MMU_KERNEL_SIZE_SHIFT, MMU_KERNEL_SIZE_SHIFT,
                             MMU_KERNEL_TOP_SHIFT, MMU_KERNEL_PAGE_SIZE_SHIFT,
-                            aspace->tt_virt, MMU_ARM64_GLOBAL_ASID);
+                            aspace->tt_virt, MMU_ARM64_GLOBAL_ASID,
+                            &aspace->large_pages);
     } else {
         ret = arm64_mmu_map(vaddr, paddr, count * PAGE_SIZE,
                             mmu_flags_to_pte_attr(flags),
                             0, MMU_USER_SIZE_SHIFT,
                             MMU_USER_TOP_SHIFT, MMU_USER_PAGE_SIZE_SHIFT,
-                            aspace->tt_virt, aspace->asid);
+                            aspace->tt_virt, aspace->asid,
+                            &aspace->large_pages);
     }
 
     if (mapped) {
@@ -721,13 +822,15 @@ status_t arch_mmu_unmap(arch_aspace_t* aspace, vaddr_t vaddr, const size_t count
                               ~0UL << MMU_KERNEL_SIZE_SHIFT, MMU_KERNEL_SIZE_SHIFT,
                               MMU_KERNEL_TOP_SHIFT, MMU_KERNEL_PAGE_SIZE_SHIFT,
                               aspace->tt_virt,
-                              MMU_ARM64_GLOBAL_ASID);
+                              MMU_ARM64_GLOBAL_ASID,
+                              &aspace->large_pages);
     } else {
         ret = arm64_mmu_unmap(vaddr, count * PAGE_SIZE,
                               0, MMU_USER_SIZE_SHIFT,
                               MMU_USER_TOP_SHIFT, MMU_USER_PAGE_SIZE_SHIFT,
                               aspace->tt_virt,
-                              aspace->asid);
+                              aspace->asid,
+                              &aspace->large_pages);
     }
 
     if (unmapped) {
@@ -758,14 +861,16 @@ status_t arch_mmu_protect(arch_aspace_t* aspace, vaddr_t vaddr, size_t count, ui
                                 ~0UL << MMU_KERNEL_SIZE_SHIFT, MMU_KERNEL_SIZE_SHIFT,
                                 MMU_KERNEL_TOP_SHIFT, MMU_KERNEL_PAGE_SIZE_SHIFT,
                                 aspace->tt_virt,
-                                MMU_ARM64_GLOBAL_ASID);
+                                MMU_ARM64_GLOBAL_ASID,
+                                &aspace->large_pages);
     } else {
         ret = arm64_mmu_protect(vaddr, count * PAGE_SIZE,
                                 mmu_flags_to_pte_attr(flags),
                                 0, MMU_USER_SIZE_SHIFT,
                                 MMU_USER_TOP_SHIFT, MMU_USER_PAGE_SIZE_SHIFT,
                                 aspace->tt_virt,
-                                aspace->asid);
+                                aspace->asid,
+                                &aspace->large_pages);
     }
 
     return ret;
@@ -784,6 +889,7 @@ status_t arch_mmu_init_aspace(arch_aspace_t* aspace, vaddr_t base, size_t size,
 
     aspace->magic = ARCH_ASPACE_MAGIC;
     aspace->flags = flags;
+    aspace->large_pages = 0;
     if (flags & ARCH_ASPACE_FLAG_KERNEL) {
         /* at the moment we can only deal with address spaces as globally defined */
         DEBUG_ASSERT(base == ~0UL << MMU_KERNEL_SIZE_SHIFT);
@@ -121,7 +121,7 @@ status_t x86_bootstrap16_prep(
     ASSERT(long_mode_entry <= UINT32_MAX);
 
     uint64_t phys_bootstrap_pml4 = bootstrap_aspace->arch_aspace().pt_phys;
-    uint64_t phys_kernel_pml4 = x86_get_cr3();
+    uint64_t phys_kernel_pml4 = x86_get_cr3() & ~0xfffULL;
     if (phys_bootstrap_pml4 > UINT32_MAX) {
         // TODO(teisenbe): Once the pmm supports it, we should request that this
         // VmAspace is backed by a low mem PML4, so we can avoid this issue.
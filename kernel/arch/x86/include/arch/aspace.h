@@ -33,6 +33,15 @@ struct arch_aspace {
      * actually an mp_cpu_mask_t, but header dependencies. */
     volatile int active_cpus;
 
+    /* number of entries currently mapping more than a single page
+     * (the kernel's boot time mappings are not included) */
+    size_t large_pages;
+
+    /* process context id tagging this aspace's tlb entries, 0 if none, and
+     * the cpus whose entries for it are known to be current (an mp_cpu_mask_t) */
+    uint16_t pcid;
+    volatile int pcid_valid_cpus;
+
     /* Pointer to a bitmap::RleBitmap representing the range of ports
      * enabled in this aspace. */
     void *io_bitmap;
@@ -53,6 +53,33 @@ static const paddr_t kernel_pt_phys = (vaddr_t)KERNEL_PT - KERNEL_BASE;
 static const uint kValidEptFlags =
     ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE | ARCH_MMU_FLAG_PERM_EXECUTE;
 
+/* A batch of TLB invalidations collected while changing page tables and
+ * issued with a single x86_tlb_invalidate() once the change is complete. */
+struct PendingTlbInvalidation {
+    /* past this many pages, flush the whole tlb instead */
+    static constexpr uint kMaxPages = 32;
+
+    struct Item {
+        vaddr_t vaddr;
+        bool is_global;
+    };
+
+    PendingTlbInvalidation() { list_initialize(&freed_pages); }
+    ~PendingTlbInvalidation();
+
+    void enqueue(vaddr_t vaddr, page_table_levels level, bool is_global);
+    void defer_free(vm_page_t* page);
+    void clear();
+
+    Item items[kMaxPages];
+    uint count = 0;
+    bool full_shootdown = false;
+    bool contains_global = false;
+
+    /* page tables to free after the invalidations are done */
+    list_node freed_pages;
+};
+
 paddr_t x86_kernel_cr3(void) {
     return kernel_pt_phys;
 }
@@ -123,69 +150,167 @@ static void x86_tlb_global_invalidate() {
     }
 }
 
-/* Task used for invalidating a TLB entry on each CPU */
+/* mask of the page table base in cr3, without the pcid */
+#define X86_CR3_BASE_MASK (~(ulong)0xfff)
+/* when writing cr3 with pcids enabled, keep the new pcid's tlb entries */
+#define X86_CR3_NOFLUSH (1UL << 63)
+#define X86_PCID_COUNT 4096
+
+/* whether the cpus support pcids and they are in use; aspaces without one
+ * (pcid 0) flush the non-global tlb entries on every switch as before */
+static bool pcid_enabled = false;
+static uint64_t pcid_pool[X86_PCID_COUNT / 64];
+static spin_lock_t pcid_lock = SPIN_LOCK_INITIAL_VALUE;
+
+static uint16_t x86_pcid_alloc() {
+    if (!pcid_enabled)
+        return 0;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pcid_lock, state);
+    uint16_t pcid = 0;
+    /* pcid 0 is left for the kernel and aspaces that didn't get one */
+    for (uint i = 1; i < X86_PCID_COUNT; i++) {
+        if ((pcid_pool[i / 64] & (1ULL << (i % 64))) == 0) {
+            pcid_pool[i / 64] |= 1ULL << (i % 64);
+            pcid = static_cast<uint16_t>(i);
+            break;
+        }
+    }
+    spin_unlock_irqrestore(&pcid_lock, state);
+    return pcid;
+}
+
+static void x86_pcid_free(uint16_t pcid) {
+    if (pcid == 0)
+        return;
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&pcid_lock, state);
+    DEBUG_ASSERT(pcid_pool[pcid / 64] & (1ULL << (pcid % 64)));
+    pcid_pool[pcid / 64] &= ~(1ULL << (pcid % 64));
+    spin_unlock_irqrestore(&pcid_lock, state);
+}
+
+/* Enqueue an invalidation for the entry mapping |vaddr| at |level|.  Once
+ * the batch is full it turns into a flush of the whole tlb. */
+void PendingTlbInvalidation::enqueue(vaddr_t vaddr, page_table_levels level, bool is_global) {
+    if (is_global)
+        contains_global = true;
+
+    /* the top level covers too much to invalidate page by page */
+    if (level == PML4_L || count == kMaxPages) {
+        full_shootdown = true;
+        return;
+    }
+    items[count].vaddr = vaddr;
+    items[count].is_global = is_global;
+    count++;
+}
+
+/* Free |page| once the pending invalidations have been issued, since other
+ * cpus may still walk it through their paging-structure caches until then. */
+void PendingTlbInvalidation::defer_free(vm_page_t* page) {
+    list_add_tail(&freed_pages, &page->free.node);
+}
+
+void PendingTlbInvalidation::clear() {
+    count = 0;
+    full_shootdown = false;
+    contains_global = false;
+    if (!list_is_empty(&freed_pages))
+        pmm_free(&freed_pages);
+}
+
+PendingTlbInvalidation::~PendingTlbInvalidation() {
+    DEBUG_ASSERT(count == 0 && !full_shootdown);
+    DEBUG_ASSERT(list_is_empty(&freed_pages));
+}
+
+/* Task used for invalidating the pending TLB entries on each CPU */
 struct tlb_invalidate_page_context {
     ulong target_cr3;
-    vaddr_t vaddr;
-    enum page_table_levels level;
-    bool global_page;
+    const PendingTlbInvalidation* pending;
 };
 static void tlb_invalidate_page_task(void* raw_context) {
     DEBUG_ASSERT(arch_ints_disabled());
     tlb_invalidate_page_context* context = (tlb_invalidate_page_context*)raw_context;
+    const PendingTlbInvalidation* pending = context->pending;
 
-    ulong cr3 = x86_get_cr3();
-    if (context->target_cr3 != cr3 && !context->global_page) {
+    bool current = context->target_cr3 == (x86_get_cr3() & X86_CR3_BASE_MASK);
+    if (!current && !pending->contains_global) {
         /* This invalidation doesn't apply to this CPU, ignore it */
         return;
     }
 
-    switch (context->level) {
-    case PML4_L:
-        x86_tlb_global_invalidate();
-        break;
-    case PDP_L:
-    case PD_L:
-    case PT_L:
-        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)context->vaddr));
-        break;
+    if (pending->full_shootdown) {
+        if (pending->contains_global) {
+            x86_tlb_global_invalidate();
+        } else {
+            /* with pcids this only drops the current pcid's entries, and
+             * without the noflush bit set it does drop all of them */
+            x86_set_cr3(x86_get_cr3());
+        }
+        return;
+    }
+
+    for (uint i = 0; i < pending->count; i++) {
+        const auto& item = pending->items[i];
+        if (!item.is_global && !current)
+            continue;
+        __asm__ volatile("invlpg %0" ::"m"(*(uint8_t*)item.vaddr));
     }
 }
 
 /**
- * @brief Invalidate a single page at a given page table level
+ * @brief Execute a batch of pending TLB invalidations
  *
- * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
- * @param vaddr The virtual address we are invalidating the TLB entry for
- * @param level The page table level that maps this vaddr
- * @param global_page True if we are invalidating a global mapping
+ * Sends a single mp_sync_exec for the whole batch, then frees any page tables
+ * whose release was deferred until the invalidations were done.
  *
- * TODO(teisenbe): Optimize this.  This is horribly inefficient.
- * We should also change this to pool invalidations from a single
- * "transaction" and then only execute a single mp_sync_exec for that
- * transaction, rather than one per page.
+ * @param aspace The aspace we're invalidating for (if NULL, assume for current one)
+ * @param pending The invalidations to issue; cleared on return
  */
-void x86_tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, enum page_table_levels level,
-                             bool global_page) {
-    ulong cr3 = aspace ? aspace->pt_phys : x86_get_cr3();
+static void x86_tlb_invalidate(arch_aspace_t* aspace, PendingTlbInvalidation* pending) {
+    if (pending->count == 0 && !pending->full_shootdown) {
+        pending->clear();
+        return;
+    }
+
+    /* invlpg only drops the paging-structure cache entries of the current
+     * pcid, so kernel page tables can't be freed out from under the other
+     * pcids without flushing everything. */
+    if (pcid_enabled && pending->contains_global && !list_is_empty(&pending->freed_pages))
+        pending->full_shootdown = true;
+
+    ulong cr3 = aspace ? aspace->pt_phys : (x86_get_cr3() & X86_CR3_BASE_MASK);
     struct tlb_invalidate_page_context task_context = {
-        .target_cr3 = cr3, .vaddr = vaddr, .level = level, .global_page = global_page,
+        .target_cr3 = cr3, .pending = pending,
     };
 
+    /* cpus that ran the aspace before may still hold entries tagged with
+     * its pcid.  Make every cpu not running it now flush the pcid the next
+     * time it switches in, before looking at which cpus are running it, so
+     * that any cpu switching in concurrently either flushes or is a target. */
+    if (aspace != nullptr && aspace->pcid != 0)
+        atomic_and(&aspace->pcid_valid_cpus, 0);
+
     /* Target only CPUs this aspace is active on.  It may be the case that some
      * other CPU will become active in it after this load, or will have left it
      * just before this load.  In the former case, it is becoming active after
      * the write to the page table, so it will see the change.  In the latter
      * case, it will get a spurious request to flush. */
     mp_cpu_mask_t targets;
-    if (global_page || aspace == nullptr) {
+    if (pending->contains_global || aspace == nullptr) {
         targets = MP_CPU_ALL;
     } else {
         targets = atomic_load(&aspace->active_cpus);
         static_assert(sizeof(mp_cpu_mask_t) == sizeof(aspace->active_cpus), "err");
     }
 
-    mp_sync_exec(targets, tlb_invalidate_page_task, &task_context);
+    if (targets != 0)
+        mp_sync_exec(targets, tlb_invalidate_page_task, &task_context);
+    pending->clear();
 }
 
 template <int Level>
@@ -375,8 +500,9 @@ struct PageTable : PageTableBase<Level> {
     /**
      * @brief Invalidate a single page at a given page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
-        x86_tlb_invalidate_page(aspace, vaddr, Base::level, global_page);
+    static void tlb_invalidate_page(PendingTlbInvalidation* pending, vaddr_t vaddr,
+                                    bool global_page) {
+        pending->enqueue(vaddr, Base::level, global_page);
     }
 };
 
@@ -426,7 +552,8 @@ struct ExtendedPageTable : PageTableBase<Level> {
     /**
      * @brief Invalidate a single page at a given page table level
      */
-    static void tlb_invalidate_page(arch_aspace_t* aspace, vaddr_t vaddr, bool global_page) {
+    static void tlb_invalidate_page(PendingTlbInvalidation* pending, vaddr_t vaddr,
+                                    bool global_page) {
         // TODO(abdulla): Implement this.
     }
 };
@@ -504,8 +631,8 @@ struct MappingCursor {
 };
 
 template <typename PageTable>
-static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte, paddr_t paddr,
-                         arch_flags_t flags) {
+static void update_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte,
+                         paddr_t paddr, arch_flags_t flags) {
     DEBUG_ASSERT(pte);
     DEBUG_ASSERT(IS_PAGE_ALIGNED(paddr));
 
@@ -517,12 +644,12 @@ static void update_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte,
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(pending, vaddr, is_kernel_address(vaddr));
     }
 }
 
 template <typename PageTable>
-static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static void unmap_entry(PendingTlbInvalidation* pending, vaddr_t vaddr, pt_entry_t* pte) {
     DEBUG_ASSERT(pte);
 
     pt_entry_t olde = *pte;
@@ -531,7 +658,7 @@ static void unmap_entry(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
 
     /* attempt to invalidate the page */
     if (IS_PAGE_PRESENT(olde)) {
-        PageTable::tlb_invalidate_page(aspace, vaddr, is_kernel_address(vaddr));
+        PageTable::tlb_invalidate_page(pending, vaddr, is_kernel_address(vaddr));
     }
 }
 
@@ -555,7 +682,8 @@ static pt_entry_t* _map_alloc_page(void) {
  * @brief Split the given large page into smaller pages
  */
 template <typename PageTable>
-static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t* pte) {
+static status_t x86_mmu_split(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                              vaddr_t vaddr, pt_entry_t* pte) {
     static_assert(PageTable::level != PT_L, "tried splitting PT_L");
     LTRACEF_LEVEL(2, "splitting table %p at level %d\n", pte, PageTable::level);
 
@@ -576,14 +704,18 @@ static status_t x86_mmu_split(arch_aspace_t* aspace, vaddr_t vaddr, pt_entry_t*
         pt_entry_t* e = m + i;
         // If this is a PDP_L (i.e. huge page), flags will include the
         // PS bit still, so the new PD entries will be large pages.
-        update_entry<typename PageTable::LowerTable>(aspace, new_vaddr, e, new_paddr, flags);
+        update_entry<typename PageTable::LowerTable>(pending, new_vaddr, e, new_paddr, flags);
         new_vaddr += ps;
         new_paddr += ps;
     }
     DEBUG_ASSERT(new_vaddr == vaddr + PageTable::page_size());
 
     flags = PageTable::intermediate_arch_flags();
-    update_entry<PageTable>(aspace, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
+    update_entry<PageTable>(pending, vaddr, pte, X86_VIRT_TO_PHYS(m), flags);
+
+    aspace->large_pages--;
+    if (PageTable::LowerTable::level != PT_L)
+        aspace->large_pages += NO_OF_PT_ENTRIES;
     return NO_ERROR;
 }
 
@@ -679,7 +811,8 @@ status_t x86_mmu_get_mapping<ExtendedPageTable<PT_L>>(pt_entry_t* table, vaddr_t
  * @return true if at least one page was unmapped at this level
  */
 template <typename PageTable>
-static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
+static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                   pt_entry_t* table,
                                    const MappingCursor& start_cursor, MappingCursor* new_cursor) {
     DEBUG_ASSERT(table);
     LTRACEF("L: %d, %016" PRIxPTR " %016zx\n", PageTable::level, start_cursor.vaddr,
@@ -714,7 +847,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             bool vaddr_level_aligned = PageTable::page_aligned(new_cursor->vaddr);
             // If the request covers the entire large page, just unmap it
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
+                aspace->large_pages--;
                 unmapped = true;
 
                 new_cursor->vaddr += ps;
@@ -724,11 +858,12 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            status_t status = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            status_t status = x86_mmu_split<PageTable>(aspace, pending, page_vaddr, e);
             if (status != NO_ERROR) {
                 // If split fails, just unmap the whole thing, and let a
                 // subsequent page fault clean it up.
-                unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+                unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
+                aspace->large_pages--;
                 unmapped = true;
 
                 const size_t size = (new_cursor->size > ps) ? ps : new_cursor->size;
@@ -741,7 +876,7 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
         bool lower_unmapped = x86_mmu_remove_mapping<typename PageTable::LowerTable>(
-            aspace, next_table, *new_cursor, &cursor);
+            aspace, pending, next_table, *new_cursor, &cursor);
 
         // If we were requesting to unmap everything in the lower page table,
         // we know we can unmap the lower level page table.  Otherwise, if
@@ -761,8 +896,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
         }
         if (unmap_page_table) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
-            pmm_free_page(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
+            unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
+            pending->defer_free(paddr_to_vm_page(X86_VIRT_TO_PHYS(next_table)));
             unmapped = true;
         }
         *new_cursor = cursor;
@@ -776,7 +911,8 @@ static bool x86_mmu_remove_mapping(arch_aspace_t* aspace, pt_entry_t* table,
 
 // Base case of x86_remove_mapping for smallest page size
 template <typename PageTable>
-static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
+static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                      pt_entry_t* table,
                                       const MappingCursor& start_cursor,
                                       MappingCursor* new_cursor) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
@@ -790,7 +926,7 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
     for (; index != NO_OF_PT_ENTRIES && new_cursor->size != 0; ++index) {
         pt_entry_t* e = table + index;
         if (IS_PAGE_PRESENT(*e)) {
-            unmap_entry<PageTable>(aspace, new_cursor->vaddr, e);
+            unmap_entry<PageTable>(pending, new_cursor->vaddr, e);
             unmapped = true;
         }
 
@@ -802,18 +938,22 @@ static bool x86_mmu_remove_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
 }
 
 template <>
-bool x86_mmu_remove_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+bool x86_mmu_remove_mapping<PageTable<PT_L>>(arch_aspace_t* aspace,
+                                             PendingTlbInvalidation* pending, pt_entry_t* table,
                                              const MappingCursor& start_cursor,
                                              MappingCursor* new_cursor) {
-    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(aspace, table, start_cursor, new_cursor);
+    return x86_mmu_remove_mapping_l0<PageTable<PT_L>>(aspace, pending, table, start_cursor,
+                                                      new_cursor);
 }
 
 template <>
-bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
+                                                     PendingTlbInvalidation* pending,
+                                                     pt_entry_t* table,
                                                      const MappingCursor& start_cursor,
                                                      MappingCursor* new_cursor) {
-    return x86_mmu_remove_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, start_cursor,
-                                                              new_cursor);
+    return x86_mmu_remove_mapping_l0<ExtendedPageTable<PT_L>>(aspace, pending, table,
+                                                              start_cursor, new_cursor);
 }
 
 /**
@@ -833,7 +973,8 @@ bool x86_mmu_remove_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_e
  * @return ERR_NO_MEMORY if intermediate page tables could not be allocated
  */
 template <typename PageTable>
-static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                    pt_entry_t* table, uint mmu_flags,
                                     const MappingCursor& start_cursor, MappingCursor* new_cursor) {
     DEBUG_ASSERT(table);
     DEBUG_ASSERT(x86_mmu_check_vaddr(start_cursor.vaddr));
@@ -862,8 +1003,9 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
         if (level_supports_large_pages && !IS_PAGE_PRESENT(*e) && level_valigned &&
             level_paligned && new_cursor->size >= ps) {
 
-            update_entry<PageTable>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
+            update_entry<PageTable>(pending, new_cursor->vaddr, table + index, new_cursor->paddr,
                                     arch_flags | X86_MMU_PG_PS);
+            aspace->large_pages++;
 
             new_cursor->paddr += ps;
             new_cursor->vaddr += ps;
@@ -880,13 +1022,13 @@ static status_t x86_mmu_add_mapping(arch_aspace_t* aspace, pt_entry_t* table, ui
 
                 LTRACEF_LEVEL(2, "new table %p at level %d\n", m, PageTable::level);
 
-                update_entry<PageTable>(aspace, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
+                update_entry<PageTable>(pending, new_cursor->vaddr, e, X86_VIRT_TO_PHYS(m),
                                         interm_arch_flags);
             }
 
             MappingCursor cursor;
             ret = x86_mmu_add_mapping<typename PageTable::LowerTable>(
-                aspace, get_next_table_from_entry(*e), mmu_flags, *new_cursor, &cursor);
+                aspace, pending, get_next_table_from_entry(*e), mmu_flags, *new_cursor, &cursor);
             *new_cursor = cursor;
             DEBUG_ASSERT(new_cursor->size <= start_cursor.size);
             if (ret != NO_ERROR) {
@@ -902,7 +1044,8 @@ err:
         // new_cursor->size should be how much is left to be mapped still
         cursor.size -= new_cursor->size;
         if (cursor.size > 0) {
-            x86_mmu_remove_mapping<typename PageTable::TopTable>(aspace, table, cursor, &result);
+            x86_mmu_remove_mapping<typename PageTable::TopTable>(aspace, pending, table, cursor,
+                                                                 &result);
             DEBUG_ASSERT(result.size == 0);
         }
     }
@@ -911,7 +1054,8 @@ err:
 
 // Base case of x86_mmu_add_mapping for smallest page size
 template <typename PageTable>
-static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                       pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
                                        MappingCursor* new_cursor) {
     static_assert(PageTable::level == PT_L, "x86_mmu_remove_mapping_l0 used with wrong level");
@@ -928,7 +1072,7 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
             return ERR_ALREADY_EXISTS;
         }
 
-        update_entry<PageTable>(aspace, new_cursor->vaddr, table + index, new_cursor->paddr,
+        update_entry<PageTable>(pending, new_cursor->vaddr, table + index, new_cursor->paddr,
                                 arch_flags);
 
         new_cursor->paddr += PAGE_SIZE;
@@ -941,20 +1085,23 @@ static status_t x86_mmu_add_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table,
 }
 
 template <>
-status_t x86_mmu_add_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+status_t x86_mmu_add_mapping<PageTable<PT_L>>(arch_aspace_t* aspace,
+                                              PendingTlbInvalidation* pending, pt_entry_t* table,
                                               uint mmu_flags, const MappingCursor& start_cursor,
                                               MappingCursor* new_cursor) {
-    return x86_mmu_add_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                   new_cursor);
+    return x86_mmu_add_mapping_l0<PageTable<PT_L>>(aspace, pending, table, mmu_flags,
+                                                   start_cursor, new_cursor);
 }
 
 template <>
-status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
+                                                      PendingTlbInvalidation* pending,
+                                                      pt_entry_t* table,
                                                       uint mmu_flags,
                                                       const MappingCursor& start_cursor,
                                                       MappingCursor* new_cursor) {
-    return x86_mmu_add_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                           new_cursor);
+    return x86_mmu_add_mapping_l0<ExtendedPageTable<PT_L>>(aspace, pending, table, mmu_flags,
+                                                           start_cursor, new_cursor);
 }
 
 /**
@@ -970,7 +1117,8 @@ status_t x86_mmu_add_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_
  * completed.  Must be non-null.
  */
 template <typename PageTable>
-static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                       pt_entry_t* table, uint mmu_flags,
                                        const MappingCursor& start_cursor,
                                        MappingCursor* new_cursor) {
     DEBUG_ASSERT(table);
@@ -1006,8 +1154,8 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             // If the request covers the entire large page, just change the
             // permissions
             if (vaddr_level_aligned && new_cursor->size >= ps) {
-                update_entry<PageTable>(aspace, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
-                                        arch_flags | X86_MMU_PG_PS);
+                update_entry<PageTable>(pending, new_cursor->vaddr, e,
+                                        PageTable::paddr_from_pte(*e), arch_flags | X86_MMU_PG_PS);
 
                 new_cursor->vaddr += ps;
                 new_cursor->size -= ps;
@@ -1016,7 +1164,7 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
             }
             // Otherwise, we need to split it
             vaddr_t page_vaddr = new_cursor->vaddr & ~(ps - 1);
-            ret = x86_mmu_split<PageTable>(aspace, page_vaddr, e);
+            ret = x86_mmu_split<PageTable>(aspace, pending, page_vaddr, e);
             if (ret != NO_ERROR) {
                 // If we failed to split the table, just unmap it.  Subsequent
                 // page faults will bring it back in.
@@ -1025,7 +1173,8 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
                 cursor.size = ps;
 
                 MappingCursor tmp_cursor;
-                x86_mmu_remove_mapping<PageTable>(aspace, table, cursor, &tmp_cursor);
+                x86_mmu_remove_mapping<PageTable>(aspace, pending, table, cursor,
+                                                  &tmp_cursor);
 
                 const size_t size = (new_cursor->size > ps) ? ps : new_cursor->size;
                 new_cursor->vaddr += size;
@@ -1035,8 +1184,8 @@ static status_t x86_mmu_update_mapping(arch_aspace_t* aspace, pt_entry_t* table,
 
         MappingCursor cursor;
         pt_entry_t* next_table = get_next_table_from_entry(*e);
-        ret = x86_mmu_update_mapping<typename PageTable::LowerTable>(aspace, next_table, mmu_flags,
-                                                                     *new_cursor, &cursor);
+        ret = x86_mmu_update_mapping<typename PageTable::LowerTable>(
+            aspace, pending, next_table, mmu_flags, *new_cursor, &cursor);
         *new_cursor = cursor;
         if (ret != NO_ERROR) {
             // Currently this can't happen
@@ -1055,7 +1204,8 @@ err:
 
 // Base case of x86_update_mapping for smallest page size
 template <typename PageTable>
-static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* table, uint mmu_flags,
+static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, PendingTlbInvalidation* pending,
+                                          pt_entry_t* table, uint mmu_flags,
                                           const MappingCursor& start_cursor,
                                           MappingCursor* new_cursor) {
     static_assert(PageTable::level == PT_L, "x86_mmu_update_mapping_l0 used with wrong level");
@@ -1071,7 +1221,7 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* tab
         pt_entry_t* e = table + index;
         // Skip unmapped pages (we may encounter these due to demand paging)
         if (IS_PAGE_PRESENT(*e)) {
-            update_entry<PageTable>(aspace, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
+            update_entry<PageTable>(pending, new_cursor->vaddr, e, PageTable::paddr_from_pte(*e),
                                     arch_flags);
         }
 
@@ -1083,19 +1233,22 @@ static status_t x86_mmu_update_mapping_l0(arch_aspace_t* aspace, pt_entry_t* tab
 }
 
 template <>
-status_t x86_mmu_update_mapping<PageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+status_t x86_mmu_update_mapping<PageTable<PT_L>>(arch_aspace_t* aspace,
+                                                 PendingTlbInvalidation* pending, pt_entry_t* table,
                                                  uint mmu_flags, const MappingCursor& start_cursor,
                                                  MappingCursor* new_cursor) {
-    return x86_mmu_update_mapping_l0<PageTable<PT_L>>(aspace, table, mmu_flags, start_cursor,
-                                                      new_cursor);
+    return x86_mmu_update_mapping_l0<PageTable<PT_L>>(aspace, pending, table, mmu_flags,
+                                                      start_cursor, new_cursor);
 }
 
 template <>
-status_t x86_mmu_update_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace, pt_entry_t* table,
+status_t x86_mmu_update_mapping<ExtendedPageTable<PT_L>>(arch_aspace_t* aspace,
+                                                         PendingTlbInvalidation* pending,
+                                                         pt_entry_t* table,
                                                          uint mmu_flags,
                                                          const MappingCursor& start_cursor,
                                                          MappingCursor* new_cursor) {
-    return x86_mmu_update_mapping_l0<ExtendedPageTable<PT_L>>(aspace, table, mmu_flags,
+    return x86_mmu_update_mapping_l0<ExtendedPageTable<PT_L>>(aspace, pending, table, mmu_flags,
                                                               start_cursor, new_cursor);
 }
 
@@ -1120,8 +1273,11 @@ static status_t mmu_unmap(arch_aspace_t* aspace, vaddr_t vaddr, const size_t cou
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
 
+    PendingTlbInvalidation pending;
     MappingCursor result;
-    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt, start, &result);
+    x86_mmu_remove_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, &pending, aspace->pt_virt, start,
+                                                        &result);
+    x86_tlb_invalidate(aspace, &pending);
     DEBUG_ASSERT(result.size == 0);
 
     if (unmapped)
@@ -1166,9 +1322,11 @@ static status_t mmu_map(arch_aspace_t* aspace, vaddr_t vaddr, paddr_t paddr, con
     MappingCursor start = {
         .paddr = paddr, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
+    PendingTlbInvalidation pending;
     MappingCursor result;
-    status_t status = x86_mmu_add_mapping<PageTable<MAX_PAGING_LEVEL>>(aspace, aspace->pt_virt,
-                                                                       mmu_flags, start, &result);
+    status_t status = x86_mmu_add_mapping<PageTable<MAX_PAGING_LEVEL>>(
+        aspace, &pending, aspace->pt_virt, mmu_flags, start, &result);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         dprintf(SPEW, "Add mapping failed with err=%d\n", status);
         return status;
@@ -1214,9 +1372,11 @@ static status_t mmu_protect(arch_aspace_t* aspace, vaddr_t vaddr, size_t count,
     MappingCursor start = {
         .paddr = 0, .vaddr = vaddr, .size = count * PAGE_SIZE,
     };
+    PendingTlbInvalidation pending;
     MappingCursor result;
     status_t status = x86_mmu_update_mapping<PageTable<MAX_PAGING_LEVEL>>(
-        aspace, aspace->pt_virt, mmu_flags, start, &result);
+        aspace, &pending, aspace->pt_virt, mmu_flags, start, &result);
+    x86_tlb_invalidate(aspace, &pending);
     if (status != NO_ERROR) {
         return status;
     }
@@ -1239,13 +1399,16 @@ void x86_mmu_early_init() {
     x86_mmu_percpu_init();
 
     /* unmap the lower identity mapping */
-    unmap_entry<PageTable<PML4_L>>(nullptr, 0, &pml4[0]);
+    PendingTlbInvalidation pending;
+    unmap_entry<PageTable<PML4_L>>(&pending, 0, &pml4[0]);
+    x86_tlb_invalidate(nullptr, &pending);
 
     /* get the address width from the CPU */
     uint8_t vaddr_width = x86_linear_address_width();
     uint8_t paddr_width = x86_physical_address_width();
 
     supports_huge_pages = x86_feature_test(X86_FEATURE_HUGE_PAGE);
+    pcid_enabled = x86_feature_test(X86_FEATURE_PCID);
 
     /* if we got something meaningful, override the defaults.
      * some combinations of cpu on certain emulators seems to return
@@ -1303,6 +1466,9 @@ status_t arch_mmu_init_aspace(arch_aspace_t* aspace, vaddr_t base, size_t size,
     }
     aspace->io_bitmap = nullptr;
     aspace->active_cpus = 0;
+    aspace->large_pages = 0;
+    aspace->pcid = (mmu_flags & ARCH_ASPACE_FLAG_KERNEL) ? 0 : x86_pcid_alloc();
+    aspace->pcid_valid_cpus = 0;
     spin_lock_init(&aspace->io_bitmap_lock);
 
     return NO_ERROR;
@@ -1328,6 +1494,9 @@ status_t guest_mmu_init_paspace(guest_paspace_t* paspace, size_t size) {
     paspace->base = 0;
     paspace->size = size;
     paspace->active_cpus = 0;
+    paspace->large_pages = 0;
+    paspace->pcid = 0;
+    paspace->pcid_valid_cpus = 0;
     paspace->io_bitmap = nullptr;
     spin_lock_init(&paspace->io_bitmap_lock);
 
@@ -1362,6 +1531,7 @@ status_t mmu_destroy_aspace(arch_aspace_t* aspace) {
         delete static_cast<bitmap::RleBitmap*>(aspace->io_bitmap);
     }
 
+    x86_pcid_free(aspace->pcid);
     pmm_free_page(paddr_to_vm_page(aspace->pt_phys));
 
     aspace->magic = 0;
@@ -1382,12 +1552,21 @@ void arch_mmu_context_switch(arch_aspace_t* old_aspace, arch_aspace_t* aspace) {
     if (aspace != nullptr) {
         DEBUG_ASSERT(aspace->magic == ARCH_ASPACE_MAGIC);
         LTRACEF_LEVEL(3, "switching to aspace %p, pt %#" PRIXPTR "\n", aspace, aspace->pt_phys);
-        x86_set_cr3(aspace->pt_phys);
 
+        /* Become a shootdown target before deciding whether this cpu's
+         * entries for the pcid can be kept; see x86_tlb_invalidate(). */
         if (old_aspace != nullptr) {
             atomic_and(&old_aspace->active_cpus, ~cpu_bit);
         }
         atomic_or(&aspace->active_cpus, cpu_bit);
+
+        ulong cr3 = aspace->pt_phys;
+        if (aspace->pcid != 0) {
+            cr3 |= aspace->pcid;
+            if (atomic_or(&aspace->pcid_valid_cpus, cpu_bit) & cpu_bit)
+                cr3 |= X86_CR3_NOFLUSH;
+        }
+        x86_set_cr3(cr3);
     } else {
         LTRACEF_LEVEL(3, "switching to kernel aspace, pt %#" PRIxPTR "\n", kernel_pt_phys);
         x86_set_cr3(kernel_pt_phys);
@@ -1488,6 +1667,9 @@ void x86_mmu_percpu_init(void) {
         cr4 |= X86_CR4_SMEP;
     if (x86_feature_test(X86_FEATURE_SMAP))
         cr4 |= X86_CR4_SMAP;
+    /* cr3 still holds pcid 0 here, as enabling pcids requires */
+    if (x86_feature_test(X86_FEATURE_PCID))
+        cr4 |= X86_CR4_PCIDE;
     x86_set_cr4(cr4);
 
     /* Set NXE bit in X86_MSR_IA32_EFER*/
@@ -77,6 +77,19 @@ static struct mtrrs *target_mtrrs = &THE_MTRRS;
 
 /* Function called by all CPUs to setup their PAT */
 static void x86_pat_sync_task(void *context);
+
+/* Flush the whole TLB.  With PCIDs enabled a CR3 reload only drops the
+ * entries of the current PCID, so toggle PGE instead, which drops all of them.
+ * |cr4| is the current value of CR4. */
+static void flush_tlb_all_pcids(ulong cr4)
+{
+    if (cr4 & X86_CR4_PCIDE) {
+        x86_set_cr4(cr4 ^ X86_CR4_PGE);
+        x86_set_cr4(cr4);
+    } else {
+        x86_set_cr3(x86_get_cr3());
+    }
+}
 struct pat_sync_task_context {
     /* Barrier counters for the two barriers described in Intel's algorithm */
     volatile int barrier1;
@@ -164,7 +177,7 @@ static void x86_pat_sync_task(void *raw_context)
 
     /* Step 7: If the PGE flag wasn't set, flush the TLB via CR3 */
     if (!pge_was_set) {
-        x86_set_cr3(x86_get_cr3());
+        flush_tlb_all_pcids(cr4);
     }
 
     /* Step 8: Disable MTRRs */
@@ -209,7 +222,7 @@ static void x86_pat_sync_task(void *raw_context)
 
     /* Step 11: Flush all cache and the TLB again */
     __asm volatile ("wbinvd" ::: "memory");
-    x86_set_cr3(x86_get_cr3());
+    flush_tlb_all_pcids(cr4);
 
     /* Step 12: Enter the normal cache mode */
     cr0 = x86_get_cr0();
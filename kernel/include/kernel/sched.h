@@ -21,3 +21,10 @@ void sched_unblock_list(struct list_node *list, bool resched);
 
 void sched_yield(void);
 void sched_preempt(void);
+bool sched_handoff(void);
+
+/* called by mp_unplug_cpu() once |old_cpu| has stopped scheduling */
+void sched_transition_off_cpu(uint old_cpu);
+
+/* called from the preemption tick to periodically balance the per cpu run queues */
+void sched_tick(void);
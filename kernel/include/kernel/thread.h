@@ -101,6 +101,14 @@ typedef struct thread {
      * left the scheduler. */
     lk_time_t runtime_ns;
 
+    /* Total time spent in THREAD_READY on a run queue waiting for a cpu,
+     * and when the current wait began (0 if the thread is not queued). */
+    lk_time_t wait_ns;
+    lk_time_t last_ready_time;
+
+    /* number of times the thread has been switched onto a cpu */
+    uint64_t context_switches;
+
     /* if blocked, a pointer to the wait queue */
     struct wait_queue *blocking_wait_queue;
 
@@ -110,6 +118,15 @@ typedef struct thread {
     /* are we allowed to be interrupted on the current thing we're blocked/sleeping on */
     bool interruptable;
 
+    /* if set, the next wakeup of handoff_target (or of any thread, if NULL)
+     * by this thread queues the woken thread as this cpu's handoff candidate
+     * instead of scheduling it normally (one shot) */
+    bool handoff_armed;
+    struct thread *handoff_target;
+    /* set when the armed wakeup queued a handoff candidate, until
+     * thread_handoff_disarm() reports it */
+    bool handoff_queued;
+
     /* non-NULL if stopped in an exception */
     const struct arch_exception_context *exception_context;
 
@@ -225,6 +242,16 @@ status_t thread_sleep_relative(lk_time_t delay);
 /* return the number of nanoseconds a thread has been running for */
 lk_time_t thread_runtime(const thread_t *t);
 
+/* scheduling statistics for a thread, including the current run or wait */
+typedef struct thread_sched_stats {
+    lk_time_t runtime;
+    lk_time_t wait_time;
+    uint64_t context_switches;
+    uint last_cpu;
+} thread_sched_stats_t;
+
+void thread_get_sched_stats(const thread_t *t, thread_sched_stats_t *stats);
+
 /* deliver a kill signal to a thread */
 void thread_kill(thread_t *t, bool block);
 
@@ -246,6 +273,17 @@ void thread_yield(void);             /* give up the cpu and time slice voluntari
 void thread_preempt(bool interrupt); /* get preempted (return to head of queue and reschedule) */
 void thread_resched(void);
 
+/* Directed handoff for synchronous rpc. Arm around the single wakeup of the
+ * peer: the woken thread (|target|, or the first thread woken if NULL) is
+ * queued at the head of this cpu's run queue without an IPI. Once the waker
+ * has dropped its locks, thread_handoff() gives the candidate the rest of the
+ * current time slice; the waker then blocks or preempts itself. Disarming
+ * returns whether a candidate was queued, so that thread_handoff() and its
+ * trip through the thread lock are only needed then. */
+void thread_handoff_arm(thread_t *target);
+bool thread_handoff_disarm(void);
+bool thread_handoff(void);
+
 static inline bool thread_is_realtime(thread_t *t)
 {
     return (t->flags & THREAD_FLAG_REAL_TIME) && t->priority > DEFAULT_PRIORITY;
@@ -292,6 +330,7 @@ struct thread_stats {
     ulong irq_preempts;
     ulong preempts;
     ulong yields;
+    ulong handoffs; /* wakeups that took over the waker's cpu and time slice */
 
     /* cpu level interrupts and exceptions */
     ulong interrupts; /* hardware interrupts, minus timer interrupts or inter-processor interrupts */
@@ -304,6 +343,10 @@ struct thread_stats {
     /* inter-processor interrupts */
     ulong reschedule_ipis;
     ulong generic_ipis;
+
+    /* run queue balancing */
+    ulong steals; /* threads taken from another cpu's queue while idle */
+    ulong balance_migrations; /* balancing passes that moved threads to this cpu */
 #endif
 };
 
@@ -24,7 +24,13 @@ typedef enum handler_return (*timer_callback)(struct timer *, lk_time_t now, voi
 
 typedef struct timer {
     int magic;
-    struct list_node node;
+
+    /* links into the owning cpu's pairing heap of pending timers. heap_prev points
+     * at the parent for the leftmost child and at the left sibling otherwise */
+    struct timer *heap_child;
+    struct timer *heap_next;
+    struct timer *heap_prev;
+    int queue_cpu;           // cpu whose queue holds the timer, <0 if not queued
 
     lk_time_t scheduled_time;
     lk_time_t period;
@@ -39,7 +45,10 @@ typedef struct timer {
 #define TIMER_INITIAL_VALUE(t) \
 { \
     .magic = TIMER_MAGIC, \
-    .node = LIST_INITIAL_CLEARED_VALUE, \
+    .heap_child = NULL, \
+    .heap_next = NULL, \
+    .heap_prev = NULL, \
+    .queue_cpu = -1, \
     .scheduled_time = 0, \
     .period = 0, \
     .callback = NULL, \
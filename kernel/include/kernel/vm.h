@@ -38,6 +38,14 @@ __BEGIN_CDECLS
 #define ROUNDUP_PAGE_SIZE(x) ROUNDUP((x), PAGE_SIZE)
 #define IS_PAGE_ALIGNED(x) IS_ALIGNED((x), PAGE_SIZE)
 
+/* sizes of the multi-page entries the mmu code installs for suitably aligned
+ * and physically contiguous runs: a 2MB pde or level 2 block, and a 1GB pdpe
+ * or level 1 block (x86 only with cpu support) */
+#define LARGE_PAGE_SIZE_SHIFT 21
+#define LARGE_PAGE_SIZE (1UL << LARGE_PAGE_SIZE_SHIFT)
+#define HUGE_PAGE_SIZE_SHIFT 30
+#define HUGE_PAGE_SIZE (1UL << HUGE_PAGE_SIZE_SHIFT)
+
 struct mmu_initial_mapping {
     paddr_t phys;
     vaddr_t virt;
@@ -112,6 +120,7 @@ status_t pmm_add_arena(const pmm_arena_info_t* arena) __NONNULL((1));
 /* flags for allocation routines below */
 #define PMM_ALLOC_FLAG_ANY (0x0)  /* no restrictions on which arena to allocate from */
 #define PMM_ALLOC_FLAG_KMAP (0x1) /* allocate only from arenas marked KMAP */
+#define PMM_ALLOC_FLAG_ZEROED (0x2) /* returned pages must be zero filled */
 
 /* Allocate count pages of physical memory, adding to the tail of the passed list.
  * The list must be initialized.
@@ -124,6 +133,7 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) _
 vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa);
 
 /* Allocate a specific range of physical pages, adding to the tail of the passed list.
+ * The pages are not zeroed.
  * Returns the number of pages allocated.
  */
 size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list);
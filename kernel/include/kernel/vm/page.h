@@ -10,6 +10,7 @@
 #include <list.h>
 #include <magenta/compiler.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #if __cplusplus
 class VmObject;
@@ -22,9 +23,15 @@ typedef struct vm_page {
     struct {
         uint32_t flags : 8;
         uint32_t state : 3;
+        // order of the free block this page heads in its arena's buddy
+        // allocator, only valid if VM_PAGE_FLAG_BUDDY_HEAD is set
+        uint32_t order : 5;
     };
     uint32_t map_count;
 
+    // physical address of the page, set once when the arena is initialized
+    paddr_t paddr;
+
     union {
         struct {
             // in allocated/just freed state, use a linked list to hold the page in a queue
@@ -38,10 +45,13 @@ typedef struct vm_page {
         } object;
 #endif
 
-        uint8_t pad[24]; // pad out to 32 bytes
+        uint8_t pad[16]; // pad out to 32 bytes
     };
 } vm_page_t;
 
+// vm_page_t flags
+#define VM_PAGE_FLAG_BUDDY_HEAD (1u << 0) // first page of a free block in an arena
+
 // pmm will maintain pages of this size
 #define VM_PAGE_STRUCT_SIZE (sizeof(vm_page_t))
 static_assert(sizeof(vm_page_t) == 32, "");
@@ -41,6 +41,10 @@
 // with execute permissions.  When on a VmMapping, controls whether or not the
 // mapping can gain this permission.
 #define VMAR_FLAG_CAN_MAP_EXECUTE (1 << 6)
+// Only valid on VmMappings.  When page faults on the mapping are detected to be
+// walking forward through the object, fault in a growing window of pages ahead
+// of the faulting address.
+#define VMAR_FLAG_PREFAULT_SEQUENTIAL (1 << 7)
 
 #define VMAR_CAN_RWX_FLAGS (VMAR_FLAG_CAN_MAP_READ |  \
                             VMAR_FLAG_CAN_MAP_WRITE | \
@@ -113,10 +117,6 @@ public:
     mxtl::RefPtr<VmAddressRegion> as_vm_address_region();
     mxtl::RefPtr<VmMapping> as_vm_mapping();
 
-    // Page fault in an address within the region.  Recursively traverses
-    // the regions to find the target mapping, if it exists.
-    virtual status_t PageFault(vaddr_t va, uint pf_flags) = 0;
-
     // WAVL tree key function
     vaddr_t GetKey() const { return base(); }
 
@@ -198,6 +198,39 @@ protected:
     // node for element in list of parent's children.
     mxtl::WAVLTreeNodeState<mxtl::RefPtr<VmAddressRegionOrMapping>, bool> subregion_list_node_;
 
+    // Summary of the subtree of the parent's children rooted at this node,
+    // used to find gaps in logarithmic time: the lowest base and highest last
+    // byte of any region in it, and the largest gap between two regions in it
+    // that are adjacent in address order.
+    vaddr_t subtree_min_base_ = 0;
+    vaddr_t subtree_max_last_ = 0;
+    size_t subtree_max_gap_ = 0;
+
+    // Recompute the subtree summary of |node| from its children's, and
+    // optionally of all of its ancestors too.
+    static void UpdateSubtreeState(VmAddressRegionOrMapping* node);
+    static void PropagateSubtreeState(VmAddressRegionOrMapping* node);
+
+    // utility so the WAVL tree keeps the subtree summaries up to date
+    struct WAVLTreeObserver : public mxtl::DefaultWAVLTreeObserver {
+        template <typename TreeType>
+        static void AugmentInsert(VmAddressRegionOrMapping* node) {
+            PropagateSubtreeState(node);
+        }
+
+        template <typename TreeType>
+        static void AugmentErase(VmAddressRegionOrMapping* parent) {
+            PropagateSubtreeState(parent);
+        }
+
+        template <typename TreeType>
+        static void AugmentRotate(VmAddressRegionOrMapping* old_top,
+                                  VmAddressRegionOrMapping* new_top) {
+            UpdateSubtreeState(old_top);
+            UpdateSubtreeState(new_top);
+        }
+    };
+
     char name_[32];
 };
 
@@ -236,7 +269,10 @@ public:
     bool is_mapping() const override { return false; }
 
     void Dump(uint depth, bool verbose) const override;
-    status_t PageFault(vaddr_t va, uint pf_flags) override;
+
+    // Recursively traverses the regions to find the mapping containing |va|,
+    // if there is one.  Caller must be holding the aspace lock.
+    mxtl::RefPtr<VmMapping> FindMappingLocked(vaddr_t va);
 
 protected:
     // constructor for use in creating a VmAddressRegionDummy
@@ -254,13 +290,16 @@ protected:
     friend class VmMapping;
     // Remove *region* from the subregion list
     void RemoveSubregion(VmAddressRegionOrMapping* region);
+    // Set the size of *region*, one of our children, in place, keeping the
+    // subregion list's gap bookkeeping up to date
+    void ResizeSubregionLocked(VmAddressRegionOrMapping* region, size_t size);
 
     friend mxtl::RefPtr<VmAddressRegion>;
 
 private:
     using ChildList = mxtl::WAVLTree<vaddr_t, mxtl::RefPtr<VmAddressRegionOrMapping>,
                                      mxtl::DefaultKeyedObjectTraits<vaddr_t, VmAddressRegionOrMapping>,
-                                     WAVLTreeTraits>;
+                                     WAVLTreeTraits, WAVLTreeObserver>;
 
     DISALLOW_COPY_ASSIGN_AND_MOVE(VmAddressRegion);
 
@@ -320,6 +359,13 @@ private:
     status_t CompactRandomizedRegionAllocatorLocked(size_t size, uint8_t align_pow2,
                                                    uint arch_mmu_flags, vaddr_t* spot);
 
+    // Find the first child at or after the one with the lowest base >= |from|
+    // whose gap to the previous child (or to the start of this region, for the
+    // first child) is at least |size| bytes.  Runs in logarithmic time using
+    // the subtree summaries.  Returns end() if there is none; the gap after
+    // the last child is not considered.
+    ChildList::iterator FindGapLocked(vaddr_t from, size_t size);
+
     // Utility for allocators for iterating over gaps between allocations
     // F should have a signature of bool func(vaddr_t gap_base, size_t gap_size).
     // If func returns false, the iteration stops.  gap_base will be aligned in
@@ -367,12 +413,6 @@ public:
         return;
     }
 
-    status_t PageFault(vaddr_t va, uint pf_flags) override {
-        // We should never be trying to page fault on this...
-        ASSERT(false);
-        return ERR_BAD_STATE;
-    }
-
     size_t AllocatedPages() const override {
         return 0;
     }
@@ -431,7 +471,14 @@ public:
     bool is_mapping() const override { return true; }
 
     void Dump(uint depth, bool verbose) const override;
-    status_t PageFault(vaddr_t va, uint pf_flags) override;
+
+    // Page fault in an address within the mapping.  Called without the aspace
+    // lock held, so that faults on disjoint mappings can run concurrently;
+    // |object| must be the mapping's object, referenced while the aspace lock
+    // was held.  Returns ERR_INTERRUPTED_RETRY if the mapping was changed or
+    // destroyed since and no longer covers |va|, in which case the lookup
+    // should be repeated.
+    status_t PageFault(vaddr_t va, uint pf_flags, const mxtl::RefPtr<VmObject>& object);
 
 protected:
     ~VmMapping() override;
@@ -470,6 +517,27 @@ private:
     // Version of AllocatedPages() that does not acquire the aspace lock
     size_t AllocatedPagesLocked() const override;
 
+    // Map pages of the object backing [va, va + count * PAGE_SIZE) that are not
+    // already mapped, skipping |skip_va|.  Pages are looked up with |pf_flags|,
+    // so only resident pages are mapped unless a fault flag is passed.  Runs of
+    // physically contiguous pages are mapped with a single arch_mmu_map call.
+    // Stops at the first page that fails to resolve for a reason other than
+    // not being present.  Returns the number of pages newly mapped.
+    // Must be called with the object_ lock held.
+    size_t MapPagesAroundLocked(vaddr_t va, size_t count, vaddr_t skip_va,
+                                uint pf_flags, uint mmu_flags);
+
+    // Fault-around and sequential prefault policies, run after the page at
+    // |va| has been successfully mapped by PageFault().
+    void FaultAroundLocked(vaddr_t va, uint pf_flags, uint mmu_flags);
+
+    // If the page at |pa| that |va| faulted on sits inside a fully resident,
+    // physically contiguous and equally aligned 1GB or 2MB run of the object
+    // that the mapping covers, map the whole run with one large entry using
+    // the fault's |mmu_flags|.  Returns true if it did.  Must be called with
+    // the object_ lock held.
+    bool FaultLargePageLocked(vaddr_t va, paddr_t pa, uint mmu_flags);
+
     void Activate() override;
 
     // Version of Activate that does not take the object_ lock.
@@ -477,7 +545,9 @@ private:
     // in Clang around capability aliasing, we need to relax the analysis.
     void ActivateLocked();
 
-    // pointer and region of the object we are mapping
+    // pointer and region of the object we are mapping.  The region and the
+    // flags below are only changed with both the aspace and the object_ locks
+    // held, so the page fault path can read them holding just the latter.
     mxtl::RefPtr<VmObject> object_;
     uint64_t object_offset_ = 0;
 
@@ -486,4 +556,10 @@ private:
 
     // used to detect recursions through the vmo fault path
     bool currently_faulting_ = false;
+
+    // sequential access tracking for VMAR_FLAG_PREFAULT_SEQUENTIAL; the offset
+    // into the mapping at which the next fault of a forward scan is expected,
+    // and the number of pages to prefault when it arrives (0 if not sequential)
+    size_t seq_next_offset_ = 0;
+    size_t seq_window_ = 0;
 };
@@ -12,6 +12,7 @@
 #include <kernel/vm.h>
 #include <kernel/vm/vm_address_region.h>
 #include <lib/crypto/prng.h>
+#include <mxtl/atomic.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/intrusive_wavl_tree.h>
@@ -87,6 +88,12 @@ public:
 
     size_t AllocatedPages() const;
 
+    // Number of page faults handled in this address space.
+    uint64_t page_faults() const;
+
+    // Number of page table entries currently mapping more than one page.
+    size_t large_pages() const;
+
     // Convenience method for traversing the tree of VMARs to find the deepest
     // VMAR in the tree that includes *va*.
     mxtl::RefPtr<VmAddressRegionOrMapping> FindRegion(vaddr_t va);
@@ -123,6 +130,12 @@ protected:
     friend class VmMapping;
     mutex_t* lock() { return &lock_; }
 
+    // Serializes changes to and lookups in the arch page tables.  Page faults
+    // only hold the lock of the object being faulted on, so faults on disjoint
+    // mappings can reach the arch mmu code concurrently.  Always acquired
+    // last, after the aspace and object locks.
+    mutex_t* mmu_lock() { return &mmu_lock_; }
+
     // Expose the PRNG for ASLR to VmAddressRegion
     crypto::PRNG& AslrPrng() {
         DEBUG_ASSERT(aslr_enabled_);
@@ -157,6 +170,10 @@ private:
     bool aslr_enabled_ = false;
 
     mutable mutex_t lock_ = MUTEX_INITIAL_VALUE(lock_);
+    // Guards the arch aspace, including its large page count.
+    mutable mutex_t mmu_lock_ = MUTEX_INITIAL_VALUE(mmu_lock_);
+
+    mxtl::atomic<uint64_t> page_faults_ = {0u};
 
     // root of virtual address space
     // Access to this reference is guarded by lock_.
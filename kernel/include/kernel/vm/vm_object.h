@@ -65,6 +65,20 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // move the pages backing a page-aligned range out of the vmo into |pages|,
+    // one per page, leaving the range decommitted. missing pages are committed
+    // first. the caller owns the returned pages.
+    virtual status_t TakePages(uint64_t offset, uint64_t len, vm_page_t** pages) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // install |pages| over a page-aligned range of the vmo, freeing the pages
+    // they replace. on success the vmo owns the pages; on failure nothing
+    // changed and the caller still does.
+    virtual status_t SupplyPages(uint64_t offset, uint64_t len, vm_page_t** pages) {
+        return ERR_NOT_SUPPORTED;
+    }
+
     // read/write operators against kernel pointers only
     virtual status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) {
         return ERR_NOT_SUPPORTED;
@@ -128,6 +142,12 @@ public:
         return ERR_NOT_SUPPORTED;
     }
 
+    // returns true if every page in [offset, offset + len) is resident in this
+    // object and together they form one physical run starting at |pa|
+    virtual bool IsContiguousLocked(uint64_t offset, uint64_t len, paddr_t pa) TA_REQ(lock_) {
+        return false;
+    }
+
     Mutex* lock() TA_RET_CAP(lock_) { return &lock_; }
     Mutex& lock_ref() TA_RET_CAP(lock_) { return lock_; }
 
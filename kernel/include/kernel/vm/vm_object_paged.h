@@ -25,7 +25,15 @@
 // the main VM object type, holding a list of pages
 class VmObjectPaged final : public VmObject {
 public:
-    static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size);
+    // Create() options.
+    // kLargePages: back commits with physically contiguous, naturally aligned
+    // runs of LARGE_PAGE_SIZE (or HUGE_PAGE_SIZE) pages wherever the committed
+    // range covers a whole aligned block, so that mappings can use large
+    // page table entries.
+    static constexpr uint32_t kLargePages = (1u << 0);
+
+    static mxtl::RefPtr<VmObject> Create(uint32_t pmm_alloc_flags, uint64_t size,
+                                         uint32_t options = 0);
 
     static mxtl::RefPtr<VmObject> CreateFromROData(const void* data, size_t size);
 
@@ -43,6 +51,9 @@ public:
                                    uint8_t alignment_log2) override;
     status_t DecommitRange(uint64_t offset, uint64_t len, uint64_t* decommitted) override;
 
+    status_t TakePages(uint64_t offset, uint64_t len, vm_page_t** pages) override;
+    status_t SupplyPages(uint64_t offset, uint64_t len, vm_page_t** pages) override;
+
     status_t Read(void* ptr, uint64_t offset, size_t len, size_t* bytes_read) override;
     status_t Write(const void* ptr, uint64_t offset, size_t len, size_t* bytes_written) override;
     status_t Lookup(uint64_t offset, uint64_t len, uint pf_flags,
@@ -67,6 +78,8 @@ public:
         // Calls a Locked method of the parent, which confuses analysis.
         TA_NO_THREAD_SAFETY_ANALYSIS;
 
+    bool IsContiguousLocked(uint64_t offset, uint64_t len, paddr_t pa) override TA_REQ(lock_);
+
     status_t CloneCOW(uint64_t offset, uint64_t size,
                       mxtl::RefPtr<VmObject>* clone_vmo) override
         // Calls a Locked method of the child, which confuses analysis.
@@ -78,7 +91,8 @@ public:
 
 private:
     // private constructor (use Create())
-    explicit VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent);
+    explicit VmObjectPaged(uint32_t pmm_alloc_flags, uint32_t options,
+                           mxtl::RefPtr<VmObject> parent);
 
     // private destructor, only called from refptr
     ~VmObjectPaged() override;
@@ -100,6 +114,10 @@ private:
     // internal page list routine
     void AddPageToArray(size_t index, vm_page_t* p);
 
+    // back the empty, naturally aligned block of 1 << block_shift bytes at
+    // |offset| with one physically contiguous run of pages aligned the same way
+    status_t CommitBlockLocked(uint64_t offset, uint block_shift) TA_REQ(lock_);
+
     // internal read/write routine that takes a templated copy function to help share some code
     template <typename T>
     status_t ReadWriteInternal(uint64_t offset, size_t len, size_t* bytes_copied, bool write,
@@ -115,6 +133,7 @@ private:
     uint64_t size_ TA_GUARDED(lock_) = 0;
     uint64_t parent_offset_ TA_GUARDED(lock_) = 0;
     uint32_t pmm_alloc_flags_ TA_GUARDED(lock_) = PMM_ALLOC_FLAG_ANY;
+    const bool large_pages_;
 
     // a tree of pages
     VmPageList page_list_ TA_GUARDED(lock_);
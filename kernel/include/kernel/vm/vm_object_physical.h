@@ -34,6 +34,8 @@ public:
     status_t GetPageLocked(uint64_t offset, uint pf_flags,
                            vm_page_t**, paddr_t* pa) override TA_REQ(lock_);
 
+    bool IsContiguousLocked(uint64_t offset, uint64_t len, paddr_t pa) override TA_REQ(lock_);
+
 private:
     // private constructor (use Create())
     VmObjectPhysical(paddr_t base, uint64_t size);
@@ -91,8 +91,20 @@ public:
     status_t AddPage(vm_page*, uint64_t offset);
     vm_page* GetPage(uint64_t offset);
     status_t FreePage(uint64_t offset);
+
+    // Unlinks and returns the page at |offset| without freeing it. The tree
+    // node is kept, so AddPage() at the same offset can't fail afterwards.
+    vm_page* RemovePage(uint64_t offset);
     size_t FreeAllPages();
 
+    // returns true if a page is present at every offset in [offset, offset + len)
+    // and their physical addresses run contiguously from |pa|, looking up each
+    // tree node only once
+    bool IsContiguousRun(uint64_t offset, uint64_t len, paddr_t pa);
+
+    // returns true if no page is present in [offset, offset + len)
+    bool IsRangeEmpty(uint64_t offset, uint64_t len);
+
 private:
     mxtl::WAVLTree<uint64_t, mxtl::unique_ptr<VmPageListNode>> list_;
 };
@@ -9,6 +9,7 @@
 #include <err.h>
 #include <magenta/compiler.h>
 #include <magenta/ktrace.h>
+#include <stdbool.h>
 
 __BEGIN_CDECLS
 
@@ -22,31 +23,28 @@ struct ktrace_probe_info {
     uint32_t num;
 } __ALIGNED(16); // align on multiple of 16 to match linker packing of the ktrace_probe section
 
-void* ktrace_open(uint32_t tag);
+// Records an event carrying as many of a..d as its tag's size has room for.
+// Returns false if the event's group is disabled or the record was lost.
+bool ktrace_write(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d);
 void ktrace_tiny(uint32_t tag, uint32_t arg);
 static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
-    uint32_t* data = (uint32_t*) ktrace_open(tag);
-    if (data) {
-        data[0] = a; data[1] = b; data[2] = c; data[3] = d;
-    }
+    ktrace_write(tag, a, b, c, d);
 }
 #define ktrace_probe0(_name) { \
     static __SECTION("ktrace_probe") ktrace_probe_info_t info = { .name = _name }; \
-    ktrace_open(TAG_PROBE_16(info.num)); \
+    ktrace_write(TAG_PROBE_16(info.num), 0, 0, 0, 0); \
 }
 #define ktrace_probe2(_name,arg0,arg1) { \
     static __SECTION("ktrace_probe") ktrace_probe_info_t info = { .name = _name }; \
-    uint32_t* args = ktrace_open(TAG_PROBE_24(info.num)); \
-    if (args) { \
-        args[0] = arg0; \
-        args[1] = arg1; \
-    } \
+    ktrace_write(TAG_PROBE_24(info.num), arg0, arg1, 0, 0); \
 }
 void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name);
 int ktrace_read_user(void* ptr, uint32_t off, uint32_t len);
 status_t ktrace_control(uint32_t action, uint32_t options, void* ptr);
 #else
-static inline void* ktrace_open(uint32_t tag) { return NULL; }
+static inline bool ktrace_write(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    return false;
+}
 static inline void ktrace_tiny(uint32_t tag, uint32_t arg) {}
 static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {}
 static inline void ktrace_probe0(const char* name) {}
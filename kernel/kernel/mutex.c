@@ -23,10 +23,93 @@
 #include <inttypes.h>
 #include <kernel/thread.h>
 #include <kernel/sched.h>
+#include <platform.h>
+#include <string.h>
 #include <trace.h>
 
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+#endif
+
 #define LOCAL_TRACE 0
 
+/* how long to spin on a contended mutex whose owner is running before blocking.
+ * most mutex hold times are shorter than a block/wakeup round trip. */
+#define MUTEX_SPIN_TIME LK_USEC(10)
+
+/* contention statistics, recorded only on the slow path.
+ * entries are found by hashing the mutex address into a small open addressed
+ * table; mutexes that don't fit are only counted in mutex_stats_dropped. */
+#define MUTEX_STATS_SHIFT 8
+#define MUTEX_STATS_SLOTS (1u << MUTEX_STATS_SHIFT)
+#define MUTEX_STATS_PROBE 8
+
+struct mutex_stats {
+    uint64_t mutex;         /* address of the mutex, 0 if the slot is free */
+    uint64_t last_caller;   /* return address of the last contended acquire */
+    uint64_t contended;     /* acquires that missed the fast path */
+    uint64_t spun;          /* ...of which were acquired by spinning */
+    uint64_t blocked;       /* ...of which blocked */
+    uint64_t blocked_time;  /* total time spent blocked */
+};
+
+static struct mutex_stats mutex_stats[MUTEX_STATS_SLOTS];
+static uint64_t mutex_stats_dropped;
+static uint64_t mutex_stats_used;   /* number of claimed slots */
+
+static inline uint mutex_stats_hash(const mutex_t *m, uint i)
+{
+    uint64_t hash = ((uintptr_t)m >> 3) * 0x9E3779B97F4A7C15ull;
+    return (uint)((hash >> (64 - MUTEX_STATS_SHIFT)) + i) % MUTEX_STATS_SLOTS;
+}
+
+/* find the stats slot for a mutex, claiming one if this is its first contention */
+static struct mutex_stats *mutex_stats_get(const mutex_t *m)
+{
+    for (uint i = 0; i < MUTEX_STATS_PROBE; i++) {
+        struct mutex_stats *stats = &mutex_stats[mutex_stats_hash(m, i)];
+        uint64_t key = atomic_load_u64_relaxed(&stats->mutex);
+        if (key == (uintptr_t)m)
+            return stats;
+        if (key == 0) {
+            if (atomic_cmpxchg_u64(&stats->mutex, &key, (uintptr_t)m)) {
+                atomic_add_u64(&mutex_stats_used, 1);
+                return stats;
+            }
+            if (key == (uintptr_t)m)
+                return stats;
+        }
+    }
+
+    atomic_add_u64(&mutex_stats_dropped, 1);
+    return NULL;
+}
+
+/* forget a mutex that is going away, so its slot can be reused */
+static void mutex_stats_clear(const mutex_t *m)
+{
+    // most mutexes are never contended, so don't probe an empty table
+    if (atomic_load_u64_relaxed(&mutex_stats_used) == 0)
+        return;
+
+    for (uint i = 0; i < MUTEX_STATS_PROBE; i++) {
+        struct mutex_stats *stats = &mutex_stats[mutex_stats_hash(m, i)];
+        if (atomic_load_u64_relaxed(&stats->mutex) == (uintptr_t)m) {
+            stats->last_caller = 0;
+            stats->contended = 0;
+            stats->spun = 0;
+            stats->blocked = 0;
+            stats->blocked_time = 0;
+            atomic_store_u64(&stats->mutex, 0);
+            atomic_add_u64(&mutex_stats_used, (uint64_t)-1);
+            return;
+        }
+    }
+}
+
+#define MUTEX_STATS_ADD(stats, name, n) \
+    do { if (stats) atomic_add_u64(&(stats)->name, (n)); } while (0)
+
 /**
  * @brief  Initialize a mutex_t
  */
@@ -60,6 +143,50 @@ void mutex_destroy(mutex_t *m)
     m->val = 0;
     wait_queue_destroy(&m->wait);
     THREAD_UNLOCK(state);
+
+    mutex_stats_clear(m);
+}
+
+/* spin while the owner is running on another cpu, in the hope that it releases
+ * the mutex before we would have finished blocking. returns true if we acquired it. */
+static bool mutex_spin(mutex_t *m, thread_t *ct)
+{
+#if WITH_SMP
+    lk_time_t deadline = current_time() + MUTEX_SPIN_TIME;
+
+    for (;;) {
+        uintptr_t val = mutex_val(m);
+        if (val == 0) {
+            if (atomic_cmpxchg_u64(&m->val, &val, (uintptr_t)ct))
+                return true;
+            continue;
+        }
+
+        // once a thread has queued, release hands the mutex directly to it,
+        // so there is nothing left to spin for
+        if (val & MUTEX_FLAG_QUEUED)
+            return false;
+
+        if (current_time() >= deadline)
+            return false;
+
+        // only an owner that is running can release the mutex soon. the owner
+        // may release the mutex and exit between the two loads, so its state
+        // is only trusted if it still held the mutex afterwards. the read of a
+        // freed thread_t can't fault: the heap hands out physmap memory, which
+        // stays mapped.
+        thread_t *holder = (thread_t *)val;
+        enum thread_state state = __atomic_load_n(&holder->state, __ATOMIC_ACQUIRE);
+        if (mutex_val(m) != val)
+            continue;
+        if (state != THREAD_RUNNING)
+            return false;
+
+        arch_spinloop_pause();
+    }
+#else
+    return false;
+#endif
 }
 
 /**
@@ -73,7 +200,6 @@ void mutex_acquire(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
     thread_t *ct = get_current_thread();
     uintptr_t oldval;
 
-retry:
     // fast path: assume its unheld, try to grab it
     oldval = 0;
     if (likely(atomic_cmpxchg_u64(&m->val, &oldval, (uintptr_t)ct))) {
@@ -87,6 +213,22 @@ retry:
               ct, ct->name, m);
 #endif
 
+    struct mutex_stats *stats = mutex_stats_get(m);
+    MUTEX_STATS_ADD(stats, contended, 1);
+    if (stats)
+        stats->last_caller = (uintptr_t)__GET_CALLER();
+
+    // the owner may be about to release it
+    if (mutex_spin(m, ct)) {
+        MUTEX_STATS_ADD(stats, spun, 1);
+        return;
+    }
+
+retry:
+    oldval = 0;
+    if (atomic_cmpxchg_u64(&m->val, &oldval, (uintptr_t)ct))
+        return;
+
     // we contended with someone else, will probably need to block
     THREAD_LOCK(state);
 
@@ -105,6 +247,7 @@ retry:
     }
 
     // we have signalled that we're blocking, so drop into the wait queue
+    lk_time_t block_start = current_time();
     status_t ret = wait_queue_block(&m->wait, INFINITE_TIME);
     if (unlikely(ret < NO_ERROR)) {
         // mutexes are not interruptable and cannot time out, so it
@@ -117,6 +260,9 @@ retry:
     DEBUG_ASSERT(ct == mutex_holder(m));
 
     THREAD_UNLOCK(state);
+
+    MUTEX_STATS_ADD(stats, blocked, 1);
+    MUTEX_STATS_ADD(stats, blocked_time, current_time() - block_start);
 }
 
 // shared implementation of release
@@ -189,3 +335,59 @@ void mutex_release_thread_locked(mutex_t *m, bool reschedule) TA_NO_THREAD_SAFET
     // the thread_lock
     mutex_release_internal(m, reschedule, true);
 }
+
+#if WITH_LIB_CONSOLE
+
+static int cmd_mutexstat(int argc, const cmd_args *argv, uint32_t flags)
+{
+    if (argc > 1 && !strcmp(argv[1].str, "reset")) {
+        for (uint i = 0; i < MUTEX_STATS_SLOTS; i++) {
+            struct mutex_stats *stats = &mutex_stats[i];
+            stats->contended = 0;
+            stats->spun = 0;
+            stats->blocked = 0;
+            stats->blocked_time = 0;
+        }
+        mutex_stats_dropped = 0;
+        return 0;
+    }
+    if (argc > 1) {
+        printf("usage:\n");
+        printf("%s         : show the most contended mutexes\n", argv[0].str);
+        printf("%s reset   : zero the counters\n", argv[0].str);
+        return -1;
+    }
+
+    // sort the slots by contention, most contended first
+    uint16_t order[MUTEX_STATS_SLOTS];
+    uint count = 0;
+    for (uint i = 0; i < MUTEX_STATS_SLOTS; i++) {
+        if (mutex_stats[i].mutex == 0 || mutex_stats[i].contended == 0)
+            continue;
+        uint j = count++;
+        while (j > 0 && mutex_stats[order[j - 1]].contended < mutex_stats[i].contended) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = (uint16_t)i;
+    }
+
+    printf("%18s %12s %12s %12s %12s %18s\n",
+           "mutex", "contended", "spun", "blocked", "block usec", "last caller");
+    for (uint i = 0; i < count; i++) {
+        const struct mutex_stats *stats = &mutex_stats[order[i]];
+        printf("%#18" PRIx64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %#18" PRIx64 "\n",
+               stats->mutex, stats->contended, stats->spun, stats->blocked,
+               stats->blocked_time / LK_USEC(1), stats->last_caller);
+    }
+    if (mutex_stats_dropped)
+        printf("%" PRIu64 " contended acquires of mutexes with no free slot\n", mutex_stats_dropped);
+
+    return 0;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("mutexstat", "mutex contention statistics", &cmd_mutexstat)
+STATIC_COMMAND_END(mutex);
+
+#endif // WITH_LIB_CONSOLE
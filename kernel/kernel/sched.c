@@ -15,16 +15,59 @@
 #include <err.h>
 #include <kernel/mp.h>
 #include <kernel/thread.h>
+#include <platform.h>
 
 /* legacy implementation that just broadcast ipis for every reschedule */
 #define BROADCAST_RESCHEDULE 0
 
-/* the run queue */
-static struct list_node run_queue[NUM_PRIORITIES];
-static uint32_t run_queue_bitmap;
+/* number of preemption ticks between load balancing passes on a cpu */
+#define SCHED_BALANCE_INTERVAL_TICKS 4
+
+/* a cpu is only considered for balancing if it has at least this many more
+ * ready threads queued than the cpu doing the balancing */
+#define SCHED_BALANCE_MIN_IMBALANCE 2
+
+/* per cpu run queue.
+ *
+ * each queue has its own lock, taken with interrupts disabled and nested
+ * inside the thread lock when both are held. the thread lock still covers
+ * thread state and wait queues, but a thread on a run queue is always READY
+ * and only ever touched through the queue, so moving threads between queues
+ * (stealing, balancing) only needs the queue locks. when two queue locks are
+ * held at once, the one of the lower numbered cpu is taken first. */
+struct run_queue {
+    spin_lock_t lock;
+    struct list_node list[NUM_PRIORITIES];
+    uint32_t bitmap;
+    /* number of threads queued across all priorities */
+    uint count;
+    /* ticks remaining until the next load balancing pass */
+    uint balance_countdown;
+    /* thread queued at the head by a directed handoff from handoff_from, until
+     * it leaves the queue or the handoff completes */
+    thread_t *handoff;
+    thread_t *handoff_from;
+} __CPU_ALIGN;
+
+static struct run_queue run_queues[SMP_MAX_CPUS];
 
 /* make sure the bitmap is large enough to cover our number of priorities */
-static_assert(NUM_PRIORITIES <= sizeof(run_queue_bitmap) * CHAR_BIT, "");
+static_assert(NUM_PRIORITIES <= sizeof(run_queues[0].bitmap) * CHAR_BIT, "");
+
+static inline uint run_queue_highest_priority(uint32_t bitmap)
+{
+    return HIGHEST_PRIORITY - __builtin_clz(bitmap)
+           - (sizeof(bitmap) * CHAR_BIT - NUM_PRIORITIES);
+}
+
+static inline bool thread_can_run_on(const thread_t *t, uint cpu)
+{
+#if WITH_SMP
+    return likely(thread_pinned_cpu(t) < 0) || (uint)thread_pinned_cpu(t) == cpu;
+#else
+    return true;
+#endif
+}
 
 /* pick a 'random' cpu */
 static mp_cpu_mask_t rand_cpu(const mp_cpu_mask_t mask)
@@ -97,57 +140,194 @@ static mp_cpu_mask_t find_cpu(thread_t *t)
 #endif
 }
 
+/* pick the run queue a newly readied thread should go on, and the mask of
+ * cpus that need to be kicked so it gets looked at */
+static uint find_run_queue(thread_t *t, mp_cpu_mask_t *reschedule_mask)
+{
+#if WITH_SMP
+    uint curr_cpu = arch_curr_cpu_num();
+
+    /* pinned threads always go on their cpu's queue */
+    if (unlikely(thread_pinned_cpu(t) >= 0)) {
+        uint cpu = (uint)thread_pinned_cpu(t);
+        *reschedule_mask = (cpu == curr_cpu) ? 0 : (1u << cpu);
+        return cpu;
+    }
+
+    mp_cpu_mask_t mask = find_cpu(t);
+    *reschedule_mask = mask;
+
+    /* a single target cpu gets the thread on its own queue, anything else
+     * (including 'run it here') stays local and relies on stealing. cpus
+     * running realtime threads are not kicked, so don't strand threads there */
+    if (mask != 0 && (mask & (mask - 1)) == 0 && mask != MP_CPU_ALL &&
+        (mask & mp_get_realtime_mask()) == 0) {
+        uint cpu = __builtin_ctz(mask);
+        if (mp_is_cpu_active(cpu))
+            return cpu;
+    }
+    return curr_cpu;
+#else
+    *reschedule_mask = 0;
+    return 0;
+#endif
+}
+
 /* run queue manipulation */
-static void insert_in_run_queue_head(thread_t *t)
+static void run_queue_insert_locked(struct run_queue *rq, thread_t *t, bool head)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
     DEBUG_ASSERT(t->state == THREAD_READY);
     DEBUG_ASSERT(!list_in_list(&t->queue_node));
     DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(spin_lock_held(&rq->lock));
+
+    /* a thread moved between queues keeps its original ready time */
+    if (t->last_ready_time == 0)
+        t->last_ready_time = current_time();
+
+    if (head)
+        list_add_head(&rq->list[t->priority], &t->queue_node);
+    else
+        list_add_tail(&rq->list[t->priority], &t->queue_node);
+    rq->bitmap |= (1u << t->priority);
+    rq->count++;
+}
+
+static void insert_in_run_queue_head(uint cpu, thread_t *t)
+{
+    DEBUG_ASSERT(cpu < SMP_MAX_CPUS);
 
-    list_add_head(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    struct run_queue *rq = &run_queues[cpu];
+    spin_lock(&rq->lock);
+    run_queue_insert_locked(rq, t, true);
+    spin_unlock(&rq->lock);
 }
 
-static void insert_in_run_queue_tail(thread_t *t)
+static void insert_in_run_queue_tail(uint cpu, thread_t *t)
 {
-    DEBUG_ASSERT(t->magic == THREAD_MAGIC);
-    DEBUG_ASSERT(t->state == THREAD_READY);
-    DEBUG_ASSERT(!list_in_list(&t->queue_node));
-    DEBUG_ASSERT(arch_ints_disabled());
-    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+    DEBUG_ASSERT(cpu < SMP_MAX_CPUS);
 
-    list_add_tail(&run_queue[t->priority], &t->queue_node);
-    run_queue_bitmap |= (1<<t->priority);
+    struct run_queue *rq = &run_queues[cpu];
+    spin_lock(&rq->lock);
+    run_queue_insert_locked(rq, t, false);
+    spin_unlock(&rq->lock);
 }
 
-thread_t *sched_get_top_thread(uint cpu)
+static void remove_from_run_queue(struct run_queue *rq, thread_t *t)
 {
-    thread_t *newthread;
-    uint32_t local_run_queue_bitmap = run_queue_bitmap;
+    DEBUG_ASSERT(spin_lock_held(&rq->lock));
+    DEBUG_ASSERT(list_in_list(&t->queue_node));
+    DEBUG_ASSERT(rq->count > 0);
 
-    while (local_run_queue_bitmap) {
-        /* find the first (remaining) queue with a thread in it */
-        uint next_queue = HIGHEST_PRIORITY - __builtin_clz(local_run_queue_bitmap)
-                          - (sizeof(run_queue_bitmap) * CHAR_BIT - NUM_PRIORITIES);
+    list_delete(&t->queue_node);
+    rq->count--;
 
-        list_for_every_entry(&run_queue[next_queue], newthread, thread_t, queue_node) {
-#if WITH_SMP
-            if (likely(newthread->pinned_cpu < 0) || (uint)newthread->pinned_cpu == cpu)
-#endif
-            {
-                list_delete(&newthread->queue_node);
+    if (rq->handoff == t) {
+        rq->handoff = NULL;
+        rq->handoff_from = NULL;
+    }
 
-                if (list_is_empty(&run_queue[next_queue]))
-                    run_queue_bitmap &= ~(1<<next_queue);
+    if (list_is_empty(&rq->list[t->priority]))
+        rq->bitmap &= ~(1u << t->priority);
+}
 
-                return newthread;
+/* find the highest priority thread on |rq| that is allowed to run on |cpu|.
+ * the caller holds |rq|'s lock.
+ * if |from_tail| is set, prefer the thread that most recently went on the queue
+ * at each priority, which is the least likely to have warm caches anywhere. */
+static thread_t *run_queue_find(struct run_queue *rq, uint cpu, bool from_tail)
+{
+    uint32_t local_bitmap = rq->bitmap;
+
+    while (local_bitmap) {
+        /* find the first (remaining) queue with a thread in it */
+        uint next_queue = run_queue_highest_priority(local_bitmap);
+
+        thread_t *t;
+        if (from_tail) {
+            for (t = list_peek_tail_type(&rq->list[next_queue], thread_t, queue_node); t;
+                 t = list_prev_type(&rq->list[next_queue], &t->queue_node, thread_t, queue_node)) {
+                if (thread_can_run_on(t, cpu))
+                    return t;
+            }
+        } else {
+            list_for_every_entry(&rq->list[next_queue], t, thread_t, queue_node) {
+                if (thread_can_run_on(t, cpu))
+                    return t;
             }
         }
 
-        local_run_queue_bitmap &= ~(1<<next_queue);
+        local_bitmap &= ~(1u << next_queue);
     }
+
+    return NULL;
+}
+
+#if WITH_SMP
+/* called by a cpu whose own queue is empty: take the best runnable thread
+ * queued on any other cpu. the victims are locked one at a time, so the
+ * best one found is looked up again once it is locked */
+static thread_t *steal_thread(uint cpu)
+{
+    struct run_queue *best_rq = NULL;
+    int best_priority = -1;
+
+    for (uint i = 1; i < SMP_MAX_CPUS; i++) {
+        uint victim = (cpu + i) % SMP_MAX_CPUS;
+        struct run_queue *rq = &run_queues[victim];
+
+        /* unlocked peek, only to skip queues that cannot beat what we
+         * already found */
+        uint32_t bitmap = rq->bitmap;
+        if (bitmap == 0 || (int)run_queue_highest_priority(bitmap) <= best_priority)
+            continue;
+
+        spin_lock(&rq->lock);
+        thread_t *t = run_queue_find(rq, cpu, true);
+        if (t && t->priority > best_priority) {
+            best_priority = t->priority;
+            best_rq = rq;
+        }
+        spin_unlock(&rq->lock);
+    }
+
+    if (!best_rq)
+        return NULL;
+
+    spin_lock(&best_rq->lock);
+    thread_t *t = run_queue_find(best_rq, cpu, true);
+    if (t) {
+        remove_from_run_queue(best_rq, t);
+        THREAD_STATS_INC(steals);
+    }
+    spin_unlock(&best_rq->lock);
+
+    return t;
+}
+#endif
+
+thread_t *sched_get_top_thread(uint cpu)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    struct run_queue *rq = &run_queues[cpu];
+
+    spin_lock(&rq->lock);
+    thread_t *newthread = run_queue_find(rq, cpu, false);
+    if (newthread)
+        remove_from_run_queue(rq, newthread);
+    spin_unlock(&rq->lock);
+    if (newthread)
+        return newthread;
+
+#if WITH_SMP
+    /* nothing local to run, see if anyone else has surplus work */
+    newthread = steal_thread(cpu);
+    if (newthread)
+        return newthread;
+#endif
+
     /* no threads to run, select the idle thread for this cpu */
     return &idle_threads[cpu];
 }
@@ -166,6 +346,68 @@ void sched_block(void)
     thread_resched();
 }
 
+/* put a newly readied thread on a run queue and kick the cpu that should pick it up */
+static void sched_insert_ready(thread_t *t, bool resched)
+{
+    t->state = THREAD_READY;
+
+    /* a waker armed for a handoff to this thread queues it at the head of the
+     * local queue without a cross-cpu kick, and remembers it as the cpu's
+     * handoff candidate. the time slice only moves in sched_handoff(), once
+     * the waker has dropped its locks */
+    thread_t *current_thread = get_current_thread();
+    if (unlikely(current_thread->handoff_armed) && t != current_thread &&
+        (!current_thread->handoff_target || current_thread->handoff_target == t) &&
+        !arch_in_int_handler()) {
+        uint cpu = arch_curr_cpu_num();
+        struct run_queue *rq = &run_queues[cpu];
+
+        current_thread->handoff_armed = false;
+        current_thread->handoff_target = NULL;
+        if (thread_can_run_on(t, cpu)) {
+            spin_lock(&rq->lock);
+            bool queued = !rq->handoff;
+            if (queued) {
+                run_queue_insert_locked(rq, t, true);
+                rq->handoff = t;
+                rq->handoff_from = current_thread;
+                current_thread->handoff_queued = true;
+            }
+            spin_unlock(&rq->lock);
+            if (queued)
+                return;
+        }
+    }
+
+    /* if the caller is about to reschedule this cpu, queue the thread locally
+     * so it gets a chance to run right away, unless it is pinned elsewhere */
+    if (resched && thread_can_run_on(t, arch_curr_cpu_num())) {
+        insert_in_run_queue_head(arch_curr_cpu_num(), t);
+        return;
+    }
+
+    mp_cpu_mask_t reschedule_mask;
+    uint cpu = find_run_queue(t, &reschedule_mask);
+    insert_in_run_queue_head(cpu, t);
+
+    mp_reschedule(reschedule_mask, 0);
+}
+
+/* put the current thread back on this cpu's queue, unless it is pinned to
+ * another cpu, in which case it goes on that cpu's queue instead */
+static void requeue_current_thread(thread_t *current_thread, bool head)
+{
+    uint cpu = arch_curr_cpu_num();
+
+    current_thread->state = THREAD_READY;
+    if (unlikely(!thread_can_run_on(current_thread, cpu)))
+        sched_insert_ready(current_thread, false);
+    else if (head)
+        insert_in_run_queue_head(cpu, current_thread);
+    else
+        insert_in_run_queue_tail(cpu, current_thread);
+}
+
 void sched_unblock(thread_t *t, bool resched)
 {
     DEBUG_ASSERT(t->magic == THREAD_MAGIC);
@@ -175,18 +417,11 @@ void sched_unblock(thread_t *t, bool resched)
      * of the run queue first, so that the newly awakened thread gets a chance to run
      * before the current one, but the current one doesn't get unnecessarilly punished.
      */
-    if (resched) {
-        thread_t *current_thread = get_current_thread();
-
-        current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
-    }
+    if (resched)
+        requeue_current_thread(get_current_thread(), true);
 
     /* stuff the new thread in the run queue */
-    t->state = THREAD_READY;
-    insert_in_run_queue_head(t);
-
-    mp_reschedule(find_cpu(t), 0);
+    sched_insert_ready(t, resched);
 
     if (resched)
         thread_resched();
@@ -201,12 +436,8 @@ void sched_unblock_list(struct list_node *list, bool resched)
      * of the run queue first, so that the newly awakened thread gets a chance to run
      * before the current one, but the current one doesn't get unnecessarilly punished.
      */
-    if (resched) {
-        thread_t *current_thread = get_current_thread();
-
-        current_thread->state = THREAD_READY;
-        insert_in_run_queue_head(current_thread);
-    }
+    if (resched)
+        requeue_current_thread(get_current_thread(), true);
 
     /* pop the list of threads and shove into the scheduler */
     thread_t *t;
@@ -215,10 +446,7 @@ void sched_unblock_list(struct list_node *list, bool resched)
         DEBUG_ASSERT(!thread_is_idle(t));
 
         /* stuff the new thread in the run queue */
-        t->state = THREAD_READY;
-        insert_in_run_queue_head(t);
-
-        mp_reschedule(find_cpu(t), 0);
+        sched_insert_ready(t, false);
     }
 
     if (resched)
@@ -234,7 +462,7 @@ void sched_yield(void)
     current_thread->state = THREAD_READY;
     current_thread->remaining_time_slice = 0;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
-        insert_in_run_queue_tail(current_thread);
+        requeue_current_thread(current_thread, false);
     }
     thread_resched();
 }
@@ -242,22 +470,198 @@ void sched_yield(void)
 void sched_preempt(void)
 {
     thread_t *current_thread = get_current_thread();
+    uint cpu = arch_curr_cpu_num();
 
     /* we are being preempted, so we get to go back into the front of the run queue if we have quantum left */
     current_thread->state = THREAD_READY;
     if (likely(!thread_is_idle(current_thread))) { /* idle thread doesn't go in the run queue */
-        if (current_thread->remaining_time_slice > 0)
-            insert_in_run_queue_head(current_thread);
-        else
-            insert_in_run_queue_tail(current_thread); /* if we're out of quantum, go to the tail of the queue */
+        /* a thread pinned to another cpu (e.g. after changing its own pinning) migrates now */
+        if (unlikely(!thread_can_run_on(current_thread, cpu))) {
+            sched_insert_ready(current_thread, false);
+        } else if (current_thread->remaining_time_slice > 0) {
+            insert_in_run_queue_head(cpu, current_thread);
+        } else {
+            insert_in_run_queue_tail(cpu, current_thread); /* if we're out of quantum, go to the tail of the queue */
+        }
     }
     sched_block();
 }
 
+/* give the handoff candidate queued by the current thread the rest of the
+ * current time slice, so the next block or preempt switches to it */
+bool sched_handoff(void)
+{
+    DEBUG_ASSERT(spin_lock_held(&thread_lock));
+
+    thread_t *current_thread = get_current_thread();
+    struct run_queue *rq = &run_queues[arch_curr_cpu_num()];
+
+    /* the candidate may already have run or been stolen, and the waker may
+     * have migrated since it armed the handoff. holding the queue lock keeps
+     * it from being taken while its time slice is set */
+    spin_lock(&rq->lock);
+    thread_t *t = rq->handoff;
+    if (!t || rq->handoff_from != current_thread) {
+        spin_unlock(&rq->lock);
+        return false;
+    }
+
+    DEBUG_ASSERT(t->state == THREAD_READY);
+    rq->handoff = NULL;
+    rq->handoff_from = NULL;
+
+    t->remaining_time_slice = current_thread->remaining_time_slice;
+    current_thread->remaining_time_slice = 0;
+    spin_unlock(&rq->lock);
+
+    THREAD_STATS_INC(handoffs);
+    return true;
+}
+
+#if WITH_SMP
+/* pull surplus threads from the busiest cpu onto this one. only the two run
+ * queue locks are taken, and only if they are free: balancing is
+ * opportunistic and runs from the preemption tick */
+static uint sched_balance(uint cpu)
+{
+    struct run_queue *rq = &run_queues[cpu];
+    uint busiest_cpu = SMP_MAX_CPUS;
+    bool inactive = false;
+
+    /* unlocked peek at the queue lengths to pick a victim */
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (i == cpu || run_queues[i].count == 0)
+            continue;
+        /* a cpu that went inactive never looks at its queue again, so take
+         * everything it left behind that is allowed to run here */
+        if (!mp_is_cpu_active(i)) {
+            busiest_cpu = i;
+            inactive = true;
+            break;
+        }
+        if (busiest_cpu == SMP_MAX_CPUS || run_queues[i].count > run_queues[busiest_cpu].count)
+            busiest_cpu = i;
+    }
+
+    if (busiest_cpu == SMP_MAX_CPUS)
+        return 0;
+
+    struct run_queue *busiest = &run_queues[busiest_cpu];
+    struct run_queue *first = (busiest_cpu < cpu) ? busiest : rq;
+    struct run_queue *second = (busiest_cpu < cpu) ? rq : busiest;
+    if (spin_trylock(&first->lock))
+        return 0;
+    if (spin_trylock(&second->lock)) {
+        spin_unlock(&first->lock);
+        return 0;
+    }
+
+    uint to_move;
+    if (inactive) {
+        to_move = busiest->count;
+    } else if (busiest->count < rq->count + SCHED_BALANCE_MIN_IMBALANCE) {
+        to_move = 0;
+    } else {
+        /* move half of the difference, taking from the tail of each priority so
+         * the threads that would run next on the busy cpu stay there */
+        to_move = (busiest->count - rq->count) / 2;
+    }
+
+    uint moved = 0;
+    while (moved < to_move) {
+        thread_t *t = run_queue_find(busiest, cpu, true);
+        if (!t)
+            break;
+
+        remove_from_run_queue(busiest, t);
+        run_queue_insert_locked(rq, t, false);
+        moved++;
+    }
+
+    spin_unlock(&second->lock);
+    spin_unlock(&first->lock);
+
+    return moved;
+}
+#endif
+
+/* move the threads queued on a cpu that has gone inactive onto the remaining
+ * cpus. threads pinned to it stay queued until it comes back */
+void sched_transition_off_cpu(uint old_cpu)
+{
+#if WITH_SMP
+    DEBUG_ASSERT(old_cpu < SMP_MAX_CPUS);
+    DEBUG_ASSERT(!mp_is_cpu_active(old_cpu));
+
+    THREAD_LOCK(state);
+
+    /* unhook the threads first, so that only one queue lock is held at a
+     * time; the thread lock keeps find_run_queue() consistent */
+    struct run_queue *rq = &run_queues[old_cpu];
+    struct list_node moving = LIST_INITIAL_VALUE(moving);
+    spin_lock(&rq->lock);
+    for (int pri = HIGHEST_PRIORITY; pri >= LOWEST_PRIORITY; pri--) {
+        thread_t *t;
+        thread_t *temp;
+        list_for_every_entry_safe(&rq->list[pri], t, temp, thread_t, queue_node) {
+            if (thread_pinned_cpu(t) == (int)old_cpu)
+                continue;
+
+            remove_from_run_queue(rq, t);
+            list_add_tail(&moving, &t->queue_node);
+        }
+    }
+    spin_unlock(&rq->lock);
+
+    mp_cpu_mask_t reschedule_mask = 0;
+    thread_t *t;
+    while ((t = list_remove_head_type(&moving, thread_t, queue_node))) {
+        mp_cpu_mask_t mask;
+        uint cpu = find_run_queue(t, &mask);
+        insert_in_run_queue_tail(cpu, t);
+        reschedule_mask |= mask;
+    }
+
+    THREAD_UNLOCK(state);
+
+    if (reschedule_mask)
+        mp_reschedule(reschedule_mask, 0);
+#endif
+}
+
+void sched_tick(void)
+{
+#if WITH_SMP
+    uint cpu = arch_curr_cpu_num();
+    struct run_queue *rq = &run_queues[cpu];
+
+    DEBUG_ASSERT(arch_ints_disabled());
+
+    if (rq->balance_countdown > 0) {
+        rq->balance_countdown--;
+        return;
+    }
+    rq->balance_countdown = SCHED_BALANCE_INTERVAL_TICKS;
+
+    /* balancing only needs the run queue locks, so the tick never contends
+     * on the thread lock */
+    uint moved = sched_balance(cpu);
+    if (moved > 0)
+        THREAD_STATS_INC(balance_migrations);
+#endif
+}
+
 void sched_init_early(void)
 {
     /* initialize the run queues */
-    for (int i=0; i < NUM_PRIORITIES; i++)
-        list_initialize(&run_queue[i]);
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        spin_lock_init(&run_queues[cpu].lock);
+        for (int i = 0; i < NUM_PRIORITIES; i++)
+            list_initialize(&run_queues[cpu].list[i]);
+        run_queues[cpu].bitmap = 0;
+        run_queues[cpu].count = 0;
+        run_queues[cpu].balance_countdown = SCHED_BALANCE_INTERVAL_TICKS;
+        run_queues[cpu].handoff = NULL;
+        run_queues[cpu].handoff_from = NULL;
+    }
 }
-
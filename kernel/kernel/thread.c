@@ -152,6 +152,9 @@ thread_t *thread_create_etc(
     t->blocking_wait_queue = NULL;
     t->blocked_status = NO_ERROR;
     t->interruptable = false;
+    t->handoff_armed = false;
+    t->handoff_target = NULL;
+    t->handoff_queued = false;
     thread_set_last_cpu(t, 0);
 
     t->retcode = 0;
@@ -690,13 +693,21 @@ void thread_resched(void)
 
     thread_t *oldthread = current_thread;
 
+    lk_time_t now = current_time();
+
+    /* charge the time the new thread spent waiting on a run queue */
+    if (newthread->last_ready_time != 0) {
+        newthread->wait_ns += now - newthread->last_ready_time;
+        newthread->last_ready_time = 0;
+    }
+
     /* if it's the same thread as we're already running, exit */
     if (newthread == oldthread)
         return;
 
-    lk_time_t now = current_time();
     oldthread->runtime_ns += now - oldthread->last_started_running;
     newthread->last_started_running = now;
+    newthread->context_switches++;
 
     /* set up quantum for the new thread if it was consumed */
     if (newthread->remaining_time_slice == 0) {
@@ -858,6 +869,66 @@ void thread_preempt(bool interrupt)
     THREAD_UNLOCK(state);
 }
 
+/**
+ * @brief Arm a directed handoff for the current thread
+ *
+ * The next wakeup of |target| by the current thread (or of any thread, if
+ * |target| is NULL) places the woken thread at the head of this cpu's run
+ * queue and records it as the cpu's handoff candidate. Nothing is switched
+ * yet; see thread_handoff(). Arm only around the one wakeup meant to be
+ * handed off and disarm right after it.
+ */
+void thread_handoff_arm(thread_t *target)
+{
+    thread_t *current_thread = get_current_thread();
+
+    DEBUG_ASSERT(current_thread->magic == THREAD_MAGIC);
+    DEBUG_ASSERT(!arch_in_int_handler());
+
+    current_thread->handoff_target = target;
+    current_thread->handoff_armed = true;
+}
+
+/**
+ * @brief Cancel a pending directed handoff, if it was not consumed
+ *
+ * @return true if the armed wakeup queued a handoff candidate, in which case
+ * the caller should complete it with thread_handoff().
+ */
+bool thread_handoff_disarm(void)
+{
+    thread_t *current_thread = get_current_thread();
+
+    current_thread->handoff_armed = false;
+    current_thread->handoff_target = NULL;
+
+    bool queued = current_thread->handoff_queued;
+    current_thread->handoff_queued = false;
+    return queued;
+}
+
+/**
+ * @brief Complete a directed handoff
+ *
+ * If a thread woken under thread_handoff_arm() by the current thread is still
+ * waiting at the head of this cpu's run queue, it is given the remainder of
+ * the current time slice, so that the caller's next block or preempt switches
+ * straight to it. Call once per operation, after dropping any locks the
+ * candidate is likely to need.
+ *
+ * @return true if the slice was handed off.
+ */
+bool thread_handoff(void)
+{
+    THREAD_LOCK(state);
+
+    bool handed_off = sched_handoff();
+
+    THREAD_UNLOCK(state);
+
+    return handed_off;
+}
+
 enum handler_return thread_timer_tick(void)
 {
     thread_t *current_thread = get_current_thread();
@@ -865,6 +936,8 @@ enum handler_return thread_timer_tick(void)
     if (thread_is_real_time_or_idle(current_thread))
         return INT_NO_RESCHEDULE;
 
+    sched_tick();
+
     current_thread->remaining_time_slice -= MIN(THREAD_TICK_RATE, current_thread->remaining_time_slice);
 
     ktrace_probe2("timer_tick", (uint32_t)current_thread->user_tid, current_thread->remaining_time_slice);
@@ -993,6 +1066,31 @@ lk_time_t thread_runtime(const thread_t *t)
     return runtime;
 }
 
+/**
+ * @brief Return the scheduling statistics of a thread.
+ *
+ * Like thread_runtime(), the run or wait in progress is included, and the
+ * thread_lock is held so the counters are consistent with each other.
+ */
+void thread_get_sched_stats(const thread_t *t, thread_sched_stats_t *stats)
+{
+    THREAD_LOCK(state);
+
+    lk_time_t now = current_time();
+    stats->runtime = t->runtime_ns;
+    if (t->state == THREAD_RUNNING) {
+        stats->runtime += now - t->last_started_running;
+    }
+    stats->wait_time = t->wait_ns;
+    if (t->last_ready_time != 0) {
+        stats->wait_time += now - t->last_ready_time;
+    }
+    stats->context_switches = t->context_switches;
+    stats->last_cpu = thread_last_cpu(t);
+
+    THREAD_UNLOCK(state);
+}
+
 /**
  * @brief Construct a thread t around the current running state
  *
@@ -1242,6 +1340,8 @@ void dump_thread(thread_t *t, bool full_dump)
 #endif
         dprintf(INFO, "\truntime_ns %" PRIu64 ", runtime_s %" PRIu64 "\n",
                 runtime, runtime / 1000000000);
+        dprintf(INFO, "\twait_ns %" PRIu64 ", context_switches %" PRIu64 "\n",
+                t->wait_ns, t->context_switches);
         dprintf(INFO, "\tstack %p, stack_size %zu\n", t->stack, t->stack_size);
         dprintf(INFO, "\tentry %p, arg %p, flags 0x%x %s%s%s%s%s%s\n", t->entry, t->arg, t->flags,
                 (t->flags & THREAD_FLAG_DETACHED) ? "Dt" :"",
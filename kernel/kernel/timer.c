@@ -17,6 +17,10 @@
  *
  * Timer callback functions are called in interrupt context.
  *
+ * Pending timers are kept in a per-cpu pairing heap ordered by deadline, so
+ * arming a timer is O(1) and cancelling or expiring one is O(log n) amortized
+ * regardless of how many deadlines are outstanding.
+ *
  * @{
  */
 #include <assert.h>
@@ -36,7 +40,7 @@
 spin_lock_t timer_lock;
 
 struct timer_state {
-    struct list_node timer_queue;
+    timer_t *heap_root; // earliest pending timer, NULL if none
 } __CPU_ALIGN;
 
 static struct timer_state timers[SMP_MAX_CPUS];
@@ -51,23 +55,115 @@ void timer_initialize(timer_t *timer)
     *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
-static void insert_timer_in_queue(uint cpu, timer_t *timer)
+/* combine two detached heaps, the later root becomes the leftmost child of the earlier one */
+static timer_t *heap_meld(timer_t *a, timer_t *b)
 {
-    timer_t *entry;
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+
+    if (TIME_LT(b->scheduled_time, a->scheduled_time)) {
+        timer_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    b->heap_prev = a;
+    b->heap_next = a->heap_child;
+    if (a->heap_child)
+        a->heap_child->heap_prev = b;
+    a->heap_child = b;
+
+    a->heap_next = NULL;
+    a->heap_prev = NULL;
+
+    return a;
+}
+
+/* standard two pass merge of a sibling list into a single heap. done iteratively
+ * since the list can be as long as the number of pending timers */
+static timer_t *heap_merge_pairs(timer_t *first)
+{
+    timer_t *pairs = NULL;
+
+    /* meld siblings pairwise left to right, stacking the results through heap_next */
+    while (first) {
+        timer_t *a = first;
+        timer_t *b = a->heap_next;
+
+        a->heap_next = NULL;
+        a->heap_prev = NULL;
+        if (b) {
+            first = b->heap_next;
+            b->heap_next = NULL;
+            b->heap_prev = NULL;
+            a = heap_meld(a, b);
+        } else {
+            first = NULL;
+        }
+
+        a->heap_next = pairs;
+        pairs = a;
+    }
+
+    /* meld the pairs back together right to left */
+    timer_t *root = NULL;
+    while (pairs) {
+        timer_t *next = pairs->heap_next;
+        pairs->heap_next = NULL;
+        root = heap_meld(root, pairs);
+        pairs = next;
+    }
 
+    return root;
+}
+
+static inline timer_t *peek_timer_queue(uint cpu)
+{
+    return timers[cpu].heap_root;
+}
+
+static void insert_timer_in_queue(uint cpu, timer_t *timer)
+{
     DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(timer->queue_cpu < 0);
 
     LTRACEF("timer %p, cpu %u, scheduled %" PRIu64 ", periodic %" PRIu64 "\n", timer, cpu, timer->scheduled_time, timer->period);
 
-    list_for_every_entry(&timers[cpu].timer_queue, entry, timer_t, node) {
-        if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-            list_add_before(&entry->node, &timer->node);
-            return;
-        }
+    timer->heap_child = NULL;
+    timer->heap_next = NULL;
+    timer->heap_prev = NULL;
+    timer->queue_cpu = cpu;
+
+    timers[cpu].heap_root = heap_meld(timers[cpu].heap_root, timer);
+}
+
+static void remove_timer_from_queue(timer_t *timer)
+{
+    DEBUG_ASSERT(arch_ints_disabled());
+    DEBUG_ASSERT(timer->queue_cpu >= 0);
+
+    struct timer_state *ts = &timers[timer->queue_cpu];
+
+    if (ts->heap_root == timer) {
+        ts->heap_root = heap_merge_pairs(timer->heap_child);
+    } else {
+        /* unlink from the parent or left sibling, then fold the children back in */
+        if (timer->heap_prev->heap_child == timer)
+            timer->heap_prev->heap_child = timer->heap_next;
+        else
+            timer->heap_prev->heap_next = timer->heap_next;
+        if (timer->heap_next)
+            timer->heap_next->heap_prev = timer->heap_prev;
+
+        ts->heap_root = heap_meld(ts->heap_root, heap_merge_pairs(timer->heap_child));
     }
 
-    /* walked off the end of the list */
-    list_add_tail(&timers[cpu].timer_queue, &timer->node);
+    timer->heap_child = NULL;
+    timer->heap_next = NULL;
+    timer->heap_prev = NULL;
+    timer->queue_cpu = -1;
 }
 
 static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, timer_callback callback, void *arg)
@@ -76,8 +172,8 @@ static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, time
 
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
-    if (list_in_list(&timer->node)) {
-        panic("timer %p already in list\n", timer);
+    if (timer->queue_cpu >= 0) {
+        panic("timer %p already in queue\n", timer);
     }
 
     spin_lock_saved_state_t state;
@@ -106,7 +202,7 @@ static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t period, time
     insert_timer_in_queue(cpu, timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    if (list_peek_head_type(&timers[cpu].timer_queue, timer_t, node) == timer) {
+    if (peek_timer_queue(cpu) == timer) {
         /* we just modified the head of the timer queue */
         LTRACEF("setting new timer for %" PRIu64 " nsecs\n", deadline);
         platform_set_oneshot_timer(timer_tick, NULL, deadline);
@@ -189,18 +285,18 @@ void timer_cancel(timer_t *timer)
     }
 
     /* if the timer is in a queue, remove it and adjust hardware timers if needed */
-    if (list_in_list(&timer->node)) {
+    if (timer->queue_cpu >= 0) {
 #if PLATFORM_HAS_DYNAMIC_TIMER
-        timer_t *oldhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer_t *oldhead = peek_timer_queue(cpu);
 #endif
 
         /* remove it from the queue */
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
         /* see if we've just modified the head of this cpu's timer queue */
         /* if we modified another cpu's queue, we'll just let it fire and sort itself out */
-        timer_t *newhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer_t *newhead = peek_timer_queue(cpu);
         if (newhead == NULL) {
             LTRACEF("clearing old hw timer, nothing in the queue\n");
             platform_stop_timer();
@@ -242,7 +338,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
     for (;;) {
         /* see if there's an event to process */
-        timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer = peek_timer_queue(cpu);
         if (likely(timer == 0))
             break;
         LTRACEF("next item on timer queue %p at %" PRIu64 " now %" PRIu64 " (%p, arg %p)\n", timer, timer->scheduled_time, now, timer->callback, timer->arg);
@@ -254,13 +350,13 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
         DEBUG_ASSERT_MSG(timer && timer->magic == TIMER_MAGIC,
                 "ASSERT: timer failed magic check: timer %p, magic 0x%x\n",
                 timer, (uint)timer->magic);
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
         /* mark the timer busy */
         timer->active_cpu = cpu;
         /* spinlock below acts as a memory barrier */
 
-        /* we pulled it off the list, release the list lock to handle it */
+        /* we pulled it off the queue, release the queue lock to handle it */
         spin_unlock(&timer_lock);
 
         LTRACEF("dequeued timer %p, scheduled %" PRIu64 " periodic %" PRIu64 "\n", timer, timer->scheduled_time, timer->period);
@@ -288,9 +384,9 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
         /* if we've been cancelled, it's not okay to touch the timer structure from now on out */
         if (!cancelled) {
             /* if it is a periodic timer and it hasn't been requeued
-             * by the callback put it back in the list
+             * by the callback put it back in the queue
              */
-            if (timer->period > 0 && !list_in_list(&timer->node)) {
+            if (timer->period > 0 && timer->queue_cpu < 0) {
                 LTRACEF("periodic timer, period %" PRIu64 "\n", timer->period);
                 timer->scheduled_time = now + timer->period;
                 insert_timer_in_queue(cpu, timer);
@@ -300,7 +396,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
     /* reset the timer to the next event */
-    timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer = peek_timer_queue(cpu);
     if (timer) {
         /* has to be the case or it would have fired already */
         DEBUG_ASSERT(TIME_GT(timer->scheduled_time, now));
@@ -349,17 +445,20 @@ void timer_transition_off_cpu(uint old_cpu)
     spin_lock_irqsave(&timer_lock, state);
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *old_head = list_peek_head_type(&timers[old_cpu].timer_queue, timer_t, node);
+    /* Remember this cpu's own earliest timer, which the hardware timer is
+     * already programmed for. If one of the migrated timers is earlier, it
+     * becomes the new head and the hardware timer has to be reprogrammed. */
+    timer_t *old_head = peek_timer_queue(cpu);
 
-    timer_t *entry = NULL, *tmp_entry = NULL;
     /* Move all timers from old_cpu to this cpu */
-    list_for_every_entry_safe(&timers[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
+    timer_t *entry;
+    while ((entry = peek_timer_queue(old_cpu)) != NULL) {
+        remove_timer_from_queue(entry);
         insert_timer_in_queue(cpu, entry);
     }
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    timer_t *new_head = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer_t *new_head = peek_timer_queue(cpu);
     if (new_head != NULL && new_head != old_head) {
         /* we just modified the head of the timer queue */
         LTRACEF("setting new timer for %" PRIu64 " nsecs\n", new_head->scheduled_time);
@@ -380,7 +479,7 @@ void timer_thaw_percpu(void)
 
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *t = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer_t *t = peek_timer_queue(cpu);
     if (t) {
         LTRACEF("rescheduling timer for %" PRIu64 " nsecs\n", t->scheduled_time);
         platform_set_oneshot_timer(timer_tick, NULL, t->scheduled_time);
@@ -394,7 +493,7 @@ void timer_init(void)
 {
     timer_lock = SPIN_LOCK_INITIAL_VALUE;
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&timers[i].timer_queue);
+        timers[i].heap_root = NULL;
     }
 #if !PLATFORM_HAS_DYNAMIC_TIMER
     /* register for a periodic timer tick */
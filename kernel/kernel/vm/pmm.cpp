@@ -10,8 +10,12 @@
 #include <err.h>
 #include <inttypes.h>
 #include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
+#include <kernel/event.h>
 #include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/vm.h>
 #include <lib/console.h>
@@ -35,6 +39,57 @@ static Mutex arena_lock;
 static mxtl::DoublyLinkedList<PmmArena*> arena_list TA_GUARDED(arena_lock);
 static size_t arena_cumulative_size TA_GUARDED(arena_lock);
 
+static size_t pmm_count_free_pages_locked() TA_REQ(arena_lock);
+
+// Sparse table of which arena covers each physical address section, so that
+// paddr_to_vm_page() doesn't have to walk the arena list. An entry is 0 if no
+// arena overlaps the section, PMM_SECTION_SHARED if several do, and otherwise
+// one more than the arena's index in indexed_arenas. Addresses above the table
+// and shared sections fall back to walking the list. Both tables are only
+// written while adding arenas during early boot.
+#define PMM_SECTION_SHIFT 28 // 256MB sections
+#define PMM_SECTION_COUNT 4096 // covers the first 1TB of the physical address space
+#define PMM_SECTION_SHARED 0xff
+#define PMM_MAX_INDEXED_ARENAS (PMM_SECTION_SHARED - 1)
+
+static uint8_t arena_sections[PMM_SECTION_COUNT];
+static PmmArena* indexed_arenas[PMM_MAX_INDEXED_ARENAS];
+static size_t indexed_arena_count;
+
+// Per cpu caches of free pages that sit in front of the arenas, so that the
+// common single page alloc/free paths only touch a cpu local spinlock. Pages
+// are moved between a cache and the arenas in batches under arena_lock.
+// Cached pages are in the ALLOC state as far as the arenas are concerned.
+#define PMM_PCPU_CACHE_MAX 64
+#define PMM_PCPU_CACHE_BATCH 32
+static_assert(PMM_PCPU_CACHE_BATCH <= PMM_PCPU_CACHE_MAX, "");
+
+struct pmm_pcpu_cache {
+    spin_lock_t lock;
+    list_node free_list;
+    size_t count;
+
+    // statistics, only modified with the lock held
+    uint64_t alloc_hits;
+    uint64_t alloc_misses;
+    uint64_t free_hits;
+    uint64_t refills;
+    uint64_t drains;
+} __CPU_ALIGN;
+
+static pmm_pcpu_cache pcpu_cache[SMP_MAX_CPUS];
+static bool pcpu_cache_enabled;
+
+static void pmm_pcpu_cache_init(uint level) {
+    for (auto& c : pcpu_cache) {
+        spin_lock_init(&c.lock);
+        list_initialize(&c.free_list);
+    }
+    smp_mb();
+    pcpu_cache_enabled = true;
+}
+LK_INIT_HOOK(pmm_pcpu_cache, &pmm_pcpu_cache_init, LK_INIT_LEVEL_VM);
+
 #if PMM_ENABLE_FREE_FILL
 static void pmm_enforce_fill(uint level) {
     for (auto& a : arena_list) {
@@ -44,30 +99,54 @@ static void pmm_enforce_fill(uint level) {
 LK_INIT_HOOK(pmm_fill, &pmm_enforce_fill, LK_INIT_LEVEL_VM);
 #endif
 
-// We don't need to hold the arena lock while executing this, since it is
-// only accesses values that are set once during system initialization.
-paddr_t vm_page_to_paddr(const vm_page_t* page) TA_NO_THREAD_SAFETY_ANALYSIS {
-    for (const auto& a : arena_list) {
-        // LTRACEF("testing page %p against arena %p\n", page, &a);
-        if (a.page_belongs_to_arena(page)) {
-            return a.page_address_from_arena(page);
-        }
+static void pmm_index_arena(PmmArena* arena) {
+    uint8_t entry = PMM_SECTION_SHARED;
+    if (indexed_arena_count < PMM_MAX_INDEXED_ARENAS) {
+        indexed_arenas[indexed_arena_count] = arena;
+        entry = static_cast<uint8_t>(++indexed_arena_count);
+    }
+
+    const size_t first = arena->base() >> PMM_SECTION_SHIFT;
+    const size_t last = (arena->base() + arena->size() - 1) >> PMM_SECTION_SHIFT;
+    for (size_t i = first; i <= last && i < PMM_SECTION_COUNT; i++) {
+        arena_sections[i] = (arena_sections[i] == 0) ? entry : PMM_SECTION_SHARED;
     }
-    return -1;
 }
 
 // We don't need to hold the arena lock while executing this, since it is
 // only accesses values that are set once during system initialization.
-vm_page_t* paddr_to_vm_page(paddr_t addr) TA_NO_THREAD_SAFETY_ANALYSIS {
-    for (auto& a : arena_list) {
-        if (a.address_in_arena(addr)) {
-            size_t index = (addr - a.base()) / PAGE_SIZE;
-            return a.get_page(index);
+static PmmArena* pmm_find_arena(paddr_t addr) TA_NO_THREAD_SAFETY_ANALYSIS {
+    const size_t section = addr >> PMM_SECTION_SHIFT;
+    if (likely(section < PMM_SECTION_COUNT)) {
+        const uint8_t entry = arena_sections[section];
+        if (entry == 0)
+            return nullptr;
+        if (likely(entry != PMM_SECTION_SHARED)) {
+            PmmArena* a = indexed_arenas[entry - 1];
+            return a->address_in_arena(addr) ? a : nullptr;
         }
     }
+
+    for (auto& a : arena_list) {
+        if (a.address_in_arena(addr))
+            return &a;
+    }
     return nullptr;
 }
 
+paddr_t vm_page_to_paddr(const vm_page_t* page) {
+    return page->paddr;
+}
+
+vm_page_t* paddr_to_vm_page(paddr_t addr) {
+    PmmArena* a = pmm_find_arena(addr);
+    if (!a)
+        return nullptr;
+
+    size_t index = (addr - a->base()) / PAGE_SIZE;
+    return a->get_page(index);
+}
+
 // We disable thread safety analysis here, since this function is only called
 // during early boot before threading exists.
 status_t pmm_add_arena(const pmm_arena_info_t* info) TA_NO_THREAD_SAFETY_ANALYSIS {
@@ -100,45 +179,401 @@ done_add:
     // tell the arena to allocate a page array
     arena->BootAllocArray();
 
+    pmm_index_arena(arena);
+
     arena_cumulative_size += info->size;
 
     return NO_ERROR;
 }
 
-vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
-    AutoLock al(&arena_lock);
+// Only pages from KMAP arenas are cached, so that a cache hit satisfies any
+// set of allocation flags. Arenas are fixed after boot, so no lock is needed.
+static bool page_is_cacheable(const vm_page_t* page) {
+    const PmmArena* a = pmm_find_arena(page->paddr);
+    return a && (a->flags() & PMM_ARENA_FLAG_KMAP) != 0;
+}
 
-    /* walk the arenas in order until we find one with a free page */
-    for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
+#if PMM_ENABLE_FREE_FILL
+// Cached pages are free as far as everyone else is concerned, so they are
+// filled on the way in and checked on the way out like arena free pages.
+static void pmm_pcpu_cache_fill(vm_page_t* page) {
+    pmm_find_arena(page->paddr)->FreeFill(page);
+}
+
+static void pmm_pcpu_cache_check_fill(vm_page_t* page) {
+    pmm_find_arena(page->paddr)->CheckFreeFill(page);
+}
+#endif
+
+// Pop up to |count| pages off the current cpu's cache onto |list|.
+static size_t pmm_pcpu_cache_alloc(size_t count, list_node* list) {
+    if (!pcpu_cache_enabled)
+        return 0;
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    pmm_pcpu_cache& c = pcpu_cache[arch_curr_cpu_num()];
+    spin_lock(&c.lock);
+
+    size_t allocated = 0;
+    while (allocated < count) {
+        vm_page_t* page = list_remove_head_type(&c.free_list, vm_page_t, free.node);
+        if (!page)
+            break;
+        DEBUG_ASSERT(c.count > 0);
+        c.count--;
+#if PMM_ENABLE_FREE_FILL
+        pmm_pcpu_cache_check_fill(page);
+#endif
+        list_add_tail(list, &page->free.node);
+        allocated++;
+    }
+
+    if (allocated > 0) {
+        c.alloc_hits++;
+    } else {
+        c.alloc_misses++;
+    }
+
+    spin_unlock_restore(&c.lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    return allocated;
+}
+
+// Push the pages on |list| onto the current cpu's cache, leaving whatever
+// does not fit on |list|.
+static void pmm_pcpu_cache_free(list_node* list) {
+    if (!pcpu_cache_enabled)
+        return;
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    pmm_pcpu_cache& c = pcpu_cache[arch_curr_cpu_num()];
+    spin_lock(&c.lock);
+
+    vm_page_t* page;
+    vm_page_t* temp;
+    list_for_every_entry_safe (list, page, temp, vm_page_t, free.node) {
+        if (c.count >= PMM_PCPU_CACHE_MAX) {
+            // full, hand a batch back to the arenas along with the rest
+            for (size_t i = 0; i < PMM_PCPU_CACHE_BATCH; i++) {
+                vm_page_t* p = list_remove_tail_type(&c.free_list, vm_page_t, free.node);
+                list_add_tail(list, &p->free.node);
+            }
+            c.count -= PMM_PCPU_CACHE_BATCH;
+            c.drains++;
+            break;
         }
+        DEBUG_ASSERT(!page_is_free(page));
+        if (!page_is_cacheable(page))
+            continue;
 
-        // try to allocate the page out of the arena
-        vm_page_t* page = a.AllocPage(pa);
-        if (page)
-            return page;
+        list_delete(&page->free.node);
+        page->state = VM_PAGE_STATE_ALLOC;
+#if PMM_ENABLE_FREE_FILL
+        pmm_pcpu_cache_fill(page);
+#endif
+        list_add_head(&c.free_list, &page->free.node);
+        c.count++;
+        c.free_hits++;
     }
 
-    LTRACEF("failed to allocate page\n");
-    return nullptr;
+    spin_unlock_restore(&c.lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
 }
 
-size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
-    LTRACEF("count %zu\n", count);
+// Return every cached page to the arenas, used when an allocation that can
+// only be satisfied from the arenas themselves comes up short.
+static void pmm_pcpu_cache_drain_all() TA_REQ(arena_lock) {
+    if (!pcpu_cache_enabled)
+        return;
 
-    /* list must be initialized prior to calling this */
-    DEBUG_ASSERT(list);
+    for (auto& c : pcpu_cache) {
+        list_node list = LIST_INITIAL_VALUE(list);
 
-    if (count == 0)
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&c.lock, state);
+        list_move(&c.free_list, &list);
+        c.count = 0;
+        c.drains++;
+        spin_unlock_irqrestore(&c.lock, state);
+
+        vm_page_t* page;
+        while ((page = list_remove_head_type(&list, vm_page_t, free.node))) {
+            for (auto& a : arena_list) {
+                if (a.FreePage(page) >= 0)
+                    break;
+            }
+        }
+    }
+}
+
+static size_t pmm_pcpu_cached_count() {
+    size_t count = 0;
+    for (const auto& c : pcpu_cache) {
+        count += c.count;
+    }
+    return count;
+}
+
+// Pool of free pages that have already been zeroed by a background thread,
+// used to satisfy PMM_ALLOC_FLAG_ZEROED requests without a synchronous
+// memset. Pooled pages come from KMAP arenas and are in the ALLOC state as far
+// as the arenas are concerned. The pool depth is set with the
+// kernel.pmm-zero-pool-pages command line option, 0 disables it.
+#define PMM_ZERO_POOL_DEFAULT_PAGES 1024
+#define PMM_ZERO_POOL_BATCH 16
+
+static spin_lock_t zero_pool_lock = SPIN_LOCK_INITIAL_VALUE;
+static list_node zero_pool_list = LIST_INITIAL_VALUE(zero_pool_list);
+static size_t zero_pool_count; // only accessed with zero_pool_lock held
+static size_t zero_pool_target;
+static event_t zero_pool_event = EVENT_INITIAL_VALUE(zero_pool_event, false, EVENT_FLAG_AUTOUNSIGNAL);
+
+// statistics
+static uint64_t zero_pool_hits;
+static uint64_t zero_pool_fallbacks;
+static uint64_t zero_pool_background_zeroed;
+
+static void pmm_zero_page(vm_page_t* page) {
+    void* ptr = paddr_to_kvaddr(vm_page_to_paddr(page));
+    DEBUG_ASSERT(ptr);
+
+    arch_zero_page(ptr);
+}
+
+static size_t pmm_zero_pool_count() {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&zero_pool_lock, state);
+    size_t count = zero_pool_count;
+    spin_unlock_irqrestore(&zero_pool_lock, state);
+    return count;
+}
+
+// Pop up to |count| zeroed pages onto |list|, poking the zeroing thread if the
+// pool is getting low.
+static size_t pmm_zero_pool_alloc(size_t count, list_node* list) {
+    if (zero_pool_target == 0)
         return 0;
 
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&zero_pool_lock, state);
+
+    size_t allocated = 0;
+    while (allocated < count) {
+        vm_page_t* page = list_remove_head_type(&zero_pool_list, vm_page_t, free.node);
+        if (!page)
+            break;
+        zero_pool_count--;
+        list_add_tail(list, &page->free.node);
+        allocated++;
+    }
+    zero_pool_hits += allocated;
+    bool low = zero_pool_count < zero_pool_target / 2;
+
+    spin_unlock_irqrestore(&zero_pool_lock, state);
+
+    if (low)
+        event_signal(&zero_pool_event, false);
+
+    return allocated;
+}
+
+// Return every pooled page to the arenas.
+static void pmm_zero_pool_drain() TA_REQ(arena_lock) {
+    list_node list = LIST_INITIAL_VALUE(list);
+
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&zero_pool_lock, state);
+    list_move(&zero_pool_list, &list);
+    zero_pool_count = 0;
+    spin_unlock_irqrestore(&zero_pool_lock, state);
+
+    vm_page_t* page;
+    while ((page = list_remove_head_type(&list, vm_page_t, free.node))) {
+        for (auto& a : arena_list) {
+            if (a.FreePage(page) >= 0)
+                break;
+        }
+    }
+}
+
+static int pmm_zero_pool_thread(void*) {
+    for (;;) {
+        event_wait(&zero_pool_event);
+
+        for (;;) {
+            size_t count = pmm_zero_pool_count();
+            if (count >= zero_pool_target)
+                break;
+
+            list_node list = LIST_INITIAL_VALUE(list);
+            size_t want = MIN(PMM_ZERO_POOL_BATCH, zero_pool_target - count);
+
+            // take dirty pages straight from the arenas, leaving the per cpu
+            // caches alone, and stop growing once memory starts getting tight
+            {
+                AutoLock al(&arena_lock);
+                if (pmm_count_free_pages_locked() < zero_pool_target * 4)
+                    break;
+
+                for (auto& a : arena_list) {
+                    if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+                        continue;
+                    a.AllocPages(want - list_length(&list), &list);
+                    if (list_length(&list) == want)
+                        break;
+                }
+            }
+            if (list_is_empty(&list))
+                break;
+
+            vm_page_t* page;
+            list_for_every_entry (&list, page, vm_page_t, free.node) {
+                pmm_zero_page(page);
+            }
+
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&zero_pool_lock, state);
+            while ((page = list_remove_head_type(&list, vm_page_t, free.node))) {
+                list_add_tail(&zero_pool_list, &page->free.node);
+                zero_pool_count++;
+                zero_pool_background_zeroed++;
+            }
+            spin_unlock_irqrestore(&zero_pool_lock, state);
+        }
+    }
+    return 0;
+}
+
+static void pmm_zero_pool_init(uint level) {
+    zero_pool_target = cmdline_get_uint32("kernel.pmm-zero-pool-pages", PMM_ZERO_POOL_DEFAULT_PAGES);
+    if (zero_pool_target == 0)
+        return;
+
+    // run just above the idle threads so zeroing only soaks up otherwise idle cpu time
+    thread_t* t = thread_create("pmm zero", &pmm_zero_pool_thread, nullptr,
+                                LOWEST_PRIORITY + 1, DEFAULT_STACK_SIZE);
+    if (!t) {
+        zero_pool_target = 0;
+        return;
+    }
+    thread_detach_and_resume(t);
+    event_signal(&zero_pool_event, false);
+}
+LK_INIT_HOOK(pmm_zero_pool, &pmm_zero_pool_init, LK_INIT_LEVEL_THREADING);
+
+static vm_page_t* pmm_alloc_page_dirty(uint alloc_flags, paddr_t* pa) {
+    list_node list = LIST_INITIAL_VALUE(list);
+
+    // fast path, grab a page from this cpu's cache
+    if (pmm_pcpu_cache_alloc(1, &list) == 0) {
+        AutoLock al(&arena_lock);
+
+        // refill the cache with a batch at a time from the KMAP arenas, keeping one
+        // for ourselves
+        if (pcpu_cache_enabled) {
+            for (auto& a : arena_list) {
+                if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+                    continue;
+                a.AllocPages(PMM_PCPU_CACHE_BATCH - list_length(&list), &list);
+                if (list_length(&list) == PMM_PCPU_CACHE_BATCH)
+                    break;
+            }
+        }
+
+        if (list_is_empty(&list)) {
+            /* walk the arenas in order until we find one with a free page */
+            for (auto& a : arena_list) {
+                /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
+                if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
+                    if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+                        continue;
+                }
+
+                // try to allocate the page out of the arena
+                vm_page_t* page = a.AllocPage(pa);
+                if (page)
+                    return page;
+            }
+
+            LTRACEF("failed to allocate page\n");
+            return nullptr;
+        }
+    }
+
+    vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+    DEBUG_ASSERT(page);
+    DEBUG_ASSERT(page->state == VM_PAGE_STATE_ALLOC);
+
+    // stash the rest of a refill batch in the cache
+    if (!list_is_empty(&list)) {
+        spin_lock_saved_state_t state;
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        pmm_pcpu_cache& c = pcpu_cache[arch_curr_cpu_num()];
+        spin_lock(&c.lock);
+
+        vm_page_t* p;
+        while ((p = list_remove_head_type(&list, vm_page_t, free.node))) {
+            list_add_tail(&c.free_list, &p->free.node);
+            c.count++;
+        }
+        c.refills++;
+
+        spin_unlock_restore(&c.lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+    }
+
+    if (pa) {
+        *pa = vm_page_to_paddr(page);
+    }
+
+    LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, vm_page_to_paddr(page));
+
+    return page;
+}
+
+vm_page_t* pmm_alloc_page(uint alloc_flags, paddr_t* pa) {
+    list_node list = LIST_INITIAL_VALUE(list);
+
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        if (pmm_zero_pool_alloc(1, &list) == 1) {
+            vm_page_t* page = list_remove_head_type(&list, vm_page_t, free.node);
+            if (pa)
+                *pa = vm_page_to_paddr(page);
+            return page;
+        }
+    }
+
+    vm_page_t* page = pmm_alloc_page_dirty(alloc_flags, pa);
+    if (!page) {
+        // out of dirty pages, the zero pool is the last resort
+        if (pmm_zero_pool_alloc(1, &list) == 0)
+            return nullptr;
+        page = list_remove_head_type(&list, vm_page_t, free.node);
+        if (pa)
+            *pa = vm_page_to_paddr(page);
+        return page;
+    }
+
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        pmm_zero_page(page);
+        __atomic_fetch_add(&zero_pool_fallbacks, 1u, __ATOMIC_RELAXED);
+    }
+
+    return page;
+}
+
+static size_t pmm_alloc_pages_dirty(size_t count, uint alloc_flags, struct list_node* list) {
+    /* small requests are served out of the per cpu cache where possible */
+    size_t allocated = 0;
+    if (count <= PMM_PCPU_CACHE_BATCH) {
+        allocated = pmm_pcpu_cache_alloc(count, list);
+        if (allocated == count)
+            return allocated;
+    }
+
     AutoLock al(&arena_lock);
 
     /* walk the arenas in order, allocating as many pages as we can from each */
-    size_t allocated = 0;
     for (auto& a : arena_list) {
         DEBUG_ASSERT(count > allocated);
 
@@ -158,6 +593,41 @@ size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
     return allocated;
 }
 
+size_t pmm_alloc_pages(size_t count, uint alloc_flags, struct list_node* list) {
+    LTRACEF("count %zu\n", count);
+
+    /* list must be initialized prior to calling this */
+    DEBUG_ASSERT(list);
+
+    if (count == 0)
+        return 0;
+
+    size_t allocated = 0;
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        allocated = pmm_zero_pool_alloc(count, list);
+        if (allocated == count)
+            return allocated;
+    }
+
+    list_node dirty = LIST_INITIAL_VALUE(dirty);
+    size_t dirty_count = pmm_alloc_pages_dirty(count - allocated, alloc_flags, &dirty);
+    if (allocated + dirty_count < count && !(alloc_flags & PMM_ALLOC_FLAG_ZEROED)) {
+        // out of dirty pages, the zero pool is the last resort
+        allocated += pmm_zero_pool_alloc(count - allocated - dirty_count, list);
+    }
+
+    vm_page_t* page;
+    while ((page = list_remove_head_type(&dirty, vm_page_t, free.node))) {
+        if (alloc_flags & PMM_ALLOC_FLAG_ZEROED)
+            pmm_zero_page(page);
+        list_add_tail(list, &page->free.node);
+    }
+    if ((alloc_flags & PMM_ALLOC_FLAG_ZEROED) && dirty_count > 0)
+        __atomic_fetch_add(&zero_pool_fallbacks, dirty_count, __ATOMIC_RELAXED);
+
+    return allocated + dirty_count;
+}
+
 size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
     LTRACEF("address %#" PRIxPTR ", count %zu\n", address, count);
 
@@ -170,9 +640,17 @@ size_t pmm_alloc_range(paddr_t address, size_t count, struct list_node* list) {
     AutoLock al(&arena_lock);
 
     /* walk through the arenas, looking to see if the physical page belongs to it */
+    bool drained = false;
     for (auto& a : arena_list) {
         while (allocated < count && a.address_in_arena(address)) {
             vm_page_t* page = a.AllocSpecific(address);
+            if (!page && !drained) {
+                /* the page may just be sitting in a per cpu cache or the zero pool */
+                pmm_pcpu_cache_drain_all();
+                pmm_zero_pool_drain();
+                drained = true;
+                page = a.AllocSpecific(address);
+            }
             if (!page)
                 break;
 
@@ -199,24 +677,52 @@ size_t pmm_alloc_contiguous(size_t count, uint alloc_flags, uint8_t alignment_lo
     if (alignment_log2 < PAGE_SIZE_SHIFT)
         alignment_log2 = PAGE_SIZE_SHIFT;
 
-    AutoLock al(&arena_lock);
+    paddr_t run_pa = 0;
+    size_t allocated = 0;
+    {
+        AutoLock al(&arena_lock);
+
+        /* if the first pass fails, return the per cpu caches and the zero pool to
+         * the arenas, since those pages may be breaking up an otherwise free run */
+        for (int pass = 0; pass < 2 && allocated == 0; pass++) {
+            if (pass > 0) {
+                pmm_pcpu_cache_drain_all();
+                pmm_zero_pool_drain();
+            }
 
-    for (auto& a : arena_list) {
-        /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
-        if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
-            if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
-                continue;
+            for (auto& a : arena_list) {
+                /* skip the arena if it's not KMAP and the KMAP only allocation flag was passed */
+                if (alloc_flags & PMM_ALLOC_FLAG_KMAP) {
+                    if ((a.flags() & PMM_ARENA_FLAG_KMAP) == 0)
+                        continue;
+                }
+
+                allocated = a.AllocContiguous(count, alignment_log2, &run_pa, list);
+                if (allocated > 0) {
+                    DEBUG_ASSERT(allocated == count);
+                    break;
+                }
+            }
         }
+    }
 
-        size_t allocated = a.AllocContiguous(count, alignment_log2, pa, list);
-        if (allocated > 0) {
-            DEBUG_ASSERT(allocated == count);
-            return allocated;
+    if (allocated == 0) {
+        LTRACEF("couldn't find run\n");
+        return 0;
+    }
+
+    /* runs never come out of the zero pool, so zero them here outside the lock */
+    if (alloc_flags & PMM_ALLOC_FLAG_ZEROED) {
+        for (size_t i = 0; i < allocated; i++) {
+            void* ptr = paddr_to_kvaddr(run_pa + i * PAGE_SIZE);
+            DEBUG_ASSERT(ptr);
+            arch_zero_page(ptr);
         }
     }
 
-    LTRACEF("couldn't find run\n");
-    return 0;
+    if (pa)
+        *pa = run_pa;
+    return allocated;
 }
 
 /* physically allocate a run from arenas marked as KMAP */
@@ -293,9 +799,15 @@ size_t pmm_free(struct list_node* list) {
 
     DEBUG_ASSERT(list);
 
+    /* whatever fits goes into this cpu's cache, the rest goes back to the arenas */
+    size_t total = list_length(list);
+    pmm_pcpu_cache_free(list);
+    size_t count = total - list_length(list);
+    if (list_is_empty(list))
+        return count;
+
     AutoLock al(&arena_lock);
 
-    uint count = 0;
     while (!list_is_empty(list)) {
         vm_page_t* page = list_remove_head_type(list, vm_page_t, free.node);
 
@@ -310,7 +822,7 @@ size_t pmm_free(struct list_node* list) {
         }
     }
 
-    LTRACEF("returning count %u\n", count);
+    LTRACEF("returning count %zu\n", count);
 
     return count;
 }
@@ -334,11 +846,12 @@ static size_t pmm_count_free_pages_locked() TA_REQ(arena_lock) {
 
 size_t pmm_count_free_pages() {
     AutoLock al(&arena_lock);
-    return pmm_count_free_pages_locked();
+    return pmm_count_free_pages_locked() + pmm_pcpu_cached_count() + pmm_zero_pool_count();
 }
 
 static void pmm_dump_free() TA_REQ(arena_lock) {
-    auto megabytes_free = pmm_count_free_pages_locked() / 256u;
+    auto megabytes_free = (pmm_count_free_pages_locked() + pmm_pcpu_cached_count() +
+                           pmm_zero_pool_count()) / 256u;
     printf(" %zu free MBs\n", megabytes_free);
 }
 
@@ -369,6 +882,36 @@ static void arena_dump(bool is_panic) TA_NO_THREAD_SAFETY_ANALYSIS {
     }
 }
 
+// No lock analysis or locking here, the counters are only informational.
+static void pmm_pcpu_cache_dump() {
+    printf("per cpu page caches: max %d pages, batch %d pages\n",
+           PMM_PCPU_CACHE_MAX, PMM_PCPU_CACHE_BATCH);
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (!mp_is_cpu_online(i))
+            continue;
+
+        const auto& c = pcpu_cache[i];
+        uint64_t allocs = c.alloc_hits + c.alloc_misses;
+        printf("\tcpu %u: cached %zu, alloc hits %" PRIu64 " misses %" PRIu64
+               " (%" PRIu64 "%% hit), frees %" PRIu64 ", refills %" PRIu64 ", drains %" PRIu64 "\n",
+               i, c.count, c.alloc_hits, c.alloc_misses,
+               allocs ? (c.alloc_hits * 100 / allocs) : 0, c.free_hits, c.refills, c.drains);
+    }
+}
+
+// Skips the lock in the panic case, the pool count is only informational.
+static void pmm_zero_pool_dump(bool is_panic) TA_NO_THREAD_SAFETY_ANALYSIS {
+    if (zero_pool_target == 0) {
+        printf("zero pool disabled\n");
+        return;
+    }
+    size_t count = is_panic ? zero_pool_count : pmm_zero_pool_count();
+    printf("zero pool: %zu of %zu pages, hits %" PRIu64 ", zero-on-demand fallbacks %" PRIu64
+           ", background zeroed %" PRIu64 "\n",
+           count, zero_pool_target, zero_pool_hits, zero_pool_fallbacks,
+           zero_pool_background_zeroed);
+}
+
 static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
     bool is_panic = flags & CMD_FLAG_PANIC;
 
@@ -378,6 +921,8 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
     usage:
         printf("usage:\n");
         printf("%s arenas\n", argv[0].str);
+        printf("%s cache\n", argv[0].str);
+        printf("%s zeropool\n", argv[0].str);
         if (!is_panic) {
             printf("%s alloc <count>\n", argv[0].str);
             printf("%s alloc_range <address> <count>\n", argv[0].str);
@@ -394,9 +939,13 @@ static int cmd_pmm(int argc, const cmd_args* argv, uint32_t flags) {
 
     if (!strcmp(argv[1].str, "arenas")) {
         arena_dump(is_panic);
+    } else if (!strcmp(argv[1].str, "cache")) {
+        pmm_pcpu_cache_dump();
+    } else if (!strcmp(argv[1].str, "zeropool")) {
+        pmm_zero_pool_dump(is_panic);
     } else if (is_panic) {
         // No other operations will work during a panic.
-        printf("Only the \"arenas\" command is available during a panic.\n");
+        printf("Only the \"arenas\", \"cache\" and \"zeropool\" commands are available during a panic.\n");
         goto usage;
     } else if (!strcmp(argv[1].str, "free")) {
         static bool show_mem = false;
@@ -9,6 +9,7 @@
 
 #include <err.h>
 #include <inttypes.h>
+#include <pow2.h>
 #include <pretty/sizes.h>
 #include <string.h>
 #include <trace.h>
@@ -16,7 +17,11 @@
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
 PmmArena::PmmArena(const pmm_arena_info_t* info)
-    : info_(*info) {}
+    : info_(*info) {
+    for (auto& l : free_lists_) {
+        list_initialize(&l);
+    }
+}
 
 PmmArena::~PmmArena() {}
 
@@ -24,9 +29,9 @@ PmmArena::~PmmArena() {}
 void PmmArena::EnforceFill() {
     DEBUG_ASSERT(!enforce_fill_);
 
-    vm_page_t* page;
-    list_for_every_entry (&free_list_, page, vm_page_t, free.node) {
-        FreeFill(page);
+    for (size_t i = 0; i < page_count(); i++) {
+        if (page_is_free(&page_array_[i]))
+            FreeFill(&page_array_[i]);
     }
 
     enforce_fill_ = true;
@@ -60,34 +65,164 @@ void PmmArena::BootAllocArray() {
 
     page_array_ = (vm_page_t*)raw_page_array;
 
-    /* add them to the free list */
     for (size_t i = 0; i < page_count; i++) {
-        auto& p = page_array_[i];
-
-        list_add_tail(&free_list_, &p.free.node);
+        page_array_[i].paddr = info_.base + i * PAGE_SIZE;
     }
 
+    /* add them to the free lists */
+    FreeRange(0, page_count);
+
     free_count_ += page_count;
 }
 
-vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
-    vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
-    if (!page)
-        return nullptr;
+void PmmArena::AddBlock(size_t index, uint order) {
+    DEBUG_ASSERT(order <= kMaxOrder);
+    DEBUG_ASSERT(index + (1UL << order) <= page_count());
+
+    vm_page_t* head = &page_array_[index];
+    DEBUG_ASSERT(page_is_free(head));
+
+    head->flags |= VM_PAGE_FLAG_BUDDY_HEAD;
+    head->order = order & 0x1f;
+    list_add_head(&free_lists_[order], &head->free.node);
+    free_blocks_[order]++;
+}
+
+void PmmArena::RemoveBlock(vm_page_t* head, uint order) {
+    DEBUG_ASSERT(is_free_block(head, order));
+    DEBUG_ASSERT(free_blocks_[order] > 0);
+
+    list_delete(&head->free.node);
+    head->flags &= ~VM_PAGE_FLAG_BUDDY_HEAD & 0xff;
+    free_blocks_[order]--;
+}
+
+vm_page_t* PmmArena::AllocBlock(uint order) {
+    uint o = order;
+    while (list_is_empty(&free_lists_[o])) {
+        if (++o > kMaxOrder)
+            return nullptr;
+    }
+
+    vm_page_t* head = list_peek_head_type(&free_lists_[o], vm_page_t, free.node);
+    RemoveBlock(head, o);
+
+    /* split it down, giving back the upper halves */
+    size_t index = page_index(head);
+    while (o > order) {
+        o--;
+        AddBlock(index + (1UL << o), o);
+    }
+
+    return head;
+}
 
-    DEBUG_ASSERT(free_count_ > 0);
+void PmmArena::FreeBlock(size_t index, uint order) {
+    const uint64_t base_pfn = base() / PAGE_SIZE;
 
-    free_count_--;
+    while (order < kMaxOrder) {
+        uint64_t buddy_pfn = (base_pfn + index) ^ (1UL << order);
+        if (buddy_pfn < base_pfn)
+            break;
+        size_t buddy_index = buddy_pfn - base_pfn;
+        if (buddy_index + (1UL << order) > page_count())
+            break;
 
-    DEBUG_ASSERT(page_is_free(page));
+        vm_page_t* buddy = &page_array_[buddy_index];
+        if (!is_free_block(buddy, order))
+            break;
 
-    page->state = VM_PAGE_STATE_ALLOC;
+        RemoveBlock(buddy, order);
+        index = MIN(index, buddy_index);
+        order++;
+    }
+
+    AddBlock(index, order);
+}
+
+void PmmArena::FreeRange(size_t index, size_t count) {
+    const uint64_t base_pfn = base() / PAGE_SIZE;
+
+    while (count > 0) {
+        /* the largest naturally aligned block that starts here and fits */
+        uint order = 0;
+        while (order < kMaxOrder &&
+               ((base_pfn + index) & ((2UL << order) - 1)) == 0 &&
+               (2UL << order) <= count) {
+            order++;
+        }
+
+        FreeBlock(index, order);
+        index += 1UL << order;
+        count -= 1UL << order;
+    }
+}
+
+bool PmmArena::RemoveFreePage(size_t index) {
+    if (!page_is_free(&page_array_[index]))
+        return false;
+
+    /* find the block holding the page */
+    const uint64_t base_pfn = base() / PAGE_SIZE;
+    const uint64_t pfn = base_pfn + index;
+    size_t head_index = 0;
+    uint order;
+    for (order = 0; order <= kMaxOrder; order++) {
+        uint64_t head_pfn = pfn & ~((1UL << order) - 1);
+        if (head_pfn < base_pfn)
+            return false;
+        head_index = head_pfn - base_pfn;
+        if (is_free_block(&page_array_[head_index], order))
+            break;
+    }
+    if (order > kMaxOrder)
+        return false;
+
+    RemoveBlock(&page_array_[head_index], order);
+
+    /* split the block around the page, giving back the other halves */
+    while (order > 0) {
+        order--;
+        size_t half = 1UL << order;
+        if (index < head_index + half) {
+            AddBlock(head_index + half, order);
+        } else {
+            AddBlock(head_index, order);
+            head_index += half;
+        }
+    }
+    DEBUG_ASSERT(head_index == index);
+
+    return true;
+}
+
+void PmmArena::TakePages(size_t index, size_t count, list_node* list) {
+    DEBUG_ASSERT(free_count_ >= count);
+
+    for (size_t i = index; i < index + count; i++) {
+        vm_page_t* p = &page_array_[i];
+        DEBUG_ASSERT(page_is_free(p));
+        DEBUG_ASSERT(!(p->flags & VM_PAGE_FLAG_BUDDY_HEAD));
+
+        p->state = VM_PAGE_STATE_ALLOC;
 #if PMM_ENABLE_FREE_FILL
-    CheckFreeFill(page);
+        CheckFreeFill(p);
 #endif
+        if (list)
+            list_add_tail(list, &p->free.node);
+    }
+
+    free_count_ -= count;
+}
+
+vm_page_t* PmmArena::AllocPage(paddr_t* pa) {
+    vm_page_t* page = AllocBlock(0);
+    if (!page)
+        return nullptr;
+
+    TakePages(page_index(page), 1, nullptr);
 
     if (pa) {
-        /* compute the physical address of the page based on its offset into the arena */
         *pa = page_address_from_arena(page);
         LTRACEF("pa %#" PRIxPTR ", page %p\n", *pa, page);
     }
@@ -105,44 +240,27 @@ vm_page_t* PmmArena::AllocSpecific(paddr_t pa) {
 
     DEBUG_ASSERT(index < size() / PAGE_SIZE);
 
-    vm_page_t* page = get_page(index);
-    if (!page_is_free(page)) {
+    if (!RemoveFreePage(index)) {
         /* we hit an allocated page */
         return nullptr;
     }
 
-    list_delete(&page->free.node);
-
-    page->state = VM_PAGE_STATE_ALLOC;
-
-    DEBUG_ASSERT(free_count_ > 0);
-
-    free_count_--;
+    TakePages(index, 1, nullptr);
 
-    return page;
+    return get_page(index);
 }
 
 size_t PmmArena::AllocPages(size_t count, list_node* list) {
     size_t allocated = 0;
 
     while (allocated < count) {
-        vm_page_t* page = list_remove_head_type(&free_list_, vm_page_t, free.node);
+        vm_page_t* page = AllocBlock(0);
         if (!page)
             return allocated;
 
         LTRACEF("allocating page %p, pa %#" PRIxPTR "\n", page, page_address_from_arena(page));
 
-        DEBUG_ASSERT(free_count_ > 0);
-
-        free_count_--;
-
-        DEBUG_ASSERT(page_is_free(page));
-#if PMM_ENABLE_FREE_FILL
-        CheckFreeFill(page);
-#endif
-
-        page->state = VM_PAGE_STATE_ALLOC;
-        list_add_tail(list, &page->free.node);
+        TakePages(page_index(page), 1, list);
 
         allocated++;
     }
@@ -151,7 +269,38 @@ size_t PmmArena::AllocPages(size_t count, list_node* list) {
 }
 
 size_t PmmArena::AllocContiguous(size_t count, uint8_t alignment_log2, paddr_t* pa, struct list_node* list) {
-    /* walk the list starting at alignment boundaries.
+    if (count == 0)
+        return 0;
+
+    /* a block of the right order satisfies both the size and the alignment */
+    uint order = (count > (1UL << kMaxOrder)) ? kMaxOrder + 1 : log2_ulong_ceil(count);
+    if (alignment_log2 > PAGE_SIZE_SHIFT)
+        order = MAX(order, (uint)(alignment_log2 - PAGE_SIZE_SHIFT));
+    if (order > kMaxOrder)
+        return AllocLargeContiguous(count, alignment_log2, pa, list);
+
+    vm_page_t* head = AllocBlock(order);
+    if (!head)
+        return 0;
+
+    /* give back the tail of the block beyond what was asked for */
+    size_t index = page_index(head);
+    if ((1UL << order) > count)
+        FreeRange(index + count, (1UL << order) - count);
+
+    LTRACEF("found run from pn %zu to %zu (order %u)\n", index, index + count, order);
+
+    TakePages(index, count, list);
+
+    if (pa)
+        *pa = base() + index * PAGE_SIZE;
+
+    return count;
+}
+
+size_t PmmArena::AllocLargeContiguous(size_t count, uint8_t alignment_log2, paddr_t* pa,
+                                      struct list_node* list) {
+    /* walk the pages starting at alignment boundaries.
      * calculate the starting offset into this arena, based on the
      * base address of the arena to handle the case where the arena
      * is not aligned on the same boundary requested.
@@ -160,51 +309,37 @@ size_t PmmArena::AllocContiguous(size_t count, uint8_t alignment_log2, paddr_t*
     if (rounded_base < base() || rounded_base > base() + size() - 1)
         return 0;
 
-    paddr_t aligned_offset = (rounded_base - base()) / PAGE_SIZE;
-    paddr_t start = aligned_offset;
-    LTRACEF("starting search at aligned offset %#" PRIxPTR "\n", start);
+    const size_t align_pages = 1UL << (alignment_log2 - PAGE_SIZE_SHIFT);
+    const size_t aligned_offset = (rounded_base - base()) / PAGE_SIZE;
+    size_t start = aligned_offset;
+    LTRACEF("starting search at aligned offset %#zx\n", start);
     LTRACEF("arena base %#" PRIxPTR " size %zu\n", base(), size());
 
-retry:
-    /* search while we're still within the arena and have a chance of finding a slot
-       (start + count < end of arena) */
-    while ((start < size() / PAGE_SIZE) && ((start + count) <= size() / PAGE_SIZE)) {
-        vm_page_t* p = &page_array_[start];
-        for (uint i = 0; i < count; i++) {
-            if (!page_is_free(p)) {
-                /* this run is broken, break out of the inner loop.
-                 * start over at the next alignment boundary
-                 */
-                start = ROUNDUP(start - aligned_offset + i + 1, 1UL << (alignment_log2 - PAGE_SIZE_SHIFT)) +
-                        aligned_offset;
-                goto retry;
-            }
-            p++;
+    /* search while there's still room for a run in the arena */
+    while (start + count <= page_count()) {
+        /* step over whole free blocks where we can rather than page by page */
+        size_t i = 0;
+        while (i < count) {
+            const vm_page_t* p = &page_array_[start + i];
+            if (!page_is_free(p))
+                break;
+            i += (p->flags & VM_PAGE_FLAG_BUDDY_HEAD) ? (1UL << p->order) : 1;
         }
 
-        /* we found a run */
-        LTRACEF("found run from pn %" PRIuPTR " to %" PRIuPTR "\n", start, start + count);
-
-        /* remove the pages from the run out of the free list */
-        for (paddr_t i = start; i < start + count; i++) {
-            p = &page_array_[i];
-            DEBUG_ASSERT(page_is_free(p));
-            DEBUG_ASSERT(list_in_list(&p->free.node));
-
-            list_delete(&p->free.node);
-            p->state = VM_PAGE_STATE_ALLOC;
-
-            DEBUG_ASSERT(free_count_ > 0);
-
-            free_count_--;
+        if (i < count) {
+            /* this run is broken, start over at the next alignment boundary past it */
+            start = ROUNDUP(start - aligned_offset + i + 1, align_pages) + aligned_offset;
+            continue;
+        }
 
-#if PMM_ENABLE_FREE_FILL
-            CheckFreeFill(p);
-#endif
+        /* we found a run */
+        LTRACEF("found run from pn %zu to %zu\n", start, start + count);
 
-            if (list)
-                list_add_tail(list, &p->free.node);
+        for (size_t j = start; j < start + count; j++) {
+            __UNUSED bool removed = RemoveFreePage(j);
+            DEBUG_ASSERT(removed);
         }
+        TakePages(start, count, list);
 
         if (pa)
             *pa = base() + start * PAGE_SIZE;
@@ -225,8 +360,9 @@ status_t PmmArena::FreePage(vm_page_t* page) {
 #endif
 
     page->state = VM_PAGE_STATE_FREE;
+    page->flags &= ~VM_PAGE_FLAG_BUDDY_HEAD & 0xff;
 
-    list_add_head(&free_list_, &page->free.node);
+    FreeBlock(page_index(page), 0);
     free_count_++;
     return NO_ERROR;
 }
@@ -256,6 +392,17 @@ void PmmArena::Dump(bool dump_pages, bool dump_free_ranges) {
                state_count[i] * PAGE_SIZE);
     }
 
+    /* fragmentation of the free pages: how they are split up into blocks, and what
+     * fraction of them can't be used for an allocation of each block size */
+    printf("\tfree blocks:\n");
+    size_t usable = free_count_;
+    for (unsigned int o = 0; o <= kMaxOrder; o++) {
+        size_t unusable_pct = free_count_ ? (free_count_ - usable) * 100 / free_count_ : 0;
+        printf("\t\torder %-2u %-8s %-10zu blocks, %3zu%% of free pages unusable at this size\n", o,
+               format_size(pbuf, sizeof(pbuf), (1UL << o) * PAGE_SIZE), free_blocks_[o], unusable_pct);
+        usable -= free_blocks_[o] << o;
+    }
+
     /* dump the free pages */
     if (dump_free_ranges) {
         printf("\tfree ranges:\n");
@@ -14,8 +14,16 @@
 #define PMM_ENABLE_FREE_FILL 0
 #define PMM_FREE_FILL_BYTE 0x42
 
+// Free pages in an arena are kept in naturally aligned power of two blocks
+// (aligned on their physical address), one free list per block order, and
+// buddies are merged again as they are freed. Single pages come off the order
+// 0 list, and contiguous or aligned runs of up to 2^kMaxOrder pages are carved
+// out of the smallest block that fits.
 class PmmArena : public mxtl::DoublyLinkedListable<PmmArena*> {
 public:
+    // largest block kept on the free lists is 2^kMaxOrder pages (4MB)
+    static constexpr uint kMaxOrder = 10;
+
     PmmArena(const pmm_arena_info_t* info);
     ~PmmArena();
 
@@ -26,6 +34,10 @@ public:
 
 #if PMM_ENABLE_FREE_FILL
     void EnforceFill();
+
+    // fill a page that is being freed, and check the fill on one being allocated
+    void FreeFill(vm_page_t* page);
+    void CheckFreeFill(vm_page_t* page);
 #endif
 
     void Dump(bool dump_pages, bool dump_free_ranges);
@@ -58,10 +70,8 @@ public:
     }
 
     paddr_t page_address_from_arena(const vm_page* page) const {
-        uintptr_t page_addr = reinterpret_cast<uintptr_t>(page);
-        uintptr_t page_array_base = reinterpret_cast<uintptr_t>(page_array_);
-
-        return ((paddr_t)(((page_addr - page_array_base) / VM_PAGE_STRUCT_SIZE) * PAGE_SIZE + info_.base));
+        DEBUG_ASSERT(page_belongs_to_arena(page));
+        return page->paddr;
     }
 
     bool address_in_arena(paddr_t address) const {
@@ -69,16 +79,43 @@ public:
     }
 
 private:
-#if PMM_ENABLE_FREE_FILL
-    void FreeFill(vm_page_t* page);
-    void CheckFreeFill(vm_page_t* page);
-#endif
+    // buddy allocator internals
+    size_t page_count() const { return size() / PAGE_SIZE; }
+    size_t page_index(const vm_page_t* page) const { return page - page_array_; }
+    bool is_free_block(const vm_page_t* page, uint order) const {
+        return page_is_free(page) && (page->flags & VM_PAGE_FLAG_BUDDY_HEAD) &&
+               page->order == order;
+    }
+
+    // push or pull a block on the free list of its order
+    void AddBlock(size_t index, uint order);
+    void RemoveBlock(vm_page_t* head, uint order);
+
+    // take a block of exactly |order| off the free lists, splitting a larger one if needed
+    vm_page_t* AllocBlock(uint order);
+
+    // return a block of free pages, merging it with its buddies
+    void FreeBlock(size_t index, uint order);
+
+    // return an arbitrary run of free pages as a set of aligned blocks
+    void FreeRange(size_t index, size_t count);
+
+    // take a particular free page out of whichever block holds it
+    bool RemoveFreePage(size_t index);
+
+    // mark a run of pages removed from the free lists as allocated
+    void TakePages(size_t index, size_t count, list_node* list);
+
+    // scan for a run larger than the largest block
+    size_t AllocLargeContiguous(size_t count, uint8_t alignment_log2, paddr_t* pa,
+                                list_node* list);
 
     const pmm_arena_info_t info_;
     vm_page_t* page_array_ = nullptr;
 
     size_t free_count_ = 0;
-    list_node free_list_ = LIST_INITIAL_VALUE(free_list_);
+    list_node free_lists_[kMaxOrder + 1];
+    size_t free_blocks_[kMaxOrder + 1] = {};
 
 #if PMM_ENABLE_FREE_FILL
     bool enforce_fill_ = false;
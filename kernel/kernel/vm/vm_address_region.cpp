@@ -207,7 +207,8 @@ status_t VmAddressRegion::CreateVmMapping(size_t mapping_offset, size_t size, ui
     LTRACEF("%p %#zx %#zx %x\n", this, mapping_offset, size, vmar_flags);
 
     // Check that only allowed flags have been set
-    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_SPECIFIC_OVERWRITE | VMAR_CAN_RWX_FLAGS)) {
+    if (vmar_flags & ~(VMAR_FLAG_SPECIFIC | VMAR_FLAG_SPECIFIC_OVERWRITE | VMAR_CAN_RWX_FLAGS |
+                       VMAR_FLAG_PREFAULT_SEQUENTIAL)) {
         return ERR_INVALID_ARGS;
     }
 
@@ -312,6 +313,15 @@ void VmAddressRegion::RemoveSubregion(VmAddressRegionOrMapping* region) {
     subregions_.erase(*region);
 }
 
+void VmAddressRegion::ResizeSubregionLocked(VmAddressRegionOrMapping* region, size_t size) {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(region->subregion_list_node_.InContainer());
+    DEBUG_ASSERT(size > 0);
+
+    region->size_ = size;
+    PropagateSubtreeState(region);
+}
+
 mxtl::RefPtr<VmAddressRegionOrMapping> VmAddressRegion::FindRegion(vaddr_t addr) {
     AutoLock guard(aspace_->lock());
     if (state_ != LifeCycleState::ALIVE) {
@@ -348,7 +358,7 @@ size_t VmAddressRegion::AllocatedPagesLocked() const {
     return sum;
 }
 
-status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
+mxtl::RefPtr<VmMapping> VmAddressRegion::FindMappingLocked(vaddr_t va) {
     canary_.Assert();
     DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
 
@@ -356,10 +366,10 @@ status_t VmAddressRegion::PageFault(vaddr_t va, uint pf_flags) {
          auto next = vmar->FindRegionLocked(va);
          vmar = next->as_vm_address_region()) {
         if (next->is_mapping())
-            return next->PageFault(va, pf_flags);
+            return next->as_vm_mapping();
     }
 
-    return ERR_NOT_FOUND;
+    return nullptr;
 }
 
 bool VmAddressRegion::IsRangeAvailableLocked(vaddr_t base, size_t size) {
@@ -478,6 +488,88 @@ not_found:
     return true; // not_found: stop search
 }
 
+VmAddressRegion::ChildList::iterator VmAddressRegion::FindGapLocked(vaddr_t from, size_t size) {
+    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(size > 0);
+
+    using PtrTraits = ChildList::PtrTraits;
+
+    // All arithmetic is done on last bytes rather than ends so that regions
+    // at the top of the address space don't wrap.  The gap between a region
+    // whose last byte is |prev_last| and one at |base| is base - prev_last - 1,
+    // which is also right for the first child if prev_last is base_ - 1.
+    auto gap_fits = [size](vaddr_t prev_last, vaddr_t base) -> bool {
+        return base - prev_last - 1 >= size;
+    };
+    // Whether the subtree at |node|, together with the gap in front of it,
+    // contains a gap that fits.
+    auto subtree_fits = [&gap_fits, size](const VmAddressRegionOrMapping* node,
+                                          vaddr_t prev_last) -> bool {
+        return node->subtree_max_gap_ >= size || gap_fits(prev_last, node->subtree_min_base_);
+    };
+    // Find the first node in the subtree at |node| whose gap fits, given that
+    // subtree_fits(node, prev_last) holds.
+    auto descend = [&gap_fits, &subtree_fits](VmAddressRegionOrMapping* node,
+                                              vaddr_t prev_last) -> VmAddressRegionOrMapping* {
+        while (PtrTraits::IsValid(node)) {
+            const auto& ns = node->subregion_list_node_;
+            if (PtrTraits::IsValid(ns.left_)) {
+                if (subtree_fits(ns.left_.get(), prev_last)) {
+                    node = ns.left_.get();
+                    continue;
+                }
+                prev_last = ns.left_->subtree_max_last_;
+            }
+            if (gap_fits(prev_last, node->base())) {
+                return node;
+            }
+            prev_last = node->base() + node->size() - 1;
+            node = PtrTraits::IsValid(ns.right_) ? ns.right_.get() : nullptr;
+        }
+        return nullptr;
+    };
+
+    // Start with the first child at or after |from|.
+    auto itr = subregions_.lower_bound(from);
+    if (!itr.IsValid()) {
+        return subregions_.end();
+    }
+    {
+        auto prev = itr;
+        --prev;
+        const vaddr_t prev_last = prev.IsValid() ? prev->base() + prev->size() - 1 : base_ - 1;
+        if (gap_fits(prev_last, itr->base())) {
+            return itr;
+        }
+    }
+
+    // Otherwise the answer is the first fitting node after it.  That is in its
+    // right subtree if anywhere in there, or else it is the first ancestor we
+    // climb to from the left, or in that ancestor's right subtree.
+    VmAddressRegionOrMapping* node = &*itr;
+    while (true) {
+        const auto& ns = node->subregion_list_node_;
+        const vaddr_t last = node->base() + node->size() - 1;
+        if (PtrTraits::IsValid(ns.right_) && subtree_fits(ns.right_.get(), last)) {
+            return subregions_.make_iterator(*descend(ns.right_.get(), last));
+        }
+
+        // Climb until we arrive at a parent from its left child.
+        VmAddressRegionOrMapping* child;
+        do {
+            child = node;
+            node = child->subregion_list_node_.parent_;
+            if (!PtrTraits::IsValid(node)) {
+                return subregions_.end();
+            }
+        } while (node->subregion_list_node_.left_.get() != child);
+
+        if (gap_fits(child->subtree_max_last_, node->base())) {
+            return subregions_.make_iterator(*node);
+        }
+    }
+}
+
 status_t VmAddressRegion::AllocSpotLocked(size_t size, uint8_t align_pow2, uint arch_mmu_flags,
                                           vaddr_t* spot) {
     canary_.Assert();
@@ -734,11 +826,18 @@ status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t align
     const vaddr_t align = 1UL << align_pow2;
 
     // Find the first gap in the address space which can contain a region of the
-    // requested size.
-    auto before_iter = subregions_.end();
-    auto after_iter = subregions_.begin();
+    // requested size.  Gaps smaller than the region can never fit it, so skip
+    // straight from one at least that large to the next one.
+    auto after_iter = FindGapLocked(base_, size);
+    while (true) {
+        auto before_iter = after_iter;
+        if (after_iter.IsValid()) {
+            --before_iter;
+        } else if (!subregions_.is_empty()) {
+            // The gap after the last child.
+            before_iter = --subregions_.end();
+        }
 
-    do {
         if (CheckGapLocked(before_iter, after_iter, spot, base, align, size, 0, arch_mmu_flags)) {
             if (*spot != static_cast<vaddr_t>(-1)) {
                 return NO_ERROR;
@@ -747,8 +846,11 @@ status_t VmAddressRegion::LinearRegionAllocatorLocked(size_t size, uint8_t align
             }
         }
 
-        before_iter = after_iter++;
-    } while (before_iter.IsValid());
+        if (!after_iter.IsValid()) {
+            break;
+        }
+        after_iter = FindGapLocked(after_iter->base() + 1, size);
+    }
 
     // couldn't find anything
     return ERR_NO_MEMORY;
@@ -789,6 +891,10 @@ constexpr size_t AllocationSpotsInRange(size_t range_size, size_t alloc_size, ui
     return ((range_size - alloc_size) >> align_pow2) + 1;
 }
 
+// Number of random spots the non-compact allocator probes before falling back
+// to enumerating every gap.
+constexpr uint kRandomAllocTries = 16;
+
 } // namespace {}
 
 // Perform allocations for VMARs that aren't using the COMPACT policy.  This
@@ -803,7 +909,33 @@ status_t VmAddressRegion::NonCompactRandomizedRegionAllocatorLocked(size_t size,
     align_pow2 = mxtl::max(align_pow2, static_cast<uint8_t>(PAGE_SIZE_SHIFT));
     const vaddr_t align = 1UL << align_pow2;
 
-    // Calculate the number of spaces that we can fit this allocation in.
+    // Address spaces are usually sparse, so first try picking uniformly among
+    // all the aligned spots in the region and taking the first one that is
+    // free.  Each try costs a single tree lookup, and conditioned on success
+    // the choice is still uniform over the spots that can hold the allocation.
+    const vaddr_t first_spot = ROUNDUP(base_, align);
+    if (first_spot >= base_ && size <= size_ && first_spot - base_ <= size_ - size) {
+        const size_t total_spaces = AllocationSpotsInRange(size_ - (first_spot - base_), size,
+                                                           align_pow2);
+        for (uint i = 0; i < kRandomAllocTries; ++i) {
+            const vaddr_t alloc_spot =
+                first_spot + (aspace_->AslrPrng().RandInt(total_spaces) << align_pow2);
+            if (!IsRangeAvailableLocked(alloc_spot, size)) {
+                continue;
+            }
+
+            auto after_iter = subregions_.upper_bound(alloc_spot + size - 1);
+            auto before_iter = after_iter;
+            --before_iter;
+            if (CheckGapLocked(before_iter, after_iter, spot, alloc_spot, align, size, 0,
+                               arch_mmu_flags) && *spot != static_cast<vaddr_t>(-1)) {
+                return NO_ERROR;
+            }
+        }
+    }
+
+    // Mostly full: calculate the number of spaces that we can fit this
+    // allocation in.
     size_t candidate_spaces = 0;
     ForEachGap([align, align_pow2, size, &candidate_spaces](vaddr_t gap_base, size_t gap_len) -> bool {
         DEBUG_ASSERT(IS_ALIGNED(gap_base, align));
@@ -12,6 +12,7 @@
 #include <inttypes.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/auto_call.h>
 #include <mxtl/auto_lock.h>
 #include <string.h>
@@ -92,3 +93,37 @@ size_t VmAddressRegionOrMapping::AllocatedPages() const {
     }
     return AllocatedPagesLocked();
 }
+
+void VmAddressRegionOrMapping::UpdateSubtreeState(VmAddressRegionOrMapping* node) {
+    using PtrTraits = mxtl::internal::ContainerPtrTraits<mxtl::RefPtr<VmAddressRegionOrMapping>>;
+
+    const auto& ns = node->subregion_list_node_;
+    const vaddr_t last = node->base_ + node->size_ - 1;
+
+    node->subtree_min_base_ = node->base_;
+    node->subtree_max_last_ = last;
+    node->subtree_max_gap_ = 0;
+
+    if (PtrTraits::IsValid(ns.left_)) {
+        const VmAddressRegionOrMapping* left = ns.left_.get();
+        node->subtree_min_base_ = left->subtree_min_base_;
+        node->subtree_max_gap_ = mxtl::max(left->subtree_max_gap_,
+                                           node->base_ - left->subtree_max_last_ - 1);
+    }
+    if (PtrTraits::IsValid(ns.right_)) {
+        const VmAddressRegionOrMapping* right = ns.right_.get();
+        node->subtree_max_last_ = right->subtree_max_last_;
+        node->subtree_max_gap_ = mxtl::max(node->subtree_max_gap_,
+                                           mxtl::max(right->subtree_max_gap_,
+                                                     right->subtree_min_base_ - last - 1));
+    }
+}
+
+void VmAddressRegionOrMapping::PropagateSubtreeState(VmAddressRegionOrMapping* node) {
+    using PtrTraits = mxtl::internal::ContainerPtrTraits<mxtl::RefPtr<VmAddressRegionOrMapping>>;
+
+    while (PtrTraits::IsValid(node)) {
+        UpdateSubtreeState(node);
+        node = node->subregion_list_node_.parent_;
+    }
+}
@@ -363,7 +363,11 @@ status_t VmAspace::ReserveSpace(const char* name, size_t size, vaddr_t vaddr) {
 
     // lookup how it's already mapped
     uint arch_mmu_flags = 0;
-    auto err = arch_mmu_query(&arch_aspace_, vaddr, nullptr, &arch_mmu_flags);
+    status_t err;
+    {
+        AutoLock a(&mmu_lock_);
+        err = arch_mmu_query(&arch_aspace_, vaddr, nullptr, &arch_mmu_flags);
+    }
     if (err) {
         // if it wasn't already mapped, use some sort of strict default
         arch_mmu_flags = ARCH_MMU_FLAG_CACHED | ARCH_MMU_FLAG_PERM_READ;
@@ -518,12 +522,29 @@ status_t VmAspace::PageFault(vaddr_t va, uint flags) {
     DEBUG_ASSERT(!aspace_destroyed_);
     LTRACEF("va %#" PRIxPTR ", flags %#x\n", va, flags);
 
-    // for now, hold the aspace lock across the page fault operation,
-    // which stops any other operations on the address space from moving
-    // the region out from underneath it
-    AutoLock a(&lock_);
+    // Only hold the aspace lock to find the mapping and take references to it
+    // and its object.  The fault itself is handled under the object lock, so
+    // faults on mappings of different objects don't serialize against each
+    // other.  If the mapping was unmapped or split while the aspace lock was
+    // dropped, it no longer covers va and we look again.
+    page_faults_.fetch_add(1u);
+
+    status_t status;
+    do {
+        mxtl::RefPtr<VmMapping> mapping;
+        mxtl::RefPtr<VmObject> object;
+        {
+            AutoLock a(&lock_);
+            mapping = root_vmar_->FindMappingLocked(va);
+            if (!mapping)
+                return ERR_NOT_FOUND;
+            object = mapping->vmo();
+        }
 
-    return root_vmar_->PageFault(va, flags);
+        status = mapping->PageFault(va, flags, object);
+    } while (status == ERR_INTERRUPTED_RETRY);
+
+    return status;
 }
 
 void VmAspace::Dump(bool verbose) const {
@@ -567,6 +588,19 @@ size_t VmAspace::AllocatedPages() const {
     return root_vmar_->AllocatedPagesLocked();
 }
 
+uint64_t VmAspace::page_faults() const {
+    canary_.Assert();
+
+    return page_faults_.load();
+}
+
+size_t VmAspace::large_pages() const {
+    canary_.Assert();
+
+    AutoLock a(&mmu_lock_);
+    return arch_aspace_.large_pages;
+}
+
 void VmAspace::InitializeAslr() {
     aslr_enabled_ = is_user() && !cmdline_get_bool("aslr.disable", false);
 
@@ -10,9 +10,11 @@
 #include <assert.h>
 #include <err.h>
 #include <inttypes.h>
+#include <kernel/cmdline.h>
 #include <kernel/vm.h>
 #include <kernel/vm/vm_aspace.h>
 #include <kernel/vm/vm_object.h>
+#include <lk/init.h>
 #include <mxalloc/new.h>
 #include <mxtl/auto_call.h>
 #include <mxtl/auto_lock.h>
@@ -21,6 +23,32 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
+namespace {
+
+// Size of the aligned window of pages around a faulting address that is
+// checked for already resident pages to map along with the faulting page.
+// Overridden with the kernel.vm-fault-around-pages command line option.
+constexpr uint32_t kDefaultFaultAroundPages = 16;
+constexpr uint32_t kMaxFaultAroundPages = 256;
+
+// Bounds of the window prefaulted ahead of a forward scan through a mapping
+// created with VMAR_FLAG_PREFAULT_SEQUENTIAL.  The window doubles on every
+// fault that continues the scan.
+constexpr size_t kSeqPrefaultMinPages = 4;
+constexpr size_t kSeqPrefaultMaxPages = 64;
+
+uint32_t fault_around_pages = kDefaultFaultAroundPages;
+
+void fault_around_init(uint level) {
+    fault_around_pages = cmdline_get_uint32("kernel.vm-fault-around-pages",
+                                            kDefaultFaultAroundPages);
+    fault_around_pages = MIN(fault_around_pages, kMaxFaultAroundPages);
+}
+
+} // namespace
+
+LK_INIT_HOOK(vm_fault_around, &fault_around_init, LK_INIT_LEVEL_VM);
+
 VmMapping::VmMapping(VmAddressRegion& parent, vaddr_t base, size_t size, uint32_t vmar_flags,
                      mxtl::RefPtr<VmObject> vmo, uint64_t vmo_offset, uint arch_mmu_flags,
                      const char* name)
@@ -117,6 +145,7 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
 
     // If we're changing the whole mapping, just make the change.
     if (base_ == base && size_ == size) {
+        AutoLock mmu_guard(aspace_->mmu_lock());
         status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
                                            new_arch_mmu_flags);
         LTRACEF("arch_mmu_protect returns %d\n", status);
@@ -135,12 +164,13 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
             return ERR_NO_MEMORY;
         }
 
+        AutoLock mmu_guard(aspace_->mmu_lock());
         status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
                                            new_arch_mmu_flags);
         LTRACEF("arch_mmu_protect returns %d\n", status);
         arch_mmu_flags_ = new_arch_mmu_flags;
 
-        size_ = size;
+        parent_->ResizeSubregionLocked(this, size);
         mapping->ActivateLocked();
         return NO_ERROR;
     }
@@ -158,11 +188,12 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
             return ERR_NO_MEMORY;
         }
 
+        AutoLock mmu_guard(aspace_->mmu_lock());
         status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
                                            new_arch_mmu_flags);
         LTRACEF("arch_mmu_protect returns %d\n", status);
 
-        size_ -= size;
+        parent_->ResizeSubregionLocked(this, size_ - size);
         mapping->ActivateLocked();
         return NO_ERROR;
     }
@@ -187,12 +218,13 @@ status_t VmMapping::ProtectLocked(vaddr_t base, size_t size, uint new_arch_mmu_f
         return ERR_NO_MEMORY;
     }
 
+    AutoLock mmu_guard(aspace_->mmu_lock());
     status_t status = arch_mmu_protect(&aspace_->arch_aspace(), base, size / PAGE_SIZE,
                                        new_arch_mmu_flags);
     LTRACEF("arch_mmu_protect returns %d\n", status);
 
     // Turn us into the left half
-    size_ = left_size;
+    parent_->ResizeSubregionLocked(this, left_size);
 
     center_mapping->ActivateLocked();
     right_mapping->ActivateLocked();
@@ -254,6 +286,7 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
     // Check if unmapping from one of the ends
     if (base_ == base || base + size == base_ + size_) {
         LTRACEF("unmapping base %#lx size %#zx\n", base, size);
+        AutoLock mmu_guard(aspace_->mmu_lock());
         status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), base, size / PAGE_SIZE, nullptr);
         if (status < 0) {
             return status;
@@ -265,9 +298,14 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
             mxtl::RefPtr<VmAddressRegionOrMapping> ref(parent_->subregions_.erase(*this));
             base_ += size;
             object_offset_ += size;
+            size_ -= size;
             parent_->subregions_.insert(mxtl::move(ref));
+        } else if (size_ == size) {
+            // Called from DestroyLocked(), which takes us out of the tree next.
+            size_ = 0;
+        } else {
+            parent_->ResizeSubregionLocked(this, size_ - size);
         }
-        size_ -= size;
 
         return NO_ERROR;
     }
@@ -289,13 +327,14 @@ status_t VmMapping::UnmapLocked(vaddr_t base, size_t size) {
 
     // Unmap the middle segment
     LTRACEF("unmapping base %#lx size %#zx\n", base, size);
+    AutoLock mmu_guard(aspace_->mmu_lock());
     status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), base, size / PAGE_SIZE, nullptr);
     if (status < 0) {
         return status;
     }
 
     // Turn us into the left half
-    size_ = base - base_;
+    parent_->ResizeSubregionLocked(this, base - base_);
     mapping->ActivateLocked();
     return NO_ERROR;
 }
@@ -359,6 +398,7 @@ status_t VmMapping::UnmapVmoRangeLocked(uint64_t offset, uint64_t len) const {
     LTRACEF("going to unmap %#" PRIxPTR ", len %#" PRIx64 " aspace %p\n",
             unmap_base.ValueOrDie(), len_new, aspace_.get());
 
+    AutoLock mmu_guard(aspace_->mmu_lock());
     status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), unmap_base.ValueOrDie(),
                                      static_cast<size_t>(len_new) / PAGE_SIZE, nullptr);
     if (status < 0)
@@ -387,6 +427,15 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     if (commit)
         pf_flags |= VMM_PF_FLAG_SW_FAULT;
 
+    // commit the whole range up front so the object can allocate it in bulk,
+    // and in large contiguous runs if it was created to. clones are left to
+    // GetPageLocked below so pages still get copied from the parent.
+    if (commit && !object_->is_cow_clone()) {
+        status_t status = object_->CommitRange(object_offset_ + offset, len, nullptr);
+        if (status != NO_ERROR && status != ERR_NOT_SUPPORTED)
+            return status;
+    }
+
     // grab the lock for the vmo
     AutoLock al(object_->lock());
 
@@ -395,6 +444,33 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
     currently_faulting_ = true;
     auto ac = mxtl::MakeAutoCall([&]() { currently_faulting_ = false; });
 
+    // the current run of virtually and physically contiguous pages. mapping
+    // each run with a single call lets the arch code use large entries for
+    // the aligned parts of it.
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_len = 0;
+
+    auto flush_run = [&]() {
+        if (run_len == 0)
+            return;
+
+        LTRACEF_LEVEL(2, "mapping %zu pages at pa %#" PRIxPTR " to va %#" PRIxPTR "\n",
+                      run_len, run_pa, run_va);
+
+        AutoLock mmu_guard(aspace_->mmu_lock());
+        size_t mapped;
+        auto ret = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_len,
+                                arch_mmu_flags_, &mapped);
+        if (ret < 0) {
+            TRACEF("error %d mapping %zu pages at va %#" PRIxPTR " pa %#" PRIxPTR "\n",
+                   ret, run_len, run_va, run_pa);
+        }
+
+        DEBUG_ASSERT(mapped == run_len);
+        run_len = 0;
+    };
+
     // iterate through the range, grabbing a page from the underlying object and
     // mapping it in
     size_t o;
@@ -406,6 +482,7 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
         status = object_->GetPageLocked(vmo_offset, pf_flags, nullptr, &pa);
         if (status < 0) {
             // no page to map
+            flush_run();
             if (commit) {
                 // fail when we can't commit every requested page
                 return status;
@@ -416,16 +493,18 @@ status_t VmMapping::MapRange(size_t offset, size_t len, bool commit) {
         }
 
         vaddr_t va = base_ + o;
-        LTRACEF_LEVEL(2, "mapping pa %#" PRIxPTR " to va %#" PRIxPTR "\n", pa, va);
-
-        size_t mapped;
-        auto ret = arch_mmu_map(&aspace_->arch_aspace(), va, pa, 1, arch_mmu_flags_, &mapped);
-        if (ret < 0) {
-            TRACEF("error %d mapping page at va %#" PRIxPTR " pa %#" PRIxPTR "\n", ret, va, pa);
+        if (run_len > 0 && va == run_va + run_len * PAGE_SIZE &&
+            pa == run_pa + run_len * PAGE_SIZE) {
+            run_len++;
+            continue;
         }
 
-        DEBUG_ASSERT(mapped == 1);
+        flush_run();
+        run_va = va;
+        run_pa = pa;
+        run_len = 1;
     }
+    flush_run();
 
     return NO_ERROR;
 }
@@ -498,11 +577,23 @@ status_t VmMapping::DestroyLocked() {
     return NO_ERROR;
 }
 
-status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
+status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags,
+                             const mxtl::RefPtr<VmObject>& object) {
     canary_.Assert();
-    DEBUG_ASSERT(is_mutex_held(aspace_->lock()));
+    DEBUG_ASSERT(object);
+
+    // grab the lock for the vmo
+    AutoLock al(object->lock());
 
-    DEBUG_ASSERT(va >= base_ && va <= base_ + size_ - 1);
+    // The aspace lock was dropped after we were looked up, so we may have been
+    // unmapped, protected or split since.  Those all change our range with the
+    // object lock held (a full unmap leaves size_ at 0), so once it's held
+    // the range and the flags below are stable.
+    if (va < base_ || va - base_ >= size_) {
+        LTRACEF("%p '%s' no longer covers va %#" PRIxPTR "\n", this, name_, va);
+        return ERR_INTERRUPTED_RETRY;
+    }
+    DEBUG_ASSERT(object_ == object);
 
     va = ROUNDDOWN(va, PAGE_SIZE);
     uint64_t vmo_offset = va - base_ + object_offset_;
@@ -529,9 +620,6 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         return ERR_ACCESS_DENIED;
     }
 
-    // grab the lock for the vmo
-    AutoLock al(object_->lock());
-
     // set the currently faulting flag for any recursive calls the vmo may make back into us
     // The specific path we're avoiding is if the VMO calls back into us during vmo->GetPageLocked()
     // via UnmapVmoRangeLocked(). Since we're responsible for that page, signal to ourself to skip
@@ -560,10 +648,16 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     }
 
     // see if something is mapped here now
-    // this may happen if we are one of multiple threads racing on a single address
+    // this may happen if we are one of multiple threads racing on a single address.
+    // Faults on the same page serialize on the object lock, so nothing else
+    // can change the mapping of va between this query and the update below.
     uint page_flags;
     paddr_t pa;
-    status_t err = arch_mmu_query(&aspace_->arch_aspace(), va, &pa, &page_flags);
+    status_t err;
+    {
+        AutoLock mmu_guard(aspace_->mmu_lock());
+        err = arch_mmu_query(&aspace_->arch_aspace(), va, &pa, &page_flags);
+    }
     if (err >= 0) {
         LTRACEF("queried va, page at pa %#" PRIxPTR ", flags %#x is already there\n", pa,
                 page_flags);
@@ -577,7 +671,13 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
             // assert that we're not accidentally marking the zero page writable
             DEBUG_ASSERT((pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
+            // a block mapped read-only by an earlier read fault is upgraded as a
+            // whole, rather than splitting it to change a single page
+            if (FaultLargePageLocked(va, new_pa, mmu_flags))
+                return NO_ERROR;
+
             // same page, different permission
+            AutoLock mmu_guard(aspace_->mmu_lock());
             status = arch_mmu_protect(&aspace_->arch_aspace(), va, 1, mmu_flags);
             if (status < 0) {
                 TRACEF("failed to modify permissions on existing mapping\n");
@@ -593,6 +693,7 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
             DEBUG_ASSERT((new_pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
             // unmap the old one and put the new one in place
+            AutoLock mmu_guard(aspace_->mmu_lock());
             status = arch_mmu_unmap(&aspace_->arch_aspace(), va, 1, nullptr);
             if (status < 0) {
                 TRACEF("failed to remove old mapping before replacing\n");
@@ -617,6 +718,11 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
         // assert that we're not accidentally mapping the zero page writable
         DEBUG_ASSERT((new_pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
 
+        // see if the page is part of a run we can map with a single large entry
+        if (FaultLargePageLocked(va, new_pa, mmu_flags))
+            return NO_ERROR;
+
+        AutoLock mmu_guard(aspace_->mmu_lock());
         size_t mapped;
         status = arch_mmu_map(&aspace_->arch_aspace(), va, new_pa, 1, mmu_flags, &mapped);
         if (status < 0) {
@@ -631,9 +737,207 @@ status_t VmMapping::PageFault(vaddr_t va, const uint pf_flags) {
     if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
         arch_sync_cache_range(va, PAGE_SIZE);
 #endif
+
+    // the faulting page is taken care of, try to save future faults on its neighbors
+    FaultAroundLocked(va, pf_flags, mmu_flags);
+
     return NO_ERROR;
 }
 
+void VmMapping::FaultAroundLocked(vaddr_t va, uint pf_flags, uint mmu_flags) {
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    const size_t offset = va - base_;
+    const size_t pages_after = (size_ - offset) / PAGE_SIZE - 1;
+
+    // A fault landing where the last one predicted continues a forward scan,
+    // so grow the window and fault in pages ahead with the same access type.
+    // This runs before fault-around so that a write scan gets the pages
+    // ahead mapped writable rather than read-only.
+    if (flags_ & VMAR_FLAG_PREFAULT_SEQUENTIAL) {
+        if (offset == seq_next_offset_) {
+            seq_window_ = seq_window_ ? MIN(seq_window_ * 2, kSeqPrefaultMaxPages)
+                                      : kSeqPrefaultMinPages;
+        } else {
+            seq_window_ = 0;
+        }
+        seq_next_offset_ = offset + PAGE_SIZE;
+
+        const size_t count = MIN(seq_window_, pages_after);
+        if (count > 0) {
+            uint prefault_flags = VMM_PF_FLAG_SW_FAULT | (pf_flags & VMM_PF_FLAG_WRITE);
+            __UNUSED size_t mapped = MapPagesAroundLocked(va + PAGE_SIZE, count, va,
+                                                          prefault_flags, mmu_flags);
+            LTRACEF_LEVEL(2, "prefaulted %zu of %zu pages after va %#" PRIxPTR "\n",
+                          mapped, count, va);
+            seq_next_offset_ += count * PAGE_SIZE;
+        }
+    }
+
+    if (fault_around_pages <= 1)
+        return;
+
+    // Map whatever is already resident in the aligned window around va.  Only
+    // look up existing pages: nothing is allocated, copied or zero-filled here.
+    // The pages are mapped read-only, since they may belong to a parent object
+    // and must be copied on the first write to them.
+    const size_t window_pos = (va / PAGE_SIZE) % fault_around_pages;
+    const size_t before = MIN(window_pos, offset / PAGE_SIZE);
+    const size_t after = MIN(fault_around_pages - window_pos - 1, pages_after);
+    const vaddr_t start = va - before * PAGE_SIZE;
+    const size_t count = before + 1 + after;
+
+    __UNUSED size_t mapped = MapPagesAroundLocked(start, count, va, 0,
+                                                  mmu_flags & ~ARCH_MMU_FLAG_PERM_WRITE);
+    LTRACEF_LEVEL(2, "fault-around mapped %zu pages around va %#" PRIxPTR "\n", mapped, va);
+}
+
+bool VmMapping::FaultLargePageLocked(vaddr_t va, paddr_t pa, uint mmu_flags) {
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+
+    // pages returned for a clone may belong to its parent and must stay
+    // read-only until copied, so only map the object's own pages this way
+    if (object_->is_cow_clone())
+        return false;
+
+    static const uint kBlockShifts[] = {HUGE_PAGE_SIZE_SHIFT, LARGE_PAGE_SIZE_SHIFT};
+    for (uint shift : kBlockShifts) {
+        const size_t block_size = 1UL << shift;
+
+        // the page has to sit at the same offset into a block as va does, and
+        // the block around va has to lie entirely within the mapping
+        if ((va ^ pa) & (block_size - 1))
+            continue;
+        const vaddr_t block_va = ROUNDDOWN(va, block_size);
+        if (block_va < base_ || size_ < block_size || block_va - base_ > size_ - block_size)
+            continue;
+        const paddr_t block_pa = pa - (va - block_va);
+
+        // every page of the block must be resident and contiguous
+        const size_t count = block_size / PAGE_SIZE;
+        const uint64_t vmo_offset = block_va - base_ + object_offset_;
+        if (!object_->IsContiguousLocked(vmo_offset, block_size, block_pa))
+            continue;
+
+        // replace whatever fault-around or earlier faults mapped in the block
+        AutoLock mmu_guard(aspace_->mmu_lock());
+        status_t status = arch_mmu_unmap(&aspace_->arch_aspace(), block_va, count, nullptr);
+        if (status < 0)
+            return false;
+
+        size_t mapped;
+        status = arch_mmu_map(&aspace_->arch_aspace(), block_va, block_pa, count,
+                              mmu_flags, &mapped);
+        if (status < 0) {
+            TRACEF("error %d mapping large page at va %#" PRIxPTR " pa %#" PRIxPTR "\n",
+                   status, block_va, block_pa);
+            return false;
+        }
+        DEBUG_ASSERT(mapped == count);
+
+#if ARCH_ARM64
+        if (arch_mmu_flags_ & ARCH_MMU_FLAG_PERM_EXECUTE)
+            arch_sync_cache_range(block_va, block_size);
+#endif
+
+        LTRACEF("mapped %#zx byte page at va %#" PRIxPTR " pa %#" PRIxPTR "\n",
+                block_size, block_va, block_pa);
+        return true;
+    }
+
+    return false;
+}
+
+size_t VmMapping::MapPagesAroundLocked(vaddr_t va, size_t count, vaddr_t skip_va,
+                                       uint pf_flags, uint mmu_flags) {
+    DEBUG_ASSERT(object_->lock()->IsHeld());
+    DEBUG_ASSERT(va >= base_ && count <= (size_ - (va - base_)) / PAGE_SIZE);
+
+    size_t total = 0;
+
+    // the current run of virtually and physically contiguous pages
+    vaddr_t run_va = 0;
+    paddr_t run_pa = 0;
+    size_t run_len = 0;
+
+    auto flush_run = [&]() -> bool {
+        if (run_len == 0)
+            return true;
+
+        AutoLock mmu_guard(aspace_->mmu_lock());
+        size_t mapped;
+        status_t status = arch_mmu_map(&aspace_->arch_aspace(), run_va, run_pa, run_len,
+                                       mmu_flags, &mapped);
+        if (status < 0) {
+            TRACEF("error %d mapping %zu pages at va %#" PRIxPTR " pa %#" PRIxPTR "\n",
+                   status, run_len, run_va, run_pa);
+            run_len = 0;
+            return false;
+        }
+        DEBUG_ASSERT(mapped == run_len);
+
+#if ARCH_ARM64
+        if (mmu_flags & ARCH_MMU_FLAG_PERM_EXECUTE)
+            arch_sync_cache_range(run_va, run_len * PAGE_SIZE);
+#endif
+        total += run_len;
+        run_len = 0;
+        return true;
+    };
+
+    for (size_t i = 0; i < count; i++) {
+        const vaddr_t cur_va = va + i * PAGE_SIZE;
+        if (cur_va == skip_va) {
+            if (!flush_run())
+                break;
+            continue;
+        }
+
+        // leave anything already mapped alone; checking this before asking the
+        // object for the page keeps us from committing pages we won't map
+        paddr_t pa;
+        uint page_flags;
+        status_t status;
+        {
+            AutoLock mmu_guard(aspace_->mmu_lock());
+            status = arch_mmu_query(&aspace_->arch_aspace(), cur_va, &pa, &page_flags);
+        }
+        if (status >= 0) {
+            if (!flush_run())
+                break;
+            continue;
+        }
+
+        status = object_->GetPageLocked(cur_va - base_ + object_offset_, pf_flags,
+                                                 nullptr, &pa);
+        if (status == ERR_NOT_FOUND) {
+            if (!flush_run())
+                break;
+            continue;
+        } else if (status < 0) {
+            break;
+        }
+
+        // assert that we're not accidentally mapping the zero page writable
+        DEBUG_ASSERT((pa != vm_get_zero_page_paddr()) || !(mmu_flags & ARCH_MMU_FLAG_PERM_WRITE));
+
+        if (run_len > 0 && cur_va == run_va + run_len * PAGE_SIZE &&
+            pa == run_pa + run_len * PAGE_SIZE) {
+            run_len++;
+            continue;
+        }
+
+        if (!flush_run())
+            break;
+        run_va = cur_va;
+        run_pa = pa;
+        run_len = 1;
+    }
+    flush_run();
+
+    return total;
+}
+
 // We disable thread safety analysis here because one of the common uses of this
 // function is for splitting one mapping object into several that will be backed
 // by the same VmObject.  In that case, object_->lock() gets aliased across all
@@ -25,24 +25,10 @@
 
 #define LOCAL_TRACE MAX(VM_GLOBAL_TRACE, 0)
 
-namespace {
-
-void ZeroPage(paddr_t pa) {
-    void* ptr = paddr_to_kvaddr(pa);
-    DEBUG_ASSERT(ptr);
-
-    arch_zero_page(ptr);
-}
-
-void ZeroPage(vm_page_t* p) {
-    paddr_t pa = vm_page_to_paddr(p);
-    ZeroPage(pa);
-}
-
-} // namespace
-
-VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, mxtl::RefPtr<VmObject> parent)
-    : VmObject(mxtl::move(parent)), pmm_alloc_flags_(pmm_alloc_flags) {
+VmObjectPaged::VmObjectPaged(uint32_t pmm_alloc_flags, uint32_t options,
+                             mxtl::RefPtr<VmObject> parent)
+    : VmObject(mxtl::move(parent)), pmm_alloc_flags_(pmm_alloc_flags),
+      large_pages_((options & kLargePages) != 0) {
     LTRACEF("%p\n", this);
 }
 
@@ -55,13 +41,14 @@ VmObjectPaged::~VmObjectPaged() {
     page_list_.FreeAllPages();
 }
 
-mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size) {
+mxtl::RefPtr<VmObject> VmObjectPaged::Create(uint32_t pmm_alloc_flags, uint64_t size,
+                                             uint32_t options) {
     // there's a max size to keep indexes within range
     if (size > MAX_SIZE)
         return nullptr;
 
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(pmm_alloc_flags, nullptr));
+    auto vmo = mxtl::AdoptRef<VmObject>(new (&ac) VmObjectPaged(pmm_alloc_flags, options, nullptr));
     if (!ac.check())
         return nullptr;
 
@@ -82,7 +69,7 @@ status_t VmObjectPaged::CloneCOW(uint64_t offset, uint64_t size, mxtl::RefPtr<Vm
     canary_.Assert();
 
     AllocChecker ac;
-    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_, mxtl::WrapRefPtr(this)));
+    auto vmo = mxtl::AdoptRef<VmObjectPaged>(new (&ac) VmObjectPaged(pmm_alloc_flags_, 0, mxtl::WrapRefPtr(this)));
     if (!ac.check())
         return ERR_NO_MEMORY;
 
@@ -318,16 +305,13 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
         return NO_ERROR;
     }
 
-    // allocate a page
-    p = pmm_alloc_page(pmm_alloc_flags_, &pa);
+    // allocate a zeroed page
+    p = pmm_alloc_page(pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &pa);
     if (!p)
         return ERR_NO_MEMORY;
 
     p->state = VM_PAGE_STATE_OBJECT;
 
-    // TODO: remove once pmm returns zeroed pages
-    ZeroPage(pa);
-
     status_t status = AddPageLocked(p, offset);
     DEBUG_ASSERT(status == NO_ERROR);
 
@@ -344,6 +328,16 @@ status_t VmObjectPaged::GetPageLocked(uint64_t offset, uint pf_flags, vm_page_t*
     return NO_ERROR;
 }
 
+bool VmObjectPaged::IsContiguousLocked(uint64_t offset, uint64_t len, paddr_t pa) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    if (offset + len < offset || offset + len > size_)
+        return false;
+
+    return page_list_.IsContiguousRun(offset, len, pa);
+}
+
 status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* committed) {
     canary_.Assert();
     LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
@@ -366,6 +360,24 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     uint64_t end = ROUNDUP_PAGE_SIZE(offset + new_len);
     DEBUG_ASSERT(end > offset);
 
+    // back every whole aligned block in the range with a contiguous run first,
+    // trying the largest size first. blocks that are partially committed
+    // already or can't be allocated contiguously get single pages below.
+    uint64_t block_committed = 0;
+    if (large_pages_) {
+        static const uint kBlockShifts[] = {HUGE_PAGE_SIZE_SHIFT, LARGE_PAGE_SIZE_SHIFT};
+        for (uint shift : kBlockShifts) {
+            const uint64_t block_size = 1ULL << shift;
+            for (uint64_t o = ROUNDUP(offset, block_size); o < end && end - o >= block_size;
+                 o += block_size) {
+                if (CommitBlockLocked(o, shift) == NO_ERROR)
+                    block_committed += block_size;
+            }
+        }
+        if (committed)
+            *committed = block_committed;
+    }
+
     // make a pass through the list, counting the number of pages we need to allocate
     size_t count = 0;
     for (uint64_t o = offset; o < end; o += PAGE_SIZE) {
@@ -379,7 +391,7 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_, &page_list);
+    size_t allocated = pmm_alloc_pages(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED, &page_list);
     if (allocated < count) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
         pmm_free(&page_list);
@@ -400,9 +412,6 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
 
         p->state = VM_PAGE_STATE_OBJECT;
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
-
         status_t status = page_list_.AddPage(p, o);
         DEBUG_ASSERT(status == NO_ERROR);
 
@@ -413,8 +422,50 @@ status_t VmObjectPaged::CommitRange(uint64_t offset, uint64_t len, uint64_t* com
     DEBUG_ASSERT(list_is_empty(&page_list));
 
     // for now we only support committing as much as we were asked for
-    DEBUG_ASSERT(!committed || *committed == count * PAGE_SIZE);
+    DEBUG_ASSERT(!committed || *committed == block_committed + count * PAGE_SIZE);
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::CommitBlockLocked(uint64_t offset, uint block_shift) {
+    canary_.Assert();
+    DEBUG_ASSERT(lock_.IsHeld());
+
+    const uint64_t block_size = 1ULL << block_shift;
+    DEBUG_ASSERT(IS_ALIGNED(offset, block_size));
+    if (offset + block_size < offset || offset + block_size > size_)
+        return ERR_OUT_OF_RANGE;
+
+    if (!page_list_.IsRangeEmpty(offset, block_size))
+        return ERR_ALREADY_EXISTS;
+
+    const size_t count = static_cast<size_t>(block_size / PAGE_SIZE);
+    list_node page_list;
+    list_initialize(&page_list);
+
+    size_t allocated = pmm_alloc_contiguous(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED,
+                                            static_cast<uint8_t>(block_shift), nullptr, &page_list);
+    if (allocated < count) {
+        LTRACEF("no contiguous run of %zu pages for offset %#" PRIx64 "\n", count, offset);
+        pmm_free(&page_list);
+        return ERR_NO_MEMORY;
+    }
+
+    // unmap all of the pages in this range on all the mapping regions
+    RangeChangeUpdateLocked(offset, block_size);
+
+    for (uint64_t o = offset; o < offset + block_size; o += PAGE_SIZE) {
+        vm_page_t* p = list_remove_head_type(&page_list, vm_page_t, free.node);
+        ASSERT(p);
+
+        p->state = VM_PAGE_STATE_OBJECT;
+
+        auto status = page_list_.AddPage(p, o);
+        DEBUG_ASSERT(status == NO_ERROR);
+    }
 
+    LTRACEF("committed %#" PRIx64 " bytes contiguously at offset %#" PRIx64 "\n",
+            block_size, offset);
     return NO_ERROR;
 }
 
@@ -454,7 +505,8 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
     list_node page_list;
     list_initialize(&page_list);
 
-    size_t allocated = pmm_alloc_contiguous(count, pmm_alloc_flags_, alignment_log2, nullptr, &page_list);
+    size_t allocated = pmm_alloc_contiguous(count, pmm_alloc_flags_ | PMM_ALLOC_FLAG_ZEROED,
+                                            alignment_log2, nullptr, &page_list);
     if (allocated < count) {
         LTRACEF("failed to allocate enough pages (asked for %zu, got %zu)\n", count, allocated);
         pmm_free(&page_list);
@@ -473,9 +525,6 @@ status_t VmObjectPaged::CommitRangeContiguous(uint64_t offset, uint64_t len, uin
 
         p->state = VM_PAGE_STATE_OBJECT;
 
-        // TODO: remove once pmm returns zeroed pages
-        ZeroPage(p);
-
         auto status = page_list_.AddPage(p, o);
         DEBUG_ASSERT(status == NO_ERROR);
 
@@ -532,6 +581,96 @@ status_t VmObjectPaged::DecommitRange(uint64_t offset, uint64_t len, uint64_t* d
     return NO_ERROR;
 }
 
+status_t VmObjectPaged::TakePages(uint64_t offset, uint64_t len, vm_page_t** pages) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len) || len == 0)
+        return ERR_INVALID_ARGS;
+
+    AutoLock a(&lock_);
+
+    if (!InRange(offset, len, size_))
+        return ERR_OUT_OF_RANGE;
+
+    // make sure we own a page at every offset, breaking copy-on-write
+    // sharing with the parent or zero filling as needed
+    for (uint64_t o = offset; o < offset + len; o += PAGE_SIZE) {
+        vm_page_t* p;
+        auto status = GetPageLocked(o, VMM_PF_FLAG_SW_FAULT | VMM_PF_FLAG_WRITE, &p, nullptr);
+        if (status != NO_ERROR)
+            return status;
+        // wired pages (e.g. from CreateFromROData) can't leave the object
+        if (p->state != VM_PAGE_STATE_OBJECT)
+            return ERR_NOT_SUPPORTED;
+    }
+
+    // unmap all of the pages in this range on all the mapping regions
+    RangeChangeUpdateLocked(offset, len);
+
+    size_t i = 0;
+    for (uint64_t o = offset; o < offset + len; o += PAGE_SIZE, i++) {
+        pages[i] = page_list_.RemovePage(o);
+        DEBUG_ASSERT(pages[i]);
+    }
+
+    return NO_ERROR;
+}
+
+status_t VmObjectPaged::SupplyPages(uint64_t offset, uint64_t len, vm_page_t** pages) {
+    canary_.Assert();
+    LTRACEF("offset %#" PRIx64 ", len %#" PRIx64 "\n", offset, len);
+
+    if (!IS_PAGE_ALIGNED(offset) || !IS_PAGE_ALIGNED(len) || len == 0)
+        return ERR_INVALID_ARGS;
+
+    AutoLock a(&lock_);
+
+    if (!InRange(offset, len, size_))
+        return ERR_OUT_OF_RANGE;
+
+    // wired pages can't be replaced (and freed)
+    for (uint64_t o = offset; o < offset + len; o += PAGE_SIZE) {
+        vm_page_t* p = page_list_.GetPage(o);
+        if (p && p->state != VM_PAGE_STATE_OBJECT)
+            return ERR_NOT_SUPPORTED;
+    }
+
+    // unmap all of the pages in this range on all the mapping regions
+    RangeChangeUpdateLocked(offset, len);
+
+    // swap each new page with whatever was there, leaving the old page in
+    // |pages| so that a failure part way through can be undone
+    size_t count = static_cast<size_t>(len / PAGE_SIZE);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t o = offset + i * PAGE_SIZE;
+        vm_page_t* old = page_list_.RemovePage(o);
+        if (page_list_.AddPage(pages[i], o) != NO_ERROR) {
+            // only fails if there was no list node to hold the page, in which
+            // case there wasn't an old page either
+            DEBUG_ASSERT(!old);
+            while (i-- > 0) {
+                o = offset + i * PAGE_SIZE;
+                vm_page_t* p = page_list_.RemovePage(o);
+                if (pages[i]) {
+                    __UNUSED auto status = page_list_.AddPage(pages[i], o);
+                    DEBUG_ASSERT(status == NO_ERROR);
+                }
+                pages[i] = p;
+            }
+            return ERR_NO_MEMORY;
+        }
+        pages[i] = old;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (pages[i])
+            pmm_free_page(pages[i]);
+    }
+
+    return NO_ERROR;
+}
+
 status_t VmObjectPaged::ResizeLocked(uint64_t s) {
     canary_.Assert();
     DEBUG_ASSERT(lock_.IsHeld());
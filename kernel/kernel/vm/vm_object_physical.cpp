@@ -80,6 +80,15 @@ status_t VmObjectPhysical::GetPageLocked(uint64_t offset, uint pf_flags, vm_page
     return NO_ERROR;
 }
 
+bool VmObjectPhysical::IsContiguousLocked(uint64_t offset, uint64_t len, paddr_t pa) {
+    canary_.Assert();
+
+    if (offset + len < offset || offset + len > size_)
+        return false;
+
+    return base_ + offset == pa;
+}
+
 status_t VmObjectPhysical::LookupUser(uint64_t offset, uint64_t len, user_ptr<paddr_t> buffer,
                                       size_t buffer_size) {
     canary_.Assert();
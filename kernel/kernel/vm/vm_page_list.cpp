@@ -111,6 +111,48 @@ vm_page* VmPageList::GetPage(uint64_t offset) {
     return pln->GetPage(index);
 }
 
+bool VmPageList::IsContiguousRun(uint64_t offset, uint64_t len, paddr_t pa) {
+    DEBUG_ASSERT(IS_PAGE_ALIGNED(offset) && IS_PAGE_ALIGNED(len));
+
+    const uint64_t node_size = PAGE_SIZE * VmPageListNode::kPageFanOut;
+    const uint64_t end = offset + len;
+
+    uint64_t o = offset;
+    auto pln = list_.find(ROUNDDOWN(o, node_size));
+    while (o < end) {
+        // every node covering the range has to exist, in order
+        if (!pln.IsValid() || pln->offset() != ROUNDDOWN(o, node_size))
+            return false;
+
+        for (size_t index = (o >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+             index < VmPageListNode::kPageFanOut && o < end; index++, o += PAGE_SIZE) {
+            vm_page* p = pln->GetPage(index);
+            if (!p || vm_page_to_paddr(p) != pa + (o - offset))
+                return false;
+        }
+        ++pln;
+    }
+
+    return true;
+}
+
+bool VmPageList::IsRangeEmpty(uint64_t offset, uint64_t len) {
+    const uint64_t node_size = PAGE_SIZE * VmPageListNode::kPageFanOut;
+    const uint64_t end = offset + len;
+
+    // only the nodes that overlap the range need looking at
+    for (auto pln = list_.lower_bound(ROUNDDOWN(offset, node_size));
+         pln.IsValid() && pln->offset() < end; ++pln) {
+        for (size_t index = 0; index < VmPageListNode::kPageFanOut; index++) {
+            const uint64_t o = pln->offset() + index * PAGE_SIZE;
+            if (o >= offset && o < end && pln->GetPage(index))
+                return false;
+        }
+    }
+
+    return true;
+}
+
 status_t VmPageList::FreePage(uint64_t offset) {
     uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
     size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
@@ -139,6 +181,22 @@ status_t VmPageList::FreePage(uint64_t offset) {
     return NO_ERROR;
 }
 
+vm_page* VmPageList::RemovePage(uint64_t offset) {
+    uint64_t node_offset = ROUNDDOWN(offset, PAGE_SIZE * VmPageListNode::kPageFanOut);
+    size_t index = (offset >> PAGE_SIZE_SHIFT) % VmPageListNode::kPageFanOut;
+
+    LTRACEF_LEVEL(2, "%p offset %#" PRIx64 " node_offset %#" PRIx64 " index %zu\n", this, offset, node_offset,
+                  index);
+
+    // lookup the tree node that holds this page
+    auto pln = list_.find(node_offset);
+    if (!pln.IsValid()) {
+        return nullptr;
+    }
+
+    return pln->RemovePage(index);
+}
+
 size_t VmPageList::FreeAllPages() {
     LTRACEF("%p\n", this);
 
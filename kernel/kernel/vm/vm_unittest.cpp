@@ -70,6 +70,73 @@ static bool pmm_oversized_alloc_test(void* context) {
     END_TEST;
 }
 
+// Allocates and frees enough single pages to overflow and refill the per cpu
+// page cache several times, checking each page translates back correctly.
+static bool pmm_single_page_churn_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_count = 256;
+    list_node list = LIST_INITIAL_VALUE(list);
+
+    for (size_t i = 0; i < alloc_count; i++) {
+        paddr_t pa;
+        vm_page_t* page = pmm_alloc_page(0, &pa);
+        EXPECT_NEQ(nullptr, page, "pmm_alloc single page");
+        if (!page)
+            break;
+        EXPECT_EQ(pa, vm_page_to_paddr(page), "vm_page_to_paddr on single page");
+        EXPECT_EQ(page, paddr_to_vm_page(pa), "paddr_to_vm_page on single page");
+        list_add_tail(&list, &page->free.node);
+    }
+
+    vm_page_t* page;
+    while ((page = list_remove_head_type(&list, vm_page_t, free.node))) {
+        EXPECT_EQ(1u, pmm_free_page(page), "pmm_free_page on single page");
+    }
+    END_TEST;
+}
+
+// Allocates contiguous runs of assorted sizes and alignments, including ones
+// that don't fit in a single buddy block, and checks the pages that come back.
+static bool pmm_contiguous_alloc_test(void* context) {
+    BEGIN_TEST;
+    static const struct {
+        size_t count;
+        uint8_t alignment_log2;
+    } allocs[] = {
+        {1, PAGE_SIZE_SHIFT},
+        {3, PAGE_SIZE_SHIFT},
+        {16, PAGE_SIZE_SHIFT + 4},
+        {17, PAGE_SIZE_SHIFT},
+        {1, 21}, // a single 2MB aligned page
+        {600, 22},
+        {2048, PAGE_SIZE_SHIFT}, // larger than the biggest buddy block
+    };
+
+    for (const auto& a : allocs) {
+        list_node list = LIST_INITIAL_VALUE(list);
+        paddr_t pa;
+        size_t count = pmm_alloc_contiguous(a.count, 0, a.alignment_log2, &pa, &list);
+        EXPECT_EQ(a.count, count, "pmm_alloc_contiguous count");
+        if (count != a.count)
+            continue;
+        EXPECT_TRUE(IS_ALIGNED(pa, 1UL << a.alignment_log2), "pmm_alloc_contiguous alignment");
+
+        size_t i = 0;
+        vm_page_t* p;
+        list_for_every_entry (&list, p, vm_page_t, free.node) {
+            if (vm_page_to_paddr(p) != pa + i * PAGE_SIZE) {
+                EXPECT_EQ(pa + i * PAGE_SIZE, vm_page_to_paddr(p), "pmm_alloc_contiguous run");
+                break;
+            }
+            i++;
+        }
+        EXPECT_EQ(a.count, list_length(&list), "pmm_alloc_contiguous list count");
+
+        EXPECT_EQ(count, pmm_free(&list), "pmm_free on a contiguous run");
+    }
+    END_TEST;
+}
+
 static uint32_t test_rand(uint32_t seed) {
     return (seed = seed * 1664525 + 1013904223);
 }
@@ -619,6 +686,60 @@ static bool vmo_read_write_smoke_test(void* context) {
     END_TEST;
 }
 
+// Moves pages between two vm objects and makes sure the data goes with them.
+static bool vmo_move_pages_test(void* context) {
+    BEGIN_TEST;
+    static const size_t alloc_size = PAGE_SIZE * 4;
+
+    auto src = VmObjectPaged::Create(0, alloc_size);
+    REQUIRE_NONNULL(src, "vmobject creation\n");
+    auto dst = VmObjectPaged::Create(0, alloc_size);
+    REQUIRE_NONNULL(dst, "vmobject creation\n");
+
+    AllocChecker ac;
+    mxtl::Array<uint8_t> a(new (&ac) uint8_t[alloc_size], alloc_size);
+    EXPECT_TRUE(ac.check(), "");
+    fill_region(77, a.get(), alloc_size);
+
+    size_t bytes;
+    status_t err = src->Write(a.get(), 0, alloc_size, &bytes);
+    EXPECT_EQ(NO_ERROR, err, "writing to object");
+
+    // only whole pages can move
+    vm_page_t* pages[4];
+    EXPECT_EQ(ERR_INVALID_ARGS, src->TakePages(7, PAGE_SIZE, pages), "unaligned take");
+    EXPECT_EQ(ERR_OUT_OF_RANGE, src->TakePages(PAGE_SIZE, alloc_size, pages), "take past end");
+
+    // the source is left decommitted
+    err = src->TakePages(0, alloc_size, pages);
+    EXPECT_EQ(NO_ERROR, err, "taking pages");
+    EXPECT_EQ(0u, src->AllocatedPages(), "source decommitted");
+
+    // supplying over committed pages replaces them
+    uint64_t committed;
+    err = dst->CommitRange(0, alloc_size, &committed);
+    EXPECT_EQ(NO_ERROR, err, "committing vm object");
+    err = dst->SupplyPages(0, alloc_size, pages);
+    EXPECT_EQ(NO_ERROR, err, "supplying pages");
+    EXPECT_EQ(alloc_size / PAGE_SIZE, dst->AllocatedPages(), "pages replaced");
+
+    mxtl::Array<uint8_t> b(new (&ac) uint8_t[alloc_size], alloc_size);
+    EXPECT_TRUE(ac.check(), "can't allocate buffer");
+    err = dst->Read(b.get(), 0, alloc_size, &bytes);
+    EXPECT_EQ(NO_ERROR, err, "reading from object");
+    EXPECT_EQ(0, memcmp(b.get(), a.get(), alloc_size), "data moved with the pages");
+
+    // and back into the holes left in the source
+    err = dst->TakePages(PAGE_SIZE, PAGE_SIZE, pages);
+    EXPECT_EQ(NO_ERROR, err, "taking pages");
+    err = src->SupplyPages(PAGE_SIZE, PAGE_SIZE, pages);
+    EXPECT_EQ(NO_ERROR, err, "supplying pages");
+    err = src->Read(b.get(), PAGE_SIZE, PAGE_SIZE, &bytes);
+    EXPECT_EQ(NO_ERROR, err, "reading from object");
+    EXPECT_EQ(0, memcmp(b.get(), a.get() + PAGE_SIZE, PAGE_SIZE), "data moved back");
+    END_TEST;
+}
+
 // Use the function name as the test name
 #define VM_UNITTEST(fname) UNITTEST(#fname, fname)
 
@@ -626,6 +747,8 @@ UNITTEST_START_TESTCASE(vm_tests)
 VM_UNITTEST(pmm_smoke_test)
 VM_UNITTEST(pmm_large_alloc_test)
 VM_UNITTEST(pmm_oversized_alloc_test)
+VM_UNITTEST(pmm_single_page_churn_test)
+VM_UNITTEST(pmm_contiguous_alloc_test)
 VM_UNITTEST(vmm_alloc_smoke_test)
 VM_UNITTEST(vmm_alloc_contiguous_smoke_test)
 VM_UNITTEST(multiple_regions_test)
@@ -645,5 +768,6 @@ VM_UNITTEST(vmo_dropped_ref_test)
 VM_UNITTEST(vmo_remap_test)
 VM_UNITTEST(vmo_double_remap_test)
 VM_UNITTEST(vmo_read_write_smoke_test)
+VM_UNITTEST(vmo_move_pages_test)
 VM_UNITTEST(dump_all_aspaces) // Run last
 UNITTEST_END_TESTCASE(vm_tests, "vmtests", "Virtual memory tests", nullptr, nullptr);
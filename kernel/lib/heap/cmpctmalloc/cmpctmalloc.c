@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <err.h>
+#include <arch/ops.h>
 #include <kernel/thread.h>
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
@@ -26,6 +27,9 @@
 // Allocation strategy takes place with a global mutex.  Freelist entries are
 // kept in linked lists with 8 different sizes per binary order of magnitude
 // and the header size is two words with eager coalescing on free.
+//
+// Small allocations go through a per-cpu cache in front of the global heap.
+// See "Per-cpu caches" below.
 
 #if defined(DEBUG) || LK_DEBUGLEVEL > 2
 #define CMPCT_DEBUG
@@ -86,7 +90,44 @@ struct heap {
 // Heap static vars.
 static struct heap theheap;
 
+// Per-cpu caches.
+//
+// Allocations of up to CACHE_MAX_SIZE bytes are served from a per-cpu list of
+// free blocks for their bucket, and freed back onto it, without taking the
+// heap lock.  Blocks in a cache are still allocated as far as the heap is
+// concerned.  When a list runs dry or overflows, CACHE_BATCH blocks move
+// to or from the heap under a single acquisition of the heap lock.
+#define CACHE_MAX_SIZE 256
+#define CACHE_BUCKETS 24  // size_to_index_allocating(CACHE_MAX_SIZE) + 1
+#define CACHE_MAX 16
+#define CACHE_BATCH 8
+
+typedef struct cached_struct {
+    struct cached_struct *next;
+} cached_t;
+
+struct cpu_cache {
+    spin_lock_t lock;
+    struct {
+        cached_t *head;
+        uint count;
+
+        // statistics, only modified with the lock held
+        uint64_t alloc_hits;
+        uint64_t alloc_misses;
+        uint64_t frees;
+        uint64_t flushes;
+    } buckets[CACHE_BUCKETS];
+} __CPU_ALIGN;
+
+static struct cpu_cache cpu_caches[SMP_MAX_CPUS];
+
+// Cleared while the self tests run, since they look at where blocks land.
+static bool cache_enabled = true;
+
 static ssize_t heap_grow(size_t len, free_t **bucket);
+static void free_locked(header_t *header) TA_REQ(theheap.lock);
+static void cache_drain(void);
 
 static void lock(void) TA_ACQ(theheap.lock)
 {
@@ -130,6 +171,25 @@ void cmpct_dump(bool panic_time) TA_NO_THREAD_SAFETY_ANALYSIS
 
     if (!panic_time)
         unlock();
+
+    dprintf(INFO, "\tper-cpu caches%s:\n", cache_enabled ? "" : " (disabled)");
+    dprintf(INFO, "\t%6s %12s %12s %12s %12s %8s\n",
+            "size", "hits", "misses", "frees", "flushes", "cached");
+    for (int i = 0; i < CACHE_BUCKETS; i++) {
+        uint64_t hits = 0, misses = 0, frees = 0, flushes = 0, cached = 0;
+        for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+            hits += cpu_caches[cpu].buckets[i].alloc_hits;
+            misses += cpu_caches[cpu].buckets[i].alloc_misses;
+            frees += cpu_caches[cpu].buckets[i].frees;
+            flushes += cpu_caches[cpu].buckets[i].flushes;
+            cached += cpu_caches[cpu].buckets[i].count;
+        }
+        if (hits + misses + frees == 0)
+            continue;
+        dprintf(INFO, "\t%6d %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %12" PRIu64 " %8" PRIu64 "\n",
+                (i + 1) * 8 <= 128 ? (i + 1) * 8 : 128 + (i - 15) * 16,
+                hits, misses, frees, flushes, cached);
+    }
 }
 
 // Operates in sizes that don't include the allocation header.
@@ -454,6 +514,7 @@ static void cmpct_test_buckets(void)
 {
     size_t rounded;
     unsigned bucket;
+    ASSERT(size_to_index_allocating(CACHE_MAX_SIZE, &rounded) == CACHE_BUCKETS - 1);
     // Check for the 8-spaced buckets up to 128.
     for (unsigned i = 1; i <= 128; i++) {
         // Round up when allocating.
@@ -565,6 +626,10 @@ static void cmpct_test_return_to_os(void)
 
 void cmpct_test(void)
 {
+    // The tests below check where blocks land, which the caches would hide.
+    cache_enabled = false;
+    cache_drain();
+
     cmpct_test_buckets();
     cmpct_test_get_back_newly_freed();
     cmpct_test_return_to_os();
@@ -621,6 +686,8 @@ void cmpct_test(void)
     }
 
     cmpct_dump(false);
+
+    cache_enabled = true;
 }
 
 static void check_free_fill(void *ptr, size_t size)
@@ -670,6 +737,10 @@ static void *large_alloc(size_t size)
 
 void cmpct_trim(void)
 {
+    // Give back what the per-cpu caches are holding first, so that it can
+    // coalesce with its neighbours.
+    cache_drain();
+
     // Look at free list entries that are at least as large as one page plus a
     // header. They might be at the start or the end of a block, so we can trim
     // them and free the page(s).
@@ -740,18 +811,10 @@ void cmpct_trim(void)
     unlock();
 }
 
-void *cmpct_alloc(size_t size)
+// Allocates from the freelists.  |start_bucket| and |rounded_up| (which
+// includes the header) come from size_to_index_allocating().
+static void *alloc_locked(size_t size, int start_bucket, size_t rounded_up) TA_REQ(theheap.lock)
 {
-    if (size == 0u) return NULL;
-
-    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
-
-    size_t rounded_up;
-    int start_bucket = size_to_index_allocating(size, &rounded_up);
-
-    rounded_up += sizeof(header_t);
-
-    lock();
     int bucket = find_nonempty_bucket(start_bucket);
     if (bucket == -1) {
         // Grow heap by at least 12% if we can.
@@ -759,10 +822,8 @@ void *cmpct_alloc(size_t size)
                             MAX(theheap.size >> 3,
                                 MAX(HEAP_GROW_SIZE, rounded_up)));
         while (heap_grow(growby, NULL) < 0) {
-            if (growby <= rounded_up) {
-                unlock();
+            if (growby <= rounded_up)
                 return NULL;
-            }
             growby = MAX(growby >> 1, rounded_up);
         }
         bucket = find_nonempty_bucket(start_bucket);
@@ -789,8 +850,133 @@ void *cmpct_alloc(size_t size)
 #ifdef CMPCT_DEBUG
     check_free_fill(result, size);
     memset(result, ALLOC_FILL, size);
-    memset(((char *)result) + size, PADDING_FILL, rounded_up - size - sizeof(header_t));
+    memset(((char *)result) + size, PADDING_FILL, head->header.size - size - sizeof(header_t));
 #endif
+    return result;
+}
+
+// Which per-cpu cache bucket a block belongs in.  Blocks are put in the bucket
+// their usable size rounds down to, so any block in a bucket is big enough
+// for any allocation that rounds up to it.
+static int cache_bucket(size_t usable_size)
+{
+    return size_to_index_freeing(usable_size);
+}
+
+static struct cpu_cache *cache_lock(spin_lock_saved_state_t *state) TA_NO_THREAD_SAFETY_ANALYSIS
+{
+    arch_interrupt_save(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    struct cpu_cache *cache = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&cache->lock);
+    return cache;
+}
+
+static void cache_unlock(struct cpu_cache *cache, spin_lock_saved_state_t state)
+    TA_NO_THREAD_SAFETY_ANALYSIS
+{
+    spin_unlock_restore(&cache->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+// Fills a block going into a cache the way the freelists would, so that
+// check_free_fill() works the same on the way out.
+static void cache_fill_free(cached_t *block)
+{
+#ifdef CMPCT_DEBUG
+    header_t *header = (header_t *)block - 1;
+    memset((char *)block + (sizeof(free_t) - sizeof(header_t)), FREE_FILL,
+           header->size - sizeof(free_t));
+#endif
+}
+
+// |start_bucket| and |rounded_up| (which doesn't include the header) come
+// from size_to_index_allocating().
+static void *cache_alloc(size_t size, int start_bucket, size_t rounded_up)
+{
+    int bucket = cache_bucket(rounded_up);
+    rounded_up += sizeof(header_t);
+
+    spin_lock_saved_state_t state;
+    struct cpu_cache *cache = cache_lock(&state);
+    cached_t *block = cache->buckets[bucket].head;
+    if (block != NULL) {
+        cache->buckets[bucket].head = block->next;
+        cache->buckets[bucket].count--;
+        cache->buckets[bucket].alloc_hits++;
+        cache_unlock(cache, state);
+#ifdef CMPCT_DEBUG
+        header_t *header = (header_t *)block - 1;
+        check_free_fill(block, size);
+        memset(block, ALLOC_FILL, size);
+        memset((char *)block + size, PADDING_FILL, header->size - size - sizeof(header_t));
+#endif
+        return block;
+    }
+    cache->buckets[bucket].alloc_misses++;
+    cache_unlock(cache, state);
+
+    // Refill with a batch from the heap, keeping the first block for ourselves.
+    cached_t *batch = NULL;
+    lock();
+    void *result = alloc_locked(size, start_bucket, rounded_up);
+    if (result != NULL) {
+        for (int i = 0; i < CACHE_BATCH - 1; i++) {
+            cached_t *extra = alloc_locked(rounded_up - sizeof(header_t), start_bucket, rounded_up);
+            if (extra == NULL)
+                break;
+            extra->next = batch;
+            batch = extra;
+        }
+    }
+    unlock();
+
+    cached_t *overflow = NULL;
+    cache = cache_lock(&state);
+    while (batch != NULL) {
+        cached_t *next = batch->next;
+        header_t *header = (header_t *)batch - 1;
+        int b = cache_bucket(header->size - sizeof(header_t));
+        if (b < CACHE_BUCKETS && cache->buckets[b].count < CACHE_MAX) {
+            cache_fill_free(batch);
+            batch->next = cache->buckets[b].head;
+            cache->buckets[b].head = batch;
+            cache->buckets[b].count++;
+        } else {
+            batch->next = overflow;
+            overflow = batch;
+        }
+        batch = next;
+    }
+    cache_unlock(cache, state);
+
+    // If we migrated to a cpu whose cache was already full, give the rest back.
+    if (overflow != NULL) {
+        lock();
+        while (overflow != NULL) {
+            cached_t *next = overflow->next;
+            free_locked((header_t *)overflow - 1);
+            overflow = next;
+        }
+        unlock();
+    }
+    return result;
+}
+
+void *cmpct_alloc(size_t size)
+{
+    if (size == 0u) return NULL;
+
+    if (size + sizeof(header_t) > (1u << HEAP_ALLOC_VIRTUAL_BITS)) return large_alloc(size);
+
+    size_t rounded_up;
+    int start_bucket = size_to_index_allocating(size, &rounded_up);
+
+    if (size <= CACHE_MAX_SIZE && cache_enabled)
+        return cache_alloc(size, start_bucket, rounded_up);
+
+    rounded_up += sizeof(header_t);
+
+    lock();
+    void *result = alloc_locked(size, start_bucket, rounded_up);
     unlock();
     return result;
 }
@@ -824,13 +1010,9 @@ void *cmpct_memalign(size_t size, size_t alignment)
     return payload;
 }
 
-void cmpct_free(void *payload)
+static void free_locked(header_t *header) TA_REQ(theheap.lock)
 {
-    if (payload == NULL) return;
-    header_t *header = (header_t *)payload - 1;
-    DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
     size_t size = header->size;
-    lock();
     header_t *left = header->left;
     if (left != NULL && is_tagged_as_free(left)) {
         // Coalesce with left free object.
@@ -859,6 +1041,94 @@ void cmpct_free(void *payload)
             free_memory(header, left, size);
         }
     }
+}
+
+// Puts a small block on this cpu's cache.  Returns false if it should go
+// straight back to the heap instead.
+static bool cache_free(header_t *header)
+{
+    int bucket = cache_bucket(header->size - sizeof(header_t));
+    if (bucket >= CACHE_BUCKETS)
+        return false;
+
+    cached_t *block = (cached_t *)(header + 1);
+    cache_fill_free(block);
+
+    cached_t *flush = NULL;
+    spin_lock_saved_state_t state;
+    struct cpu_cache *cache = cache_lock(&state);
+    cache->buckets[bucket].frees++;
+    if (cache->buckets[bucket].count == CACHE_MAX) {
+        // Hand a batch back to the heap to make room.
+        cache->buckets[bucket].flushes++;
+        for (int i = 0; i < CACHE_BATCH; i++) {
+            cached_t *b = cache->buckets[bucket].head;
+            cache->buckets[bucket].head = b->next;
+            b->next = flush;
+            flush = b;
+        }
+        cache->buckets[bucket].count -= CACHE_BATCH;
+    }
+    block->next = cache->buckets[bucket].head;
+    cache->buckets[bucket].head = block;
+    cache->buckets[bucket].count++;
+    cache_unlock(cache, state);
+
+    if (flush != NULL) {
+        lock();
+        while (flush != NULL) {
+            cached_t *next = flush->next;
+            free_locked((header_t *)flush - 1);
+            flush = next;
+        }
+        unlock();
+    }
+    return true;
+}
+
+// Returns every cached block on every cpu to the heap.
+static void cache_drain(void)
+{
+    for (uint cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        struct cpu_cache *cache = &cpu_caches[cpu];
+        cached_t *drain = NULL;
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&cache->lock, state);
+        for (int i = 0; i < CACHE_BUCKETS; i++) {
+            cached_t *b = cache->buckets[i].head;
+            while (b != NULL) {
+                cached_t *next = b->next;
+                b->next = drain;
+                drain = b;
+                b = next;
+            }
+            cache->buckets[i].head = NULL;
+            cache->buckets[i].count = 0;
+        }
+        spin_unlock_irqrestore(&cache->lock, state);
+
+        if (drain != NULL) {
+            lock();
+            while (drain != NULL) {
+                cached_t *next = drain->next;
+                free_locked((header_t *)drain - 1);
+                drain = next;
+            }
+            unlock();
+        }
+    }
+}
+
+void cmpct_free(void *payload)
+{
+    if (payload == NULL) return;
+    header_t *header = (header_t *)payload - 1;
+    DEBUG_ASSERT(!is_tagged_as_free(header));  // Double free!
+    if (cache_enabled && cache_free(header))
+        return;
+    lock();
+    free_locked(header);
     unlock();
 }
 
@@ -6,12 +6,16 @@
 
 #include <debug.h>
 #include <err.h>
+#include <inttypes.h>
 #include <platform.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
+#include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
+#include <kernel/spinlock.h>
 #include <kernel/vm/vm_aspace.h>
 #include <lib/ktrace.h>
 #include <lk/init.h>
@@ -82,40 +86,289 @@ static void ktrace_report_probes(void) {
     mutex_release(&probe_list_lock);
 }
 
-typedef struct ktrace_state {
-    // where the next record will be written
-    int offset;
+// Each cpu writes into its own ring so tracing never bounces a shared
+// cacheline between cpus. A ring is made of chunks, which are the unit in
+// which the circular mode overwrites and the streaming mode drains. Writers
+// on a cpu serialize on that cpu's lock with interrupts disabled; other
+// cpus only take it to rewind, stop or drain.
+typedef struct ktrace_cpu {
+    spin_lock_t lock;
+
+    // base of this cpu's ring
+    uint8_t* buffer;
+
+    // total bytes ever written and offset of the oldest byte still held,
+    // both only grow and are reduced modulo the ring size to address it
+    uint64_t head;
+    uint64_t tail;
+
+    // header of the chunk being filled, nullptr if a new one must be opened
+    ktrace_rec_32b_t* chunk;
+
+    // records dropped because the ring was full or overwritten
+    uint64_t lost;
+} __CPU_ALIGN ktrace_cpu_t;
 
+typedef struct ktrace_state {
     // mask of groups we allow, 0 == tracing disabled
     int grpmask;
 
-    // total size of the trace buffer
-    uint32_t bufsize;
+    // one of KTRACE_MODE_*
+    uint32_t mode;
+
+    // a rewind requested while stopped, applied on the next start so the
+    // stopped trace stays readable until then
+    bool rewind_pending;
+
+    // name records, written under meta_lock and kept apart from the per-cpu
+    // rings so they can never be overwritten
+    spin_lock_t meta_lock;
+    uint8_t* meta;
+    uint32_t meta_size;
+    uint32_t meta_offset;
+    uint32_t meta_read;
+    uint32_t meta_lost;
 
-    // offset where tracing was stopped, 0 if tracing active
-    uint32_t marker;
+    // geometry of the per-cpu rings
+    uint32_t ncpus;
+    uint32_t cpusize;
 
-    // raw trace buffer
+    // raw trace buffer, the metadata area followed by the rings
     uint8_t* buffer;
 } ktrace_state_t;
 
 static ktrace_state_t KTRACE_STATE;
+static ktrace_cpu_t KTRACE_CPUS[SMP_MAX_CPUS];
 
-int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
+// serializes readers, which in streaming mode consume the chunks they read
+static mutex_t read_lock = MUTEX_INITIAL_VALUE(read_lock);
+
+static uint32_t ktrace_meta_used(ktrace_state_t* ks) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&ks->meta_lock, state);
+    uint32_t n = ks->meta_offset;
+    spin_unlock_irqrestore(&ks->meta_lock, state);
+    return n;
+}
+
+static void ktrace_cpu_extent(ktrace_cpu_t* kc, uint64_t* tail, uint64_t* head) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&kc->lock, state);
+    *tail = kc->tail;
+    *head = kc->head;
+    spin_unlock_irqrestore(&kc->lock, state);
+}
+
+// Fill the unused end of the cpu's current chunk with pad records so that
+// head lands on a chunk boundary.
+static void ktrace_close_chunk(ktrace_state_t* ks, ktrace_cpu_t* kc) {
+    if (kc->chunk == nullptr) {
+        return;
+    }
+    uint32_t pos = (uint32_t)(kc->head % KTRACE_CHUNK_SIZE);
+    uint32_t gap = pos ? KTRACE_CHUNK_SIZE - pos : 0;
+    while (gap > 0) {
+        uint32_t n = MIN(gap, KTRACE_LEN(0xF));
+        uint32_t* tag = (uint32_t*) (kc->buffer + kc->head % ks->cpusize);
+        *tag = (TAG_PAD & 0xFFFFFFF0) | (n >> 3);
+        kc->head += n;
+        gap -= n;
+    }
+    kc->chunk = nullptr;
+}
+
+// Reserve len bytes in the cpu's ring, opening a new chunk if the record
+// does not fit in the current one. Returns nullptr if the record is lost.
+static void* ktrace_reserve(ktrace_state_t* ks, ktrace_cpu_t* kc, uint cpu,
+                            uint32_t len, uint64_t ts) {
+    if (kc->chunk != nullptr) {
+        uint32_t pos = (uint32_t)(kc->head % KTRACE_CHUNK_SIZE);
+        if ((pos == 0) || (pos + len > KTRACE_CHUNK_SIZE)) {
+            ktrace_close_chunk(ks, kc);
+        }
+    }
+    if (kc->chunk == nullptr) {
+        if (kc->head - kc->tail + KTRACE_CHUNK_SIZE > ks->cpusize) {
+            if (ks->mode != KTRACE_MODE_CIRCULAR) {
+                kc->lost++;
+                return nullptr;
+            }
+            // overwrite the oldest chunk
+            ktrace_rec_32b_t* oldest = (ktrace_rec_32b_t*) (kc->buffer + kc->tail % ks->cpusize);
+            kc->lost += oldest->c;
+            kc->tail += KTRACE_CHUNK_SIZE;
+        }
+        ktrace_rec_32b_t* hdr = (ktrace_rec_32b_t*) (kc->buffer + kc->head % ks->cpusize);
+        hdr->tag = TAG_CPU_CHUNK;
+        hdr->tid = 0;
+        hdr->ts = ts;
+        hdr->a = cpu;
+        hdr->b = (uint32_t)(kc->head / KTRACE_CHUNK_SIZE);
+        hdr->c = 0;
+        hdr->d = (uint32_t)kc->lost;
+        kc->chunk = hdr;
+        kc->head += sizeof(*hdr);
+    }
+
+    void* rec = kc->buffer + kc->head % ks->cpusize;
+    kc->head += len;
+    kc->chunk->c++;
+    return rec;
+}
+
+// Write a whole record, header and up to four payload words, while holding
+// the cpu's ring lock. Once the lock is dropped the slot may be drained by a
+// streaming reader or recycled by a circular overwrite, so nothing touches
+// it afterwards. Returns false if the record was lost.
+static bool ktrace_write_record(uint32_t tag, uint32_t tid, uint64_t ts,
+                                uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
     ktrace_state_t* ks = &KTRACE_STATE;
+    DEBUG_ASSERT(KTRACE_LEN(tag) >= KTRACE_HDRSIZE);
+    DEBUG_ASSERT(KTRACE_LEN(tag) <= KTRACE_HDRSIZE + 4 * sizeof(uint32_t));
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    uint cpu = arch_curr_cpu_num();
+    ktrace_cpu_t* kc = &KTRACE_CPUS[cpu];
+    spin_lock(&kc->lock);
+
+    ktrace_header_t* hdr = (ktrace_header_t*) ktrace_reserve(ks, kc, cpu, KTRACE_LEN(tag), ts);
+    if (hdr != nullptr) {
+        hdr->ts = ts;
+        hdr->tag = tag;
+        hdr->tid = tid;
+
+        const uint32_t args[] = {a, b, c, d};
+        uint32_t* payload = (uint32_t*) (hdr + 1);
+        for (uint32_t i = 0; i < (KTRACE_LEN(tag) - KTRACE_HDRSIZE) / sizeof(uint32_t); i++) {
+            payload[i] = args[i];
+        }
+    }
+
+    spin_unlock_restore(&kc->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+    return hdr != nullptr;
+}
+
+// Discard everything recorded and start over with fresh metadata.
+static void ktrace_reset(ktrace_state_t* ks) {
+    spin_lock_saved_state_t state;
+    spin_lock_irqsave(&ks->meta_lock, state);
+    ks->meta_offset = KTRACE_RECSIZE * 2;
+    ks->meta_read = 0;
+    ks->meta_lost = 0;
+    spin_unlock_irqrestore(&ks->meta_lock, state);
+
+    for (uint32_t i = 0; i < ks->ncpus; i++) {
+        ktrace_cpu_t* kc = &KTRACE_CPUS[i];
+        spin_lock_irqsave(&kc->lock, state);
+        kc->head = 0;
+        kc->tail = 0;
+        kc->chunk = nullptr;
+        kc->lost = 0;
+        spin_unlock_irqrestore(&kc->lock, state);
+    }
+
+    ktrace_report_syscalls(kt_syscall_info);
+    ktrace_report_probes();
+}
+
+// Copy the part of [src, src + n), found at stream position *pos, that lies
+// within the window [off, off + len) described by the user buffer.
+static status_t ktrace_copy_window(uint8_t* uptr, uint32_t off, uint32_t len,
+                                   uint32_t* pos, const uint8_t* src, uint32_t n) {
+    uint32_t start = *pos;
+    *pos += n;
+    if ((start + n <= off) || (start >= off + len)) {
+        return NO_ERROR;
+    }
+    uint32_t skip = (off > start) ? off - start : 0;
+    uint32_t dst = start + skip - off;
+    return arch_copy_to_user(uptr + dst, src + skip, MIN(n - skip, len - dst));
+}
+
+// Streaming reads hand out unread metadata first and then whole completed
+// chunks, one per cpu in turn, releasing each chunk once it is copied.
+static int ktrace_drain_user(ktrace_state_t* ks, uint8_t* uptr, uint32_t len) {
+    uint32_t meta_end = ktrace_meta_used(ks);
+    uint32_t avail = meta_end - ks->meta_read;
+    for (uint32_t i = 0; i < ks->ncpus; i++) {
+        uint64_t tail, head;
+        ktrace_cpu_extent(&KTRACE_CPUS[i], &tail, &head);
+        avail += (uint32_t)(ROUNDDOWN(head, KTRACE_CHUNK_SIZE) - tail);
+    }
+
+    // null read is a query for the bytes ready to drain
+    if (uptr == nullptr) {
+        return avail;
+    }
 
-    // Buffer size is limited by the marker if set,
-    // otherwise limited by offset (last written point).
-    // Offset can end up pointing past the end, so clip
-    // it to the actual buffer size to be safe.
-    uint32_t max;
-    if (ks->marker) {
-        max = ks->marker;
-    } else {
-        max = ks->offset;
-        if (max > ks->bufsize) {
-            max = ks->bufsize;
+    // metadata records are copied whole
+    uint32_t copied = 0;
+    uint32_t n = 0;
+    while (ks->meta_read + n < meta_end) {
+        uint32_t reclen = KTRACE_LEN(*(uint32_t*) (ks->meta + ks->meta_read + n));
+        if (n + reclen > len) {
+            break;
         }
+        n += reclen;
+    }
+    if (n > 0) {
+        if (arch_copy_to_user(uptr, ks->meta + ks->meta_read, n) != NO_ERROR) {
+            return ERR_INVALID_ARGS;
+        }
+        ks->meta_read += n;
+        copied = n;
+    }
+
+    bool progress = true;
+    while (progress && (len - copied >= KTRACE_CHUNK_SIZE)) {
+        progress = false;
+        for (uint32_t i = 0; (i < ks->ncpus) && (len - copied >= KTRACE_CHUNK_SIZE); i++) {
+            ktrace_cpu_t* kc = &KTRACE_CPUS[i];
+            uint64_t tail, head;
+            ktrace_cpu_extent(kc, &tail, &head);
+            if (tail + KTRACE_CHUNK_SIZE > head) {
+                continue;
+            }
+            // records are completed under kc->lock and streaming mode never
+            // overwrites, so the writer leaves the chunk alone until tail
+            // moves past it below
+            if (arch_copy_to_user(uptr + copied, kc->buffer + tail % ks->cpusize,
+                                  KTRACE_CHUNK_SIZE) != NO_ERROR) {
+                return ERR_INVALID_ARGS;
+            }
+            copied += KTRACE_CHUNK_SIZE;
+            progress = true;
+
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&kc->lock, state);
+            kc->tail += KTRACE_CHUNK_SIZE;
+            spin_unlock_irqrestore(&kc->lock, state);
+        }
+    }
+    return copied;
+}
+
+int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
+    ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->buffer == nullptr) {
+        return ptr ? ERR_INVALID_ARGS : 0;
+    }
+
+    AutoLock lock(&read_lock);
+
+    if (ks->mode == KTRACE_MODE_STREAMING) {
+        return ktrace_drain_user(ks, (uint8_t*) ptr, len);
+    }
+
+    // The trace reads as the metadata area followed by what each cpu's
+    // ring holds, oldest chunk first.
+    uint32_t meta_end = ktrace_meta_used(ks);
+    uint64_t tails[SMP_MAX_CPUS], heads[SMP_MAX_CPUS];
+    uint32_t max = meta_end;
+    for (uint32_t i = 0; i < ks->ncpus; i++) {
+        ktrace_cpu_extent(&KTRACE_CPUS[i], &tails[i], &heads[i]);
+        max += (uint32_t)(heads[i] - tails[i]);
     }
 
     // null read is a query for trace buffer size
@@ -131,7 +384,21 @@ int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
         len = max - off;
     }
 
-    if (arch_copy_to_user(ptr, ks->buffer + off, len) != NO_ERROR) {
+    uint8_t* uptr = (uint8_t*) ptr;
+    uint32_t pos = 0;
+    status_t status = ktrace_copy_window(uptr, off, len, &pos, ks->meta, meta_end);
+    for (uint32_t i = 0; (i < ks->ncpus) && (status == NO_ERROR) && (pos < off + len); i++) {
+        // a ring's contents wrap at most once
+        uint8_t* base = KTRACE_CPUS[i].buffer;
+        uint32_t start = (uint32_t)(tails[i] % ks->cpusize);
+        uint32_t n = (uint32_t)(heads[i] - tails[i]);
+        uint32_t first = MIN(n, ks->cpusize - start);
+        status = ktrace_copy_window(uptr, off, len, &pos, base + start, first);
+        if ((status == NO_ERROR) && (n > first)) {
+            status = ktrace_copy_window(uptr, off, len, &pos, base, n - first);
+        }
+    }
+    if (status != NO_ERROR) {
         return ERR_INVALID_ARGS;
     }
     return len;
@@ -141,26 +408,47 @@ status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     ktrace_state_t* ks = &KTRACE_STATE;
     switch (action) {
     case KTRACE_ACTION_START:
+        if (ks->buffer == nullptr) {
+            return ERR_BAD_STATE;
+        }
         options = KTRACE_GRP_TO_MASK(options);
-        ks->marker = 0;
+        if (ks->rewind_pending) {
+            AutoLock lock(&read_lock);
+            ks->rewind_pending = false;
+            ktrace_reset(ks);
+        }
         atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
         ktrace_report_live_threads();
         break;
     case KTRACE_ACTION_STOP: {
         atomic_store(&ks->grpmask, 0);
-        uint32_t n = ks->offset;
-        if (n > ks->bufsize) {
-            ks->marker = ks->bufsize;
-        } else {
-            ks->marker = n;
+        // finish every cpu's partial chunk so it can be read or drained
+        for (uint32_t i = 0; i < ks->ncpus; i++) {
+            ktrace_cpu_t* kc = &KTRACE_CPUS[i];
+            spin_lock_saved_state_t state;
+            spin_lock_irqsave(&kc->lock, state);
+            ktrace_close_chunk(ks, kc);
+            uint64_t lost = kc->lost;
+            spin_unlock_irqrestore(&kc->lock, state);
+            if (lost) {
+                dprintf(INFO, "ktrace: cpu %u lost %" PRIu64 " records\n", i, lost);
+            }
+        }
+        if (ks->meta_lost) {
+            dprintf(INFO, "ktrace: %u name records lost\n", ks->meta_lost);
         }
         break;
     }
     case KTRACE_ACTION_REWIND:
-        // roll back to just after the metadata
-        atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
-        ktrace_report_syscalls(kt_syscall_info);
-        ktrace_report_probes();
+        if (ks->buffer == nullptr) {
+            break;
+        }
+        if (atomic_load(&ks->grpmask)) {
+            AutoLock lock(&read_lock);
+            ktrace_reset(ks);
+        } else {
+            ks->rewind_pending = true;
+        }
         break;
     case KTRACE_ACTION_NEW_PROBE: {
         ktrace_probe_info_t* probe;
@@ -180,6 +468,19 @@ status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
         mutex_release(&probe_list_lock);
         return probe->num;
     }
+    case KTRACE_ACTION_SET_MODE: {
+        if (options > KTRACE_MODE_STREAMING) {
+            return ERR_INVALID_ARGS;
+        }
+        if ((ks->buffer == nullptr) || atomic_load(&ks->grpmask)) {
+            return ERR_BAD_STATE;
+        }
+        AutoLock lock(&read_lock);
+        ks->mode = options;
+        ks->rewind_pending = false;
+        ktrace_reset(ks);
+        break;
+    }
     default:
         return ERR_INVALID_ARGS;
     }
@@ -188,6 +489,19 @@ status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
 
 int trace_not_ready = 0;
 
+static uint32_t ktrace_mode_from_cmdline(void) {
+    const char* mode = cmdline_get("ktrace.mode");
+    if (mode == nullptr || !strcmp(mode, "oneshot")) {
+        return KTRACE_MODE_ONESHOT;
+    } else if (!strcmp(mode, "circular")) {
+        return KTRACE_MODE_CIRCULAR;
+    } else if (!strcmp(mode, "streaming")) {
+        return KTRACE_MODE_STREAMING;
+    }
+    dprintf(INFO, "ktrace: unknown mode '%s', using oneshot\n", mode);
+    return KTRACE_MODE_ONESHOT;
+}
+
 void ktrace_init(unsigned level) {
     ktrace_state_t* ks = &KTRACE_STATE;
 
@@ -201,19 +515,36 @@ void ktrace_init(unsigned level) {
 
     mb *= (1024*1024);
 
+    // a sixteenth of the buffer holds names, the rest is split evenly
+    // between the cpus, each getting at least two chunks
+    uint32_t ncpus = arch_max_num_cpus();
+    uint32_t meta_size = ROUNDDOWN(mb / 16, 8);
+    uint32_t cpusize = ROUNDDOWN((mb - meta_size) / ncpus, KTRACE_CHUNK_SIZE);
+    if (cpusize < 2 * KTRACE_CHUNK_SIZE) {
+        cpusize = 2 * KTRACE_CHUNK_SIZE;
+    }
+    size_t size = meta_size + (size_t)ncpus * cpusize;
+
     status_t status;
     VmAspace* aspace = VmAspace::kernel_aspace();
-    if ((status = aspace->Alloc("ktrace", mb, (void**)&ks->buffer, 0, VMM_FLAG_COMMIT,
+    if ((status = aspace->Alloc("ktrace", size, (void**)&ks->buffer, 0, VMM_FLAG_COMMIT,
                                 ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
         dprintf(INFO, "ktrace: cannot alloc buffer %d\n", status);
+        ks->buffer = nullptr;
         return;
     }
 
-    // The last packet written can overhang the end of the buffer,
-    // so we reduce the reported size by the max size of a record
-    ks->bufsize = mb - 256;
+    ks->mode = ktrace_mode_from_cmdline();
+    ks->meta = ks->buffer;
+    ks->meta_size = meta_size;
+    ks->ncpus = ncpus;
+    ks->cpusize = cpusize;
+    for (uint32_t i = 0; i < ncpus; i++) {
+        KTRACE_CPUS[i].buffer = ks->buffer + meta_size + (size_t)i * cpusize;
+    }
 
-    dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
+    dprintf(INFO, "ktrace: buffer at %p (%zu bytes, %u cpus, mode %u)\n",
+            ks->buffer, size, ncpus, ks->mode);
 
     // register all static probes
     ktrace_probe_info_t *probe;
@@ -225,7 +556,7 @@ void ktrace_init(unsigned level) {
 
     // write metadata to the first two event slots
     uint64_t n = ktrace_ticks_per_ms();
-    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->buffer;
+    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->meta;
     rec[0].tag = TAG_VERSION;
     rec[0].a = KTRACE_VERSION;
     rec[1].tag = TAG_TICKS_PER_MS;
@@ -233,9 +564,7 @@ void ktrace_init(unsigned level) {
     rec[1].b = (uint32_t)(n >> 32);
 
     // enable tracing
-    atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
-    ktrace_report_syscalls(kt_syscall_info);
-    ktrace_report_probes();
+    ktrace_reset(ks);
     atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
 
     // report names of existing threads
@@ -247,60 +576,46 @@ void ktrace_tiny(uint32_t tag, uint32_t arg) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (tag & atomic_load(&ks->grpmask)) {
         tag = (tag & 0xFFFFFFF0) | 2;
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-            hdr->ts = ts;
-            hdr->tag = tag;
-            hdr->tid = arg;
-        }
+        ktrace_write_record(tag, arg, ts, 0, 0, 0, 0);
     }
 }
 
-void* ktrace_open(uint32_t tag) {
+bool ktrace_write(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
     uint64_t ts = ktrace_timestamp();
     ktrace_state_t* ks = &KTRACE_STATE;
     if (!(tag & atomic_load(&ks->grpmask))) {
-        return nullptr;
+        return false;
     }
 
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-        // if we arrive at the end, stop
-        atomic_store(&ks->grpmask, 0);
-        return nullptr;
-    }
-
-    ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-    hdr->ts = ts;
-    hdr->tag = tag;
-    hdr->tid = (uint32_t)get_current_thread()->user_tid;
-    return hdr + 1;
+    return ktrace_write_record(tag, (uint32_t)get_current_thread()->user_tid, ts, a, b, c, d);
 }
 
 static void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always) {
     ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->meta == nullptr) {
+        return;
+    }
     if ((tag & atomic_load(&ks->grpmask)) || always) {
         uint32_t len = static_cast<uint32_t>(strnlen(name, 31));
 
         // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
         tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&ks->meta_lock, state);
+        if (ks->meta_offset + KTRACE_LEN(tag) > ks->meta_size) {
+            // names are never overwritten, once full further ones are lost
+            ks->meta_lost++;
         } else {
-            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
+            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->meta + ks->meta_offset);
             rec->tag = tag;
             rec->id = id;
             rec->arg = arg;
             memcpy(rec->name, name, len);
             rec->name[len] = 0;
+            ks->meta_offset += KTRACE_LEN(tag);
         }
+        spin_unlock_irqrestore(&ks->meta_lock, state);
     }
 }
 
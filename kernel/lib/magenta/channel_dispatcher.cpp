@@ -13,6 +13,7 @@
 #include <trace.h>
 
 #include <kernel/event.h>
+#include <kernel/thread.h>
 #include <platform.h>
 
 #include <magenta/handle.h>
@@ -168,6 +169,60 @@ status_t ChannelDispatcher::Read(uint32_t* msg_size,
     return rv;
 }
 
+status_t ChannelDispatcher::ReadMany(size_t count,
+                                     uint32_t* msg_sizes,
+                                     uint32_t* msg_handle_counts,
+                                     mxtl::unique_ptr<MessagePacket>* msgs,
+                                     size_t* actual) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+
+    if (messages_.is_empty())
+        return other_ ? ERR_SHOULD_WAIT : ERR_PEER_CLOSED;
+
+    status_t rv = NO_ERROR;
+    size_t n = 0u;
+    while (n < count && !messages_.is_empty()) {
+        uint32_t size = messages_.front().data_size();
+        uint32_t handle_count = messages_.front().num_handles();
+        if (size > msg_sizes[n] || handle_count > msg_handle_counts[n]) {
+            if (n == 0u) {
+                msg_sizes[0] = size;
+                msg_handle_counts[0] = handle_count;
+                rv = ERR_BUFFER_TOO_SMALL;
+            }
+            break;
+        }
+
+        msg_sizes[n] = size;
+        msg_handle_counts[n] = handle_count;
+        msgs[n++] = messages_.pop_front();
+    }
+
+    if (messages_.is_empty())
+        state_tracker_.UpdateState(MX_CHANNEL_READABLE, 0u);
+
+    *actual = n;
+    return rv;
+}
+
+void ChannelDispatcher::UnreadMany(mxtl::unique_ptr<MessagePacket>* msgs, size_t count) {
+    canary_.Assert();
+
+    if (count == 0u)
+        return;
+
+    AutoLock lock(&lock_);
+
+    for (size_t ix = count; ix != 0u; --ix)
+        messages_.push_front(mxtl::move(msgs[ix - 1]));
+
+    // The messages were already announced to the port client when they were
+    // first written, so only the readable signal needs restoring.
+    state_tracker_.UpdateState(0u, MX_CHANNEL_READABLE);
+}
+
 status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
     canary_.Assert();
 
@@ -183,7 +238,38 @@ status_t ChannelDispatcher::Write(mxtl::unique_ptr<MessagePacket> msg) {
         other = other_;
     }
 
-    if (other->WriteSelf(mxtl::move(msg)) > 0)
+    // If this was a reply to a waiting caller, hand the caller our time slice
+    // now that the peer's lock is dropped, so preempting runs it right away.
+    bool handoff = false;
+    int woken = other->WriteSelf(mxtl::move(msg), true, false, &handoff);
+    if (handoff)
+        thread_handoff();
+    if (woken > 0)
+        thread_preempt(false);
+
+    return NO_ERROR;
+}
+
+status_t ChannelDispatcher::WriteMany(mxtl::unique_ptr<MessagePacket>* msgs, size_t count) {
+    canary_.Assert();
+
+    mxtl::RefPtr<ChannelDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_) {
+            // See Write(). The caller puts the handles back into the process.
+            for (size_t ix = 0; ix != count; ++ix)
+                msgs[ix]->set_owns_handles(false);
+            return ERR_PEER_CLOSED;
+        }
+        other = other_;
+    }
+
+    bool handoff = false;
+    int woken = other->WriteSelfMany(msgs, count, &handoff);
+    if (handoff)
+        thread_handoff();
+    if (woken > 0)
         thread_preempt(false);
 
     return NO_ERROR;
@@ -220,8 +306,12 @@ status_t ChannelDispatcher::Call(mxtl::unique_ptr<MessagePacket> msg,
         waiters_.push_back(waiter);
     }
 
-    // (1) Write outbound message to opposing endpoint.
-    other->WriteSelf(mxtl::move(msg));
+    // (1) Write outbound message to opposing endpoint. A server blocked reading
+    // the other end gets our cpu and time slice, since we block next anyway.
+    bool handoff = false;
+    other->WriteSelf(mxtl::move(msg), false, true, &handoff);
+    if (handoff)
+        thread_handoff();
 
     // Reuse the code from the half-call used for retrying a Call after thread
     // suspend.
@@ -264,10 +354,30 @@ status_t ChannelDispatcher::ResumeInterruptedCall(mx_time_t deadline,
     return status;
 }
 
-int ChannelDispatcher::WriteSelf(mxtl::unique_ptr<MessagePacket> msg) {
+int ChannelDispatcher::WriteSelf(mxtl::unique_ptr<MessagePacket> msg,
+                                 bool handoff_caller, bool handoff_reader, bool* handoff) {
     canary_.Assert();
 
     AutoLock lock(&lock_);
+    return WriteSelfLocked(mxtl::move(msg), handoff_caller, handoff_reader, handoff);
+}
+
+int ChannelDispatcher::WriteSelfMany(mxtl::unique_ptr<MessagePacket>* msgs, size_t count,
+                                     bool* handoff) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+    int woken = 0;
+    for (size_t ix = 0; ix != count; ++ix) {
+        // Only the first caller woken by the batch is handed our cpu.
+        woken += WriteSelfLocked(mxtl::move(msgs[ix]), woken == 0, false, handoff);
+    }
+    return woken;
+}
+
+int ChannelDispatcher::WriteSelfLocked(mxtl::unique_ptr<MessagePacket> msg,
+                                       bool handoff_caller, bool handoff_reader,
+                                       bool* handoff) {
     auto size = msg->data_size();
 
     if (!waiters_.is_empty()) {
@@ -281,13 +391,24 @@ int ChannelDispatcher::WriteSelf(mxtl::unique_ptr<MessagePacket> msg) {
             if (waiter.get_txid() == txid) {
                 waiters_.erase(waiter);
                 // we return how many threads have been woken up, or zero.
-                return waiter.Deliver(mxtl::move(msg));
+                if (handoff_caller)
+                    thread_handoff_arm(waiter.get_thread());
+                int woken = waiter.Deliver(mxtl::move(msg));
+                if (thread_handoff_disarm())
+                    *handoff = true;
+                return woken;
             }
         }
     }
     messages_.push_back(mxtl::move(msg));
 
+    // Only a thread waiting for this endpoint to become readable is a
+    // candidate, not whoever the port signal below happens to wake.
+    if (handoff_reader)
+        thread_handoff_arm(nullptr);
     state_tracker_.UpdateState(0u, MX_CHANNEL_READABLE);
+    if (thread_handoff_disarm())
+        *handoff = true;
     if (iopc_)
         iopc_->Signal(MX_CHANNEL_READABLE, size, &lock_);
     return 0;
@@ -16,6 +16,7 @@
 
 #include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
+#include <magenta/message_packet.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/vm_object_dispatcher.h>
 
@@ -528,6 +529,9 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         printf("%s asd  <pid>|kernel : dump process/kernel address space\n",
                argv[0].str);
         printf("%s htinfo            : handle table info\n", argv[0].str);
+        printf("%s mpinfo            : message packet allocator info\n", argv[0].str);
+        printf("%s mpslabs on|off    : allocate message packets from slabs/the heap\n",
+               argv[0].str);
         return -1;
     }
 
@@ -572,6 +576,20 @@ static int cmd_diagnostics(int argc, const cmd_args* argv, uint32_t flags) {
         if (argc != 2)
             goto usage;
         internal::DumpHandleTableInfo();
+    } else if (strcmp(argv[1].str, "mpinfo") == 0) {
+        if (argc != 2)
+            goto usage;
+        MessagePacket::DumpAllocatorStats();
+    } else if (strcmp(argv[1].str, "mpslabs") == 0) {
+        if (argc < 3)
+            goto usage;
+        if (strcmp(argv[2].str, "on") == 0) {
+            MessagePacket::SetSlabsEnabled(true);
+        } else if (strcmp(argv[2].str, "off") == 0) {
+            MessagePacket::SetSlabsEnabled(false);
+        } else {
+            goto usage;
+        }
     } else {
         printf("unrecognized subcommand '%s'\n", argv[1].str);
         goto usage;
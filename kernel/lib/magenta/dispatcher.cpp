@@ -8,6 +8,7 @@
 #include <magenta/state_tracker.h>
 
 #include <arch/ops.h>
+#include <kernel/auto_lock.h>
 #include <lib/ktrace.h>
 #include <mxtl/atomic.h>
 
@@ -23,10 +24,46 @@ Dispatcher::Dispatcher()
       handle_count_(0u) {
 }
 
+// Static storage
+Dispatcher::KoidIndexStripe Dispatcher::koid_index_[kKoidIndexStripes];
+
 Dispatcher::~Dispatcher() {
 #if WITH_LIB_KTRACE
     ktrace(TAG_OBJECT_DELETE, (uint32_t)koid_, 0, 0, 0);
 #endif
+
+    // A lookup may have found us after our ref count dropped to zero, but it
+    // holds the stripe lock while it looks, so once we are out of the index
+    // nobody can be touching us.
+    if (koid_index_node_.InContainer()) {
+        KoidIndexStripe* stripe = GetKoidIndexStripe(koid_);
+        AutoLock lock(&stripe->lock);
+        stripe->index.erase(*this);
+    }
+}
+
+void Dispatcher::AddToKoidIndex() {
+    KoidIndexStripe* stripe = GetKoidIndexStripe(koid_);
+    AutoLock lock(&stripe->lock);
+    DEBUG_ASSERT(!koid_index_node_.InContainer());
+    stripe->index.insert(this);
+}
+
+// static
+mxtl::RefPtr<Dispatcher> Dispatcher::LookupByKoidInternal(mx_koid_t koid) {
+    KoidIndexStripe* stripe = GetKoidIndexStripe(koid);
+    AutoLock lock(&stripe->lock);
+
+    auto iter = stripe->index.find(koid);
+    if (!iter.IsValid())
+        return nullptr;
+
+    // The dispatcher stays in the index until its destructor runs, which can
+    // be after its last reference is gone.  Don't bring it back to life.
+    Dispatcher* dispatcher = iter.CopyPointer();
+    if (!dispatcher->AddRefMaybeInDestructor())
+        return nullptr;
+    return mxtl::internal::MakeRefPtrNoAdopt(dispatcher);
 }
 
 status_t Dispatcher::add_observer(StateObserver* observer) {
@@ -7,6 +7,8 @@
 #include <string.h>
 
 #include <kernel/auto_lock.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_object_paged.h>
 #include <lib/user_copy/user_ptr.h>
 #include <magenta/fifo_dispatcher.h>
 #include <magenta/handle.h>
@@ -23,12 +25,39 @@ status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t opti
                                 mx_rights_t* rights) {
     // count and elemsize must be nonzero
     // count must be a power of two
-    // total size must be <= kMaxSizeBytes
+    // total size must be <= kMaxSizeBytes, or kMaxSharedSizeBytes per
+    // direction for shared rings
+    const uint32_t max_bytes =
+        (options & MX_FIFO_SHARED_RING) ? kMaxSharedSizeBytes : kMaxSizeBytes;
     if (!count || !elemsize || (count & (count - 1)) ||
-        (count > kMaxSizeBytes) || (elemsize > kMaxSizeBytes) ||
-        ((count * elemsize) > kMaxSizeBytes)) {
+        (count > max_bytes) || (elemsize > max_bytes) ||
+        ((static_cast<uint64_t>(count) * elemsize) > max_bytes)) {
         return ERR_OUT_OF_RANGE;
     }
+    if (options & ~MX_FIFO_SHARED_RING)
+        return ERR_INVALID_ARGS;
+
+    // A shared ring fifo keeps both directions in one vmo, each a control
+    // block followed by the entries, rounded up so that they can be mapped
+    // separately.
+    mxtl::RefPtr<SharedRing> ring;
+    uint64_t ring_bytes = 0u;
+    if (options & MX_FIFO_SHARED_RING) {
+        ring_bytes = ROUNDUP_PAGE_SIZE(sizeof(mx_fifo_ring_t) + count * elemsize);
+        auto vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, 2 * ring_bytes);
+        if (!vmo)
+            return ERR_NO_MEMORY;
+        uint64_t committed;
+        if (vmo->CommitRange(0, 2 * ring_bytes, &committed) != NO_ERROR ||
+            committed != 2 * ring_bytes)
+            return ERR_NO_MEMORY;
+
+        AllocChecker ac;
+        ring = mxtl::AdoptRef(new (&ac) SharedRing(mxtl::move(vmo)));
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+    }
+
     AllocChecker ac;
     auto fifo0 = mxtl::AdoptRef(new (&ac) FifoDispatcher(count, elemsize, options));
     if (!ac.check())
@@ -39,9 +68,9 @@ status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t opti
         return ERR_NO_MEMORY;
 
     mx_status_t status;
-    if ((status = fifo0->Init(fifo1)) != NO_ERROR)
+    if ((status = fifo0->Init(fifo1, ring, ring_bytes, 0u)) != NO_ERROR)
         return status;
-    if ((status = fifo1->Init(fifo0)) != NO_ERROR)
+    if ((status = fifo1->Init(fifo0, ring, 0u, ring_bytes)) != NO_ERROR)
         return status;
 
     *rights = kDefaultFifoRights;
@@ -53,7 +82,7 @@ status_t FifoDispatcher::Create(uint32_t count, uint32_t elemsize, uint32_t opti
 FifoDispatcher::FifoDispatcher(uint32_t count, uint32_t elem_size, uint32_t /*options*/)
     : elem_count_(count), elem_size_(elem_size), mask_(count - 1),
       peer_koid_(0u), state_tracker_(MX_FIFO_WRITABLE),
-      head_(0u), tail_(0u) {
+      head_(0u), tail_(0u), data_(nullptr), rx_offset_(0u), tx_offset_(0u) {
 }
 
 FifoDispatcher::~FifoDispatcher() {
@@ -62,9 +91,19 @@ FifoDispatcher::~FifoDispatcher() {
 
 // Thread safety analysis disabled as this happens during creation only,
 // when no other thread could be accessing the object.
-mx_status_t FifoDispatcher::Init(mxtl::RefPtr<FifoDispatcher> other) TA_NO_THREAD_SAFETY_ANALYSIS {
+mx_status_t FifoDispatcher::Init(mxtl::RefPtr<FifoDispatcher> other,
+                                 mxtl::RefPtr<SharedRing> ring,
+                                 uint64_t rx_offset,
+                                 uint64_t tx_offset) TA_NO_THREAD_SAFETY_ANALYSIS {
     other_ = mxtl::move(other);
     peer_koid_ = other_->get_koid();
+    if (ring) {
+        // the entries live in the shared vmo and never pass through the kernel
+        ring_ = mxtl::move(ring);
+        rx_offset_ = rx_offset;
+        tx_offset_ = tx_offset;
+        return NO_ERROR;
+    }
     if ((data_ = (uint8_t*) calloc(elem_count_, elem_size_)) == nullptr)
         return ERR_NO_MEMORY;
     return NO_ERROR;
@@ -124,6 +163,15 @@ mx_status_t FifoDispatcher::Write(const uint8_t* ptr, size_t len, uint32_t* actu
                                   fifo_copy_from_fn_t copy_from_fn) {
     canary_.Assert();
 
+    // Shared rings move entries in userspace; a zero length write is the
+    // doorbell that brings the signals up to date with the shared indices.
+    if (ring_) {
+        if (len != 0)
+            return ERR_NOT_SUPPORTED;
+        *actual = 0u;
+        return SyncShared();
+    }
+
     mxtl::RefPtr<FifoDispatcher> other;
     {
         AutoLock lock(&lock_);
@@ -197,6 +245,13 @@ mx_status_t FifoDispatcher::Read(uint8_t* ptr, size_t bytelen, uint32_t* actual,
                                  fifo_copy_to_fn_t copy_to_fn) {
     canary_.Assert();
 
+    if (ring_) {
+        if (bytelen != 0)
+            return ERR_NOT_SUPPORTED;
+        *actual = 0u;
+        return SyncShared();
+    }
+
     size_t count = bytelen / elem_size_;
     if (count == 0)
         return ERR_OUT_OF_RANGE;
@@ -251,3 +306,82 @@ mx_status_t FifoDispatcher::Read(uint8_t* ptr, size_t bytelen, uint32_t* actual,
     *actual = (tail_ - old_tail);
     return NO_ERROR;
 }
+
+mx_status_t FifoDispatcher::GetRing(mxtl::RefPtr<VmObject>* vmo, mx_fifo_ring_info_t* info) {
+    canary_.Assert();
+
+    if (!ring_)
+        return ERR_NOT_SUPPORTED;
+
+    *vmo = ring_->vmo;
+    info->rx_offset = rx_offset_;
+    info->tx_offset = tx_offset_;
+    info->elem_count = elem_count_;
+    info->elem_size = elem_size_;
+    return NO_ERROR;
+}
+
+// Samples the number of entries in the ring at |offset|. The control block is
+// writable by userspace, so it is read through the vmo's pages rather than a
+// kernel mapping (which a resize or decommit could pull out from under us),
+// and the indices are not trusted.
+mx_status_t FifoDispatcher::ReadRingCount(uint64_t offset, uint32_t* count) {
+    struct Sample {
+        size_t page_offset;
+        uint32_t head;
+        uint32_t tail;
+    } sample = {offset & (PAGE_SIZE - 1), 0u, 0u};
+
+    auto read_indices = [](void* context, size_t offset, size_t index, paddr_t pa) -> status_t {
+        auto sample = static_cast<Sample*>(context);
+        auto ctl = reinterpret_cast<mx_fifo_ring_t*>(
+            static_cast<uint8_t*>(paddr_to_kvaddr(pa)) + sample->page_offset);
+        sample->head = __atomic_load_n(&ctl->head, __ATOMIC_ACQUIRE);
+        sample->tail = __atomic_load_n(&ctl->tail, __ATOMIC_ACQUIRE);
+        return NO_ERROR;
+    };
+
+    // only look at pages that are present; the ring was committed up front
+    if (ring_->vmo->Lookup(offset, sizeof(mx_fifo_ring_t), 0, read_indices, &sample) != NO_ERROR)
+        return ERR_BAD_STATE;
+
+    uint32_t n = sample.head - sample.tail;
+    if (n > elem_count_)
+        return ERR_BAD_STATE;
+
+    *count = n;
+    return NO_ERROR;
+}
+
+mx_status_t FifoDispatcher::SyncShared() {
+    canary_.Assert();
+
+    AutoLock ring_lock(&ring_->lock);
+
+    uint32_t rx_count;
+    uint32_t tx_count;
+    mx_status_t status;
+    if ((status = ReadRingCount(rx_offset_, &rx_count)) != NO_ERROR)
+        return status;
+    if ((status = ReadRingCount(tx_offset_, &tx_count)) != NO_ERROR)
+        return status;
+
+    auto update = [](StateTracker* tracker, bool readable, bool writable) {
+        mx_signals_t set = (readable ? MX_FIFO_READABLE : 0u) |
+                           (writable ? MX_FIFO_WRITABLE : 0u);
+        tracker->UpdateState((MX_FIFO_READABLE | MX_FIFO_WRITABLE) & ~set, set);
+    };
+
+    mxtl::RefPtr<FifoDispatcher> other;
+    {
+        // OnPeerZeroHandles() clears MX_FIFO_WRITABLE under lock_, so check
+        // for the peer under it as well.
+        AutoLock lock(&lock_);
+        other = other_;
+        update(&state_tracker_, rx_count != 0u, other && tx_count < elem_count_);
+    }
+    if (other)
+        update(&other->state_tracker_, tx_count != 0u, rx_count < elem_count_);
+
+    return NO_ERROR;
+}
@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 
+#include <kernel/thread.h>
+
 #include <magenta/dispatcher.h>
 #include <magenta/message_packet.h>
 #include <magenta/state_tracker.h>
@@ -46,8 +48,27 @@ public:
                   mxtl::unique_ptr<MessagePacket>* msg,
                   bool may_disard);
 
+    // Read up to |count| messages from this endpoint's message queue under a single acquisition
+    // of the lock. |msg_sizes| and |msg_handle_counts| hold the limits for each message on input
+    // and the actual sizes of the |*actual| messages returned in |msgs| on output. The batch ends
+    // at the first message that does not fit; if that is the first one, ERR_BUFFER_TOO_SMALL is
+    // returned, the message stays queued and its sizes are reported in the first entries.
+    status_t ReadMany(size_t count,
+                      uint32_t* msg_sizes,
+                      uint32_t* msg_handle_counts,
+                      mxtl::unique_ptr<MessagePacket>* msgs,
+                      size_t* actual);
+
+    // Put |count| messages taken by ReadMany() back at the front of the message queue, in
+    // order, for when they could not be copied out to the reader.
+    void UnreadMany(mxtl::unique_ptr<MessagePacket>* msgs, size_t count);
+
     // Write to the opposing endpoint's message queue.
     status_t Write(mxtl::unique_ptr<MessagePacket> msg);
+    // Write |count| messages, in order, under a single acquisition of the opposing endpoint's
+    // lock. On failure no message is written and the packets are left in |msgs|, no longer
+    // owning their handles.
+    status_t WriteMany(mxtl::unique_ptr<MessagePacket>* msgs, size_t count);
     status_t Call(mxtl::unique_ptr<MessagePacket> msg,
                   mx_time_t deadline, bool* return_handles,
                   mxtl::unique_ptr<MessagePacket>* reply);
@@ -86,6 +107,7 @@ public:
 
             txid_ = txid;
             status_ = ERR_TIMED_OUT;
+            thread_ = get_current_thread();
             channel_ = mxtl::move(channel);
             event_.Unsignal();
             return NO_ERROR;
@@ -102,6 +124,9 @@ public:
 
         mx_txid_t get_txid() const { return txid_; }
 
+        // The thread waiting for the reply.
+        thread_t* get_thread() const { return thread_; }
+
         mx_status_t Wait(lk_time_t deadline) {
             DEBUG_ASSERT(armed());
             return event_.Wait(deadline);
@@ -123,6 +148,7 @@ public:
         // TODO(teisenbe/swetland): Investigate hoisting this outside to reduce
         // userthread size
         WaitEvent event_;
+        thread_t* thread_ = nullptr;
         mx_txid_t txid_;
         mx_status_t status_;
     };
@@ -135,7 +161,17 @@ private:
 
     ChannelDispatcher(uint32_t flags);
     void Init(mxtl::RefPtr<ChannelDispatcher> other);
-    int WriteSelf(mxtl::unique_ptr<MessagePacket> msg);
+    // |handoff_caller| arms a directed handoff to the caller waiting for |msg|
+    // if it is a reply, and |handoff_reader| to the reader woken by |msg|
+    // otherwise, which is what a call wants since it blocks right after
+    // writing. |*handoff| is set if a handoff candidate was queued; the
+    // writer then completes it with thread_handoff() once it has dropped our
+    // lock.
+    int WriteSelf(mxtl::unique_ptr<MessagePacket> msg, bool handoff_caller, bool handoff_reader,
+                  bool* handoff);
+    int WriteSelfMany(mxtl::unique_ptr<MessagePacket>* msgs, size_t count, bool* handoff);
+    int WriteSelfLocked(mxtl::unique_ptr<MessagePacket> msg,
+                        bool handoff_caller, bool handoff_reader, bool* handoff) TA_REQ(lock_);
     status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     void OnPeerZeroHandles();
 
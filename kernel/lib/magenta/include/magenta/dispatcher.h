@@ -9,12 +9,16 @@
 #include <err.h>
 #include <stdint.h>
 
+#include <kernel/mutex.h>
+
 #include <magenta/handle.h>
 #include <magenta/port_client.h>
 #include <magenta/magenta.h>
 #include <magenta/syscalls/object.h>
 #include <magenta/types.h>
 
+#include <mxtl/atomic.h>
+#include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/ref_counted.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
@@ -62,7 +66,7 @@ public:
     mx_koid_t get_koid() const { return koid_; }
 
     // Updating |handle_count_| is done at the magenta handle management layer.
-    uint32_t* get_handle_count_ptr() { return &handle_count_; }
+    mxtl::atomic<uint32_t>* get_handle_count_ptr() { return &handle_count_; }
 
     // Interface for derived classes.
 
@@ -92,12 +96,55 @@ public:
     // a CookieJar for those cookies to be stored in.
     virtual CookieJar* get_cookie_jar() { return nullptr; }
 
+    // Returns a new reference to the live dispatcher of type T with |koid|,
+    // or null if there is none.  Only dispatchers that have called
+    // AddToKoidIndex() can be found.
+    template <typename T>
+    static mxtl::RefPtr<T> LookupByKoid(mx_koid_t koid);
+
 protected:
     static mx_koid_t GenerateKernelObjectId();
 
+    // Makes this dispatcher findable by LookupByKoid().  Must be called once
+    // the object is fully constructed and adopted, since lookups can call
+    // into it as soon as it is in the index.  The index only holds a weak
+    // pointer; the dispatcher removes itself when destroyed.
+    void AddToKoidIndex();
+
 private:
+    struct KoidIndexKeyTraits {
+        static mx_koid_t GetKey(const Dispatcher& obj) { return obj.koid_; }
+        static bool LessThan(mx_koid_t key1, mx_koid_t key2) { return key1 < key2; }
+        static bool EqualTo(mx_koid_t key1, mx_koid_t key2) { return key1 == key2; }
+    };
+    struct KoidIndexNodeTraits {
+        static mxtl::WAVLTreeNodeState<Dispatcher*>& node_state(Dispatcher& obj) {
+            return obj.koid_index_node_;
+        }
+    };
+    using KoidIndex = mxtl::WAVLTree<mx_koid_t, Dispatcher*,
+                                     KoidIndexKeyTraits, KoidIndexNodeTraits>;
+
+    // The index is split into independently locked stripes by koid, so that
+    // lookups don't contend with each other or with dispatcher churn.
+    static constexpr size_t kKoidIndexStripes = 16;
+    struct KoidIndexStripe {
+        Mutex lock;
+        KoidIndex index TA_GUARDED(lock);
+    };
+
+    static KoidIndexStripe* GetKoidIndexStripe(mx_koid_t koid) {
+        return &koid_index_[koid % kKoidIndexStripes];
+    }
+
+    static mxtl::RefPtr<Dispatcher> LookupByKoidInternal(mx_koid_t koid);
+
     const mx_koid_t koid_;
-    uint32_t handle_count_;
+    mxtl::atomic<uint32_t> handle_count_;
+
+    mxtl::WAVLTreeNodeState<Dispatcher*> koid_index_node_;
+
+    static KoidIndexStripe koid_index_[kKoidIndexStripes];
 };
 
 // Checks if a RefPtr<Dispatcher> points to a dispatcher of a given dispatcher subclass T and, if
@@ -114,3 +161,12 @@ template <>
 inline mxtl::RefPtr<Dispatcher> DownCastDispatcher(mxtl::RefPtr<Dispatcher>* disp) {
     return mxtl::move(*disp);
 }
+
+// static
+template <typename T>
+mxtl::RefPtr<T> Dispatcher::LookupByKoid(mx_koid_t koid) {
+    auto dispatcher = LookupByKoidInternal(koid);
+    if (!dispatcher)
+        return nullptr;
+    return DownCastDispatcher<T>(&dispatcher);
+}
@@ -9,6 +9,7 @@
 #include <stdint.h>
 
 #include <kernel/mutex.h>
+#include <kernel/vm/vm_object.h>
 
 #include <magenta/dispatcher.h>
 #include <magenta/state_tracker.h>
@@ -40,9 +41,26 @@ public:
     mx_status_t WriteFromUser(const uint8_t* src, size_t len, uint32_t* actual);
     mx_status_t ReadToUser(uint8_t* dst, size_t len, uint32_t* actual);
 
+    // MX_FIFO_SHARED_RING fifos only: returns the vmo holding both rings and
+    // where this endpoint's rings live in it.
+    mx_status_t GetRing(mxtl::RefPtr<VmObject>* vmo, mx_fifo_ring_info_t* info);
+
 private:
+    // State shared by both endpoints of a MX_FIFO_SHARED_RING fifo.
+    struct SharedRing : public mxtl::RefCounted<SharedRing> {
+        explicit SharedRing(mxtl::RefPtr<VmObject> vmo) : vmo(mxtl::move(vmo)) {}
+
+        const mxtl::RefPtr<VmObject> vmo;
+        // Serializes signal updates driven by either endpoint's doorbell, so
+        // that a stale snapshot of the indices can't overwrite a newer one.
+        Mutex lock;
+    };
+
     FifoDispatcher(uint32_t elem_count, uint32_t elem_size, uint32_t options);
-    mx_status_t Init(mxtl::RefPtr<FifoDispatcher> other);
+    mx_status_t Init(mxtl::RefPtr<FifoDispatcher> other, mxtl::RefPtr<SharedRing> ring,
+                     uint64_t rx_offset, uint64_t tx_offset);
+    mx_status_t SyncShared();
+    mx_status_t ReadRingCount(uint64_t offset, uint32_t* count);
     mx_status_t Write(const uint8_t* ptr, size_t len, uint32_t* actual,
                       fifo_copy_from_fn_t copy_from_fn);
     mx_status_t WriteSelf(const uint8_t* ptr, size_t len, uint32_t* actual,
@@ -65,5 +83,11 @@ private:
     uint32_t tail_ TA_GUARDED(lock_);
     uint8_t* data_ TA_GUARDED(lock_);
 
+    // Only set for MX_FIFO_SHARED_RING fifos, and constant after Init().
+    mxtl::RefPtr<SharedRing> ring_;
+    uint64_t rx_offset_;
+    uint64_t tx_offset_;
+
     static constexpr uint32_t kMaxSizeBytes = PAGE_SIZE;
+    static constexpr uint32_t kMaxSharedSizeBytes = 64 * PAGE_SIZE;
 };
@@ -10,6 +10,7 @@
 #include <lib/user_copy/user_ptr.h>
 #include <magenta/futex_node.h>
 #include <magenta/types.h>
+#include <mxtl/intrusive_hash_table.h>
 
 // FutexContext is a class that encapsulates support for futex operations.
 // FutexContext uses a hash table keyed on the futex address (a pointer to integer in userspace)
@@ -23,6 +24,8 @@
 // When the thread at the head of the futex's blocked thread list is resumed,
 // The FutexNode for the new head of the blocked thread list is set as the hash table value
 // for the futex.
+// The hash table is split into kNumBuckets independently locked buckets, selected by the
+// futex address, so that operations on unrelated futexes in one process do not contend.
 class FutexContext {
 public:
     FutexContext();
@@ -51,14 +54,36 @@ private:
     FutexContext(const FutexContext&) = delete;
     FutexContext& operator=(const FutexContext&) = delete;
 
-    void QueueNodesLocked(FutexNode* head) TA_REQ(lock_);
+    static constexpr uint32_t kNumBucketsShift = 4;
+    static constexpr uint32_t kNumBuckets = 1u << kNumBucketsShift;
 
-    bool UnqueueNodeLocked(FutexNode* node) TA_REQ(lock_);
+    // The futexes are already spread across buckets, so each bucket's own
+    // table can be much smaller than the default.
+    using HashTable = mxtl::HashTable<uintptr_t, FutexNode*,
+                                      mxtl::SinglyLinkedList<FutexNode*>, size_t, 7>;
 
-    // protects futex_table_
-    Mutex lock_;
+    struct Bucket {
+        // protects table
+        Mutex lock;
 
-    // Hash table for futexes in this context.
-    // Key is futex address, value is the FutexNode for the head of futex's blocked thread list.
-    FutexNode::HashTable futex_table_ TA_GUARDED(lock_);
+        // Key is futex address, value is the FutexNode for the head of futex's
+        // blocked thread list.
+        HashTable table TA_GUARDED(lock);
+    };
+
+    Bucket* GetBucket(uintptr_t futex_key);
+
+    status_t RequeueLocked(Bucket* wake_bucket, user_ptr<int> wake_ptr,
+                           uint32_t wake_count, int current_value,
+                           Bucket* requeue_bucket, uintptr_t requeue_key,
+                           uint32_t requeue_count)
+        TA_REQ(wake_bucket->lock, requeue_bucket->lock);
+
+    void QueueNodesLocked(Bucket* bucket, FutexNode* head) TA_REQ(bucket->lock);
+
+    // Takes the lock of whichever bucket |node| is currently queued in.
+    bool UnqueueNode(FutexNode* node);
+    bool UnqueueNodeLocked(Bucket* bucket, FutexNode* node) TA_REQ(bucket->lock);
+
+    Bucket buckets_[kNumBuckets];
 };
@@ -75,7 +75,10 @@ public:
     uint32_t process_count() const TA_REQ(lock_) { return process_count_;}
     uint32_t job_count() const TA_REQ(lock_) { return job_count_; }
     bool AddChildProcess(ProcessDispatcher* process);
-    void RemoveChildProcess(ProcessDispatcher* process);
+    // |runtime| is the cpu time used by the process over its lifetime; it
+    // stays accounted to this job after the process is gone.
+    void RemoveChildProcess(ProcessDispatcher* process,
+                            const mx_info_task_runtime_t& runtime);
     void Kill();
 
     // Set policy. |mode| is is either MX_JOB_POL_RELATIVE or MX_JOB_POL_ABSOLUTE and
@@ -83,6 +86,10 @@ public:
     status_t SetPolicy(uint32_t mode, const mx_policy_basic* in_policy, size_t policy_count);
     pol_cookie_t GetPolicy();
 
+    // Sums the cpu time used by every process in the job tree rooted here,
+    // including the processes that have already exited.
+    status_t GetRuntime(mx_info_task_runtime_t* info);
+
     // Walks the job/process tree and invokes |je| methods on each node. If
     // |recurse| is false, only visits direct children of this job. Returns
     // false if any methods of |je| return false; returns true otherwise.
@@ -124,6 +131,8 @@ private:
     State state_ TA_GUARDED(lock_);
     uint32_t process_count_ TA_GUARDED(lock_);
     uint32_t job_count_ TA_GUARDED(lock_);
+    // cpu time used by exited processes and destroyed child jobs
+    mx_info_task_runtime_t exited_runtime_ TA_GUARDED(lock_) = {};
     StateTracker state_tracker_;
 
     using WeakJobList =
@@ -20,6 +20,14 @@ public:
     static mx_status_t Create(uint32_t data_size, uint32_t num_handles,
                               mxtl::unique_ptr<MessagePacket>* msg);
 
+    // Prints the hit rates and cached bytes of the size-classed slabs that
+    // small packets are allocated from.
+    static void DumpAllocatorStats();
+
+    // Switches small packets between the slabs and the heap, so the two
+    // can be compared without a reboot.
+    static void SetSlabsEnabled(bool enabled);
+
     uint32_t data_size() const { return data_size_; }
     uint32_t num_handles() const { return num_handles_; }
 
@@ -44,9 +52,7 @@ private:
     MessagePacket(uint32_t data_size, uint32_t num_handles, Handle** handles);
     ~MessagePacket();
 
-    static void operator delete(void* ptr) {
-        free(ptr);
-    }
+    static void operator delete(void* ptr);
     friend class mxtl::unique_ptr<MessagePacket>;
 
     bool owns_handles_;
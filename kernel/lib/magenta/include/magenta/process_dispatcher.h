@@ -29,6 +29,7 @@
 #include <mxtl/string_piece.h>
 
 class JobDispatcher;
+class ThreadDispatcher;
 
 class ProcessDispatcher : public Dispatcher {
 public:
@@ -175,6 +176,7 @@ public:
     // Syscall helpers
     status_t GetInfo(mx_info_process_t* info);
     status_t GetStats(mx_info_task_stats_t* stats);
+    status_t GetRuntime(mx_info_task_runtime_t* info);
     // NOTE: Code outside of the syscall layer should not typically know about
     // user_ptrs; do not use this pattern as an example.
     status_t GetAspaceMaps(user_ptr<mx_info_maps_t> maps, size_t max,
@@ -203,8 +205,9 @@ public:
     static mxtl::RefPtr<ProcessDispatcher> LookupProcessById(mx_koid_t koid);
 
     // Look up a thread in this process given its koid.
-    // Returns nullptr if not found.
-    mxtl::RefPtr<UserThread> LookupThreadById(mx_koid_t koid);
+    // Returns nullptr if not found, including for threads that have already
+    // exited and left the process.
+    mxtl::RefPtr<ThreadDispatcher> LookupThreadById(mx_koid_t koid);
 
     uintptr_t get_debug_addr() const;
     mx_status_t set_debug_addr(uintptr_t addr);
@@ -277,6 +280,9 @@ private:
     // list of threads in this process
     mxtl::DoublyLinkedList<UserThread*> thread_list_ TA_GUARDED(state_lock_);
 
+    // cpu time used by threads that have already left |thread_list_|
+    mx_info_task_runtime_t exited_runtime_ TA_GUARDED(state_lock_) = {};
+
     // our address space
     mxtl::RefPtr<VmAspace> aspace_;
 
@@ -45,6 +45,15 @@ public:
     mx_status_t Read(void* dest, size_t len, bool from_user,
                      size_t* nread);
 
+    // Like Write() and Read() but against a range of |vmo|. Whole pages are
+    // moved rather than copied wherever the vmo offset and the socket buffer
+    // position are both page aligned; pages moved out of |vmo| leave that
+    // part of it decommitted.
+    mx_status_t WriteVmo(mxtl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                         size_t* written);
+    mx_status_t ReadVmo(mxtl::RefPtr<VmObject> vmo, uint64_t offset, size_t len,
+                        size_t* nread);
+
     void OnPeerZeroHandles();
 
 private:
@@ -54,11 +63,17 @@ private:
         bool Init(uint32_t len);
         size_t Write(const void* src, size_t len, bool from_user);
         size_t Read(void* dest, size_t len, bool from_user);
+        size_t WriteVmo(VmObject* vmo, uint64_t offset, size_t len);
+        size_t ReadVmo(VmObject* vmo, uint64_t offset, size_t len);
         size_t CouldRead() const;
         size_t free() const;
         bool empty() const;
 
     private:
+        // contiguous bytes that can be written at head_ or read at tail_
+        size_t WriteRoom() const;
+        size_t ReadRoom() const;
+
         size_t head_ = 0u;
         size_t tail_ = 0u;
         uint32_t len_pow2_ = 0u;
@@ -70,6 +85,10 @@ private:
     mx_status_t Init(mxtl::RefPtr<SocketDispatcher> other);
     mx_status_t WriteSelf(const void* src, size_t len, bool from_user,
                           size_t* nwritten);
+    mx_status_t WriteSelfVmo(VmObject* vmo, uint64_t offset, size_t len,
+                             size_t* nwritten);
+    void UpdateWriteStateLocked(bool was_empty, size_t written) TA_REQ(lock_);
+    void UpdateReadStateLocked(bool closed, bool was_full, size_t nread) TA_REQ(lock_);
     status_t UserSignalSelf(uint32_t clear_mask, uint32_t set_mask);
     status_t HalfCloseOther();
 
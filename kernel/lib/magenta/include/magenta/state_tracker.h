@@ -12,6 +12,7 @@
 #include <kernel/spinlock.h>
 #include <magenta/state_observer.h>
 #include <magenta/types.h>
+#include <mxtl/atomic.h>
 #include <mxtl/canary.h>
 #include <mxtl/intrusive_double_list.h>
 
@@ -55,7 +56,7 @@ public:
 
     // Nofity others with MX_SIGNAL_LAST_HANDLE if the value pointed by |count| is 1. This
     // value is allowed to mutate by other threads while this call is executing.
-    void UpdateLastHandleSignal(uint32_t* count);
+    void UpdateLastHandleSignal(mxtl::atomic<uint32_t>* count);
 
     mx_signals_t GetSignalsState() { return signals_; }
 
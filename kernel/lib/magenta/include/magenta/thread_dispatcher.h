@@ -28,6 +28,8 @@ public:
     void Kill() { thread_->Kill(); }
 
     status_t GetInfo(mx_info_thread_t* info);
+    status_t GetStats(mx_info_thread_stats_t* info);
+    status_t GetRuntime(mx_info_task_runtime_t* info);
 
     status_t GetExceptionReport(mx_exception_report_t* report);
 
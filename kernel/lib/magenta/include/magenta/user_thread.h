@@ -137,6 +137,10 @@ public:
 
     // Fetch the state of the thread for userspace tools.
     void GetInfoForUserspace(mx_info_thread_t* info);
+    // Fetch the scheduling statistics of the thread for userspace tools.
+    void GetStatsForUserspace(mx_info_thread_stats_t* info);
+    // Add the cpu time used by the thread so far to |*runtime|.
+    void AddRuntime(mx_info_task_runtime_t* runtime);
 
     // For debugger usage.
     // TODO(dje): The term "state" here conflicts with "state tracker".
@@ -19,6 +19,12 @@ constexpr mx_rights_t kDefaultJobRights =
     MX_RIGHT_ENUMERATE | MX_RIGHT_GET_PROPERTY | MX_RIGHT_SET_PROPERTY |
     MX_RIGHT_SET_POLICY | MX_RIGHT_GET_POLICY;
 
+static void AddRuntime(mx_info_task_runtime_t* sum, const mx_info_task_runtime_t& runtime) {
+    sum->cpu_time += runtime.cpu_time;
+    sum->queue_time += runtime.queue_time;
+    sum->context_switches += runtime.context_switches;
+}
+
 mxtl::RefPtr<JobDispatcher> JobDispatcher::CreateRootJob() {
     AllocChecker ac;
     auto job = mxtl::AdoptRef(new (&ac) JobDispatcher(0u, nullptr, kPolicyEmpty));
@@ -92,7 +98,8 @@ bool JobDispatcher::AddChildJob(JobDispatcher* job) {
     return true;
 }
 
-void JobDispatcher::RemoveChildProcess(ProcessDispatcher* process) {
+void JobDispatcher::RemoveChildProcess(ProcessDispatcher* process,
+                                       const mx_info_task_runtime_t& runtime) {
     canary_.Assert();
 
     AutoLock lock(&lock_);
@@ -100,6 +107,7 @@ void JobDispatcher::RemoveChildProcess(ProcessDispatcher* process) {
     if (!ProcessDispatcher::JobListTraitsWeak::node_state(*process).InContainer())
         return;
     procs_.erase(*process);
+    AddRuntime(&exited_runtime_, runtime);
     --process_count_;
     UpdateSignalsDecrementLocked();
 }
@@ -111,6 +119,11 @@ void JobDispatcher::RemoveChildJob(JobDispatcher* job) {
     if (!JobDispatcher::ListTraitsWeak::node_state(*job).InContainer())
         return;
     jobs_.erase(*job);
+    {
+        // Same parent-then-child lock order as EnumerateChildren().
+        AutoLock child_lock(&job->lock_);
+        AddRuntime(&exited_runtime_, job->exited_runtime_);
+    }
     --job_count_;
     UpdateSignalsDecrementLocked();
 }
@@ -219,6 +232,80 @@ status_t JobDispatcher::SetPolicy(
     return NO_ERROR;
 }
 
+// Pushes |job| onto the |count| deep stack of jobs still to be visited by
+// GetRuntime(), doubling its storage when it is full.
+static bool PushJob(mxtl::Array<mxtl::RefPtr<JobDispatcher>>* stack, size_t* count,
+                    mxtl::RefPtr<JobDispatcher> job) {
+    if (*count == stack->size()) {
+        size_t size = stack->size() ? stack->size() * 2 : 8u;
+        AllocChecker ac;
+        mxtl::Array<mxtl::RefPtr<JobDispatcher>> bigger(
+            new (&ac) mxtl::RefPtr<JobDispatcher>[size], size);
+        if (!ac.check())
+            return false;
+        for (size_t i = 0; i < *count; ++i) {
+            bigger[i] = mxtl::move((*stack)[i]);
+        }
+        stack->swap(bigger);
+    }
+    (*stack)[(*count)++] = mxtl::move(job);
+    return true;
+}
+
+status_t JobDispatcher::GetRuntime(mx_info_task_runtime_t* info) {
+    canary_.Assert();
+
+    // Walk the job tree with an explicit stack instead of recursing, since
+    // the tree depth is under user control. References to each job's
+    // children are taken under its lock and the processes are queried
+    // outside of it: a process holds its own lock when it removes itself
+    // from its job.
+    *info = {};
+    mxtl::Array<mxtl::RefPtr<JobDispatcher>> stack;
+    size_t count = 0;
+    if (!PushJob(&stack, &count, mxtl::RefPtr<JobDispatcher>(this)))
+        return ERR_NO_MEMORY;
+
+    while (count > 0) {
+        mxtl::RefPtr<JobDispatcher> job = mxtl::move(stack[--count]);
+        mxtl::Array<mxtl::RefPtr<ProcessDispatcher>> procs;
+        size_t nprocs = 0;
+        {
+            AutoLock lock(&job->lock_);
+            AllocChecker ac;
+            procs.reset(new (&ac) mxtl::RefPtr<ProcessDispatcher>[job->process_count_],
+                        job->process_count_);
+            if (!ac.check())
+                return ERR_NO_MEMORY;
+
+            // A child can still be on our lists after its last reference is
+            // gone, while its destructor waits for this lock to remove it.
+            // Don't bring it back to life; its runtime reaches
+            // exited_runtime_ once it is removed.
+            for (auto& p : job->procs_) {
+                if (p.AddRefMaybeInDestructor())
+                    procs[nprocs++] = mxtl::internal::MakeRefPtrNoAdopt(&p);
+            }
+            for (auto& j : job->jobs_) {
+                if (!j.AddRefMaybeInDestructor())
+                    continue;
+                if (!PushJob(&stack, &count, mxtl::internal::MakeRefPtrNoAdopt(&j)))
+                    return ERR_NO_MEMORY;
+            }
+            AddRuntime(info, job->exited_runtime_);
+        }
+
+        for (size_t i = 0; i < nprocs; ++i) {
+            mx_info_task_runtime_t child;
+            status_t status = procs[i]->GetRuntime(&child);
+            if (status != NO_ERROR)
+                return status;
+            AddRuntime(info, child);
+        }
+    }
+    return NO_ERROR;
+}
+
 bool JobDispatcher::EnumerateChildren(JobEnumerator* je, bool recurse) {
     canary_.Assert();
 
@@ -6,12 +6,16 @@
 
 #include <magenta/magenta.h>
 
+#include <inttypes.h>
 #include <pow2.h>
+#include <string.h>
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
+#include <kernel/mp.h>
 #include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 
 #include <lk/init.h>
 
@@ -30,6 +34,7 @@
 #include <magenta/io_mapping_dispatcher.h>
 
 #include <mxtl/arena.h>
+#include <mxtl/atomic.h>
 #include <mxtl/intrusive_double_list.h>
 #include <mxtl/type_support.h>
 
@@ -44,10 +49,34 @@ constexpr size_t kMaxHandleCount = 256 * 1024u;
 // there are this many outstanding handles.
 constexpr size_t kHighHandleCount = (kMaxHandleCount * 7) / 8;
 
-// The handle arena and its mutex. It also guards Dispatcher::handle_count_.
+// The handle arena and its mutex.
 static Mutex handle_mutex;
 static mxtl::Arena TA_GUARDED(handle_mutex) handle_arena;
-static size_t outstanding_handles TA_GUARDED(handle_mutex) = 0u;
+static mxtl::atomic<size_t> outstanding_handles(0u);
+
+// Per cpu caches of free handle arena slots that sit in front of the arena,
+// so that making and deleting a handle only touches a cpu local spinlock.
+// Slots move between a cache and the arena in batches under handle_mutex.
+// A cached slot is free memory like any other, with its last base_value
+// stashed in it by TearDownHandle(), so it gets a new generation number
+// when it is handed out again.
+constexpr size_t kHandleCacheMax = 64;
+constexpr size_t kHandleCacheBatch = 32;
+static_assert(kHandleCacheBatch <= kHandleCacheMax, "");
+
+struct HandleCache {
+    spin_lock_t lock;
+    size_t count;
+    void* slots[kHandleCacheMax];
+
+    // statistics, only modified with the lock held
+    uint64_t alloc_hits;
+    uint64_t alloc_misses;
+    uint64_t frees;
+    uint64_t drains;
+} __CPU_ALIGN;
+
+static HandleCache handle_cache[SMP_MAX_CPUS];
 
 // The system exception port.
 static mutex_t system_exception_mutex = MUTEX_INITIAL_VALUE(system_exception_mutex);
@@ -61,6 +90,9 @@ static mxtl::RefPtr<JobDispatcher> root_job;
 static PolicyManager* policy_manager;
 
 void magenta_init(uint level) TA_NO_THREAD_SAFETY_ANALYSIS {
+    for (auto& c : handle_cache) {
+        spin_lock_init(&c.lock);
+    }
     handle_arena.Init("handles", sizeof(Handle), kMaxHandleCount);
     root_job = JobDispatcher::CreateRootJob();
     policy_manager = PolicyManager::Create();
@@ -94,8 +126,11 @@ static_assert(((3 << 30) ^ kHandleGenerationMask ^ kHandleIndexMask) ==
 // Returns a new |base_value| based on the value stored in the free
 // |handle_arena| slot pointed to by |addr|. The new value will be different
 // from the last |base_value| used by this slot.
-static uint32_t GetNewHandleBaseValue(void* addr) TA_REQ(handle_mutex) {
-    // Get the index of this slot within handle_arena.
+//
+// The slot is owned by the caller, so this does not need handle_mutex.
+static uint32_t GetNewHandleBaseValue(void* addr) TA_NO_THREAD_SAFETY_ANALYSIS {
+    // Get the index of this slot within handle_arena. The arena's memory
+    // does not move after magenta_init().
     auto va = reinterpret_cast<Handle*>(addr) -
               reinterpret_cast<Handle*>(handle_arena.start());
     uint32_t handle_index = static_cast<uint32_t>(va);
@@ -143,35 +178,143 @@ void internal::TearDownHandle(Handle *handle) TA_EXCL(handle_mutex) {
 
 static void high_handle_count(size_t count) {
     // TODO: Avoid calling this for every handle after kHighHandleCount;
-    // printfs are slow and |handle_mutex| is held by our caller.
+    // printfs are slow.
     printf("WARNING: High handle count: %zu handles\n", count);
 }
 
-Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
-    uint32_t* handle_count = nullptr;
-    void* addr;
-    uint32_t base_value;
+// Returns every cached slot to the arena, used when the arena itself runs
+// out so that slots stranded in other cpus' caches are not lost.
+static void HandleCacheDrainAll() TA_REQ(handle_mutex) {
+    for (auto& c : handle_cache) {
+        void* slots[kHandleCacheMax];
+        size_t count;
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&c.lock, state);
+        count = c.count;
+        memcpy(slots, c.slots, count * sizeof(void*));
+        c.count = 0;
+        c.drains++;
+        spin_unlock_irqrestore(&c.lock, state);
+
+        for (size_t i = 0; i < count; i++) {
+            handle_arena.Free(slots[i]);
+        }
+    }
+}
 
+// Allocates a free slot for a Handle, from the current cpu's cache if it
+// has one, otherwise refilling the cache with a batch from the arena.
+static void* AllocHandleSlot() {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    HandleCache* c = &handle_cache[arch_curr_cpu_num()];
+    spin_lock(&c->lock);
+    if (c->count > 0) {
+        void* addr = c->slots[--c->count];
+        c->alloc_hits++;
+        spin_unlock_restore(&c->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+        return addr;
+    }
+    c->alloc_misses++;
+    spin_unlock_restore(&c->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    // Take a batch from the arena, one slot for us and the rest for the
+    // cache of whichever cpu we are running on once we have them.
+    void* slots[kHandleCacheBatch];
+    size_t count = 0;
     {
         AutoLock lock(&handle_mutex);
-        addr = handle_arena.Alloc();
-        if (addr == nullptr) {
-            const auto oh = outstanding_handles;
-            lock.release();
-            printf("WARNING: Could not allocate new handle (%zu outstanding)\n",
-                   oh);
-            return nullptr;
+        while (count < kHandleCacheBatch) {
+            void* addr = handle_arena.Alloc();
+            if (addr == nullptr) {
+                if (count > 0)
+                    break;
+                HandleCacheDrainAll();
+                addr = handle_arena.Alloc();
+                if (addr == nullptr)
+                    return nullptr;
+            }
+            slots[count++] = addr;
+        }
+    }
+
+    void* addr = slots[--count];
+    if (count == 0)
+        return addr;
+
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    c = &handle_cache[arch_curr_cpu_num()];
+    spin_lock(&c->lock);
+    while (count > 0 && c->count < kHandleCacheMax) {
+        c->slots[c->count++] = slots[--count];
+    }
+    spin_unlock_restore(&c->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    // Someone else refilled the cache while we were at it.
+    if (count > 0) {
+        AutoLock lock(&handle_mutex);
+        while (count > 0) {
+            handle_arena.Free(slots[--count]);
+        }
+    }
+
+    return addr;
+}
+
+// Frees a slot torn down by TearDownHandle(), to the current cpu's cache if
+// there is room, otherwise along with a batch of the cache to the arena.
+static void FreeHandleSlot(void* addr) {
+    void* slots[kHandleCacheBatch];
+    size_t count = 0;
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    HandleCache* c = &handle_cache[arch_curr_cpu_num()];
+    spin_lock(&c->lock);
+    c->frees++;
+    if (c->count == kHandleCacheMax) {
+        // Hand back the oldest slots, keeping the recently freed and
+        // likely cache hot ones.
+        count = kHandleCacheBatch;
+        memcpy(slots, c->slots, count * sizeof(void*));
+        memmove(c->slots, c->slots + count, (c->count - count) * sizeof(void*));
+        c->count -= count;
+        c->drains++;
+    }
+    c->slots[c->count++] = addr;
+    spin_unlock_restore(&c->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (count > 0) {
+        AutoLock lock(&handle_mutex);
+        for (size_t i = 0; i < count; i++) {
+            handle_arena.Free(slots[i]);
         }
-        if (++outstanding_handles > kHighHandleCount)
-            high_handle_count(outstanding_handles);
+    }
+}
 
-        handle_count = dispatcher->get_handle_count_ptr();
-        (*handle_count)++;
-        if (*handle_count != 2u)
-            handle_count = nullptr;
+// Counts a new handle to |dispatcher|. Returns the dispatcher's handle count
+// if its MX_SIGNAL_LAST_HANDLE state may need updating, otherwise nullptr.
+static mxtl::atomic<uint32_t>* AddHandleRef(Dispatcher* dispatcher) {
+    const size_t oh = outstanding_handles.fetch_add(1u) + 1u;
+    if (oh > kHighHandleCount)
+        high_handle_count(oh);
+
+    auto handle_count = dispatcher->get_handle_count_ptr();
+    if (handle_count->fetch_add(1u) + 1u != 2u)
+        handle_count = nullptr;
+    return handle_count;
+}
 
-        base_value = GetNewHandleBaseValue(addr);
+Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
+    void* addr = AllocHandleSlot();
+    if (addr == nullptr) {
+        printf("WARNING: Could not allocate new handle (%zu outstanding)\n",
+               outstanding_handles.load());
+        return nullptr;
     }
+    uint32_t base_value = GetNewHandleBaseValue(addr);
+    auto handle_count = AddHandleRef(dispatcher.get());
 
     auto state_tracker = dispatcher->get_state_tracker();
     if (state_tracker != nullptr)
@@ -182,30 +325,15 @@ Handle* MakeHandle(mxtl::RefPtr<Dispatcher> dispatcher, mx_rights_t rights) {
 
 Handle* DupHandle(Handle* source, mx_rights_t rights, bool is_replace) {
     mxtl::RefPtr<Dispatcher> dispatcher(source->dispatcher());
-    uint32_t* handle_count;
-    void* addr;
-    uint32_t base_value;
-
-    {
-        AutoLock lock(&handle_mutex);
-        addr = handle_arena.Alloc();
-        if (addr == nullptr) {
-            const auto oh = outstanding_handles;
-            lock.release();
-            printf(
-                "WARNING: Could not allocate duplicate handle (%zu outstanding)\n", oh);
-            return nullptr;
-        }
-        if (++outstanding_handles > kHighHandleCount)
-            high_handle_count(outstanding_handles);
 
-        handle_count = dispatcher->get_handle_count_ptr();
-        (*handle_count)++;
-        if (*handle_count != 2u)
-            handle_count = nullptr;
-
-        base_value = GetNewHandleBaseValue(addr);
+    void* addr = AllocHandleSlot();
+    if (addr == nullptr) {
+        printf("WARNING: Could not allocate duplicate handle (%zu outstanding)\n",
+               outstanding_handles.load());
+        return nullptr;
     }
+    uint32_t base_value = GetNewHandleBaseValue(addr);
+    auto handle_count = AddHandleRef(dispatcher.get());
 
     auto state_tracker = dispatcher->get_state_tracker();
     if (!is_replace && (state_tracker != nullptr))
@@ -245,20 +373,16 @@ void DeleteHandle(Handle* handle) {
     internal::TearDownHandle(handle);
 
     bool zero_handles = false;
-    uint32_t* handle_count;
-    {
-        AutoLock lock(&handle_mutex);
-        --outstanding_handles;
+    outstanding_handles.fetch_sub(1u);
 
-        handle_count = dispatcher->get_handle_count_ptr();
-        (*handle_count)--;
-        if (*handle_count == 0u)
-            zero_handles = true;
-        else if (*handle_count != 1u)
-            handle_count = nullptr;
+    auto handle_count = dispatcher->get_handle_count_ptr();
+    const uint32_t count = handle_count->fetch_sub(1u) - 1u;
+    if (count == 0u)
+        zero_handles = true;
+    else if (count != 1u)
+        handle_count = nullptr;
 
-        handle_arena.Free(handle);
-    }
+    FreeHandleSlot(handle);
 
     if (zero_handles) {
         dispatcher->on_zero_handles();
@@ -287,8 +411,21 @@ Handle* MapU32ToHandle(uint32_t value) TA_NO_THREAD_SAFETY_ANALYSIS {
 }
 
 void internal::DumpHandleTableInfo() {
-    AutoLock lock(&handle_mutex);
-    handle_arena.Dump();
+    {
+        AutoLock lock(&handle_mutex);
+        handle_arena.Dump();
+    }
+
+    printf("%zu outstanding handles\n", outstanding_handles.load());
+    printf("per cpu handle caches:\n");
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        const HandleCache& c = handle_cache[i];
+        if (c.alloc_hits == 0 && c.alloc_misses == 0 && c.frees == 0)
+            continue;
+        printf("  cpu %u: %zu cached, %" PRIu64 " alloc hits, %" PRIu64 " misses, "
+               "%" PRIu64 " frees, %" PRIu64 " drains\n",
+               i, c.count, c.alloc_hits, c.alloc_misses, c.frees, c.drains);
+    }
 }
 
 mx_status_t SetSystemExceptionPort(mxtl::RefPtr<ExceptionPort> eport) {
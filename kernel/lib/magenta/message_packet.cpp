@@ -7,14 +7,219 @@
 #include <magenta/message_packet.h>
 
 #include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
 
+#include <arch/ops.h>
+#include <kernel/auto_lock.h>
+#include <kernel/cmdline.h>
+#include <kernel/mp.h>
+#include <kernel/spinlock.h>
+#include <lk/init.h>
 #include <magenta/handle_reaper.h>
 #include <magenta/magenta.h>
 #include <mxcpp/new.h>
+#include <mxtl/atomic.h>
 
 constexpr uint32_t kMaxMessageSize = 65536u;
 constexpr uint32_t kMaxMessageHandles = 1024u;
 
+namespace {
+
+// Message packets are allocated with a small header in front of them that
+// records where the memory came from, so that operator delete can return it
+// there.  Packets that fit one of the size classes below come out of slabs
+// carved into blocks of that size, through a per cpu cache of free blocks in
+// front of a global depot per class.  Larger packets, or ones that find the
+// slabs of their class exhausted, come from the heap.
+struct BlockHeader {
+    uint32_t size_class;
+    uint32_t reserved;
+};
+static_assert(sizeof(BlockHeader) % alignof(MessagePacket) == 0, "");
+
+constexpr uint32_t kHeapClass = UINT32_MAX;
+constexpr size_t kSizeClasses[] = {128, 256, 512, 1024};
+constexpr size_t kNumSizeClasses = countof(kSizeClasses);
+
+constexpr size_t kSlabSize = 16 * 1024;
+// Slab memory is never returned to the heap, so cap how much each class
+// holds on to; 2MB for the largest class.
+constexpr size_t kMaxSlabsPerClass = 128;
+
+constexpr size_t kCacheMax = 32;
+constexpr size_t kCacheBatch = 16;
+static_assert(kCacheBatch <= kCacheMax, "");
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct Depot {
+    spin_lock_t lock;
+    FreeBlock* free;
+    size_t free_count;
+    size_t slab_count;
+};
+
+struct CpuCache {
+    spin_lock_t lock;
+    struct {
+        size_t count;
+        void* blocks[kCacheMax];
+
+        // statistics, only modified with the lock held
+        uint64_t alloc_hits;
+        uint64_t alloc_misses;
+        uint64_t frees;
+    } classes[kNumSizeClasses];
+} __CPU_ALIGN;
+
+Depot depots[kNumSizeClasses];
+CpuCache cpu_caches[SMP_MAX_CPUS];
+bool slabs_enabled;
+
+mxtl::atomic<uint64_t> heap_allocs(0u);
+mxtl::atomic<uint64_t> slab_exhausted(0u);
+
+uint32_t SizeClassFor(size_t size) {
+    for (uint32_t i = 0; i < kNumSizeClasses; i++) {
+        if (size <= kSizeClasses[i])
+            return i;
+    }
+    return kHeapClass;
+}
+
+// Takes up to |count| blocks of class |sc| from the depot, allocating a new
+// slab for it if it is empty and the class is under its slab limit.
+size_t DepotAlloc(uint32_t sc, void** blocks, size_t count) {
+    Depot& d = depots[sc];
+    const size_t block_size = kSizeClasses[sc];
+
+    for (;;) {
+        size_t n = 0;
+        bool grow = false;
+        {
+            AutoSpinLockIrqSave lock(d.lock);
+            while (n < count && d.free != nullptr) {
+                blocks[n++] = d.free;
+                d.free = d.free->next;
+                d.free_count--;
+            }
+            if (n == 0 && d.slab_count < kMaxSlabsPerClass) {
+                // Claim the slab up front so racing cpus don't overshoot
+                // the limit.
+                d.slab_count++;
+                grow = true;
+            }
+        }
+        if (!grow)
+            return n;
+
+        char* slab = static_cast<char*>(malloc(kSlabSize));
+        if (slab == nullptr) {
+            AutoSpinLockIrqSave lock(d.lock);
+            d.slab_count--;
+            return 0;
+        }
+
+        AutoSpinLockIrqSave lock(d.lock);
+        for (size_t off = 0; off + block_size <= kSlabSize; off += block_size) {
+            FreeBlock* b = reinterpret_cast<FreeBlock*>(slab + off);
+            b->next = d.free;
+            d.free = b;
+            d.free_count++;
+        }
+    }
+}
+
+void DepotFree(uint32_t sc, void** blocks, size_t count) {
+    Depot& d = depots[sc];
+    AutoSpinLockIrqSave lock(d.lock);
+    for (size_t i = 0; i < count; i++) {
+        FreeBlock* b = static_cast<FreeBlock*>(blocks[i]);
+        b->next = d.free;
+        d.free = b;
+        d.free_count++;
+    }
+}
+
+void* SlabAlloc(uint32_t sc) {
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    CpuCache* c = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&c->lock);
+    auto* cc = &c->classes[sc];
+    if (cc->count > 0) {
+        void* block = cc->blocks[--cc->count];
+        cc->alloc_hits++;
+        spin_unlock_restore(&c->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+        return block;
+    }
+    cc->alloc_misses++;
+    spin_unlock_restore(&c->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    // Refill with a batch from the depot, keeping one block for ourselves.
+    void* blocks[kCacheBatch];
+    size_t count = DepotAlloc(sc, blocks, kCacheBatch);
+    if (count == 0)
+        return nullptr;
+    void* block = blocks[--count];
+
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    c = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&c->lock);
+    cc = &c->classes[sc];
+    while (count > 0 && cc->count < kCacheMax) {
+        cc->blocks[cc->count++] = blocks[--count];
+    }
+    spin_unlock_restore(&c->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (count > 0)
+        DepotFree(sc, blocks, count);
+    return block;
+}
+
+void SlabFree(uint32_t sc, void* block) {
+    void* blocks[kCacheBatch];
+    size_t count = 0;
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    CpuCache* c = &cpu_caches[arch_curr_cpu_num()];
+    spin_lock(&c->lock);
+    auto* cc = &c->classes[sc];
+    cc->frees++;
+    if (cc->count == kCacheMax) {
+        // Hand the oldest batch back to the depot.
+        count = kCacheBatch;
+        memcpy(blocks, cc->blocks, count * sizeof(void*));
+        memmove(cc->blocks, cc->blocks + count, (cc->count - count) * sizeof(void*));
+        cc->count -= count;
+    }
+    cc->blocks[cc->count++] = block;
+    spin_unlock_restore(&c->lock, state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    if (count > 0)
+        DepotFree(sc, blocks, count);
+}
+
+void message_packet_init(uint level) {
+    for (auto& d : depots) {
+        spin_lock_init(&d.lock);
+    }
+    for (auto& c : cpu_caches) {
+        spin_lock_init(&c.lock);
+    }
+    smp_mb();
+    MessagePacket::SetSlabsEnabled(cmdline_get_bool("kernel.message-packet-slabs", true));
+}
+
+} // namespace
+
+LK_INIT_HOOK(message_packet, &message_packet_init, LK_INIT_LEVEL_THREADING);
+
 // static
 mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
                                   mxtl::unique_ptr<MessagePacket>* msg) {
@@ -25,11 +230,31 @@ mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
 
     // Allocate space for the MessagePacket object followed by num_handles
     // Handle*s followed by data_size bytes.
-    char* ptr = static_cast<char*>(malloc(sizeof(MessagePacket) +
-                                          num_handles * sizeof(Handle*) +
-                                          data_size));
-    if (ptr == nullptr)
-        return ERR_NO_MEMORY;
+    const size_t size = sizeof(BlockHeader) + sizeof(MessagePacket) +
+                        num_handles * sizeof(Handle*) + data_size;
+
+    // Packets remember where they came from, so the slabs can be switched
+    // on and off while messages are in flight.
+    const bool slabs = __atomic_load_n(&slabs_enabled, __ATOMIC_RELAXED);
+    uint32_t sc = slabs ? SizeClassFor(size) : kHeapClass;
+    void* block = nullptr;
+    if (sc != kHeapClass) {
+        block = SlabAlloc(sc);
+        if (block == nullptr) {
+            slab_exhausted.fetch_add(1u);
+            sc = kHeapClass;
+        }
+    }
+    if (sc == kHeapClass) {
+        heap_allocs.fetch_add(1u);
+        block = malloc(size);
+        if (block == nullptr)
+            return ERR_NO_MEMORY;
+    }
+
+    BlockHeader* header = static_cast<BlockHeader*>(block);
+    header->size_class = sc;
+    char* ptr = reinterpret_cast<char*>(header + 1);
 
     // The storage space for the Handle*s and bytes is not initialized
     // because the only creators of MessagePackets (sys_channel_write and _call)
@@ -39,6 +264,49 @@ mx_status_t MessagePacket::Create(uint32_t data_size, uint32_t num_handles,
     return NO_ERROR;
 }
 
+// static
+void MessagePacket::operator delete(void* ptr) {
+    BlockHeader* header = static_cast<BlockHeader*>(ptr) - 1;
+    if (header->size_class == kHeapClass) {
+        free(header);
+    } else {
+        DEBUG_ASSERT(header->size_class < kNumSizeClasses);
+        SlabFree(header->size_class, header);
+    }
+}
+
+// static
+void MessagePacket::SetSlabsEnabled(bool enabled) {
+    __atomic_store_n(&slabs_enabled, enabled, __ATOMIC_RELAXED);
+}
+
+// static
+void MessagePacket::DumpAllocatorStats() {
+    printf("message packet slabs %s, %" PRIu64 " heap allocations "
+           "(%" PRIu64 " with the slabs of their class exhausted)\n",
+           __atomic_load_n(&slabs_enabled, __ATOMIC_RELAXED) ? "enabled" : "disabled",
+           heap_allocs.load(), slab_exhausted.load());
+
+    for (uint32_t sc = 0; sc < kNumSizeClasses; sc++) {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t frees = 0;
+        size_t cached = 0;
+        for (const auto& c : cpu_caches) {
+            hits += c.classes[sc].alloc_hits;
+            misses += c.classes[sc].alloc_misses;
+            frees += c.classes[sc].frees;
+            cached += c.classes[sc].count;
+        }
+        const Depot& d = depots[sc];
+        const uint64_t allocs = hits + misses;
+        printf("  %4zu bytes: %zu slabs, %" PRIu64 " allocs, %" PRIu64 "%% cpu cache hits, "
+               "%" PRIu64 " frees, %zu bytes in cpu caches, %zu bytes in depot\n",
+               kSizeClasses[sc], d.slab_count, allocs, allocs ? hits * 100 / allocs : 0,
+               frees, cached * kSizeClasses[sc], d.free_count * kSizeClasses[sc]);
+    }
+}
+
 MessagePacket::~MessagePacket() {
     if (owns_handles_) {
         // Delete handles out-of-band to avoid the worst case recursive
@@ -199,6 +199,46 @@ wait:
     }
 }
 
+mx_status_t PortDispatcherV2::DeQueueMany(mx_time_t deadline, mx_port_packet_t* packets,
+                                          size_t count, size_t* actual) {
+    canary_.Assert();
+    DEBUG_ASSERT(count > 0u);
+
+    // Packets whose storage has to be freed once the lock is dropped.
+    mxtl::DoublyLinkedList<PortPacket*> reap;
+    size_t n = 0u;
+
+    while (true) {
+        {
+            AutoLock al(&lock_);
+            while (n < count && !packets_.is_empty()) {
+                auto port_packet = packets_.pop_front();
+                bool user = port_packet->type() == MX_PKT_TYPE_USER;
+                if (CopyLocked(port_packet, &packets[n++]) || user)
+                    reap.push_back(port_packet);
+            }
+        }
+
+        if (n > 0u)
+            break;
+
+        status_t st = sema_.Wait(deadline);
+        if (st != NO_ERROR)
+            return st;
+    }
+
+    while (!reap.is_empty()) {
+        auto port_packet = reap.pop_front();
+        if (port_packet->type() == MX_PKT_TYPE_USER)
+            delete port_packet;
+        else
+            delete port_packet->observer;
+    }
+
+    *actual = n;
+    return NO_ERROR;
+}
+
 PortObserver* PortDispatcherV2::CopyLocked(PortPacket* port_packet, mx_port_packet_t* packet) {
     if (packet)
         *packet = port_packet->packet;
@@ -80,7 +80,9 @@ mx_status_t ProcessDispatcher::Create(
     mxtl::RefPtr<VmAddressRegion> vmar(process->aspace()->RootVmar());
 
     *rights = kDefaultProcessRights;
-    *dispatcher = mxtl::AdoptRef<Dispatcher>(process.release());
+    ProcessDispatcher* pd = process.release();
+    *dispatcher = mxtl::AdoptRef<Dispatcher>(pd);
+    pd->AddToKoidIndex();
 
     // Create a dispatcher for the root VMAR.
     mxtl::RefPtr<Dispatcher> new_vmar_dispatcher;
@@ -125,7 +127,7 @@ ProcessDispatcher::~ProcessDispatcher() {
 
     // Remove ourselves from the parent job's weak ref to us. Note that this might
     // have beeen called when transitioning State::DEAD. The Job can handle double calls.
-    job_->RemoveChildProcess(this);
+    job_->RemoveChildProcess(this, exited_runtime_);
 
     LTRACE_EXIT_OBJ;
 }
@@ -260,6 +262,9 @@ void ProcessDispatcher::RemoveThread(UserThread* t) {
     DEBUG_ASSERT(t != nullptr);
     thread_list_.erase(*t);
 
+    // keep the thread's cpu time accounted to the process
+    t->AddRuntime(&exited_runtime_);
+
     // if this was the last thread, transition directly to DEAD state
     if (thread_list_.is_empty()) {
         LTRACEF("last thread left the process %p, entering DEAD state\n", this);
@@ -369,7 +374,7 @@ void ProcessDispatcher::SetStateLocked(State s) {
 
         // We remove ourselves from the parent Job weak ref (to us) list early, so
         // the semantics of signaling MX_JOB_NO_PROCESSES match that of MX_TASK_TERMINATED.
-        job_->RemoveChildProcess(this);
+        job_->RemoveChildProcess(this, exited_runtime_);
 
         // The PROC_CREATE record currently emits a uint32_t.
         uint32_t koid = static_cast<uint32_t>(get_koid());
@@ -507,6 +512,18 @@ status_t ProcessDispatcher::GetStats(mx_info_task_stats_t* stats) {
     }
     stats->mem_mapped_bytes = usage.mapped_pages * PAGE_SIZE;
     stats->mem_committed_bytes = usage.committed_pages * PAGE_SIZE;
+    stats->page_faults = aspace_->page_faults();
+    stats->mem_large_pages = aspace_->large_pages();
+    return NO_ERROR;
+}
+
+status_t ProcessDispatcher::GetRuntime(mx_info_task_runtime_t* info) {
+    DEBUG_ASSERT(info != nullptr);
+    AutoLock lock(&state_lock_);
+    *info = exited_runtime_;
+    for (auto& thread : thread_list_) {
+        thread.AddRuntime(info);
+    }
     return NO_ERROR;
 }
 
@@ -658,42 +675,29 @@ mxtl::RefPtr<ExceptionPort> ProcessDispatcher::debugger_exception_port() {
     return debugger_exception_port_;
 }
 
-class FindProcessByKoid final : public JobEnumerator {
-public:
-    FindProcessByKoid(mx_koid_t koid) : koid_(koid) {}
-    FindProcessByKoid(const FindProcessByKoid&) = delete;
-
-    // To be called after enumeration.
-    mxtl::RefPtr<ProcessDispatcher> get_pd() { return pd_; }
-
-private:
-    bool OnProcess(ProcessDispatcher* process) final {
-        if (process->get_koid() == koid_) {
-            pd_ = mxtl::WrapRefPtr(process);
-            // Stop the enumeration.
-            return false;
-        }
-        // Keep looking.
-        return true;
-    }
-
-    const mx_koid_t koid_;
-    mxtl::RefPtr<ProcessDispatcher> pd_ = nullptr;
-};
-
 // static
 mxtl::RefPtr<ProcessDispatcher> ProcessDispatcher::LookupProcessById(mx_koid_t koid) {
-    FindProcessByKoid finder(koid);
-    GetRootJobDispatcher()->EnumerateChildren(&finder, /* recurse */ true);
-    return finder.get_pd();
+    auto process = Dispatcher::LookupByKoid<ProcessDispatcher>(koid);
+    // Dead processes have already left their job, so they are not reachable
+    // by walking the job tree either.
+    if (process && process->state() == State::DEAD)
+        return nullptr;
+    return process;
 }
 
-mxtl::RefPtr<UserThread> ProcessDispatcher::LookupThreadById(mx_koid_t koid) {
+mxtl::RefPtr<ThreadDispatcher> ProcessDispatcher::LookupThreadById(mx_koid_t koid) {
     LTRACE_ENTRY_OBJ;
-    AutoLock lock(&state_lock_);
 
-    auto iter = thread_list_.find_if([koid](const UserThread& t) { return t.get_koid() == koid; });
-    return mxtl::WrapRefPtr(iter.CopyPointer());
+    auto thread = Dispatcher::LookupByKoid<ThreadDispatcher>(koid);
+    if (!thread || thread->thread()->process() != this)
+        return nullptr;
+
+    // The dispatcher outlives the thread leaving the process, but only
+    // threads still in the process are its children.
+    AutoLock lock(&state_lock_);
+    if (!thread->thread()->InContainer())
+        return nullptr;
+    return thread;
 }
 
 uintptr_t ProcessDispatcher::get_debug_addr() const {
@@ -31,6 +31,9 @@ constexpr mx_rights_t kDefaultSocketRights =
 
 constexpr size_t kDeFaultSocketBufferSize = 256 * 1024u;
 
+// Pages moved per TakePages()/SupplyPages() pair by the vmo paths.
+constexpr size_t kMaxMovePages = 16u;
+
 constexpr mx_signals_t kValidSignalMask =
     MX_SOCKET_READABLE | MX_SOCKET_PEER_CLOSED | MX_USER_SIGNAL_ALL;
 
@@ -74,26 +77,37 @@ bool SocketDispatcher::CBuf::empty() const {
     return tail_ == head_;
 }
 
+size_t SocketDispatcher::CBuf::WriteRoom() const {
+    if (head_ >= tail_) {
+        if (tail_ == 0) {
+            // Special case - if tail is at position 0, we can't write all
+            // the way to the end of the buffer. Otherwise, head ends up at
+            // 0, head == tail, and buffer is considered "empty" again.
+            return valpow2(len_pow2_) - head_ - 1;
+        }
+        // Write to the end of the buffer.
+        return valpow2(len_pow2_) - head_;
+    }
+    // Write from head to tail-1.
+    return tail_ - head_ - 1;
+}
+
+size_t SocketDispatcher::CBuf::ReadRoom() const {
+    if (head_ >= tail_) {
+        // simple case where there is no wraparound
+        return head_ - tail_;
+    }
+    // read to the end of buffer in this pass
+    return valpow2(len_pow2_) - tail_;
+}
+
 size_t SocketDispatcher::CBuf::Write(const void* src, size_t len, bool from_user) {
 
     size_t write_len;
     size_t pos = 0;
 
     while (pos < len && (free() > 0)) {
-        if (head_ >= tail_) {
-            if (tail_ == 0) {
-                // Special case - if tail is at position 0, we can't write all
-                // the way to the end of the buffer. Otherwise, head ends up at
-                // 0, head == tail, and buffer is considered "empty" again.
-                write_len = MIN(valpow2(len_pow2_) - head_ - 1, len - pos);
-            } else {
-                // Write to the end of the buffer.
-                write_len = MIN(valpow2(len_pow2_) - head_, len - pos);
-            }
-        } else {
-            // Write from head to tail-1.
-            write_len = MIN(tail_ - head_ - 1, len - pos);
-        }
+        write_len = MIN(WriteRoom(), len - pos);
 
         // if it's full, abort and return how much we've written
         if (write_len == 0) {
@@ -124,14 +138,7 @@ size_t SocketDispatcher::CBuf::Read(void* dest, size_t len, bool from_user) {
         // loop until we've read everything we need
         // at most this will make two passes to deal with wraparound
         while (pos < len && tail_ != head_) {
-            size_t read_len;
-            if (head_ > tail_) {
-                // simple case where there is no wraparound
-                read_len = MIN(head_ - tail_, len - pos);
-            } else {
-                // read to the end of buffer in this pass
-                read_len = MIN(valpow2(len_pow2_) - tail_, len - pos);
-            }
+            size_t read_len = MIN(ReadRoom(), len - pos);
 
             char *ptr = (char*)dest;
             ptr += pos;
@@ -151,6 +158,95 @@ size_t SocketDispatcher::CBuf::Read(void* dest, size_t len, bool from_user) {
     return ret;
 }
 
+// Moves |len| bytes of whole pages from |src| to |dst|, a batch at a time.
+// Returns how much was moved; whatever fails to move stays in |src|.
+static size_t MovePages(VmObject* src, uint64_t src_offset,
+                        VmObject* dst, uint64_t dst_offset, size_t len) {
+    vm_page_t* pages[kMaxMovePages];
+    size_t moved = 0;
+    while (moved < len) {
+        size_t batch = MIN(len - moved, kMaxMovePages * PAGE_SIZE);
+        if (src->TakePages(src_offset + moved, batch, pages) != NO_ERROR)
+            break;
+        if (dst->SupplyPages(dst_offset + moved, batch, pages) != NO_ERROR) {
+            // |src| kept its page list nodes so this only fails if it was
+            // shrunk in the meantime, and then the data has nowhere to go
+            if (src->SupplyPages(src_offset + moved, batch, pages) != NO_ERROR) {
+                for (size_t i = 0; i < batch / PAGE_SIZE; i++)
+                    pmm_free_page(pages[i]);
+            }
+            break;
+        }
+        moved += batch;
+    }
+    return moved;
+}
+
+size_t SocketDispatcher::CBuf::WriteVmo(VmObject* vmo, uint64_t offset, size_t len) {
+    size_t pos = 0;
+    bool can_move = true;
+
+    while (pos < len && (free() > 0)) {
+        size_t write_len = MIN(WriteRoom(), len - pos);
+        if (write_len == 0)
+            break;
+
+        if (can_move && IS_PAGE_ALIGNED(head_) && IS_PAGE_ALIGNED(offset + pos) &&
+            write_len >= PAGE_SIZE) {
+            size_t moved = MovePages(vmo, offset + pos, vmo_.get(), head_,
+                                     ROUNDDOWN(write_len, PAGE_SIZE));
+            if (moved > 0) {
+                head_ = INC_POINTER(len_pow2_, head_, moved);
+                pos += moved;
+                continue;
+            }
+            // e.g. a physical vmo; don't keep trying
+            can_move = false;
+        }
+
+        // copy up to the next page boundary in the buffer, after which a vmo
+        // offset with the same alignment can be moved again
+        write_len = MIN(write_len, PAGE_SIZE - (head_ & (PAGE_SIZE - 1)));
+        if (vmo->Read(reinterpret_cast<void*>(mapping_->base() + head_), offset + pos,
+                      write_len, nullptr) != NO_ERROR)
+            break;
+
+        head_ = INC_POINTER(len_pow2_, head_, write_len);
+        pos += write_len;
+    }
+    return pos;
+}
+
+size_t SocketDispatcher::CBuf::ReadVmo(VmObject* vmo, uint64_t offset, size_t len) {
+    size_t pos = 0;
+    bool can_move = true;
+
+    while (pos < len && tail_ != head_) {
+        size_t read_len = MIN(ReadRoom(), len - pos);
+
+        if (can_move && IS_PAGE_ALIGNED(tail_) && IS_PAGE_ALIGNED(offset + pos) &&
+            read_len >= PAGE_SIZE) {
+            size_t moved = MovePages(vmo_.get(), tail_, vmo, offset + pos,
+                                     ROUNDDOWN(read_len, PAGE_SIZE));
+            if (moved > 0) {
+                tail_ = INC_POINTER(len_pow2_, tail_, moved);
+                pos += moved;
+                continue;
+            }
+            can_move = false;
+        }
+
+        read_len = MIN(read_len, PAGE_SIZE - (tail_ & (PAGE_SIZE - 1)));
+        if (vmo->Write(reinterpret_cast<void*>(mapping_->base() + tail_), offset + pos,
+                       read_len, nullptr) != NO_ERROR)
+            break;
+
+        tail_ = INC_POINTER(len_pow2_, tail_, read_len);
+        pos += read_len;
+    }
+    return pos;
+}
+
 size_t SocketDispatcher::CBuf::CouldRead() const {
     return modpow2((uint)(head_ - tail_), len_pow2_);
 }
@@ -323,6 +419,26 @@ mx_status_t SocketDispatcher::Write(const void* src, size_t len,
     return other->WriteSelf(src, len, from_user, nwritten);
 }
 
+mx_status_t SocketDispatcher::WriteVmo(mxtl::RefPtr<VmObject> vmo, uint64_t offset,
+                                       size_t len, size_t* nwritten) {
+    canary_.Assert();
+
+    if (offset + len < offset || offset + len > vmo->size())
+        return ERR_OUT_OF_RANGE;
+
+    mxtl::RefPtr<SocketDispatcher> other;
+    {
+        AutoLock lock(&lock_);
+        if (!other_)
+            return ERR_PEER_CLOSED;
+        if (half_closed_[0])
+            return ERR_BAD_STATE;
+        other = other_;
+    }
+
+    return other->WriteSelfVmo(vmo.get(), offset, len, nwritten);
+}
+
 mx_status_t SocketDispatcher::WriteSelf(const void* src, size_t len,
                                         bool from_user, size_t* written) {
     canary_.Assert();
@@ -336,18 +452,41 @@ mx_status_t SocketDispatcher::WriteSelf(const void* src, size_t len,
 
     auto st = cbuf_.Write(src, len, from_user);
 
-    if (st > 0) {
+    UpdateWriteStateLocked(was_empty, st);
+
+    *written = st;
+    return NO_ERROR;
+}
+
+mx_status_t SocketDispatcher::WriteSelfVmo(VmObject* vmo, uint64_t offset, size_t len,
+                                           size_t* written) {
+    canary_.Assert();
+
+    AutoLock lock(&lock_);
+
+    if (!cbuf_.free())
+        return ERR_SHOULD_WAIT;
+
+    bool was_empty = cbuf_.empty();
+
+    auto st = cbuf_.WriteVmo(vmo, offset, len);
+
+    UpdateWriteStateLocked(was_empty, st);
+
+    *written = st;
+    return NO_ERROR;
+}
+
+void SocketDispatcher::UpdateWriteStateLocked(bool was_empty, size_t written) {
+    if (written > 0) {
         if (was_empty)
             state_tracker_.UpdateState(0u, MX_SOCKET_READABLE);
         if (iopc_)
-            iopc_->Signal(MX_SOCKET_READABLE, st, &lock_);
+            iopc_->Signal(MX_SOCKET_READABLE, written, &lock_);
     }
 
     if (!cbuf_.free())
         other_->state_tracker_.UpdateState(MX_SOCKET_WRITABLE, 0u);
-
-    *written = st;
-    return NO_ERROR;
 }
 
 mx_status_t SocketDispatcher::Read(void* dest, size_t len,
@@ -371,13 +510,41 @@ mx_status_t SocketDispatcher::Read(void* dest, size_t len,
 
     auto st = cbuf_.Read(dest, len, from_user);
 
+    UpdateReadStateLocked(closed, was_full, st);
+
+    *nread = static_cast<size_t>(st);
+    return NO_ERROR;
+}
+
+mx_status_t SocketDispatcher::ReadVmo(mxtl::RefPtr<VmObject> vmo, uint64_t offset,
+                                      size_t len, size_t* nread) {
+    canary_.Assert();
+
+    if (offset + len < offset || offset + len > vmo->size())
+        return ERR_OUT_OF_RANGE;
+
+    AutoLock lock(&lock_);
+
+    bool closed = half_closed_[1] || !other_;
+
+    if (cbuf_.empty())
+        return closed ? ERR_PEER_CLOSED: ERR_SHOULD_WAIT;
+
+    bool was_full = cbuf_.free() == 0u;
+
+    auto st = cbuf_.ReadVmo(vmo.get(), offset, len);
+
+    UpdateReadStateLocked(closed, was_full, st);
+
+    *nread = st;
+    return NO_ERROR;
+}
+
+void SocketDispatcher::UpdateReadStateLocked(bool closed, bool was_full, size_t nread) {
     if (cbuf_.empty()) {
         state_tracker_.UpdateState(MX_SOCKET_READABLE, 0u);
     }
 
-    if (!closed && was_full && (st > 0))
+    if (!closed && was_full && (nread > 0))
         other_->state_tracker_.UpdateState(0u, MX_SOCKET_WRITABLE);
-
-    *nread = static_cast<size_t>(st);
-    return NO_ERROR;
 }
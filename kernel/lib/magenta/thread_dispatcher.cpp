@@ -6,6 +6,7 @@
 
 #include <magenta/thread_dispatcher.h>
 
+#include <string.h>
 #include <trace.h>
 
 #include <magenta/handle.h>
@@ -27,6 +28,7 @@ status_t ThreadDispatcher::Create(mxtl::RefPtr<UserThread> thread, mxtl::RefPtr<
         return ERR_NO_MEMORY;
 
     thread->set_dispatcher(disp.get());
+    disp->AddToKoidIndex();
 
     *rights = kDefaultThreadRights;
     *dispatcher = mxtl::move(disp);
@@ -53,6 +55,21 @@ status_t ThreadDispatcher::GetInfo(mx_info_thread_t* info) {
     return NO_ERROR;
 }
 
+status_t ThreadDispatcher::GetStats(mx_info_thread_stats_t* info) {
+    canary_.Assert();
+
+    thread_->GetStatsForUserspace(info);
+    return NO_ERROR;
+}
+
+status_t ThreadDispatcher::GetRuntime(mx_info_task_runtime_t* info) {
+    canary_.Assert();
+
+    memset(info, 0, sizeof(*info));
+    thread_->AddRuntime(info);
+    return NO_ERROR;
+}
+
 status_t ThreadDispatcher::GetExceptionReport(mx_exception_report_t* report) {
     canary_.Assert();
 
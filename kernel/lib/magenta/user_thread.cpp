@@ -831,6 +831,31 @@ void UserThread::GetInfoForUserspace(mx_info_thread_t* info) {
     }
 }
 
+void UserThread::GetStatsForUserspace(mx_info_thread_stats_t* info) {
+    canary_.Assert();
+
+    LTRACE_ENTRY_OBJ;
+    thread_sched_stats_t stats;
+    thread_get_sched_stats(&thread_, &stats);
+
+    memset(info, 0, sizeof(*info));
+    info->total_runtime = stats.runtime;
+    info->total_wait_time = stats.wait_time;
+    info->context_switches = stats.context_switches;
+    info->last_scheduled_cpu = stats.last_cpu;
+}
+
+void UserThread::AddRuntime(mx_info_task_runtime_t* runtime) {
+    canary_.Assert();
+
+    thread_sched_stats_t stats;
+    thread_get_sched_stats(&thread_, &stats);
+
+    runtime->cpu_time += stats.runtime;
+    runtime->queue_time += stats.wait_time;
+    runtime->context_switches += stats.context_switches;
+}
+
 status_t UserThread::GetExceptionReport(mx_exception_report_t* report) {
     canary_.Assert();
 
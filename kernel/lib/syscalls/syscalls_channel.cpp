@@ -31,6 +31,9 @@
 
 constexpr size_t kChannelReadHandlesChunkCount = 16u;
 constexpr size_t kChannelWriteHandlesInlineCount = 8u;
+// The most messages a single read_many/write_many call moves; the descriptors
+// and packets for a batch are staged on the kernel stack.
+constexpr uint32_t kChannelMsgBatchMax = 16u;
 
 mx_status_t sys_channel_create(
     uint32_t options, user_ptr<mx_handle_t> _out0, user_ptr<mx_handle_t> _out1) {
@@ -149,6 +152,94 @@ mx_status_t sys_channel_read(mx_handle_t handle_value, uint32_t options,
     return result;
 }
 
+mx_status_t sys_channel_read_many(mx_handle_t handle_value, uint32_t options,
+                                  user_ptr<mx_channel_msg_t> _msgs, uint32_t count,
+                                  user_ptr<uint32_t> _actual) {
+    LTRACEF("handle %d msgs %p count %u\n", handle_value, _msgs.get(), count);
+
+    if (options & ~MX_CHANNEL_READ_MAY_DISCARD)
+        return ERR_INVALID_ARGS;
+    // Discarding would make the batch stop at, and drop, a message that does not
+    // fit; callers that want that use channel_read.
+    if (options & MX_CHANNEL_READ_MAY_DISCARD)
+        return ERR_NOT_SUPPORTED;
+    if (count == 0u)
+        return ERR_INVALID_ARGS;
+    count = mxtl::min(count, kChannelMsgBatchMax);
+
+    mx_channel_msg_t msgs[kChannelMsgBatchMax];
+    if (_msgs.copy_array_from_user(msgs, count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (_actual && _actual.copy_to_user(0u) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_READ, &channel);
+    if (result != NO_ERROR)
+        return result;
+
+    uint32_t num_bytes[kChannelMsgBatchMax];
+    uint32_t num_handles[kChannelMsgBatchMax];
+    for (uint32_t ix = 0; ix != count; ++ix) {
+        num_bytes[ix] = msgs[ix].num_bytes;
+        num_handles[ix] = msgs[ix].num_handles;
+    }
+
+    mxtl::unique_ptr<MessagePacket> packets[kChannelMsgBatchMax];
+    size_t actual = 0u;
+    result = channel->ReadMany(count, num_bytes, num_handles, packets, &actual);
+    if (result == ERR_BUFFER_TOO_SMALL) {
+        // As with channel_read, report the size of the message that did not fit.
+        msgs[0].num_bytes = num_bytes[0];
+        msgs[0].num_handles = num_handles[0];
+        if (_msgs.copy_array_to_user(msgs, 1u) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        return result;
+    }
+    if (result != NO_ERROR)
+        return result;
+
+    // Report the sizes before consuming anything, so that a bad descriptor array
+    // leaves every message in the channel.
+    for (size_t ix = 0; ix != actual; ++ix) {
+        msgs[ix].num_bytes = num_bytes[ix];
+        msgs[ix].num_handles = num_handles[ix];
+    }
+    if (_msgs.copy_array_to_user(msgs, actual) != NO_ERROR) {
+        channel->UnreadMany(packets, actual);
+        return ERR_INVALID_ARGS;
+    }
+
+    // A message is consumed once its bytes are copied out and its handles are
+    // installed. If a copy fails, that message and the ones after it go back
+    // to the channel and the messages already consumed are reported.
+    size_t consumed = 0u;
+    for (; consumed != actual; ++consumed) {
+        MessagePacket* msg = packets[consumed].get();
+        const mx_channel_msg_t& desc = msgs[consumed];
+
+        if (desc.num_bytes > 0u) {
+            if (make_user_ptr(desc.bytes).copy_array_to_user(msg->data(),
+                                                             desc.num_bytes) != NO_ERROR)
+                break;
+        }
+        if (desc.num_handles > 0u)
+            msg_get_handles(up, msg, make_user_ptr(desc.handles), desc.num_handles);
+
+        ktrace(TAG_CHANNEL_READ, (uint32_t)channel->get_koid(), desc.num_bytes,
+               desc.num_handles, 0);
+    }
+    channel->UnreadMany(packets + consumed, actual - consumed);
+    if (consumed == 0u)
+        return ERR_INVALID_ARGS;
+
+    if (_actual && _actual.copy_to_user(static_cast<uint32_t>(consumed)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
+}
+
 static mx_status_t msg_put_handles(ProcessDispatcher* up, MessagePacket* msg, mx_handle_t* handles,
                                    user_ptr<const mx_handle_t> _handles, uint32_t num_handles,
                                    Dispatcher* channel) {
@@ -249,6 +340,97 @@ mx_status_t sys_channel_write(mx_handle_t handle_value, uint32_t options,
     return result;
 }
 
+// Builds a message for write_many from one user descriptor, taking its handles
+// out of the process.
+static mx_status_t msg_create_from_user(ProcessDispatcher* up, ChannelDispatcher* channel,
+                                        const mx_channel_msg_t& desc,
+                                        mxtl::unique_ptr<MessagePacket>* out) {
+    mxtl::unique_ptr<MessagePacket> msg;
+    mx_status_t result = MessagePacket::Create(desc.num_bytes, desc.num_handles, &msg);
+    if (result != NO_ERROR)
+        return result;
+
+    if (desc.num_bytes > 0u) {
+        if (make_user_ptr<const void>(desc.bytes).copy_array_from_user(
+                msg->mutable_data(), desc.num_bytes) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+    }
+
+    if (desc.num_handles > 0u) {
+        AllocChecker ac;
+        mxtl::InlineArray<mx_handle_t, kChannelWriteHandlesInlineCount> handles(&ac,
+                                                                              desc.num_handles);
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        result = msg_put_handles(up, msg.get(), handles.get(),
+                                 make_user_ptr<const mx_handle_t>(desc.handles), desc.num_handles,
+                                 static_cast<Dispatcher*>(channel));
+        if (result)
+            return result;
+    }
+
+    *out = mxtl::move(msg);
+    return NO_ERROR;
+}
+
+mx_status_t sys_channel_write_many(mx_handle_t handle_value, uint32_t options,
+                                   user_ptr<const mx_channel_msg_t> _msgs, uint32_t count,
+                                   user_ptr<uint32_t> _actual) {
+    LTRACEF("handle %d msgs %p count %u\n", handle_value, _msgs.get(), count);
+
+    // No write options exist; unknown bits are rejected like read_many's.
+    if (options)
+        return ERR_INVALID_ARGS;
+    if (count == 0u)
+        return ERR_INVALID_ARGS;
+    count = mxtl::min(count, kChannelMsgBatchMax);
+
+    mx_channel_msg_t msgs[kChannelMsgBatchMax];
+    if (_msgs.copy_array_from_user(msgs, count) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<ChannelDispatcher> channel;
+    mx_status_t result = up->GetDispatcherWithRights(handle_value, MX_RIGHT_WRITE, &channel);
+    if (result != NO_ERROR)
+        return result;
+
+    // Build messages up to the first one that is invalid. Everything before it
+    // is written; its error is what the call returns.
+    mxtl::unique_ptr<MessagePacket> packets[kChannelMsgBatchMax];
+    mx_status_t msg_result = NO_ERROR;
+    uint32_t prepared = 0u;
+    for (; prepared != count; ++prepared) {
+        msg_result = msg_create_from_user(up, channel.get(), msgs[prepared], &packets[prepared]);
+        if (msg_result != NO_ERROR)
+            break;
+    }
+    if (prepared == 0u)
+        return msg_result;
+
+    result = channel->WriteMany(packets, prepared);
+    if (result != NO_ERROR) {
+        // Write failed, put back the handles of every message into this process.
+        AutoLock lock(up->handle_table_lock());
+        for (uint32_t ix = 0; ix != prepared; ++ix) {
+            Handle* const* handles = packets[ix]->handles();
+            for (uint32_t h = 0; h != packets[ix]->num_handles(); ++h)
+                up->UndoRemoveHandleLocked(up->MapHandleToValue(handles[h]));
+        }
+        return result;
+    }
+
+    for (uint32_t ix = 0; ix != prepared; ++ix) {
+        ktrace(TAG_CHANNEL_WRITE, (uint32_t)channel->get_koid(), msgs[ix].num_bytes,
+               msgs[ix].num_handles, 0);
+    }
+
+    if (_actual && _actual.copy_to_user(prepared) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return msg_result;
+}
+
 mx_status_t sys_channel_call(mx_handle_t handle_value, uint32_t options,
                              mx_time_t deadline, user_ptr<const mx_channel_call_args_t> _args,
                              user_ptr<uint32_t> actual_bytes, user_ptr<uint32_t> actual_handles,
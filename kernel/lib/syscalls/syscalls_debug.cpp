@@ -165,14 +165,11 @@ mx_status_t sys_ktrace_write(mx_handle_t handle, uint32_t event_id, uint32_t arg
         return ERR_INVALID_ARGS;
     }
 
-    uint32_t* args = static_cast<uint32_t*>(ktrace_open(TAG_PROBE_24(event_id)));
-    if (!args) {
+    if (!ktrace_write(TAG_PROBE_24(event_id), arg0, arg1, 0, 0)) {
         //  There is not a single reason for failure. Assume it reached the end.
         return ERR_UNAVAILABLE;
     }
 
-    args[0] = arg0;
-    args[1] = arg1;
     return NO_ERROR;
 }
 
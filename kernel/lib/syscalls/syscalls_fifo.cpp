@@ -19,6 +19,7 @@
 #include <magenta/magenta.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/user_copy.h>
+#include <magenta/vm_object_dispatcher.h>
 
 #include <mxtl/ref_ptr.h>
 
@@ -95,3 +96,38 @@ mx_status_t sys_fifo_read(mx_handle_t handle, user_ptr<void> entries, size_t len
 
     return NO_ERROR;
 }
+
+mx_status_t sys_fifo_get_ring(mx_handle_t handle, user_ptr<mx_fifo_ring_info_t> _info,
+                              user_ptr<mx_handle_t> _vmo) {
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // the ring is both read and written through the vmo
+    mxtl::RefPtr<FifoDispatcher> fifo;
+    mx_status_t status = up->GetDispatcherWithRights(
+        handle, MX_RIGHT_READ | MX_RIGHT_WRITE, &fifo);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<VmObject> vmo;
+    mx_fifo_ring_info_t info;
+    if ((status = fifo->GetRing(&vmo, &info)) != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    if ((status = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights)) != NO_ERROR)
+        return status;
+
+    HandleOwner vmo_handle(MakeHandle(mxtl::move(dispatcher), rights & ~MX_RIGHT_EXECUTE));
+    if (!vmo_handle)
+        return ERR_NO_MEMORY;
+
+    if (_info.copy_to_user(info) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    if (_vmo.copy_to_user(up->MapHandleToValue(vmo_handle)) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+
+    up->AddHandle(mxtl::move(vmo_handle));
+
+    return NO_ERROR;
+}
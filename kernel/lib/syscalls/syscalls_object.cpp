@@ -6,8 +6,14 @@
 
 #include <err.h>
 #include <inttypes.h>
+#include <platform.h>
+#include <string.h>
 #include <trace.h>
 
+#include <arch/ops.h>
+#include <kernel/mp.h>
+#include <kernel/thread.h>
+
 #include <magenta/handle_owner.h>
 #include <magenta/job_dispatcher.h>
 #include <magenta/magenta.h>
@@ -16,6 +22,7 @@
 #include <magenta/thread_dispatcher.h>
 #include <magenta/vm_address_region_dispatcher.h>
 
+#include <mxtl/algorithm.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
@@ -68,6 +75,40 @@ private:
     size_t count_ = 0;
     size_t avail_ = 0;
 };
+
+// Snapshots the scheduler counters of |cpu|.
+void GetCpuStats(uint cpu, mx_info_cpu_stats_t* info) {
+    memset(info, 0, sizeof(*info));
+    info->cpu_number = cpu;
+    if (!mp_is_cpu_active(cpu))
+        return;
+    info->flags = MX_CPU_STATS_FLAG_ONLINE;
+
+    const struct thread_stats* stats = &thread_stats[cpu];
+    {
+        // The idle accounting is updated under the thread lock when the cpu
+        // switches to or from its idle thread.
+        THREAD_LOCK(state);
+        info->idle_time = stats->idle_time;
+        if (mp_is_cpu_idle(cpu))
+            info->idle_time += current_time() - stats->last_idle_timestamp;
+        THREAD_UNLOCK(state);
+    }
+    info->reschedules = stats->reschedules;
+    info->context_switches = stats->context_switches;
+    info->irq_preempts = stats->irq_preempts;
+    info->preempts = stats->preempts;
+    info->yields = stats->yields;
+    info->ints = stats->interrupts;
+    info->timer_ints = stats->timer_ints;
+    info->timers = stats->timers;
+    info->exceptions = stats->exceptions;
+    info->syscalls = stats->syscalls;
+#if WITH_SMP
+    info->reschedule_ipis = stats->reschedule_ipis;
+    info->generic_ipis = stats->generic_ipis;
+#endif
+}
 } // namespace
 
 // actual is an optional return parameter for the number of records returned
@@ -380,6 +421,94 @@ mx_status_t sys_object_get_info(mx_handle_t handle, uint32_t topic,
                 return ERR_BUFFER_TOO_SMALL;
             return NO_ERROR;
         }
+        case MX_INFO_THREAD_STATS: {
+            size_t actual = (buffer_size < sizeof(mx_info_thread_stats_t)) ? 0 : 1;
+            size_t avail = 1;
+
+            mxtl::RefPtr<ThreadDispatcher> thread;
+            auto error = up->GetDispatcherWithRights(handle, MX_RIGHT_READ, &thread);
+            if (error < 0)
+                return error;
+
+            if (actual > 0) {
+                mx_info_thread_stats_t info = {};
+
+                auto err = thread->GetStats(&info);
+                if (err != NO_ERROR)
+                    return err;
+
+                if (_buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_TASK_RUNTIME: {
+            size_t actual = (buffer_size < sizeof(mx_info_task_runtime_t)) ? 0 : 1;
+            size_t avail = 1;
+
+            // Supports threads, processes and jobs.
+            mxtl::RefPtr<Dispatcher> dispatcher;
+            auto error = up->GetDispatcherWithRights(handle, MX_RIGHT_READ, &dispatcher);
+            if (error < 0)
+                return error;
+
+            if (actual > 0) {
+                mx_info_task_runtime_t info = {};
+
+                status_t err;
+                if (auto thread = DownCastDispatcher<ThreadDispatcher>(&dispatcher)) {
+                    err = thread->GetRuntime(&info);
+                } else if (auto process = DownCastDispatcher<ProcessDispatcher>(&dispatcher)) {
+                    err = process->GetRuntime(&info);
+                } else if (auto job = DownCastDispatcher<JobDispatcher>(&dispatcher)) {
+                    err = job->GetRuntime(&info);
+                } else {
+                    return ERR_WRONG_TYPE;
+                }
+                if (err != NO_ERROR)
+                    return err;
+
+                if (_buffer.copy_array_to_user(&info, sizeof(info)) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+            if (_actual && (_actual.copy_to_user(actual) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (actual == 0)
+                return ERR_BUFFER_TOO_SMALL;
+            return NO_ERROR;
+        }
+        case MX_INFO_CPU_STATS: {
+            // TODO: finer grained validation
+            mx_status_t status = validate_resource_handle(handle);
+            if (status < 0)
+                return status;
+
+            // One record per possible cpu, so that callers can index by cpu
+            // number.
+            size_t avail = arch_max_num_cpus();
+            size_t count = mxtl::min(buffer_size / sizeof(mx_info_cpu_stats_t), avail);
+            auto records = _buffer.reinterpret<mx_info_cpu_stats_t>();
+            for (size_t i = 0; i < count; i++) {
+                mx_info_cpu_stats_t info;
+                GetCpuStats(static_cast<uint>(i), &info);
+                if (records.copy_array_to_user(&info, 1, i) != NO_ERROR)
+                    return ERR_INVALID_ARGS;
+            }
+
+            if (_actual && (_actual.copy_to_user(count) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            if (_avail && (_avail.copy_to_user(avail) != NO_ERROR))
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
         default:
             return ERR_NOT_SUPPORTED;
     }
@@ -588,10 +717,7 @@ mx_status_t sys_object_get_child(mx_handle_t handle, uint64_t koid, mx_rights_t
         auto thread = process->LookupThreadById(koid);
         if (!thread)
             return ERR_NOT_FOUND;
-        auto td = mxtl::RefPtr<Dispatcher>(thread->dispatcher());
-        if (!td)
-            return ERR_NOT_FOUND;
-        HandleOwner thread_h(MakeHandle(td, rights));
+        HandleOwner thread_h(MakeHandle(mxtl::move(thread), rights));
         if (!thread_h)
             return ERR_NO_MEMORY;
 
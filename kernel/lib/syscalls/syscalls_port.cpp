@@ -18,6 +18,7 @@
 #include <magenta/user_copy.h>
 
 #include <mxalloc/new.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/ref_ptr.h>
 
 #include "syscalls_priv.h"
@@ -119,6 +120,50 @@ mx_status_t sys_port_wait2(mx_handle_t handle, mx_time_t deadline, user_ptr<void
     return NO_ERROR;
 }
 
+// The most packets sys_port_wait_many() dequeues per acquisition of the port
+// lock; they are staged on the kernel stack before being copied out.
+static constexpr size_t kPortWaitManyBatch = 16u;
+
+mx_status_t sys_port_wait_many(mx_handle_t handle, mx_time_t deadline,
+                               user_ptr<mx_port_packet_t> _packets, uint32_t count,
+                               user_ptr<uint32_t> _actual) {
+    LTRACEF("handle %d count %u\n", handle, count);
+
+    if (!_packets || count == 0u)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<PortDispatcherV2> port;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &port);
+    if (status != NO_ERROR)
+        return status;
+
+    // Only the first batch waits; later ones take what is already queued.
+    mx_port_packet_t pp[kPortWaitManyBatch];
+    uint32_t total = 0u;
+    while (total < count) {
+        size_t n = 0u;
+        size_t max = mxtl::min(static_cast<size_t>(count - total), kPortWaitManyBatch);
+        status = port->DeQueueMany(total ? 0ull : deadline, pp, max, &n);
+        if (status != NO_ERROR)
+            break;
+
+        if (_packets.copy_array_to_user(pp, n, total) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        total += static_cast<uint32_t>(n);
+        if (n < max)
+            break;
+    }
+
+    if (total == 0u)
+        return status;
+
+    if (_actual && _actual.copy_to_user(total) != NO_ERROR)
+        return ERR_INVALID_ARGS;
+    return NO_ERROR;
+}
+
 mx_status_t sys_port_wait(mx_handle_t handle, mx_time_t deadline,
                           user_ptr<void> _packet, size_t size) {
     LTRACEF("handle %d\n", handle);
@@ -8,6 +8,7 @@
 
 #include <magenta/types.h>
 #include <magenta/syscalls/types.h>
+#include <magenta/syscalls/port.h>
 #include <lib/user_copy/user_ptr.h>
 
 #include <magenta/syscall-definitions.h>
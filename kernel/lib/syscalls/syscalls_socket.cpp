@@ -19,6 +19,7 @@
 #include <magenta/handle_owner.h>
 #include <magenta/process_dispatcher.h>
 #include <magenta/socket_dispatcher.h>
+#include <magenta/vm_object_dispatcher.h>
 
 #include <mxtl/ref_ptr.h>
 
@@ -124,3 +125,64 @@ mx_status_t sys_socket_read(mx_handle_t handle, uint32_t options,
 
     return status;
 }
+
+mx_status_t sys_socket_write_vmo(mx_handle_t handle, uint32_t options,
+                                 mx_handle_t vmo_handle, uint64_t offset, size_t size,
+                                 user_ptr<size_t> _actual) {
+    LTRACEF("handle %d vmo %d offset %#" PRIx64 " size %#zx\n", handle, vmo_handle, offset, size);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<SocketDispatcher> socket;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_WRITE, &socket);
+    if (status != NO_ERROR)
+        return status;
+
+    // pages may be moved out of the vmo, which modifies it
+    mxtl::RefPtr<VmObjectDispatcher> vmo;
+    status = up->GetDispatcherWithRights(vmo_handle, MX_RIGHT_READ | MX_RIGHT_WRITE, &vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    size_t nwritten;
+    status = socket->WriteVmo(vmo->vmo(), offset, size, &nwritten);
+
+    // Caller may ignore results if desired.
+    if (status == NO_ERROR && _actual)
+        status = _actual.copy_to_user(nwritten);
+
+    return status;
+}
+
+mx_status_t sys_socket_read_vmo(mx_handle_t handle, uint32_t options,
+                                mx_handle_t vmo_handle, uint64_t offset, size_t size,
+                                user_ptr<size_t> _actual) {
+    LTRACEF("handle %d vmo %d offset %#" PRIx64 " size %#zx\n", handle, vmo_handle, offset, size);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    mxtl::RefPtr<SocketDispatcher> socket;
+    mx_status_t status = up->GetDispatcherWithRights(handle, MX_RIGHT_READ, &socket);
+    if (status != NO_ERROR)
+        return status;
+
+    mxtl::RefPtr<VmObjectDispatcher> vmo;
+    status = up->GetDispatcherWithRights(vmo_handle, MX_RIGHT_WRITE, &vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    size_t nread;
+    status = socket->ReadVmo(vmo->vmo(), offset, size, &nread);
+
+    // Caller may ignore results if desired.
+    if (status == NO_ERROR && _actual)
+        status = _actual.copy_to_user(nread);
+
+    return status;
+}
@@ -29,11 +29,15 @@
 mx_status_t sys_vmo_create(uint64_t size, uint32_t options, user_ptr<mx_handle_t> _out) {
     LTRACEF("size %#" PRIx64 "\n", size);
 
-    if (options)
+    if (options & ~MX_VMO_LARGE_PAGES)
         return ERR_INVALID_ARGS;
 
+    uint32_t vmo_options = 0;
+    if (options & MX_VMO_LARGE_PAGES)
+        vmo_options |= VmObjectPaged::kLargePages;
+
     // create a vm object
-    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::Create(0, size);
+    mxtl::RefPtr<VmObject> vmo = VmObjectPaged::Create(0, size, vmo_options);
     if (!vmo)
         return ERR_NO_MEMORY;
 
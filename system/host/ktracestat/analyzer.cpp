@@ -0,0 +1,327 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "analyzer.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace {
+
+// Thread states reported in context switch records, from kernel/thread.h.
+enum {
+    kThreadReady = 1,
+    kThreadBlocked = 3,
+    kThreadSleeping = 4,
+    kThreadSuspended = 5,
+};
+
+constexpr uint64_t kKernelThread = 1ull << 32;
+
+// Writes that are never read would otherwise grow without bound.
+constexpr size_t kMaxQueuedMessages = 4096;
+
+bool is_event(uint32_t tag, uint32_t which) {
+    return KTRACE_EVENT(tag) == KTRACE_EVENT(which);
+}
+
+unsigned long long ull(uint64_t v) {
+    return static_cast<unsigned long long>(v);
+}
+
+} // namespace
+
+uint64_t Analyzer::thread_key(uint32_t tid, uint32_t kthread) {
+    return tid ? tid : (kKernelThread | kthread);
+}
+
+Analyzer::Thread& Analyzer::thread(uint64_t key) {
+    return threads_[key];
+}
+
+uint64_t Analyzer::chrome_tid(uint64_t key) const {
+    return key;
+}
+
+std::string Analyzer::thread_label(uint64_t key, const Thread& t) const {
+    if (!t.name.empty())
+        return t.name;
+    char buf[32];
+    if (key & kKernelThread) {
+        snprintf(buf, sizeof(buf), "kthread %#x", static_cast<uint32_t>(key));
+    } else {
+        snprintf(buf, sizeof(buf), "thread %llu", ull(key));
+    }
+    return buf;
+}
+
+std::string Analyzer::syscall_label(uint32_t num) const {
+    auto it = syscall_names_.find(num);
+    if (it != syscall_names_.end())
+        return it->second;
+    char buf[32];
+    snprintf(buf, sizeof(buf), "syscall %u", num);
+    return buf;
+}
+
+void Analyzer::name(uint32_t tag, uint32_t id, uint32_t arg, const std::string& name) {
+    if (is_event(tag, TAG_THREAD_NAME)) {
+        Thread& t = thread(thread_key(id, 0));
+        t.name = name;
+        t.pid = arg;
+        if (chrome_)
+            chrome_->thread_name(t.pid, chrome_tid(id), name);
+    } else if (is_event(tag, TAG_KTHREAD_NAME)) {
+        uint64_t key = thread_key(0, id);
+        thread(key).name = name;
+        if (chrome_)
+            chrome_->thread_name(0, chrome_tid(key), name);
+    } else if (is_event(tag, TAG_PROC_NAME)) {
+        process_names_[id] = name;
+        if (chrome_)
+            chrome_->process_name(id, name);
+    } else if (is_event(tag, TAG_SYSCALL_NAME)) {
+        syscall_names_[id] = name;
+    }
+}
+
+void Analyzer::event(int cpu, uint64_t ts, const ktrace_header_t* rec) {
+    if (records_++ == 0)
+        start_ns_ = ts;
+    end_ns_ = std::max(end_ns_, ts);
+
+    uint32_t tag = rec->tag;
+    const ktrace_rec_32b_t* rec32 = reinterpret_cast<const ktrace_rec_32b_t*>(rec);
+    bool has_args = KTRACE_LEN(tag) >= sizeof(ktrace_rec_32b_t);
+
+    if (is_event(tag, TAG_SYSCALL_ENTER)) {
+        syscall(ts, rec->tid, true);
+    } else if (is_event(tag, TAG_SYSCALL_EXIT)) {
+        syscall(ts, rec->tid, false);
+    } else if (!has_args) {
+        return;
+    } else if (is_event(tag, TAG_CONTEXT_SWITCH)) {
+        context_switch(ts, rec32);
+    } else if (is_event(tag, TAG_CHANNEL_CREATE)) {
+        peers_[rec32->a] = rec32->b;
+        peers_[rec32->b] = rec32->a;
+    } else if (is_event(tag, TAG_CHANNEL_WRITE)) {
+        channel_write(ts, rec32);
+    } else if (is_event(tag, TAG_CHANNEL_READ)) {
+        channel_read(ts, rec32);
+    } else if (is_event(tag, TAG_OBJECT_DELETE)) {
+        auto it = queued_.find(rec32->a);
+        if (it != queued_.end()) {
+            dropped_messages_ += it->second.size();
+            queued_.erase(it);
+        }
+        peers_.erase(rec32->a);
+    } else if (is_event(tag, TAG_THREAD_CREATE)) {
+        thread(thread_key(rec32->a, 0)).pid = rec32->b;
+    }
+}
+
+void Analyzer::end_run(uint64_t key, Thread& t, uint64_t ts) {
+    if (t.cpu < 0)
+        return;
+    uint64_t dur = ts - t.run_start;
+    t.run_ns += dur;
+    if (chrome_)
+        chrome_->complete("sched", thread_label(key, t), t.pid, chrome_tid(key),
+                          t.run_start - start_ns_, dur, t.cpu);
+    t.cpu = -1;
+}
+
+void Analyzer::context_switch(uint64_t ts, const ktrace_rec_32b_t* rec) {
+    uint32_t cpu = rec->b & 0xFFFF;
+    uint32_t state = rec->b >> 16;
+    uint64_t from = thread_key(rec->tid, rec->c);
+    uint64_t to = thread_key(rec->a, rec->d);
+
+    if (cpu >= running_.size())
+        running_.resize(cpu + 1);
+
+    Thread& f = thread(from);
+    if (f.cpu < 0) {
+        // running since before the trace started
+        f.cpu = cpu;
+        f.run_start = start_ns_;
+    }
+    end_run(from, f, ts);
+    f.off_valid = true;
+    f.off_ts = ts;
+    f.off_state = state;
+    f.switches++;
+
+    Thread& t = thread(to);
+    if (t.off_valid) {
+        uint64_t wait = ts - t.off_ts;
+        if (t.off_state == kThreadReady) {
+            ready_latency_.add(wait);
+            t.ready_ns += wait;
+        } else if (t.off_state == kThreadBlocked || t.off_state == kThreadSleeping ||
+                   t.off_state == kThreadSuspended) {
+            blocked_wait_.add(wait);
+            t.blocked_ns += wait;
+        }
+        t.off_valid = false;
+    }
+    t.cpu = cpu;
+    t.run_start = ts;
+    running_[cpu] = to;
+}
+
+// Syscall records carry (number << 8) | cpu instead of a tid, the thread is
+// whichever one the last context switch put on that cpu.
+void Analyzer::syscall(uint64_t ts, uint32_t arg, bool enter) {
+    uint32_t cpu = arg & 0xFF;
+    uint32_t num = arg >> 8;
+    if (cpu >= running_.size() || running_[cpu] == 0)
+        return;
+    uint64_t key = running_[cpu];
+    Thread& t = thread(key);
+
+    if (enter) {
+        t.in_syscall = true;
+        t.syscall = num;
+        t.syscall_start = ts;
+        return;
+    }
+    if (!t.in_syscall || t.syscall != num)
+        return;
+    t.in_syscall = false;
+    uint64_t dur = ts - t.syscall_start;
+    syscalls_[num].add(dur);
+    if (chrome_)
+        chrome_->complete("syscall", syscall_label(num), t.pid, chrome_tid(key),
+                          t.syscall_start - start_ns_, dur, -1);
+}
+
+// Writes are recorded against the writer's endpoint and reads against the
+// reader's, CHANNEL_CREATE records pair them up.
+void Analyzer::channel_write(uint64_t ts, const ktrace_rec_32b_t* rec) {
+    auto peer = peers_.find(rec->a);
+    if (peer == peers_.end()) {
+        unpaired_writes_++;
+        return;
+    }
+    std::deque<Message>& q = queued_[peer->second];
+    if (q.size() >= kMaxQueuedMessages) {
+        q.pop_front();
+        dropped_messages_++;
+    }
+    uint64_t flow = next_flow_++;
+    q.push_back(Message{ts, flow});
+    if (chrome_) {
+        const Thread& t = thread(rec->tid);
+        chrome_->flow_start("channel", flow, t.pid, chrome_tid(rec->tid), ts - start_ns_);
+    }
+}
+
+void Analyzer::channel_read(uint64_t ts, const ktrace_rec_32b_t* rec) {
+    auto it = queued_.find(rec->a);
+    if (it == queued_.end() || it->second.empty()) {
+        unmatched_reads_++;
+        return;
+    }
+    Message msg = it->second.front();
+    it->second.pop_front();
+    if (it->second.empty())
+        queued_.erase(it);
+    channel_latency_.add(ts - msg.ts);
+    if (chrome_) {
+        const Thread& t = thread(rec->tid);
+        chrome_->flow_end("channel", msg.flow, t.pid, chrome_tid(rec->tid), ts - start_ns_);
+    }
+}
+
+void Analyzer::finish() {
+    for (auto& it : threads_)
+        end_run(it.first, it.second, end_ns_);
+}
+
+namespace {
+
+void print_latency_line(FILE* out, const char* label, const Histogram& h) {
+    char p50[16], p90[16], p99[16], max[16];
+    fprintf(out, "  %-28s %10llu %10s %10s %10s %10s\n", label, ull(h.count()),
+            format_ns(h.percentile(50), p50, sizeof(p50)),
+            format_ns(h.percentile(90), p90, sizeof(p90)),
+            format_ns(h.percentile(99), p99, sizeof(p99)),
+            format_ns(h.max(), max, sizeof(max)));
+}
+
+void print_latency_header(FILE* out, const char* what) {
+    fprintf(out, "  %-28s %10s %10s %10s %10s %10s\n", what, "count", "p50", "p90", "p99", "max");
+}
+
+} // namespace
+
+void Analyzer::report(FILE* out, const KtraceReader& reader, size_t top_threads) const {
+    char buf[16];
+    fprintf(out, "ktrace version %#x, %llu records over %s\n", reader.version(),
+            ull(records_), format_ns(end_ns_ - start_ns_, buf, sizeof(buf)));
+    for (int cpu = 0; cpu <= reader.max_cpu(); cpu++) {
+        if (reader.lost(cpu))
+            fprintf(out, "  cpu %d: %llu records lost\n", cpu, ull(reader.lost(cpu)));
+    }
+
+    // threads, busiest first
+    std::vector<std::pair<uint64_t, const Thread*>> order;
+    for (const auto& it : threads_) {
+        if (it.second.switches)
+            order.push_back(std::make_pair(it.first, &it.second));
+    }
+    std::sort(order.begin(), order.end(), [](const std::pair<uint64_t, const Thread*>& a,
+                                             const std::pair<uint64_t, const Thread*>& b) {
+        return a.second->run_ns > b.second->run_ns;
+    });
+    if (top_threads && order.size() > top_threads)
+        order.resize(top_threads);
+
+    fprintf(out, "\nthreads (run / ready to run / blocked):\n");
+    fprintf(out, "  %8s %8s %-24s %10s %10s %10s %8s\n",
+            "pid", "tid", "name", "run", "ready", "blocked", "switches");
+    for (const auto& it : order) {
+        const Thread& t = *it.second;
+        char run[16], ready[16], blocked[16];
+        bool kernel = (it.first & kKernelThread) != 0;
+        fprintf(out, "  %8llu %8s %-24.24s %10s %10s %10s %8llu\n", ull(t.pid),
+                kernel ? "-" : std::to_string(it.first).c_str(),
+                thread_label(it.first, t).c_str(),
+                format_ns(t.run_ns, run, sizeof(run)),
+                format_ns(t.ready_ns, ready, sizeof(ready)),
+                format_ns(t.blocked_ns, blocked, sizeof(blocked)), ull(t.switches));
+    }
+
+    fprintf(out, "\nscheduling:\n");
+    print_latency_header(out, "wait");
+    print_latency_line(out, "preempted -> running", ready_latency_);
+    print_latency_line(out, "blocked -> running", blocked_wait_);
+    fprintf(out, "\n  preempted -> running histogram:\n");
+    ready_latency_.print(out, "    ");
+
+    fprintf(out, "\nsyscalls:\n");
+    print_latency_header(out, "syscall");
+    std::vector<std::pair<uint32_t, const Histogram*>> calls;
+    for (const auto& it : syscalls_)
+        calls.push_back(std::make_pair(it.first, &it.second));
+    std::sort(calls.begin(), calls.end(), [](const std::pair<uint32_t, const Histogram*>& a,
+                                             const std::pair<uint32_t, const Histogram*>& b) {
+        return a.second->total() > b.second->total();
+    });
+    for (const auto& it : calls)
+        print_latency_line(out, syscall_label(it.first).c_str(), *it.second);
+
+    fprintf(out, "\nchannels:\n");
+    print_latency_header(out, "latency");
+    print_latency_line(out, "write -> read", channel_latency_);
+    size_t unread = 0;
+    for (const auto& it : queued_)
+        unread += it.second.size();
+    fprintf(out, "  %llu writes on channels created before the trace, %llu reads without a"
+                 " traced write, %zu unread, %llu dropped\n",
+            ull(unpaired_writes_), ull(unmatched_reads_), unread, ull(dropped_messages_));
+}
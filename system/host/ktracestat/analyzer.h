@@ -0,0 +1,106 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chrome_trace.h"
+#include "histogram.h"
+#include "reader.h"
+
+// Accumulates scheduler, syscall and channel statistics from the event
+// stream. State is kept per thread, per syscall and per live channel, never
+// per record.
+class Analyzer : public KtraceVisitor {
+public:
+    // |chrome| may be null or closed, in which case no timeline is written.
+    explicit Analyzer(ChromeTraceWriter* chrome) : chrome_(chrome) {}
+
+    void name(uint32_t tag, uint32_t id, uint32_t arg, const std::string& name) override;
+    void event(int cpu, uint64_t ts_ns, const ktrace_header_t* rec) override;
+
+    // Closes the spans still open at the end of the trace.
+    void finish();
+
+    void report(FILE* out, const KtraceReader& reader, size_t top_threads) const;
+
+private:
+    struct Thread {
+        uint64_t pid = 0;
+        std::string name;
+
+        // cpu the thread is running on, -1 if it is not
+        int cpu = -1;
+        uint64_t run_start = 0;
+
+        // when and in what state the thread was last switched out
+        bool off_valid = false;
+        uint64_t off_ts = 0;
+        uint32_t off_state = 0;
+
+        // syscall in progress, if any
+        bool in_syscall = false;
+        uint32_t syscall = 0;
+        uint64_t syscall_start = 0;
+
+        uint64_t run_ns = 0;
+        uint64_t ready_ns = 0;
+        uint64_t blocked_ns = 0;
+        uint64_t switches = 0;
+    };
+
+    struct Message {
+        uint64_t ts;
+        uint64_t flow;
+    };
+
+    // Threads are keyed by user tid, or by kernel thread address for threads
+    // without one.
+    static uint64_t thread_key(uint32_t tid, uint32_t kthread);
+    Thread& thread(uint64_t key);
+    uint64_t chrome_tid(uint64_t key) const;
+    std::string thread_label(uint64_t key, const Thread& t) const;
+    std::string syscall_label(uint32_t num) const;
+
+    void context_switch(uint64_t ts, const ktrace_rec_32b_t* rec);
+    void syscall(uint64_t ts, uint32_t arg, bool enter);
+    void channel_write(uint64_t ts, const ktrace_rec_32b_t* rec);
+    void channel_read(uint64_t ts, const ktrace_rec_32b_t* rec);
+    void end_run(uint64_t key, Thread& t, uint64_t ts);
+
+    ChromeTraceWriter* chrome_;
+
+    uint64_t start_ns_ = 0;
+    uint64_t end_ns_ = 0;
+    uint64_t records_ = 0;
+
+    std::map<uint32_t, std::string> syscall_names_;
+    std::map<uint32_t, std::string> process_names_;
+    std::unordered_map<uint64_t, Thread> threads_;
+
+    // thread running on each cpu, 0 if unknown
+    std::vector<uint64_t> running_;
+
+    Histogram ready_latency_;
+    Histogram blocked_wait_;
+    std::map<uint32_t, Histogram> syscalls_;
+
+    // channel endpoint koid to its peer, and the writes queued at each
+    // endpoint that have not been read yet
+    std::unordered_map<uint32_t, uint32_t> peers_;
+    std::unordered_map<uint32_t, std::deque<Message>> queued_;
+    Histogram channel_latency_;
+    uint64_t unpaired_writes_ = 0;
+    uint64_t unmatched_reads_ = 0;
+    uint64_t dropped_messages_ = 0;
+    uint64_t next_flow_ = 1;
+};
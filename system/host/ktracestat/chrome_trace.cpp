@@ -0,0 +1,117 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "chrome_trace.h"
+
+namespace {
+
+// Chrome trace timestamps are floating point microseconds.
+double to_us(uint64_t ns) {
+    return static_cast<double>(ns) / 1000.0;
+}
+
+unsigned long long ull(uint64_t v) {
+    return static_cast<unsigned long long>(v);
+}
+
+} // namespace
+
+ChromeTraceWriter::~ChromeTraceWriter() {
+    close();
+}
+
+bool ChromeTraceWriter::open(const char* path) {
+    out_ = fopen(path, "w");
+    if (!out_) {
+        fprintf(stderr, "ktracestat: cannot create '%s'\n", path);
+        return false;
+    }
+    fprintf(out_, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    return true;
+}
+
+bool ChromeTraceWriter::close() {
+    if (!out_)
+        return true;
+    fprintf(out_, "\n]}\n");
+    bool ok = !ferror(out_);
+    ok = (fclose(out_) == 0) && ok;
+    out_ = nullptr;
+    return ok;
+}
+
+void ChromeTraceWriter::begin_event() {
+    fprintf(out_, first_ ? "\n{" : ",\n{");
+    first_ = false;
+}
+
+void ChromeTraceWriter::string(const std::string& s) {
+    fputc('"', out_);
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', out_);
+            fputc(c, out_);
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            fprintf(out_, "\\u%04x", c);
+        } else {
+            fputc(c, out_);
+        }
+    }
+    fputc('"', out_);
+}
+
+void ChromeTraceWriter::complete(const char* cat, const std::string& name, uint64_t pid,
+                                 uint64_t tid, uint64_t ts_ns, uint64_t dur_ns, int cpu) {
+    if (!out_)
+        return;
+    begin_event();
+    fprintf(out_, "\"ph\":\"X\",\"cat\":\"%s\",\"name\":", cat);
+    string(name);
+    fprintf(out_, ",\"pid\":%llu,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f",
+            ull(pid), ull(tid), to_us(ts_ns), to_us(dur_ns));
+    if (cpu >= 0)
+        fprintf(out_, ",\"args\":{\"cpu\":%d}", cpu);
+    fputc('}', out_);
+}
+
+void ChromeTraceWriter::flow_start(const char* cat, uint64_t id, uint64_t pid, uint64_t tid,
+                                   uint64_t ts_ns) {
+    if (!out_)
+        return;
+    begin_event();
+    fprintf(out_, "\"ph\":\"s\",\"cat\":\"%s\",\"name\":\"%s\",\"id\":%llu,"
+                  "\"pid\":%llu,\"tid\":%llu,\"ts\":%.3f}",
+            cat, cat, ull(id), ull(pid), ull(tid), to_us(ts_ns));
+}
+
+void ChromeTraceWriter::flow_end(const char* cat, uint64_t id, uint64_t pid, uint64_t tid,
+                                 uint64_t ts_ns) {
+    if (!out_)
+        return;
+    begin_event();
+    fprintf(out_, "\"ph\":\"f\",\"bp\":\"e\",\"cat\":\"%s\",\"name\":\"%s\",\"id\":%llu,"
+                  "\"pid\":%llu,\"tid\":%llu,\"ts\":%.3f}",
+            cat, cat, ull(id), ull(pid), ull(tid), to_us(ts_ns));
+}
+
+void ChromeTraceWriter::thread_name(uint64_t pid, uint64_t tid, const std::string& name) {
+    if (!out_)
+        return;
+    begin_event();
+    fprintf(out_, "\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%llu,\"tid\":%llu,"
+                  "\"args\":{\"name\":",
+            ull(pid), ull(tid));
+    string(name);
+    fprintf(out_, "}}");
+}
+
+void ChromeTraceWriter::process_name(uint64_t pid, const std::string& name) {
+    if (!out_)
+        return;
+    begin_event();
+    fprintf(out_, "\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%llu,\"args\":{\"name\":",
+            ull(pid));
+    string(name);
+    fprintf(out_, "}}");
+}
@@ -0,0 +1,39 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+// Writes events in the Chrome trace event JSON format (chrome://tracing,
+// catapult) as they are produced, so nothing is buffered.
+class ChromeTraceWriter {
+public:
+    ~ChromeTraceWriter();
+
+    bool open(const char* path);
+    bool is_open() const { return out_ != nullptr; }
+    bool close();
+
+    // A span of |dur_ns| starting at |ts_ns| on thread |tid| of process |pid|.
+    void complete(const char* cat, const std::string& name, uint64_t pid, uint64_t tid,
+                  uint64_t ts_ns, uint64_t dur_ns, int cpu);
+
+    // The two ends of an arrow between the enclosing spans of two threads.
+    void flow_start(const char* cat, uint64_t id, uint64_t pid, uint64_t tid, uint64_t ts_ns);
+    void flow_end(const char* cat, uint64_t id, uint64_t pid, uint64_t tid, uint64_t ts_ns);
+
+    void thread_name(uint64_t pid, uint64_t tid, const std::string& name);
+    void process_name(uint64_t pid, const std::string& name);
+
+private:
+    void begin_event();
+    void string(const std::string& s);
+
+    FILE* out_ = nullptr;
+    bool first_ = true;
+};
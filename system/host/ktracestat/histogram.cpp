@@ -0,0 +1,84 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "histogram.h"
+
+#include <algorithm>
+
+size_t Histogram::bucket(uint64_t value) {
+    if (value < (1u << kSubBits))
+        return static_cast<size_t>(value);
+    int exp = 63 - __builtin_clzll(value);
+    uint64_t sub = (value >> (exp - kSubBits)) & ((1u << kSubBits) - 1);
+    return static_cast<size_t>((exp - kSubBits + 1) << kSubBits) + sub;
+}
+
+uint64_t Histogram::bucket_start(size_t index) {
+    if (index < (1u << kSubBits))
+        return index;
+    int exp = static_cast<int>(index >> kSubBits) + kSubBits - 1;
+    uint64_t sub = index & ((1u << kSubBits) - 1);
+    return (1ull << exp) | (sub << (exp - kSubBits));
+}
+
+void Histogram::add(uint64_t value) {
+    size_t b = bucket(value);
+    if (b >= buckets_.size())
+        buckets_.resize(b + 1);
+    buckets_[b]++;
+    count_++;
+    total_ += value;
+    max_ = std::max(max_, value);
+}
+
+uint64_t Histogram::percentile(double pct) const {
+    if (count_ == 0)
+        return 0;
+    uint64_t rank = static_cast<uint64_t>(pct / 100.0 * static_cast<double>(count_ - 1)) + 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets_.size(); i++) {
+        seen += buckets_[i];
+        if (seen >= rank)
+            return std::min(bucket_start(i), max_);
+    }
+    return max_;
+}
+
+void Histogram::print(FILE* out, const char* indent) const {
+    // fold the sub-buckets back into powers of two
+    std::vector<uint64_t> pow2(65);
+    for (size_t i = 0; i < buckets_.size(); i++) {
+        uint64_t start = bucket_start(i);
+        int exp = start ? 64 - __builtin_clzll(start) : 0;
+        pow2[exp] += buckets_[i];
+    }
+    uint64_t most = *std::max_element(pow2.begin(), pow2.end());
+    if (most == 0)
+        return;
+
+    for (size_t exp = 0; exp < pow2.size(); exp++) {
+        if (pow2[exp] == 0)
+            continue;
+        char lo[16], hi[16];
+        format_ns(exp ? 1ull << (exp - 1) : 0, lo, sizeof(lo));
+        format_ns(1ull << exp, hi, sizeof(hi));
+        int bar = static_cast<int>(pow2[exp] * 40 / most);
+        fprintf(out, "%s%8s - %-8s %10llu |%.*s\n", indent, lo, hi,
+                static_cast<unsigned long long>(pow2[exp]), bar,
+                "########################################");
+    }
+}
+
+const char* format_ns(uint64_t ns, char* buf, size_t len) {
+    if (ns < 1000) {
+        snprintf(buf, len, "%lluns", static_cast<unsigned long long>(ns));
+    } else if (ns < 1000000) {
+        snprintf(buf, len, "%.1fus", static_cast<double>(ns) / 1e3);
+    } else if (ns < 1000000000) {
+        snprintf(buf, len, "%.1fms", static_cast<double>(ns) / 1e6);
+    } else {
+        snprintf(buf, len, "%.2fs", static_cast<double>(ns) / 1e9);
+    }
+    return buf;
+}
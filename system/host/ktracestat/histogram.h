@@ -0,0 +1,42 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+// Log-linear histogram of durations in ns: each power of two is split into
+// 16 buckets, so percentiles are accurate to about 6% in bounded space.
+class Histogram {
+public:
+    void add(uint64_t value);
+
+    uint64_t count() const { return count_; }
+    uint64_t max() const { return max_; }
+    uint64_t total() const { return total_; }
+
+    // Lower bound of the bucket holding the |pct|th percentile.
+    uint64_t percentile(double pct) const;
+
+    // One line per power of two that has samples, with a bar scaled to the
+    // most populated one.
+    void print(FILE* out, const char* indent) const;
+
+private:
+    static constexpr int kSubBits = 4;
+
+    static size_t bucket(uint64_t value);
+    static uint64_t bucket_start(size_t index);
+
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t max_ = 0;
+    uint64_t total_ = 0;
+};
+
+// Formats |ns| with a unit that keeps it short, e.g. "12.3us".
+const char* format_ns(uint64_t ns, char* buf, size_t len);
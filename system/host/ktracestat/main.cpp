@@ -0,0 +1,70 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analyzer.h"
+#include "chrome_trace.h"
+#include "reader.h"
+
+// 1. Capture:   magenta> dm ktraceoff
+//               host> netcp :/dev/misc/ktrace test.trace
+// 2. Analyze:   host> ktracestat -c test.json test.trace
+// 3. View:      load test.json in chrome://tracing
+
+static void usage(void) {
+    fprintf(stderr, "usage: ktracestat [-c chrome.json] [-n threads] trace\n"
+                    "  -c FILE  also write the timeline as Chrome trace JSON to FILE\n"
+                    "  -n N     list only the N busiest threads (default 20, 0 for all)\n");
+}
+
+int main(int argc, char** argv) {
+    const char* chrome_path = nullptr;
+    size_t top_threads = 20;
+
+    argc--;
+    argv++;
+    while (argc > 0 && argv[0][0] == '-') {
+        if (!strcmp(argv[0], "-c") && argc > 1) {
+            chrome_path = argv[1];
+            argc--;
+            argv++;
+        } else if (!strcmp(argv[0], "-n") && argc > 1) {
+            top_threads = strtoul(argv[1], nullptr, 0);
+            argc--;
+            argv++;
+        } else {
+            usage();
+            return -1;
+        }
+        argc--;
+        argv++;
+    }
+    if (argc != 1) {
+        usage();
+        return -1;
+    }
+
+    KtraceReader reader;
+    if (!reader.open(argv[0]))
+        return -1;
+
+    ChromeTraceWriter chrome;
+    if (chrome_path && !chrome.open(chrome_path))
+        return -1;
+
+    Analyzer analyzer(chrome.is_open() ? &chrome : nullptr);
+    if (!reader.read(&analyzer))
+        return -1;
+    analyzer.finish();
+
+    if (!chrome.close()) {
+        fprintf(stderr, "ktracestat: error writing '%s'\n", chrome_path);
+        return -1;
+    }
+    analyzer.report(stdout, reader, top_threads);
+    return 0;
+}
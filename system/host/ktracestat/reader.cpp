@@ -0,0 +1,234 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "reader.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <queue>
+#include <utility>
+
+namespace {
+
+bool is_event(uint32_t tag, uint32_t which) {
+    return KTRACE_EVENT(tag) == KTRACE_EVENT(which);
+}
+
+// Name records are the META events 0x020 through 0x02f.
+bool is_name(uint32_t tag) {
+    return (KTRACE_GROUP(tag) & KTRACE_GRP_META) && ((KTRACE_EVENT(tag) & 0xFF0) == 0x020);
+}
+
+// Reads one whole record into |buf|, returning false at the end of the file
+// or on a record that cannot be valid.
+bool read_record(FILE* f, uint8_t* buf) {
+    if (fread(buf, sizeof(uint32_t), 1, f) != 1)
+        return false;
+    uint32_t tag;
+    memcpy(&tag, buf, sizeof(tag));
+    size_t len = KTRACE_LEN(tag);
+    if (len < sizeof(uint32_t)) {
+        fprintf(stderr, "ktracestat: bad record at offset %ld\n", ftell(f) - 4);
+        return false;
+    }
+    return fread(buf + sizeof(uint32_t), len - sizeof(uint32_t), 1, f) == 1;
+}
+
+} // namespace
+
+// Walks the records of one cpu's chunks.
+struct KtraceReader::Cursor {
+    int cpu;
+    const std::vector<uint64_t>* offsets;
+    size_t next_chunk = 0;
+
+    std::vector<uint8_t> chunk;
+    size_t pos = 0;
+    uint32_t remaining = 0;
+
+    const ktrace_header_t* current = nullptr;
+
+    bool load(FILE* f, uint64_t file_size) {
+        while (next_chunk < offsets->size()) {
+            uint64_t off = (*offsets)[next_chunk++];
+            size_t len = static_cast<size_t>(
+                std::min<uint64_t>(KTRACE_CHUNK_SIZE, file_size - off));
+            chunk.resize(len);
+            if (fseek(f, static_cast<long>(off), SEEK_SET) != 0 ||
+                fread(chunk.data(), len, 1, f) != 1)
+                return false;
+            ktrace_rec_32b_t hdr;
+            memcpy(&hdr, chunk.data(), sizeof(hdr));
+            pos = sizeof(hdr);
+            remaining = hdr.c;
+            if (remaining > 0)
+                return true;
+        }
+        return false;
+    }
+
+    // Advances to the next record, returns false once all chunks are consumed.
+    bool next(FILE* f, uint64_t file_size) {
+        for (;;) {
+            while (remaining > 0 && pos + sizeof(uint32_t) <= chunk.size()) {
+                uint32_t tag;
+                memcpy(&tag, &chunk[pos], sizeof(tag));
+                size_t len = KTRACE_LEN(tag);
+                if (len == 0 || pos + len > chunk.size()) {
+                    // truncated chunk, give up on the rest of it
+                    break;
+                }
+                size_t at = pos;
+                pos += len;
+                if (is_event(tag, TAG_PAD))
+                    continue;
+                remaining--;
+                if (len < sizeof(ktrace_header_t))
+                    continue;
+                current = reinterpret_cast<const ktrace_header_t*>(&chunk[at]);
+                return true;
+            }
+            if (!load(f, file_size))
+                return false;
+        }
+    }
+};
+
+KtraceReader::~KtraceReader() {
+    if (file_)
+        fclose(file_);
+}
+
+bool KtraceReader::open(const char* path) {
+    file_ = fopen(path, "rb");
+    if (!file_) {
+        fprintf(stderr, "ktracestat: cannot open '%s'\n", path);
+        return false;
+    }
+    if (fseek(file_, 0, SEEK_END) != 0) {
+        fprintf(stderr, "ktracestat: '%s' is not seekable\n", path);
+        return false;
+    }
+    size_ = static_cast<uint64_t>(ftell(file_));
+    rewind(file_);
+    return true;
+}
+
+uint64_t KtraceReader::lost(int cpu) const {
+    return (cpu >= 0 && static_cast<size_t>(cpu) < lost_.size()) ? lost_[cpu] : 0;
+}
+
+uint64_t KtraceReader::to_ns(uint64_t ticks) const {
+    if (ticks_per_ms_ == 0)
+        return ticks;
+    return static_cast<uint64_t>(
+        static_cast<unsigned __int128>(ticks) * 1000000u / ticks_per_ms_);
+}
+
+bool KtraceReader::read(KtraceVisitor* visitor) {
+    if (!scan(visitor))
+        return false;
+    return chunks_.empty() ? merge_flat(visitor) : merge(visitor);
+}
+
+// First pass: deliver the names, pick up the clock rate and index the chunks.
+bool KtraceReader::scan(KtraceVisitor* visitor) {
+    alignas(8) uint8_t buf[KTRACE_LEN(0xF) + 1];
+    uint32_t in_chunk = 0;
+    bool chunk_open = false;
+
+    rewind(file_);
+    for (;;) {
+        uint64_t off = static_cast<uint64_t>(ftell(file_));
+        if (!read_record(file_, buf))
+            break;
+        uint32_t tag;
+        memcpy(&tag, buf, sizeof(tag));
+
+        if (is_event(tag, TAG_CPU_CHUNK)) {
+            ktrace_rec_32b_t hdr;
+            memcpy(&hdr, buf, sizeof(hdr));
+            if (hdr.a >= chunks_.size()) {
+                chunks_.resize(hdr.a + 1);
+                lost_.resize(hdr.a + 1);
+            }
+            chunks_[hdr.a].push_back(off);
+            lost_[hdr.a] = std::max<uint64_t>(lost_[hdr.a], hdr.d);
+            in_chunk = hdr.c;
+            chunk_open = true;
+            continue;
+        }
+        if (chunk_open) {
+            if (is_event(tag, TAG_PAD))
+                continue;
+            if (in_chunk > 0) {
+                in_chunk--;
+                continue;
+            }
+            chunk_open = false;
+        }
+
+        if (is_name(tag)) {
+            ktrace_rec_name_t* rec = reinterpret_cast<ktrace_rec_name_t*>(buf);
+            size_t max = KTRACE_LEN(tag) - KTRACE_NAMESIZE;
+            visitor->name(tag, rec->id, rec->arg, std::string(rec->name, strnlen(rec->name, max)));
+        } else if (is_event(tag, TAG_VERSION)) {
+            ktrace_rec_32b_t rec;
+            memcpy(&rec, buf, sizeof(rec));
+            version_ = rec.a;
+        } else if (is_event(tag, TAG_TICKS_PER_MS)) {
+            ktrace_rec_32b_t rec;
+            memcpy(&rec, buf, sizeof(rec));
+            ticks_per_ms_ = (static_cast<uint64_t>(rec.b) << 32) | rec.a;
+        }
+    }
+
+    if (version_ == 0) {
+        fprintf(stderr, "ktracestat: no version record, not a ktrace capture?\n");
+        return false;
+    }
+    return true;
+}
+
+// Second pass for per-cpu traces: merge the cpus by timestamp.
+bool KtraceReader::merge(KtraceVisitor* visitor) {
+    std::vector<Cursor> cursors(chunks_.size());
+    typedef std::pair<uint64_t, int> Entry; // ts, cpu
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+
+    for (size_t i = 0; i < chunks_.size(); i++) {
+        cursors[i].cpu = static_cast<int>(i);
+        cursors[i].offsets = &chunks_[i];
+        if (cursors[i].next(file_, size_))
+            heap.push(Entry(cursors[i].current->ts, static_cast<int>(i)));
+    }
+
+    while (!heap.empty()) {
+        Cursor& c = cursors[heap.top().second];
+        heap.pop();
+        visitor->event(c.cpu, to_ns(c.current->ts), c.current);
+        if (c.next(file_, size_))
+            heap.push(Entry(c.current->ts, c.cpu));
+    }
+    return true;
+}
+
+// Second pass for traces from a single shared buffer, already in order.
+bool KtraceReader::merge_flat(KtraceVisitor* visitor) {
+    alignas(8) uint8_t buf[KTRACE_LEN(0xF) + 1];
+
+    rewind(file_);
+    while (read_record(file_, buf)) {
+        uint32_t tag;
+        memcpy(&tag, buf, sizeof(tag));
+        if (is_name(tag) || KTRACE_LEN(tag) < sizeof(ktrace_header_t))
+            continue;
+        if (KTRACE_GROUP(tag) & KTRACE_GRP_META)
+            continue;
+        const ktrace_header_t* rec = reinterpret_cast<const ktrace_header_t*>(buf);
+        visitor->event(-1, to_ns(rec->ts), rec);
+    }
+    return true;
+}
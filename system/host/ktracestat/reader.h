@@ -0,0 +1,70 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <magenta/ktrace.h>
+
+// Receives the decoded contents of a trace.
+class KtraceVisitor {
+public:
+    // Name records, delivered before any event.
+    virtual void name(uint32_t tag, uint32_t id, uint32_t arg, const std::string& name) {}
+
+    // Every other record, in timestamp order across all cpus. |cpu| is the
+    // cpu whose buffer held the record, or -1 for traces without per-cpu
+    // chunks. |rec| is valid for KTRACE_LEN(rec->tag) bytes.
+    virtual void event(int cpu, uint64_t ts_ns, const ktrace_header_t* rec) = 0;
+
+protected:
+    virtual ~KtraceVisitor() {}
+};
+
+// Streams a ktrace capture from a file.
+//
+// Per-cpu chunks are only ordered within a cpu, so the reader indexes where
+// each cpu's chunks start and then merges the cpus by timestamp, keeping one
+// chunk per cpu in memory. The index costs 8 bytes per chunk, so memory use
+// does not depend on the number of records.
+class KtraceReader {
+public:
+    KtraceReader() = default;
+    ~KtraceReader();
+
+    bool open(const char* path);
+
+    // Decodes the whole trace, first the names and then the events.
+    bool read(KtraceVisitor* visitor);
+
+    uint64_t ticks_per_ms() const { return ticks_per_ms_; }
+    uint32_t version() const { return version_; }
+
+    // Records the kernel reported as lost on |cpu|, and the highest cpu seen.
+    uint64_t lost(int cpu) const;
+    int max_cpu() const { return static_cast<int>(chunks_.size()) - 1; }
+
+private:
+    struct Cursor;
+
+    bool scan(KtraceVisitor* visitor);
+    bool merge(KtraceVisitor* visitor);
+    bool merge_flat(KtraceVisitor* visitor);
+    uint64_t to_ns(uint64_t ticks) const;
+
+    FILE* file_ = nullptr;
+    uint64_t size_ = 0;
+    uint32_t version_ = 0;
+    uint64_t ticks_per_ms_ = 0;
+
+    // file offsets of each cpu's chunk headers, in order
+    std::vector<std::vector<uint64_t>> chunks_;
+    std::vector<uint64_t> lost_;
+};
@@ -0,0 +1,18 @@
+# Copyright 2017 The Fuchsia Authors. All rights reserved.
+# Use of this source code is governed by a BSD-style license that can be
+# found in the LICENSE file.
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+MODULE := $(LOCAL_DIR)
+
+MODULE_TYPE := hostapp
+
+MODULE_SRCS += \
+    $(LOCAL_DIR)/analyzer.cpp \
+    $(LOCAL_DIR)/chrome_trace.cpp \
+    $(LOCAL_DIR)/histogram.cpp \
+    $(LOCAL_DIR)/main.cpp \
+    $(LOCAL_DIR)/reader.cpp \
+
+include make/module.mk
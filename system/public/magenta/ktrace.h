@@ -88,5 +88,17 @@ enum {
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_SET_MODE  5 // options = KTRACE_MODE_*, tracing must be stopped
+
+// Buffering modes
+//
+// Each cpu records into its own ring of KTRACE_CHUNK_SIZE chunks, each chunk
+// starting with a TAG_CPU_CHUNK record and padded at its end with TAG_PAD
+// records. Name records are kept apart in a metadata area that is read first.
+#define KTRACE_MODE_ONESHOT     0 // records are dropped once a cpu's ring is full
+#define KTRACE_MODE_CIRCULAR    1 // a full ring overwrites its oldest chunk
+#define KTRACE_MODE_STREAMING   2 // reads consume completed chunks, offset is ignored
+
+#define KTRACE_CHUNK_SIZE         (64 * 1024)
 
 __END_CDECLS
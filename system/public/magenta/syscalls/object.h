@@ -27,6 +27,9 @@ typedef enum {
     MX_INFO_THREAD_EXCEPTION_REPORT    = 11, // mx_exception_report_t[1]
     MX_INFO_TASK_STATS                 = 12, // mx_info_task_stats_t[1]
     MX_INFO_PROCESS_MAPS               = 13, // mx_info_maps_t[n]
+    MX_INFO_THREAD_STATS               = 14, // mx_info_thread_stats_t[1]
+    MX_INFO_TASK_RUNTIME               = 15, // mx_info_task_runtime_t[1]
+    MX_INFO_CPU_STATS                  = 16, // mx_info_cpu_stats_t[n]
     MX_INFO_LAST
 } mx_object_info_topic_t;
 
@@ -120,8 +123,77 @@ typedef struct mx_info_task_stats {
     // Some of the pages may be double-mapped (and thus double-counted),
     // or may be shared with other tasks.
     size_t mem_committed_bytes;
+
+    // The number of page faults taken in the task's address space.
+    uint64_t page_faults;
+
+    // The number of large (e.g., 2MB or 1GB) page table entries currently
+    // mapping memory in the task's address space.
+    uint64_t mem_large_pages;
 } mx_info_task_stats_t;
 
+// Scheduling statistics of a thread. Cheap to gather.
+typedef struct mx_info_thread_stats {
+    // Total time the thread has spent running on a cpu, in nanoseconds.
+    mx_time_t total_runtime;
+
+    // Total time the thread has spent ready to run but waiting in a run
+    // queue for a cpu, in nanoseconds.
+    mx_time_t total_wait_time;
+
+    // The number of times the thread has been switched onto a cpu.
+    uint64_t context_switches;
+
+    // The cpu the thread is running on or last ran on.
+    uint32_t last_scheduled_cpu;
+} mx_info_thread_stats_t;
+
+// Cpu time used by a task. For a process this is the sum over its threads,
+// and for a job the sum over all the processes below it, including threads
+// and processes that have already exited.
+typedef struct mx_info_task_runtime {
+    // Time spent running on a cpu, in nanoseconds.
+    mx_time_t cpu_time;
+
+    // Time spent ready to run but waiting for a cpu, in nanoseconds.
+    mx_time_t queue_time;
+
+    // The number of times threads of the task were switched onto a cpu.
+    uint64_t context_switches;
+} mx_info_task_runtime_t;
+
+// Set in mx_info_cpu_stats_t.flags if the cpu is online.
+#define MX_CPU_STATS_FLAG_ONLINE       (1u << 0)
+
+// Scheduler and interrupt counters of a single cpu. MX_INFO_CPU_STATS
+// returns one entry per possible cpu, indexed by cpu number; entries for
+// cpus that are not online have every counter zero.
+typedef struct mx_info_cpu_stats {
+    uint32_t cpu_number;
+    uint32_t flags;
+
+    // Time the cpu has spent running its idle thread, in nanoseconds.
+    mx_time_t idle_time;
+
+    // kernel scheduler counters
+    uint64_t reschedules;
+    uint64_t context_switches;
+    uint64_t irq_preempts;
+    uint64_t preempts;
+    uint64_t yields;
+
+    // cpu level interrupts and exceptions
+    uint64_t ints;              // hardware interrupts, minus timer interrupts or inter-processor interrupts
+    uint64_t timer_ints;        // timer interrupts
+    uint64_t timers;            // timer callbacks
+    uint64_t exceptions;        // exceptions such as page faults or undefined opcodes
+    uint64_t syscalls;
+
+    // inter-processor interrupts
+    uint64_t reschedule_ipis;
+    uint64_t generic_ipis;
+} mx_info_cpu_stats_t;
+
 typedef struct mx_info_vmar {
     // Base address of the region.
     uintptr_t base;
@@ -174,6 +174,16 @@ typedef struct {
     uint32_t rd_num_handles;
 } mx_channel_call_args_t;
 
+// Structure for mx_channel_read_many() and mx_channel_write_many(), one per
+// message. When reading, |num_bytes| and |num_handles| give the room in the
+// buffers on input and are set to the size of the message read on output.
+typedef struct {
+    void* bytes;
+    mx_handle_t* handles;
+    uint32_t num_bytes;
+    uint32_t num_handles;
+} mx_channel_msg_t;
+
 // Structure for mx_object_wait_many():
 typedef struct {
     mx_handle_t handle;
@@ -205,6 +215,9 @@ typedef uint32_t mx_rights_t;
 
 #define MX_RIGHT_SAME_RIGHTS      ((mx_rights_t)1u << 31)
 
+// VM Object creation options
+#define MX_VMO_LARGE_PAGES               1u
+
 // VM Object opcodes
 #define MX_VMO_OP_COMMIT                 1u
 #define MX_VMO_OP_DECOMMIT               2u
@@ -231,6 +244,7 @@ typedef uint32_t mx_rights_t;
 #define MX_VM_FLAG_CAN_MAP_WRITE      (1u << 8)
 #define MX_VM_FLAG_CAN_MAP_EXECUTE    (1u << 9)
 #define MX_VM_FLAG_MAP_RANGE          (1u << 10)
+#define MX_VM_FLAG_PREFAULT_SEQUENTIAL (1u << 11)
 
 // clock ids
 #define MX_CLOCK_MONOTONIC        (0u)
@@ -263,6 +277,9 @@ typedef int64_t mx_rel_off_t;
 // Socket options and limits.
 #define MX_SOCKET_HALF_CLOSE                1u
 
+// Fifo options and limits.
+#define MX_FIFO_SHARED_RING                 1u
+
 // Flags which can be used to to control cache policy for APIs which map memory.
 typedef enum {
     MX_CACHE_POLICY_CACHED          = 0,
@@ -277,6 +294,30 @@ typedef struct {
     uint64_t tail;
 } mx_fifo_state_t;
 
+// Control block at the start of each direction of a MX_FIFO_SHARED_RING fifo,
+// followed directly by the entries. The producer advances |head| and the
+// consumer advances |tail|; both are free-running and wrap at 2^32. A side
+// that is about to sleep sets its |*_waiting| flag so that the other side
+// knows to ring the doorbell (a zero length mx_fifo_write()) after publishing.
+typedef struct {
+    uint32_t head;
+    uint32_t consumer_waiting;
+    uint8_t reserved0[56];
+    uint32_t tail;
+    uint32_t producer_waiting;
+    uint8_t reserved1[56];
+} mx_fifo_ring_t;
+
+// Structure for mx_fifo_get_ring(). Offsets are into the returned vmo and
+// point at an mx_fifo_ring_t; |rx_offset| is the ring this endpoint consumes
+// from and |tx_offset| the ring it produces into.
+typedef struct {
+    uint64_t rx_offset;
+    uint64_t tx_offset;
+    uint32_t elem_count;
+    uint32_t elem_size;
+} mx_fifo_ring_info_t;
+
 // Fifo ops
 typedef enum {
     MX_FIFO_OP_READ_STATE         = 0,
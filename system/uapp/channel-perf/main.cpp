@@ -4,18 +4,26 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
 
 #include <magenta/compiler.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/log.h>
 #include <mxtl/unique_ptr.h>
 
 namespace {
 
+// The most messages mx_channel_write_many()/read_many() move per call.
+constexpr uint32_t kMaxBatch = 16u;
+
 void argument_error(const char* argv0, const char* message) {
     fprintf(stderr, "%s: error: %s\nRun with -h for help.\n", argv0, message);
     exit(EXIT_FAILURE);
@@ -31,12 +39,25 @@ struct TestArgs {
     uint32_t size;
     uint32_t handles;
     uint32_t queue;
+    uint32_t threads;
+    uint32_t batch;
+};
+
+struct ThreadResult {
+    uint32_t duration;
+    const TestArgs* test_args;
+    uint64_t iterations;
+    uint64_t elapsed_ns;
 };
 
-void do_test(uint32_t duration, const TestArgs& test_args) {
+// Writes and reads messages through a channel of its own for |duration|
+// seconds, recording how many round trips it managed.
+int test_thread(void* arg) {
+    ThreadResult* result = static_cast<ThreadResult*>(arg);
+    const TestArgs& test_args = *result->test_args;
     __UNUSED mx_status_t status;
 
-    uint64_t duration_ns = duration * 1000000000ull;
+    uint64_t duration_ns = result->duration * 1000000000ull;
 
     // We'll write to mp[0] (and read from mp[1]).
     mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
@@ -48,15 +69,18 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     assert(mx_event_create(0u, &event) == NO_ERROR);
 
     // Storage space for our messages' stuff.
+    // With batching, every message in a batch gets its own slice of these.
+    uint32_t batch = test_args.batch > 1u ? test_args.batch : 1u;
     mxtl::unique_ptr<uint8_t[]> data;
     if (test_args.size) {
-        data.reset(new uint8_t[test_args.size]);
-        for (uint32_t i = 0; i < test_args.size; i++)
+        data.reset(new uint8_t[test_args.size * batch]);
+        for (uint32_t i = 0; i < test_args.size * batch; i++)
             data[i] = static_cast<uint8_t>(i);
     }
     mxtl::unique_ptr<mx_handle_t[]> handles;
     if (test_args.handles)
-        handles.reset(new mx_handle_t[test_args.handles]);
+        handles.reset(new mx_handle_t[test_args.handles * batch]);
+    mxtl::unique_ptr<mx_channel_msg_t[]> msgs(new mx_channel_msg_t[batch]);
 
     // Pre-queue |test_args.queue| messages (there'll always be this many messages in the queue).
     for (uint32_t i = 0; i < test_args.queue; i++) {
@@ -66,7 +90,7 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
         assert(status == NO_ERROR);
     }
 
-    duplicate_handles(test_args.handles, event, handles.get());
+    duplicate_handles(test_args.handles * batch, event, handles.get());
 
     static constexpr uint32_t big_it_size = 10000;
     uint64_t big_its = 0;
@@ -75,6 +99,27 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     for (;;) {
         big_its++;
         for (uint32_t i = 0; i < big_it_size; i++) {
+            if (batch > 1u) {
+                // Write and read |batch| messages with one syscall each.
+                for (uint32_t j = 0; j < batch; j++) {
+                    msgs[j].bytes = data.get() + j * test_args.size;
+                    msgs[j].handles = handles.get() + j * test_args.handles;
+                    msgs[j].num_bytes = test_args.size;
+                    msgs[j].num_handles = test_args.handles;
+                }
+                uint32_t actual = 0;
+                status = mx_channel_write_many(mp[0], 0u, msgs.get(), batch, &actual);
+                assert(status == NO_ERROR);
+                assert(actual == batch);
+
+                status = mx_channel_read_many(mp[1], 0u, msgs.get(), batch, &actual);
+                assert(status == NO_ERROR);
+                assert(actual == batch);
+                assert(msgs[0].num_bytes == test_args.size);
+                assert(msgs[0].num_handles == test_args.handles);
+                continue;
+            }
+
             status = mx_channel_write(mp[0], 0, data.get(), test_args.size,
                                       handles.get(), test_args.handles);
             assert(status == NO_ERROR);
@@ -92,8 +137,10 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
         if ((end_ns - start_ns) >= duration_ns)
             break;
     }
+    result->iterations = big_its * big_it_size * batch;
+    result->elapsed_ns = end_ns - start_ns;
 
-    for (uint32_t i = 0; i < test_args.handles; i++) {
+    for (uint32_t i = 0; i < test_args.handles * batch; i++) {
         status = mx_handle_close(handles[i]);
         assert(status == NO_ERROR);
     }
@@ -103,12 +150,258 @@ void do_test(uint32_t duration, const TestArgs& test_args) {
     assert(status == NO_ERROR);
     status = mx_handle_close(mp[1]);
     assert(status == NO_ERROR);
+    return 0;
+}
+
+// Returns the number of round trips per second.
+double do_test(uint32_t duration, const TestArgs& test_args) {
+    uint32_t num_threads = test_args.threads ? test_args.threads : 1u;
+    mxtl::unique_ptr<ThreadResult[]> results(new ThreadResult[num_threads]);
+    mxtl::unique_ptr<thrd_t[]> threads(new thrd_t[num_threads]);
+
+    for (uint32_t i = 0; i < num_threads; i++) {
+        results[i] = {duration, &test_args, 0u, 0u};
+        __UNUSED int ret = thrd_create(&threads[i], test_thread, &results[i]);
+        assert(ret == thrd_success);
+    }
+
+    // Every thread runs for about |duration|, so the sum of their rates is
+    // the throughput of the system as a whole.
+    double its_per_second = 0.0;
+    for (uint32_t i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], nullptr);
+        double real_duration = static_cast<double>(results[i].elapsed_ns) / 1000000000.0;
+        its_per_second += static_cast<double>(results[i].iterations) / real_duration;
+    }
+
+    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued), "
+               "%" PRIu32 " threads",
+           test_args.size, test_args.handles, test_args.queue, num_threads);
+    if (test_args.batch > 1u)
+        printf(", %" PRIu32 " per syscall", test_args.batch);
+    printf(": %.0f iterations/second", its_per_second);
+    if (test_args.handles)
+        printf(", %.0f handles transferred/second", its_per_second * test_args.handles);
+    printf("\n");
+    return its_per_second;
+}
+
+struct CallServerArgs {
+    mx_handle_t channel;
+    const TestArgs* test_args;
+};
+
+// Echoes every message that arrives on its end of the channel back to the
+// caller, until the client end is closed.
+int call_server_thread(void* arg) {
+    CallServerArgs* server_args = static_cast<CallServerArgs*>(arg);
+    const TestArgs& test_args = *server_args->test_args;
+    mx_handle_t channel = server_args->channel;
+    __UNUSED mx_status_t status;
+
+    mxtl::unique_ptr<uint8_t[]> data(new uint8_t[test_args.size]);
+    mxtl::unique_ptr<mx_handle_t[]> handles;
+    if (test_args.handles)
+        handles.reset(new mx_handle_t[test_args.handles]);
+
+    for (;;) {
+        mx_signals_t pending = 0;
+        status = mx_object_wait_one(channel, MX_CHANNEL_READABLE | MX_CHANNEL_PEER_CLOSED,
+                                    MX_TIME_INFINITE, &pending);
+        if (status != NO_ERROR || !(pending & MX_CHANNEL_READABLE))
+            break;
+
+        uint32_t r_size = test_args.size;
+        uint32_t r_handles = test_args.handles;
+        status = mx_channel_read(channel, 0u, data.get(), handles.get(), r_size,
+                                 r_handles, &r_size, &r_handles);
+        assert(status == NO_ERROR);
 
-    double real_duration = static_cast<double>(end_ns - start_ns) / 1000000000.0;
-    double its_per_second = static_cast<double>(big_its) * big_it_size / real_duration;
-    printf("write/read %" PRIu32 " bytes, %" PRIu32 " handles (%" PRIu32 " pre-queued): "
-               "%.0f iterations/second\n",
-           test_args.size, test_args.handles, test_args.queue, its_per_second);
+        // The reply carries the caller's txid back in its first bytes.
+        status = mx_channel_write(channel, 0u, data.get(), r_size, handles.get(), r_handles);
+        if (status != NO_ERROR)
+            break;
+    }
+
+    status = mx_handle_close(channel);
+    assert(status == NO_ERROR);
+    return 0;
+}
+
+// Measures the round trip time of mx_channel_call() against a server thread
+// that is blocked waiting on the other end of the channel. Returns the number
+// of calls per second.
+double do_call_test(uint32_t duration, const TestArgs& test_args) {
+    __UNUSED mx_status_t status;
+
+    uint64_t duration_ns = duration * 1000000000ull;
+
+    mx_handle_t mp[2] = {MX_HANDLE_INVALID, MX_HANDLE_INVALID};
+    status = mx_channel_create(0u, &mp[0], &mp[1]);
+    assert(status == NO_ERROR);
+
+    CallServerArgs server_args = {mp[1], &test_args};
+    thrd_t server;
+    __UNUSED int ret = thrd_create(&server, call_server_thread, &server_args);
+    assert(ret == thrd_success);
+
+    mx_handle_t event;
+    assert(mx_event_create(0u, &event) == NO_ERROR);
+
+    // Both directions use the same buffers; the reply overwrites the request.
+    mxtl::unique_ptr<uint8_t[]> data(new uint8_t[test_args.size]);
+    for (uint32_t i = 0; i < test_args.size; i++)
+        data[i] = static_cast<uint8_t>(i);
+    mxtl::unique_ptr<mx_handle_t[]> handles;
+    if (test_args.handles)
+        handles.reset(new mx_handle_t[test_args.handles]);
+    duplicate_handles(test_args.handles, event, handles.get());
+
+    mx_channel_call_args_t args = {};
+    args.wr_bytes = data.get();
+    args.wr_handles = handles.get();
+    args.rd_bytes = data.get();
+    args.rd_handles = handles.get();
+    args.wr_num_bytes = test_args.size;
+    args.wr_num_handles = test_args.handles;
+    args.rd_num_bytes = test_args.size;
+    args.rd_num_handles = test_args.handles;
+
+    static constexpr uint32_t big_it_size = 1000;
+    uint64_t big_its = 0;
+    uint64_t start_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+    uint64_t end_ns;
+    for (;;) {
+        big_its++;
+        for (uint32_t i = 0; i < big_it_size; i++) {
+            uint32_t act_bytes = 0;
+            uint32_t act_handles = 0;
+            mx_status_t read_status = NO_ERROR;
+            status = mx_channel_call(mp[0], 0u, MX_TIME_INFINITE, &args, &act_bytes,
+                                     &act_handles, &read_status);
+            assert(status == NO_ERROR);
+            assert(act_bytes == test_args.size);
+            assert(act_handles == test_args.handles);
+        }
+
+        end_ns = mx_time_get(MX_CLOCK_MONOTONIC);
+        if ((end_ns - start_ns) >= duration_ns)
+            break;
+    }
+
+    // Closing our end makes the server thread exit.
+    status = mx_handle_close(mp[0]);
+    assert(status == NO_ERROR);
+    thrd_join(server, nullptr);
+
+    for (uint32_t i = 0; i < test_args.handles; i++) {
+        status = mx_handle_close(handles[i]);
+        assert(status == NO_ERROR);
+    }
+    status = mx_handle_close(event);
+    assert(status == NO_ERROR);
+
+    uint64_t calls = big_its * big_it_size;
+    double ns_per_call = static_cast<double>(end_ns - start_ns) / static_cast<double>(calls);
+    printf("call %" PRIu32 " bytes, %" PRIu32 " handles: %" PRIu64 " calls, "
+               "%.0f ns/call, %.0f calls/second\n",
+           test_args.size, test_args.handles, calls, ns_per_call, 1000000000.0 / ns_per_call);
+    return 1000000000.0 / ns_per_call;
+}
+
+double run_test(bool call_mode, uint32_t duration, const TestArgs& test_args) {
+    return call_mode ? do_call_test(duration, test_args) : do_test(duration, test_args);
+}
+
+// Runs a kernel console command through the devmgr, like "k" in the shell.
+// The command has finished by the time this returns.
+bool send_kernel_command(const char* cmd) {
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "kerneldebug %s", cmd);
+    if (len < 0 || static_cast<size_t>(len) >= sizeof(buf))
+        return false;
+    int fd = open("/dev/misc/dmctl", O_WRONLY);
+    if (fd < 0)
+        return false;
+    ssize_t r = write(fd, buf, len);
+    close(fd);
+    return r >= 0;
+}
+
+// Finds out whether the kernel allocates small message packets from its
+// slabs, from what "k mx mpinfo" prints to the debuglog.
+bool get_message_packet_slabs(bool* enabled) {
+    static constexpr char kPrefix[] = "message packet slabs ";
+
+    mx_handle_t log;
+    if (mx_log_create(MX_LOG_FLAG_READABLE, &log) != NO_ERROR)
+        return false;
+
+    // Skip everything logged so far.
+    alignas(mx_log_record_t) char buf[MX_LOG_RECORD_MAX + 1];
+    mx_log_record_t* rec = reinterpret_cast<mx_log_record_t*>(buf);
+    while (mx_log_read(log, MX_LOG_RECORD_MAX, rec, 0) >= 0)
+        ;
+
+    bool found = false;
+    if (send_kernel_command("mx mpinfo")) {
+        mx_time_t deadline = mx_time_get(MX_CLOCK_MONOTONIC) + MX_SEC(1);
+        while (!found) {
+            if (mx_log_read(log, MX_LOG_RECORD_MAX, rec, 0) < 0) {
+                if (mx_object_wait_one(log, MX_LOG_READABLE, deadline, nullptr) != NO_ERROR)
+                    break;
+                continue;
+            }
+            if (!(rec->flags & MX_LOG_FLAG_KERNEL))
+                continue;
+            rec->data[rec->datalen] = '\0';
+            const char* state = strstr(rec->data, kPrefix);
+            if (state) {
+                state += sizeof(kPrefix) - 1;
+                *enabled = strncmp(state, "enabled", strlen("enabled")) == 0;
+                found = true;
+            }
+        }
+    }
+
+    mx_handle_close(log);
+    return found;
+}
+
+// Switches the kernel between allocating small message packets from its
+// slabs and from the heap.
+bool set_message_packet_slabs(bool enabled) {
+    return send_kernel_command(enabled ? "mx mpslabs on" : "mx mpslabs off");
+}
+
+// The allocator setting found before -m changed it, put back on exit.
+bool initial_message_packet_slabs;
+
+void restore_message_packet_slabs() {
+    if (!set_message_packet_slabs(initial_message_packet_slabs))
+        fprintf(stderr, "error: cannot restore the message packet allocator\n");
+}
+
+// Runs |test_args| with message packets allocated from the heap and then from
+// the slabs, and prints how the slabs compare.
+void do_allocator_comparison(bool call_mode, uint32_t duration, const TestArgs& test_args) {
+    printf("heap:  ");
+    fflush(stdout);
+    if (!set_message_packet_slabs(false)) {
+        fprintf(stderr, "error: cannot switch message packet allocators\n");
+        exit(EXIT_FAILURE);
+    }
+    double heap = run_test(call_mode, duration, test_args);
+
+    printf("slabs: ");
+    fflush(stdout);
+    if (!set_message_packet_slabs(true)) {
+        fprintf(stderr, "error: cannot switch message packet allocators\n");
+        exit(EXIT_FAILURE);
+    }
+    double slabs = run_test(call_mode, duration, test_args);
+
+    printf("slabs/heap: %.2fx\n", slabs / heap);
 }
 
 }  // namespace
@@ -120,25 +413,37 @@ int main(int argc, char** argv) {
         "Options:\n"
         "  -h    show help (this)\n"
         "  -o    run single test (default)\n"
-        "  -s    run suite (ignores -S/-H/-Q)\n"
+        "  -s    run suite (ignores -S/-H/-Q/-T/-B)\n"
+        "  -c    measure mx_channel_call() round trips to a server thread instead\n"
+        "        (ignores -Q/-T/-B; -S must be at least 4 to hold the txid)\n"
+        "  -m    run each test with the kernel allocating message packets from the\n"
+        "        heap and then from its slabs, and compare the two (the kernel's\n"
+        "        setting is put back afterwards)\n"
         "  -n N  set test repetition count to N (default: 1)\n"
         "  -d N  set test duration to N seconds (default: 5)\n"
         "  -S N  set message size to N bytes (default: 10)\n"
         "  -H N  set message handle count to N handles (default: 0)\n"
-        "  -Q N  set message pre-queue count to N messages (default: 0)\n";
+        "  -Q N  set message pre-queue count to N messages (default: 0)\n"
+        "  -T N  run the test on N threads at once, each with its own channel (default: 1)\n"
+        "  -B N  move N (at most 16) messages per mx_channel_write_many()/read_many()\n"
+        "        (default: 1, meaning plain mx_channel_write()/read())\n";
 
     bool run_suite = false;  // -o/-s
+    bool call_mode = false;  // -c
+    bool compare = false;    // -m
     uint32_t duration = 5;   // -d
     uint32_t repeats = 1;    // -n
     // Ignored when running a suite:
     TestArgs test_args = {
         10,                  // -S (size)
         0,                   // -H (handles)
-        0                    // -Q (queue)
+        0,                   // -Q (queue)
+        1,                   // -T (threads)
+        1                    // -B (batch)
     };
 
     int opt;
-    while ((opt = getopt(argc, argv, "+hosn:d:S:H:Q:")) != -1) {
+    while ((opt = getopt(argc, argv, "+hoscmn:d:S:H:Q:T:B:")) != -1) {
         // Our option values are always unsigned numbers.
         uint32_t value = 0;
         if (optarg) {
@@ -160,6 +465,12 @@ int main(int argc, char** argv) {
             case 's':
                 run_suite = true;
                 break;
+            case 'c':
+                call_mode = true;
+                break;
+            case 'm':
+                compare = true;
+                break;
             case 'n':
                 assert(optarg);
                 repeats = value;
@@ -180,6 +491,14 @@ int main(int argc, char** argv) {
                 assert(optarg);
                 test_args.queue = value;
                 break;
+            case 'T':
+                assert(optarg);
+                test_args.threads = value;
+                break;
+            case 'B':
+                assert(optarg);
+                test_args.batch = value;
+                break;
             default:  // '?'
                 argument_error(argv[0], "invalid option");
                 break;
@@ -187,6 +506,18 @@ int main(int argc, char** argv) {
     }
     if (optind < argc)
         argument_error(argv[0], "unexpected positional argument");
+    if (test_args.batch > kMaxBatch)
+        argument_error(argv[0], "batch too large");
+    if (call_mode && !run_suite && test_args.size < sizeof(mx_txid_t))
+        argument_error(argv[0], "call messages need room for a txid");
+    if (compare) {
+        // -m changes a system wide setting, so leave it as we found it.
+        if (!get_message_packet_slabs(&initial_message_packet_slabs)) {
+            fprintf(stderr, "error: cannot read the message packet allocator setting\n");
+            return EXIT_FAILURE;
+        }
+        atexit(restore_message_packet_slabs);
+    }
 
     for (uint32_t i = 0; i < repeats; i++) {
         if (repeats > 1u) {
@@ -198,26 +529,51 @@ int main(int argc, char** argv) {
 
         if (run_suite) {
             static constexpr TestArgs suite[] = {
-                {10, 0, 0},
-                {100, 0, 0},
-                {1000, 0, 0},
-                {10, 1, 0},
-                {100, 1, 0},
-                {1000, 1, 0},
-                {10, 2, 0},
-                {100, 2, 0},
-                {1000, 2, 0},
-                {10, 5, 0},
-                {100, 5, 0},
-                {1000, 5, 0},
-                {10, 0, 1},
-                {100, 0, 1},
-                {1000, 0, 1},
+                {10, 0, 0, 1},
+                {100, 0, 0, 1},
+                {1000, 0, 0, 1},
+                {10, 1, 0, 1},
+                {100, 1, 0, 1},
+                {1000, 1, 0, 1},
+                {10, 2, 0, 1},
+                {100, 2, 0, 1},
+                {1000, 2, 0, 1},
+                {10, 5, 0, 1},
+                {100, 5, 0, 1},
+                {1000, 5, 0, 1},
+                {10, 0, 1, 1},
+                {100, 0, 1, 1},
+                {1000, 0, 1, 1},
+                // handle transfer throughput as the number of cpus in use grows
+                {10, 5, 0, 2},
+                {10, 5, 0, 4},
+                {10, 5, 0, 8},
+                // cost of the syscalls and channel lock amortized over a batch
+                {10, 0, 0, 1, 4},
+                {10, 0, 0, 1, 16},
+                {1000, 0, 0, 1, 16},
+                {10, 1, 0, 1, 16},
+            };
+            static constexpr TestArgs call_suite[] = {
+                {10, 0, 0, 1},
+                {100, 0, 0, 1},
+                {1000, 0, 0, 1},
+                {10, 1, 0, 1},
+                {10, 5, 0, 1},
             };
-            for (size_t i = 0; i < countof(suite); i++)
-                do_test(duration, suite[i]);
+            const TestArgs* tests = call_mode ? call_suite : suite;
+            size_t count = call_mode ? countof(call_suite) : countof(suite);
+            for (size_t i = 0; i < count; i++) {
+                if (compare) {
+                    do_allocator_comparison(call_mode, duration, tests[i]);
+                } else {
+                    run_test(call_mode, duration, tests[i]);
+                }
+            }
+        } else if (compare) {
+            do_allocator_comparison(call_mode, duration, test_args);
         } else {
-            do_test(duration, test_args);
+            run_test(call_mode, duration, test_args);
         }
     }
 
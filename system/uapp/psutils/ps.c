@@ -17,6 +17,7 @@
 #include <string.h>
 
 #define MAX_STATE_LEN (7 + 1)  // +1 for trailing NUL
+#define MAX_TIME_LEN (9 + 1)   // +1 for trailing NUL
 
 // A single task (job or process).
 typedef struct {
@@ -27,6 +28,7 @@ typedef struct {
     char mapped_bytes_str[MAX_FORMAT_SIZE_LEN];
     char state_str[MAX_STATE_LEN];
     char allocated_bytes_str[MAX_FORMAT_SIZE_LEN];
+    char cpu_time_str[MAX_TIME_LEN];
 } task_entry_t;
 
 // An array of tasks.
@@ -52,6 +54,19 @@ void add_entry(task_table_t* table, const task_entry_t* entry) {
 // The array of tasks built by the callbacks.
 static task_table_t tasks = {};
 
+// Fills in |e->cpu_time_str| with the cpu time used by |task|, in seconds.
+static mx_status_t format_cpu_time(task_entry_t* e, mx_handle_t task) {
+    mx_info_task_runtime_t info;
+    mx_status_t status = mx_object_get_info(
+        task, MX_INFO_TASK_RUNTIME, &info, sizeof(info), NULL, NULL);
+    if (status != NO_ERROR) {
+        return status;
+    }
+    snprintf(e->cpu_time_str, sizeof(e->cpu_time_str), "%.3f",
+             (double)info.cpu_time / 1e9);
+    return NO_ERROR;
+}
+
 // Adds a job's information to |tasks|.
 static mx_status_t job_callback(int depth, mx_handle_t job, mx_koid_t koid) {
     task_entry_t e = {.type = 'j', .depth = depth};
@@ -60,6 +75,10 @@ static mx_status_t job_callback(int depth, mx_handle_t job, mx_koid_t koid) {
     if (status != NO_ERROR) {
         return status;
     }
+    status = format_cpu_time(&e, job);
+    if (status != NO_ERROR) {
+        return status;
+    }
     snprintf(e.koid_str, sizeof(e.koid_str), "%" PRIu64, koid);
     add_entry(&tasks, &e);
     return NO_ERROR;
@@ -87,6 +106,10 @@ static mx_status_t process_callback(int depth, mx_handle_t process, mx_koid_t ko
                 info.mem_mapped_bytes);
     format_size(e.allocated_bytes_str, sizeof(e.allocated_bytes_str),
                 info.mem_committed_bytes);
+    status = format_cpu_time(&e, process);
+    if (status != NO_ERROR) {
+        return status;
+    }
     snprintf(e.koid_str, sizeof(e.koid_str), "%" PRIu64, koid);
     add_entry(&tasks, &e);
     return NO_ERROR;
@@ -130,6 +153,10 @@ static mx_status_t thread_callback(int depth, mx_handle_t thread, mx_koid_t koid
         return status;
     }
     // TODO: Print thread stack size in one of the memory usage fields?
+    status = format_cpu_time(&e, thread);
+    if (status != NO_ERROR) {
+        return status;
+    }
     snprintf(e.koid_str, sizeof(e.koid_str), "%" PRIu64, koid);
     snprintf(e.state_str, sizeof(e.state_str), "%s", state_string(&info));
     add_entry(&tasks, &e);
@@ -138,9 +165,10 @@ static mx_status_t thread_callback(int depth, mx_handle_t thread, mx_koid_t koid
 
 void print_header(int id_w, bool with_threads) {
     if (with_threads) {
-        printf("%*s %7s %7s %7s %s\n", -id_w, "TASK", "VIRT", "RES", "STATE", "NAME");
+        printf("%*s %7s %7s %9s %7s %s\n",
+               -id_w, "TASK", "VIRT", "RES", "TIME", "STATE", "NAME");
     } else {
-        printf("%*s %7s %7s %s\n", -id_w, "TASK", "VIRT", "RES", "NAME");
+        printf("%*s %7s %7s %9s %s\n", -id_w, "TASK", "VIRT", "RES", "TIME", "NAME");
     }
 }
 
@@ -171,13 +199,15 @@ void print_table(task_table_t* table, bool with_threads) {
         snprintf(idbuf, id_w + 1,
                  "%*s%c:%s", e->depth * 2, "", e->type, e->koid_str);
         if (with_threads) {
-            printf("%*s %7s %7s %7s %s\n",
+            printf("%*s %7s %7s %9s %7s %s\n",
                    -id_w, idbuf,
-                   e->mapped_bytes_str, e->allocated_bytes_str, e->state_str, e->name);
+                   e->mapped_bytes_str, e->allocated_bytes_str, e->cpu_time_str,
+                   e->state_str, e->name);
         } else {
-            printf("%*s %7s %7s %s\n",
+            printf("%*s %7s %7s %9s %s\n",
                    -id_w, idbuf,
-                   e->mapped_bytes_str, e->allocated_bytes_str, e->name);
+                   e->mapped_bytes_str, e->allocated_bytes_str, e->cpu_time_str,
+                   e->name);
         }
     }
     free(idbuf);
@@ -17,6 +17,8 @@
 #include <string.h>
 #include <threads.h>
 
+// In streaming mode the kernel ignores the offset and each read drains the
+// chunks that have completed since the last one.
 static mx_status_t ktrace_read(void* ctx, void* buf, size_t count, mx_off_t off, size_t* actual) {
     uint32_t length;
     mx_status_t status = mx_ktrace_read(get_root_resource(), buf, off, count, &length);
@@ -65,6 +67,13 @@ static mx_status_t ktrace_ioctl(void* ctx, uint32_t op,
         *out_actual = sizeof(uint32_t);
         return NO_ERROR;
     }
+    case IOCTL_KTRACE_SET_MODE: {
+        if (cmdlen != sizeof(uint32_t)) {
+            return ERR_INVALID_ARGS;
+        }
+        uint32_t mode = *((const uint32_t*) cmd);
+        return mx_ktrace_control(get_root_resource(), KTRACE_ACTION_SET_MODE, mode, NULL);
+    }
     default:
         return ERR_INVALID_ARGS;
     }
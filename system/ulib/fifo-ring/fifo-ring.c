@@ -0,0 +1,186 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fifo-ring/fifo-ring.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+
+mx_status_t fifo_ring_init(fifo_ring_t* ring, mx_handle_t fifo) {
+    mx_fifo_ring_info_t info;
+    mx_handle_t vmo;
+    mx_status_t status = mx_fifo_get_ring(fifo, &info, &vmo);
+    if (status != NO_ERROR)
+        return status;
+
+    uint64_t size;
+    if ((status = mx_vmo_get_size(vmo, &size)) != NO_ERROR) {
+        mx_handle_close(vmo);
+        return status;
+    }
+
+    uintptr_t mapping;
+    status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                         MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &mapping);
+    if (status != NO_ERROR) {
+        mx_handle_close(vmo);
+        return status;
+    }
+
+    ring->fifo = fifo;
+    ring->vmo = vmo;
+    ring->mapping = mapping;
+    ring->mapping_len = size;
+    ring->rx = (mx_fifo_ring_t*)(mapping + info.rx_offset);
+    ring->rx_entries = (uint8_t*)(ring->rx + 1);
+    ring->tx = (mx_fifo_ring_t*)(mapping + info.tx_offset);
+    ring->tx_entries = (uint8_t*)(ring->tx + 1);
+    ring->elem_count = info.elem_count;
+    ring->elem_size = info.elem_size;
+    return NO_ERROR;
+}
+
+void fifo_ring_destroy(fifo_ring_t* ring) {
+    mx_vmar_unmap(mx_vmar_root_self(), ring->mapping, ring->mapping_len);
+    mx_handle_close(ring->vmo);
+    ring->vmo = MX_HANDLE_INVALID;
+}
+
+// Brings the fifo's signals up to date with the shared indices of both rings.
+static mx_status_t ring_doorbell(fifo_ring_t* ring) {
+    uint32_t actual;
+    return mx_fifo_write(ring->fifo, NULL, 0u, &actual);
+}
+
+// Returns the number of entries queued in |ctl|, or a value larger than
+// |elem_count| if the peer has corrupted the indices.
+static uint32_t ring_used(const mx_fifo_ring_t* ctl) {
+    return __atomic_load_n(&ctl->head, __ATOMIC_SEQ_CST) -
+           __atomic_load_n(&ctl->tail, __ATOMIC_SEQ_CST);
+}
+
+// Wakes the peer if it announced that it is about to sleep on |waiting|. The
+// caller has just published an index with a seq_cst store, which pairs with
+// the flag store in ring_wait().
+static void ring_wake(fifo_ring_t* ring, uint32_t* waiting) {
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST) &&
+        __atomic_exchange_n(waiting, 0u, __ATOMIC_SEQ_CST))
+        ring_doorbell(ring);
+}
+
+mx_status_t fifo_ring_write(fifo_ring_t* ring, const void* entries, size_t len,
+                            uint32_t* actual) {
+    size_t count = len / ring->elem_size;
+    if (count == 0)
+        return ERR_OUT_OF_RANGE;
+
+    mx_fifo_ring_t* ctl = ring->tx;
+    uint32_t used = ring_used(ctl);
+    if (used > ring->elem_count)
+        return ERR_BAD_STATE;
+
+    uint32_t avail = ring->elem_count - used;
+    if (avail == 0)
+        return ERR_SHOULD_WAIT;
+    if (count > avail)
+        count = avail;
+
+    // copy up to the end of the ring, then wrap to the front
+    uint32_t head = __atomic_load_n(&ctl->head, __ATOMIC_RELAXED);
+    uint32_t offset = head & (ring->elem_count - 1);
+    size_t n = ring->elem_count - offset;
+    if (n > count)
+        n = count;
+    memcpy(ring->tx_entries + offset * ring->elem_size, entries, n * ring->elem_size);
+    memcpy(ring->tx_entries, (const uint8_t*)entries + n * ring->elem_size,
+           (count - n) * ring->elem_size);
+
+    __atomic_store_n(&ctl->head, head + (uint32_t)count, __ATOMIC_SEQ_CST);
+    ring_wake(ring, &ctl->consumer_waiting);
+
+    *actual = (uint32_t)count;
+    return NO_ERROR;
+}
+
+mx_status_t fifo_ring_read(fifo_ring_t* ring, void* entries, size_t len,
+                           uint32_t* actual) {
+    size_t count = len / ring->elem_size;
+    if (count == 0)
+        return ERR_OUT_OF_RANGE;
+
+    mx_fifo_ring_t* ctl = ring->rx;
+    uint32_t used = ring_used(ctl);
+    if (used > ring->elem_count)
+        return ERR_BAD_STATE;
+    if (used == 0)
+        return ERR_SHOULD_WAIT;
+    if (count > used)
+        count = used;
+
+    uint32_t tail = __atomic_load_n(&ctl->tail, __ATOMIC_RELAXED);
+    uint32_t offset = tail & (ring->elem_count - 1);
+    size_t n = ring->elem_count - offset;
+    if (n > count)
+        n = count;
+    memcpy(entries, ring->rx_entries + offset * ring->elem_size, n * ring->elem_size);
+    memcpy((uint8_t*)entries + n * ring->elem_size, ring->rx_entries,
+           (count - n) * ring->elem_size);
+
+    __atomic_store_n(&ctl->tail, tail + (uint32_t)count, __ATOMIC_SEQ_CST);
+    ring_wake(ring, &ctl->producer_waiting);
+
+    *actual = (uint32_t)count;
+    return NO_ERROR;
+}
+
+static bool ring_ready(const fifo_ring_t* ring, const mx_fifo_ring_t* ctl, bool want_entries) {
+    uint32_t used = ring_used(ctl);
+    // a corrupt ring counts as ready so that the next read or write reports it
+    if (used > ring->elem_count)
+        return true;
+    return want_entries ? (used != 0) : (used != ring->elem_count);
+}
+
+static mx_status_t ring_wait(fifo_ring_t* ring, mx_fifo_ring_t* ctl, uint32_t* waiting,
+                             bool want_entries, mx_signals_t signal, mx_time_t deadline) {
+    for (;;) {
+        if (ring_ready(ring, ctl, want_entries))
+            return NO_ERROR;
+
+        // Announce the sleep and look again: either the peer sees the flag
+        // after publishing and rings the doorbell, or we see its update here.
+        __atomic_store_n(waiting, 1u, __ATOMIC_SEQ_CST);
+        if (ring_ready(ring, ctl, want_entries)) {
+            __atomic_store_n(waiting, 0u, __ATOMIC_RELAXED);
+            return NO_ERROR;
+        }
+
+        // Clear any stale signal left by an earlier doorbell before
+        // sleeping on it.
+        mx_signals_t observed = 0u;
+        mx_status_t status = ring_doorbell(ring);
+        if (status == NO_ERROR)
+            status = mx_object_wait_one(ring->fifo, signal | MX_FIFO_PEER_CLOSED,
+                                        deadline, &observed);
+        __atomic_store_n(waiting, 0u, __ATOMIC_RELAXED);
+        if (status != NO_ERROR)
+            return status;
+
+        if (!(observed & signal) && (observed & MX_FIFO_PEER_CLOSED))
+            return ring_ready(ring, ctl, want_entries) ? NO_ERROR : ERR_PEER_CLOSED;
+    }
+}
+
+mx_status_t fifo_ring_wait_readable(fifo_ring_t* ring, mx_time_t deadline) {
+    return ring_wait(ring, ring->rx, &ring->rx->consumer_waiting, true,
+                     MX_FIFO_READABLE, deadline);
+}
+
+mx_status_t fifo_ring_wait_writable(fifo_ring_t* ring, mx_time_t deadline) {
+    return ring_wait(ring, ring->tx, &ring->tx->producer_waiting, false,
+                     MX_FIFO_WRITABLE, deadline);
+}
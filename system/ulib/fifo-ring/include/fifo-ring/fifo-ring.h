@@ -0,0 +1,56 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/types.h>
+#include <magenta/compiler.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+__BEGIN_CDECLS;
+
+// Userspace side of a MX_FIFO_SHARED_RING fifo. Entries are copied straight
+// into the mapped ring and only a sleeping peer costs a syscall. Each
+// direction supports a single producer and a single consumer; callers that
+// share an endpoint between threads must serialize reads and writes
+// themselves.
+typedef struct {
+    mx_handle_t fifo;
+    mx_handle_t vmo;
+    uintptr_t mapping;
+    size_t mapping_len;
+    mx_fifo_ring_t* rx;
+    uint8_t* rx_entries;
+    mx_fifo_ring_t* tx;
+    uint8_t* tx_entries;
+    uint32_t elem_count;
+    uint32_t elem_size;
+} fifo_ring_t;
+
+// Maps the rings of |fifo|, which must have been created with
+// MX_FIFO_SHARED_RING. |fifo| is not consumed and must outlive |ring|.
+mx_status_t fifo_ring_init(fifo_ring_t* ring, mx_handle_t fifo);
+
+// Unmaps the rings.
+void fifo_ring_destroy(fifo_ring_t* ring);
+
+// Same contract as mx_fifo_write() and mx_fifo_read(): copies as many whole
+// entries as fit, returning ERR_SHOULD_WAIT if none do and ERR_OUT_OF_RANGE
+// if |len| is smaller than one entry. ERR_BAD_STATE means the peer has
+// corrupted the ring indices. Unlike the syscalls these can't see that the
+// peer has closed; writes keep succeeding until the ring is full.
+mx_status_t fifo_ring_write(fifo_ring_t* ring, const void* entries, size_t len,
+                            uint32_t* actual);
+mx_status_t fifo_ring_read(fifo_ring_t* ring, void* entries, size_t len,
+                           uint32_t* actual);
+
+// Block until an entry can be read, or written, or |deadline| passes.
+// Return ERR_PEER_CLOSED once the peer is gone and the wait can never be
+// satisfied.
+mx_status_t fifo_ring_wait_readable(fifo_ring_t* ring, mx_time_t deadline);
+mx_status_t fifo_ring_wait_writable(fifo_ring_t* ring, mx_time_t deadline);
+
+__END_CDECLS;
@@ -18,6 +18,7 @@
 #include <mxtl/ref_counted.h>
 #include <mxtl/unique_ptr.h>
 #include <mxio/dispatcher.h>
+#include <mxio/remoteio.h>
 #include <fs/vfs.h>
 
 #include "dispatcher.h"
@@ -38,6 +39,12 @@ public:
         return dispatch_cb(h_.get(), cb_, cookie_);
     }
 
+    // Handles up to |count| queued messages. Remote io handlers drain them in
+    // one read and one write syscall using |msgs| as scratch space; other
+    // handlers get one callback per message.
+    mx_status_t ExecuteCallbacks(mxio_dispatcher_cb_t dispatch_cb, mxrio_msg_t* msgs,
+                                 uint32_t count);
+
     void ExecuteCloseCallback(mxio_dispatcher_cb_t dispatch_cb) {
         dispatch_cb(MX_HANDLE_INVALID, cb_, cookie_);
     }
@@ -44,6 +44,21 @@ mx_status_t Handler::CancelAsyncCallback(const mx::port& dispatch_ioport) {
     return dispatch_ioport.cancel(h_.get(), (uint64_t)(uintptr_t)this);
 }
 
+mx_status_t Handler::ExecuteCallbacks(mxio_dispatcher_cb_t dispatch_cb, mxrio_msg_t* msgs,
+                                      uint32_t count) {
+    if (dispatch_cb == mxrio_handler && count > 1) {
+        return mxrio_handle_rpc_many(h_.get(), msgs, count,
+                                     reinterpret_cast<mxrio_cb_t>(cb_), cookie_);
+    }
+    for (uint32_t ix = 0; ix < count; ++ix) {
+        mx_status_t r;
+        if ((r = ExecuteCallback(dispatch_cb)) != NO_ERROR) {
+            return r;
+        }
+    }
+    return NO_ERROR;
+}
+
 void Handler::Close() {
     h_.reset();
 }
@@ -104,59 +119,81 @@ int VfsDispatcher::Loop() {
     // when draining queue, limit the number of messages you take
     // at once, so you don't dominate the cpu
     constexpr unsigned kMaxMessageBatchSize = 4;
+    // likewise, only take a few port packets per wakeup so the other
+    // threads in the pool still get a share of the ready handlers
+    constexpr uint32_t kMaxPacketBatchSize = 8;
     char tname[128];
     GetThreadName(tname, sizeof(tname));
 
+    // scratch space for draining a burst of remote io requests at once
+    AllocChecker ac;
+    mxtl::unique_ptr<mxrio_msg_t[]> msgs(new (&ac) mxrio_msg_t[kMaxMessageBatchSize]);
+    if (!ac.check()) {
+        error("vfs-dispatcher: no memory for message batch, worker exiting\n");
+        return ERR_NO_MEMORY;
+    }
+
     for (;;) {
-        mx_port_packet_t packet;
+        mx_port_packet_t packets[kMaxPacketBatchSize];
+        uint32_t count = 0;
 
-        if ((r = ioport_.wait(MX_TIME_INFINITE, &packet, 0u)) < 0) {
+        if ((r = ioport_.wait_many(MX_TIME_INFINITE, packets, kMaxPacketBatchSize, &count)) < 0) {
             xprintf("mxio_dispatcher: port wait failed %d, worker exiting\n", r);
             return NO_ERROR;
         }
 
-        xprintf("port_wait: thread %s \n", tname);
+        xprintf("port_wait: thread %s, %u packets\n", tname, count);
 
-        if ((packet.signal.observed & MX_EVENT_SIGNALED) != 0) {
-            // reset for the next thread
-            r = shutdown_event_.wait_async(ioport_, 0u, MX_EVENT_SIGNALED,
-                                           MX_WAIT_ASYNC_ONCE);
-            if (r != NO_ERROR) {
-                error("vfs-dispatcher: error, couldn't reset thread event\n");
+        // the rest of the batch is still handled after a shutdown packet, since
+        // its handlers are not re-armed by anyone else
+        bool shutdown = false;
+        for (uint32_t i = 0; i < count; i++) {
+            const mx_port_packet_t& packet = packets[i];
+
+            if ((packet.signal.observed & MX_EVENT_SIGNALED) != 0) {
+                shutdown = true;
+                continue;
             }
-            // exit thread
-            xprintf("%s: suicide\n", tname);
-            return r;
-        }
 
-        xprintf("thrd_: port_wait: returns key %p effective:%#x \n",
-                (void*)packet.key, packet.signal.observed);
+            xprintf("thrd_: port_wait: returns key %p effective:%#x \n",
+                    (void*)packet.key, packet.signal.observed);
 
-        Handler* handler = (Handler*)(uintptr_t)packet.key;
+            Handler* handler = (Handler*)(uintptr_t)packet.key;
 
-        if (packet.signal.observed & MX_CHANNEL_READABLE) {
-            // hit cb multiple times if we know multi packets available
-            for (unsigned ix = 0; ix < mxtl::min(kMaxMessageBatchSize, (unsigned)packet.signal.count); ++ix) {
-                if ((r = handler->ExecuteCallback(cb_)) != NO_ERROR) {
+            if (packet.signal.observed & MX_CHANNEL_READABLE) {
+                // handle as many messages as we know are available, in one go
+                unsigned count = mxtl::min(kMaxMessageBatchSize, (unsigned)packet.signal.count);
+                if ((r = handler->ExecuteCallbacks(cb_, msgs.get(), count)) != NO_ERROR) {
                     // error or close: invoke callback in case of error
                     DisconnectHandler(handler, r != ERR_DISPATCHER_DONE);
                     goto free_handler;
                 }
-            }
-            // maybe more work to do: re-arm handler to fire again
-            if ((r = handler->SetAsyncCallback(ioport_))!= NO_ERROR){
+                // maybe more work to do: re-arm handler to fire again
+                if ((r = handler->SetAsyncCallback(ioport_))!= NO_ERROR){
+                    DisconnectHandler(handler, true);
+                    goto free_handler;
+                }
+            } else if (packet.signal.observed & MX_CHANNEL_PEER_CLOSED) {
                 DisconnectHandler(handler, true);
-                goto free_handler;
-            }
-        } else if (packet.signal.observed & MX_CHANNEL_PEER_CLOSED) {
-            DisconnectHandler(handler, true);
-        free_handler:
-            {
-                mxtl::AutoLock md_lock(&lock_);
-                handlers_.erase(*handler);
+            free_handler:
+                {
+                    mxtl::AutoLock md_lock(&lock_);
+                    handlers_.erase(*handler);
+                }
             }
         }
 
+        if (shutdown) {
+            // reset for the next thread
+            r = shutdown_event_.wait_async(ioport_, 0u, MX_EVENT_SIGNALED,
+                                           MX_WAIT_ASYNC_ONCE);
+            if (r != NO_ERROR) {
+                error("vfs-dispatcher: error, couldn't reset thread event\n");
+            }
+            // exit thread
+            xprintf("%s: suicide\n", tname);
+            return r;
+        }
     }
 
     // fatal error -- exiting thread
@@ -42,6 +42,16 @@ public:
                                 num_handles);
     }
 
+    mx_status_t read_many(uint32_t flags, mx_channel_msg_t* msgs, uint32_t count,
+                          uint32_t* actual) const {
+        return mx_channel_read_many(get(), flags, msgs, count, actual);
+    }
+
+    mx_status_t write_many(uint32_t flags, const mx_channel_msg_t* msgs, uint32_t count,
+                           uint32_t* actual) const {
+        return mx_channel_write_many(get(), flags, msgs, count, actual);
+    }
+
     mx_status_t call(uint32_t flags, mx_time_t deadline,
                      const mx_channel_call_args_t* args,
                      uint32_t* actual_bytes, uint32_t* actual_handles,
@@ -90,6 +90,14 @@ mx_status_t mxrio_handler(mx_handle_t h, void* cb, void* cookie);
 // event (eg, channel was remotely closed), and neither function
 // should be callaed again after handle_close().
 mx_status_t mxrio_handle_rpc(mx_handle_t h, mxrio_msg_t* msg, mxrio_cb_t cb, void* cookie);
+
+// like handle_rpc(), but processes up to |count| (at most MXRIO_MAX_RPC_BATCH)
+// queued messages, reading them with a single mx_channel_read_many() into
+// |msgs| and sending their replies with mx_channel_write_many().  returns
+// ERR_SHOULD_WAIT if no message was queued.
+#define MXRIO_MAX_RPC_BATCH 16
+mx_status_t mxrio_handle_rpc_many(mx_handle_t h, mxrio_msg_t* msgs, uint32_t count,
+                                  mxrio_cb_t cb, void* cookie);
 mx_status_t mxrio_handle_close(mxrio_cb_t cb, void* cookie);
 
 // OPEN and CLOSE messages, can be forwarded to another remoteio server,
@@ -90,29 +90,24 @@ static void discard_handles(mx_handle_t* handles, unsigned count) {
     }
 }
 
-mx_status_t mxrio_handle_rpc(mx_handle_t h, mxrio_msg_t* msg, mxrio_cb_t cb, void* cookie) {
-    mx_status_t r;
-
-    msg->hcount = MXIO_MAX_HANDLES;
-    uint32_t dsz = sizeof(mxrio_msg_t);
-    if ((r = mx_channel_read(h, 0, msg, msg->handle, dsz, msg->hcount, &dsz, &msg->hcount)) < 0) {
-        return r;
-    }
-
+// runs the callback on a request of |dsz| bytes that was just read into |msg|
+// and turns |msg| into the reply. returns ERR_DISPATCHER_INDIRECT if no reply
+// should be sent, or ERR_INVALID_ARGS (with the handles discarded) if the
+// request was malformed.
+static mx_status_t mxrio_dispatch_msg(mxrio_msg_t* msg, uint32_t dsz,
+                                      mxrio_cb_t cb, void* cookie) {
     if (!is_message_reply_valid(msg, dsz)) {
         discard_handles(msg->handle, msg->hcount);
         return ERR_INVALID_ARGS;
     }
 
-    bool is_close = (MXRIO_OP(msg->op) == MXRIO_CLOSE);
-
     xprintf("handle_rio: op=%s arg=%d len=%u hsz=%d\n",
             mxio_opname(msg->op), msg->arg, msg->datalen, msg->hcount);
 
     if ((msg->arg = cb(msg, cookie)) == ERR_DISPATCHER_INDIRECT) {
         // callback is handling the reply itself
         // and took ownership of the reply handle
-        return NO_ERROR;
+        return ERR_DISPATCHER_INDIRECT;
     }
     if ((msg->arg < 0) || !is_message_valid(msg)) {
         // in the event of an error response or bad message
@@ -128,6 +123,24 @@ mx_status_t mxrio_handle_rpc(mx_handle_t h, mxrio_msg_t* msg, mxrio_cb_t cb, voi
     }
 
     msg->op = MXRIO_STATUS;
+    return NO_ERROR;
+}
+
+mx_status_t mxrio_handle_rpc(mx_handle_t h, mxrio_msg_t* msg, mxrio_cb_t cb, void* cookie) {
+    mx_status_t r;
+
+    msg->hcount = MXIO_MAX_HANDLES;
+    uint32_t dsz = sizeof(mxrio_msg_t);
+    if ((r = mx_channel_read(h, 0, msg, msg->handle, dsz, msg->hcount, &dsz, &msg->hcount)) < 0) {
+        return r;
+    }
+
+    bool is_close = (MXRIO_OP(msg->op) == MXRIO_CLOSE);
+
+    if ((r = mxrio_dispatch_msg(msg, dsz, cb, cookie)) != NO_ERROR) {
+        return (r == ERR_DISPATCHER_INDIRECT) ? NO_ERROR : r;
+    }
+
     if ((r = mx_channel_write(h, 0, msg, MXRIO_HDR_SZ + msg->datalen, msg->handle, msg->hcount)) < 0) {
         discard_handles(msg->handle, msg->hcount);
     }
@@ -139,6 +152,79 @@ mx_status_t mxrio_handle_rpc(mx_handle_t h, mxrio_msg_t* msg, mxrio_cb_t cb, voi
     }
 }
 
+mx_status_t mxrio_handle_rpc_many(mx_handle_t h, mxrio_msg_t* msgs, uint32_t count,
+                                  mxrio_cb_t cb, void* cookie) {
+    mx_channel_msg_t io[MXRIO_MAX_RPC_BATCH];
+    mx_status_t r;
+
+    if (count > MXRIO_MAX_RPC_BATCH) {
+        count = MXRIO_MAX_RPC_BATCH;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        io[i].bytes = &msgs[i];
+        io[i].handles = msgs[i].handle;
+        io[i].num_bytes = sizeof(mxrio_msg_t);
+        io[i].num_handles = MXIO_MAX_HANDLES;
+    }
+
+    uint32_t actual = 0;
+    if ((r = mx_channel_read_many(h, 0, io, count, &actual)) < 0) {
+        return r;
+    }
+
+    // handle every request, collecting the replies in io[] (a reply never
+    // lands past the request it answers); stop at a close or a bad request
+    // and drop whatever was queued behind it
+    uint32_t nreplies = 0;
+    bool is_close = false;
+    mx_status_t status = NO_ERROR;
+    for (uint32_t i = 0; i < actual; i++) {
+        mxrio_msg_t* msg = &msgs[i];
+        msg->hcount = io[i].num_handles;
+        if (is_close || (status < 0)) {
+            discard_handles(msg->handle, msg->hcount);
+            continue;
+        }
+
+        is_close = (MXRIO_OP(msg->op) == MXRIO_CLOSE);
+        if ((r = mxrio_dispatch_msg(msg, io[i].num_bytes, cb, cookie)) != NO_ERROR) {
+            if (r != ERR_DISPATCHER_INDIRECT) {
+                status = r;
+            }
+            continue;
+        }
+
+        io[nreplies].bytes = msg;
+        io[nreplies].handles = msg->handle;
+        io[nreplies].num_bytes = MXRIO_HDR_SZ + msg->datalen;
+        io[nreplies].num_handles = msg->hcount;
+        nreplies++;
+    }
+
+    uint32_t written = 0;
+    while (written < nreplies) {
+        uint32_t n = 0;
+        r = mx_channel_write_many(h, 0, &io[written], nreplies - written, &n);
+        written += n;
+        if (r < 0) {
+            // the reply at |written| failed; like a failed single write,
+            // drop its handles and carry on with the rest
+            mxrio_msg_t* msg = io[written].bytes;
+            discard_handles(msg->handle, msg->hcount);
+            written++;
+            if (status == NO_ERROR) {
+                status = r;
+            }
+        }
+    }
+
+    if (is_close) {
+        // signals to not perform a close callback
+        return ERR_DISPATCHER_DONE;
+    }
+    return status;
+}
+
 mx_status_t mxrio_handle_close(mxrio_cb_t cb, void* cookie) {
     mxrio_msg_t msg;
 
@@ -105,7 +105,7 @@ template <typename _KeyType,
                                     _KeyType,
                                     typename internal::ContainerPtrTraits<_PtrType>::ValueType>,
           typename _NodeTraits = DefaultWAVLTreeTraits<_PtrType>,
-          typename _Observer   = tests::intrusive_containers::DefaultWAVLTreeObserver>
+          typename _Observer   = DefaultWAVLTreeObserver>
 class WAVLTree {
 private:
     // Private fwd decls of the iterator implementation.
@@ -662,10 +662,12 @@ private:
             left_most_  = PtrTraits::GetRaw(ptr);
             right_most_ = PtrTraits::GetRaw(ptr);
 
+            RawPtrType raw = PtrTraits::GetRaw(ptr);
             root_ = mxtl::move(ptr);
 
             ++count_;
             Observer::RecordInsert();
+            Observer::template AugmentInsert<ContainerType>(raw);
             return;
         }
 
@@ -741,6 +743,7 @@ private:
 
         ++count_;
         Observer::RecordInsert();
+        Observer::template AugmentInsert<ContainerType>(PtrTraits::GetRaw(*owner));
 
         // Finally, perform post-insert balance operations.
         BalancePostInsert(PtrTraits::GetRaw(*owner));
@@ -881,6 +884,8 @@ private:
         // Update the count bookkeeping.
         --count_;
         Observer::RecordErase();
+        if (!PtrTraits::IsSentinel(parent))
+            Observer::template AugmentErase<ContainerType>(parent);
 
         // Time to rebalance.  We know that we don't need to rebalance if we
         // just removed the root (IOW - its parent was the sentinel value).
@@ -1260,6 +1265,8 @@ private:
         Z_ns.parent_ = X;
         if (Y)
             NodeTraits::node_state(*Y).parent_ = Z;
+
+        Observer::template AugmentRotate<ContainerType>(Z, X);
     }
 
     // PostInsertFixupLR<LRTraits>
@@ -12,6 +12,8 @@ namespace tests {
 namespace intrusive_containers {
 // Fwd decl of sanity checker class used by tests.
 class WAVLTreeChecker;
+}  // namespace intrusive_containers
+}  // namespace tests
 
 // Definition of the default (no-op) Observer.
 //
@@ -20,6 +22,21 @@ class WAVLTreeChecker;
 // usage.  The DefaultWAVLTreeObserver does nothing and should fall out of the
 // code during template expansion.
 //
+// Observers may also be used to maintain augmented per-node data which
+// summarizes each node's subtree (for example, the largest gap between the
+// keys in it).  The Augment hooks are called with the nodes whose subtrees
+// changed membership...
+// ++ AugmentInsert : after |node| has been linked into the tree as a leaf, but
+//                    before rebalancing.  Every ancestor of |node| gained it.
+// ++ AugmentErase  : after a node has been unlinked from below |parent|, but
+//                    before rebalancing.  |parent| and every one of its
+//                    ancestors lost it.  Not called when the root was removed
+//                    without a replacement being swapped into its place.
+// ++ AugmentRotate : after a rotation moved |new_top| into the position held
+//                    by |old_top|, which is now |new_top|'s child.  Only
+//                    these two nodes' subtrees changed, |old_top|'s must be
+//                    recomputed first.
+//
 // Note: Records of promotions and demotions are used by tests to demonstrate
 // that the computational complexity of insert/erase rebalancing is amortized
 // constant.  Promotions and demotions which are side effects of the rotation
@@ -37,6 +54,16 @@ struct DefaultWAVLTreeObserver {
     static void RecordEraseRotation()        { }
     static void RecordEraseDoubleRotation()  { }
 
+    template <typename TreeType>
+    static void AugmentInsert(typename TreeType::RawPtrType node) { }
+
+    template <typename TreeType>
+    static void AugmentErase(typename TreeType::RawPtrType parent) { }
+
+    template <typename TreeType>
+    static void AugmentRotate(typename TreeType::RawPtrType old_top,
+                              typename TreeType::RawPtrType new_top) { }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         return true;
@@ -48,9 +75,6 @@ struct DefaultWAVLTreeObserver {
     }
 };
 
-}  // namespace tests
-}  // namespace intrusive_containers
-
 // Prototypes for the WAVL tree node state.  By default, we just use a bool to
 // record the rank parity of a node.  During testing, however, we actually use a
 // specialized version of the node state in which the rank is stored as an
@@ -37,6 +37,7 @@ public:
 
     using internal::RefCountedBase::AddRef;
     using internal::RefCountedBase::Release;
+    using internal::RefCountedBase::AddRefMaybeInDestructor;
 #if MX_DEBUG_ASSERT_IMPLEMENTED
     using internal::RefCountedBase::Adopt;
 #endif
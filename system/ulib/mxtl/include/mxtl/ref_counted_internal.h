@@ -20,6 +20,22 @@ protected:
         // TODO(jamesr): Replace uses of GCC builtins with something safer.
         ref_count_.fetch_add(1, memory_order_relaxed);
     }
+    // Adds a reference unless the count has already dropped to zero, which
+    // means the object is being destroyed.  Returns whether a reference was
+    // added.  This is only for objects reachable through a weak pointer that
+    // their destructor clears under a lock the caller also holds.
+    bool AddRefMaybeInDestructor() __WARN_UNUSED_RESULT {
+        MX_DEBUG_ASSERT_COND(adopted_);
+        int old = ref_count_.load(memory_order_relaxed);
+        do {
+            if (old == 0)
+                return false;
+        } while (!ref_count_.compare_exchange_weak(&old, old + 1,
+                                                   memory_order_relaxed,
+                                                   memory_order_relaxed));
+        return true;
+    }
+
     // Returns true if the object should self-delete.
     bool Release() __WARN_UNUSED_RESULT {
         MX_DEBUG_ASSERT_COND(adopted_);
@@ -647,6 +647,102 @@ static int call_server(void* ptr) {
     return 0;
 }
 
+static bool channel_read_write_many(void) {
+    BEGIN_TEST;
+
+    mx_handle_t channel[2];
+    ASSERT_EQ(mx_channel_create(0, &channel[0], &channel[1]), NO_ERROR, "");
+
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "failed to create event");
+    mx_handle_t dup;
+    ASSERT_EQ(mx_handle_duplicate(event, MX_RIGHT_SAME_RIGHTS, &dup), NO_ERROR, "");
+
+    // Three messages of different sizes, the second one carrying a handle.
+    uint32_t out[3][4] = {{1u}, {2u, 2u}, {3u, 3u, 3u}};
+    mx_channel_msg_t msgs[3] = {
+        {out[0], NULL, 4u, 0u},
+        {out[1], &dup, 8u, 1u},
+        {out[2], NULL, 12u, 0u},
+    };
+    uint32_t actual = 0u;
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, msgs, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 3u, "");
+
+    // A message that does not fit ends the batch.
+    uint32_t in[3][4] = {};
+    mx_handle_t in_handle = MX_HANDLE_INVALID;
+    mx_channel_msg_t rd[3] = {
+        {in[0], NULL, 16u, 0u},
+        {in[1], &in_handle, 16u, 1u},
+        {in[2], NULL, 4u, 0u},
+    };
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, rd, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 2u, "");
+    EXPECT_EQ(rd[0].num_bytes, 4u, "");
+    EXPECT_EQ(in[0][0], 1u, "");
+    EXPECT_EQ(rd[1].num_bytes, 8u, "");
+    EXPECT_EQ(rd[1].num_handles, 1u, "");
+    EXPECT_EQ(in[1][1], 2u, "");
+    EXPECT_NEQ(in_handle, MX_HANDLE_INVALID, "");
+
+    // The one left behind is reported like mx_channel_read() would.
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, &rd[2], 1u, &actual), ERR_BUFFER_TOO_SMALL, "");
+    EXPECT_EQ(rd[2].num_bytes, 12u, "");
+    rd[2].num_bytes = 16u;
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, &rd[2], 1u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "");
+    EXPECT_EQ(in[2][2], 3u, "");
+
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, rd, 3u, &actual), ERR_SHOULD_WAIT, "");
+
+    // Options are checked the same way by both calls.
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0x10u, msgs, 1u, &actual), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0x10u, rd, 1u, &actual), ERR_INVALID_ARGS, "");
+    EXPECT_EQ(mx_channel_read_many(channel[1], MX_CHANNEL_READ_MAY_DISCARD, rd, 1u, &actual),
+              ERR_NOT_SUPPORTED, "");
+
+    // A buffer that cannot be written ends the batch without losing messages.
+    msgs[1].handles = NULL;
+    msgs[1].num_handles = 0u;
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, msgs, 3u, &actual), NO_ERROR, "");
+    mx_channel_msg_t bad_rd[3] = {
+        {in[0], NULL, 16u, 0u},
+        {(void*)1, NULL, 16u, 0u},
+        {in[2], NULL, 16u, 0u},
+    };
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, bad_rd, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "");
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, &bad_rd[1], 1u, &actual), ERR_INVALID_ARGS, "");
+    rd[0].num_bytes = 16u;
+    rd[1].num_bytes = 16u;
+    rd[1].num_handles = 0u;
+    rd[2].num_bytes = 16u;
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, rd, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 2u, "");
+    EXPECT_EQ(rd[0].num_bytes, 8u, "");
+    EXPECT_EQ(rd[1].num_bytes, 12u, "");
+    msgs[1].handles = &dup;
+    msgs[1].num_handles = 1u;
+
+    // A bad message stops the batch, and the ones before it are still written.
+    mx_handle_t bad = in_handle;
+    EXPECT_EQ(mx_handle_close(in_handle), NO_ERROR, "");
+    msgs[1].handles = &bad;
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, msgs, 3u, &actual), ERR_BAD_HANDLE, "");
+    EXPECT_EQ(actual, 1u, "");
+    EXPECT_EQ(mx_channel_read_many(channel[1], 0u, rd, 3u, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 1u, "");
+
+    EXPECT_EQ(mx_handle_close(channel[1]), NO_ERROR, "");
+    EXPECT_EQ(mx_channel_write_many(channel[0], 0u, msgs, 1u, &actual), ERR_PEER_CLOSED, "");
+
+    EXPECT_EQ(mx_handle_close(event), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(channel[0]), NO_ERROR, "");
+
+    END_TEST;
+}
+
 static bool channel_call(void) {
     BEGIN_TEST;
 
@@ -793,6 +889,7 @@ RUN_TEST(channel_non_transferable)
 RUN_TEST(channel_duplicate_handles)
 RUN_TEST(channel_multithread_read)
 RUN_TEST(channel_may_discard)
+RUN_TEST(channel_read_write_many)
 RUN_TEST(channel_call)
 RUN_TEST(channel_call2)
 RUN_TEST(channel_nest)
@@ -0,0 +1,232 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include <fifo-ring/fifo-ring.h>
+#include <magenta/syscalls.h>
+
+#include "bench.h"
+
+// Entries are the size of a block_fifo_request_t.
+typedef struct {
+    uint64_t data[4];
+} entry_t;
+
+#define MAX_BATCH 64u
+
+static const uint64_t kStreamEntries = 1000000u;
+static const uint32_t kPingPongRounds = 20000u;
+
+// One endpoint, driven either through the fifo syscalls or through the
+// shared ring.
+typedef struct {
+    mx_handle_t fifo;
+    bool shared;
+    fifo_ring_t ring;
+} endpoint_t;
+
+static mx_time_t now(void) {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+static mx_status_t ep_write(endpoint_t* ep, const entry_t* entries, uint32_t count,
+                            uint32_t* actual) {
+    for (;;) {
+        mx_status_t status = ep->shared ?
+            fifo_ring_write(&ep->ring, entries, count * sizeof(entry_t), actual) :
+            mx_fifo_write(ep->fifo, entries, count * sizeof(entry_t), actual);
+        if (status != ERR_SHOULD_WAIT)
+            return status;
+        if (ep->shared) {
+            status = fifo_ring_wait_writable(&ep->ring, MX_TIME_INFINITE);
+        } else {
+            status = mx_object_wait_one(ep->fifo, MX_FIFO_WRITABLE | MX_FIFO_PEER_CLOSED,
+                                        MX_TIME_INFINITE, NULL);
+        }
+        if (status != NO_ERROR)
+            return status;
+    }
+}
+
+static mx_status_t ep_read(endpoint_t* ep, entry_t* entries, uint32_t count,
+                           uint32_t* actual) {
+    for (;;) {
+        mx_status_t status = ep->shared ?
+            fifo_ring_read(&ep->ring, entries, count * sizeof(entry_t), actual) :
+            mx_fifo_read(ep->fifo, entries, count * sizeof(entry_t), actual);
+        if (status != ERR_SHOULD_WAIT)
+            return status;
+        if (ep->shared) {
+            status = fifo_ring_wait_readable(&ep->ring, MX_TIME_INFINITE);
+        } else {
+            status = mx_object_wait_one(ep->fifo, MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
+                                        MX_TIME_INFINITE, NULL);
+        }
+        if (status != NO_ERROR)
+            return status;
+    }
+}
+
+static bool ep_init(endpoint_t* ep, mx_handle_t fifo, bool shared) {
+    ep->fifo = fifo;
+    ep->shared = shared;
+    return !shared || fifo_ring_init(&ep->ring, fifo) == NO_ERROR;
+}
+
+static void ep_destroy(endpoint_t* ep) {
+    if (ep->shared)
+        fifo_ring_destroy(&ep->ring);
+    mx_handle_close(ep->fifo);
+}
+
+typedef struct {
+    endpoint_t* ep;
+    uint32_t batch;
+} worker_args_t;
+
+static int stream_producer(void* arg) {
+    worker_args_t* args = arg;
+    entry_t entries[MAX_BATCH] = {};
+    for (uint64_t sent = 0u; sent < kStreamEntries;) {
+        uint32_t actual;
+        if (ep_write(args->ep, entries, args->batch, &actual) != NO_ERROR)
+            return -1;
+        sent += actual;
+    }
+    return 0;
+}
+
+static int echo_server(void* arg) {
+    worker_args_t* args = arg;
+    entry_t entry;
+    for (uint32_t i = 0u; i < kPingPongRounds; i++) {
+        uint32_t actual;
+        if (ep_read(args->ep, &entry, 1u, &actual) != NO_ERROR ||
+            ep_write(args->ep, &entry, 1u, &actual) != NO_ERROR)
+            return -1;
+    }
+    return 0;
+}
+
+static bool create_pair(uint32_t depth, bool shared, endpoint_t* a, endpoint_t* b) {
+    mx_handle_t h0, h1;
+    uint32_t options = shared ? MX_FIFO_SHARED_RING : 0u;
+    if (mx_fifo_create(depth, sizeof(entry_t), options, &h0, &h1) != NO_ERROR)
+        return false;
+    if (!ep_init(a, h0, shared)) {
+        mx_handle_close(h0);
+        mx_handle_close(h1);
+        return false;
+    }
+    if (!ep_init(b, h1, shared)) {
+        ep_destroy(a);
+        mx_handle_close(h1);
+        return false;
+    }
+    return true;
+}
+
+static const char* mode_name(bool shared) {
+    return shared ? "shared ring" : "syscall";
+}
+
+// A producer thread streams entries to this thread, both moving |batch|
+// entries per call; reports throughput.
+static void stream(uint32_t depth, bool shared, uint32_t batch) {
+    endpoint_t a, b;
+    if (!create_pair(depth, shared, &a, &b)) {
+        printf("\tfailed to create fifo\n");
+        return;
+    }
+
+    worker_args_t args = {&a, batch};
+    thrd_t producer;
+    mx_time_t t = now();
+    if (thrd_create(&producer, stream_producer, &args) != thrd_success) {
+        printf("\tfailed to create producer thread\n");
+        ep_destroy(&a);
+        ep_destroy(&b);
+        return;
+    }
+
+    entry_t entries[MAX_BATCH];
+    uint64_t received = 0u;
+    while (received < kStreamEntries) {
+        uint32_t actual;
+        mx_status_t status = ep_read(&b, entries, batch, &actual);
+        if (status != NO_ERROR) {
+            printf("\tfifo read failed: %d\n", status);
+            break;
+        }
+        received += actual;
+    }
+    t = now() - t;
+    thrd_join(producer, NULL);
+
+    printf("\t%-11s depth %5" PRIu32 " batch %2" PRIu32 ": %" PRIu64 " entries/sec\n",
+           mode_name(shared), depth, batch, (uint64_t)(received * 1000000000ull / t));
+
+    ep_destroy(&a);
+    ep_destroy(&b);
+}
+
+// Bounces a single entry off an echo thread; every hop has to wake the
+// other side, so this is the worst case for the shared ring.
+static void ping_pong(bool shared) {
+    endpoint_t a, b;
+    if (!create_pair(16u, shared, &a, &b)) {
+        printf("\tfailed to create fifo\n");
+        return;
+    }
+
+    worker_args_t args = {&b, 1u};
+    thrd_t server;
+    if (thrd_create(&server, echo_server, &args) != thrd_success) {
+        printf("\tfailed to create echo thread\n");
+        ep_destroy(&a);
+        ep_destroy(&b);
+        return;
+    }
+
+    entry_t entry = {};
+    mx_time_t t = now();
+    for (uint32_t i = 0u; i < kPingPongRounds; i++) {
+        uint32_t actual;
+        if (ep_write(&a, &entry, 1u, &actual) != NO_ERROR ||
+            ep_read(&a, &entry, 1u, &actual) != NO_ERROR) {
+            printf("\tping pong failed\n");
+            break;
+        }
+    }
+    t = now() - t;
+    thrd_join(server, NULL);
+
+    printf("\t%-11s ping pong: %" PRIu64 " ns/round trip\n",
+           mode_name(shared), t / kPingPongRounds);
+
+    ep_destroy(&a);
+    ep_destroy(&b);
+}
+
+int fifo_run_benchmark(void) {
+    printf("starting fifo benchmark\n");
+
+    // 128 entries is the deepest a syscall fifo of this entry size can be
+    for (uint32_t batch = 1u; batch <= MAX_BATCH; batch *= 8u) {
+        stream(128u, false, batch);
+        stream(128u, true, batch);
+    }
+    stream(4096u, true, 1u);
+    stream(4096u, true, MAX_BATCH);
+
+    ping_pong(false);
+    ping_pong(true);
+
+    printf("done with benchmark\n");
+    return 0;
+}
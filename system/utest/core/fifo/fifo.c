@@ -7,11 +7,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <threads.h>
+#include <string.h>
 #include <unistd.h>
 
+#include <fifo-ring/fifo-ring.h>
 #include <magenta/syscalls.h>
 #include <unittest/unittest.h>
 
+#include "bench.h"
+
 static mx_signals_t get_signals(mx_handle_t h) {
     mx_signals_t pending;
     mx_status_t status = mx_object_wait_one(h, 0xFFFFFFFF, 0u, &pending);
@@ -108,12 +112,162 @@ static bool basic_test(void) {
     END_TEST;
 }
 
+static bool shared_ring_test(void) {
+    BEGIN_TEST;
+    mx_handle_t a, b;
+    uint64_t n[8] = { 1, 2, 3, 4, 5, 6, 7, 8};
+    uint32_t actual;
+
+    // shared rings may be deeper than a page, up to a limit
+    EXPECT_EQ(mx_fifo_create(1u << 20, 8, MX_FIFO_SHARED_RING, &a, &b), ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(mx_fifo_create(8, 8, 2, &a, &b), ERR_INVALID_ARGS, "");
+    ASSERT_EQ(mx_fifo_create(4096, 8, MX_FIFO_SHARED_RING, &a, &b), NO_ERROR, "");
+    mx_handle_close(a);
+    mx_handle_close(b);
+
+    // plain fifos have no ring
+    mx_fifo_ring_info_t info;
+    mx_handle_t vmo;
+    ASSERT_EQ(mx_fifo_create(8, 8, 0, &a, &b), NO_ERROR, "");
+    EXPECT_EQ(mx_fifo_get_ring(a, &info, &vmo), ERR_NOT_SUPPORTED, "");
+    mx_handle_close(a);
+    mx_handle_close(b);
+
+    ASSERT_EQ(mx_fifo_create(8, 8, MX_FIFO_SHARED_RING, &a, &b), NO_ERROR, "");
+    ASSERT_EQ(mx_fifo_get_ring(a, &info, &vmo), NO_ERROR, "");
+    EXPECT_EQ(info.elem_count, 8u, "");
+    EXPECT_EQ(info.elem_size, 8u, "");
+    EXPECT_NEQ(info.rx_offset, info.tx_offset, "");
+    mx_handle_close(vmo);
+
+    // entries only move through the ring; a zero length call is the doorbell
+    EXPECT_EQ(mx_fifo_write(a, n, sizeof(n), &actual), ERR_NOT_SUPPORTED, "");
+    EXPECT_EQ(mx_fifo_read(b, n, sizeof(n), &actual), ERR_NOT_SUPPORTED, "");
+    EXPECT_EQ(mx_fifo_write(a, NULL, 0, &actual), NO_ERROR, "");
+    EXPECT_EQ(actual, 0u, "");
+
+    fifo_ring_t ra, rb;
+    ASSERT_EQ(fifo_ring_init(&ra, a), NO_ERROR, "");
+    ASSERT_EQ(fifo_ring_init(&rb, b), NO_ERROR, "");
+
+    EXPECT_EQ(fifo_ring_read(&rb, n, sizeof(n), &actual), ERR_SHOULD_WAIT, "");
+    EXPECT_EQ(fifo_ring_wait_readable(&rb, 0u), ERR_TIMED_OUT, "");
+
+    // fill the ring; the signals follow once the doorbell is rung
+    ASSERT_EQ(fifo_ring_write(&ra, n, sizeof(n), &actual), NO_ERROR, "");
+    ASSERT_EQ(actual, 8u, "");
+    EXPECT_EQ(fifo_ring_write(&ra, n, sizeof(n), &actual), ERR_SHOULD_WAIT, "");
+    EXPECT_EQ(fifo_ring_wait_writable(&ra, 0u), ERR_TIMED_OUT, "");
+    EXPECT_SIGNALS(a, MX_SIGNAL_LAST_HANDLE);
+    EXPECT_SIGNALS(b, MX_FIFO_READABLE | MX_FIFO_WRITABLE | MX_SIGNAL_LAST_HANDLE);
+    EXPECT_EQ(fifo_ring_wait_readable(&rb, 0u), NO_ERROR, "");
+
+    // read across the wrap
+    memset(n, 0, sizeof(n));
+    ASSERT_EQ(fifo_ring_read(&rb, n, sizeof(uint64_t) * 6, &actual), NO_ERROR, "");
+    ASSERT_EQ(actual, 6u, "");
+    EXPECT_EQ(n[5], 6u, "");
+    EXPECT_EQ(fifo_ring_wait_writable(&ra, 0u), NO_ERROR, "");
+    n[0] = 9u; n[1] = 10u; n[2] = 11u;
+    ASSERT_EQ(fifo_ring_write(&ra, n, sizeof(uint64_t) * 3, &actual), NO_ERROR, "");
+    ASSERT_EQ(actual, 3u, "");
+    ASSERT_EQ(fifo_ring_read(&rb, n, sizeof(n), &actual), NO_ERROR, "");
+    ASSERT_EQ(actual, 5u, "");
+    for (unsigned i = 0; i < 5; i++) {
+        EXPECT_EQ(n[i], 7u + i, "");
+    }
+
+    // corrupt indices are caught by both sides
+    ra.tx->head += 100u;
+    EXPECT_EQ(fifo_ring_read(&rb, n, sizeof(n), &actual), ERR_BAD_STATE, "");
+    EXPECT_EQ(mx_fifo_write(a, NULL, 0, &actual), ERR_BAD_STATE, "");
+    ra.tx->head -= 100u;
+
+    fifo_ring_destroy(&rb);
+    mx_handle_close(b);
+    EXPECT_EQ(fifo_ring_wait_readable(&ra, MX_TIME_INFINITE), ERR_PEER_CLOSED, "");
+
+    // the ring itself can't tell the peer is gone, only a wait can
+    ASSERT_EQ(fifo_ring_write(&ra, n, sizeof(n), &actual), NO_ERROR, "");
+    ASSERT_EQ(actual, 8u, "");
+    EXPECT_EQ(fifo_ring_wait_writable(&ra, MX_TIME_INFINITE), ERR_PEER_CLOSED, "");
+
+    fifo_ring_destroy(&ra);
+    mx_handle_close(a);
+
+    END_TEST;
+}
+
+typedef struct {
+    mx_handle_t fifo;
+    uint64_t count;
+} ring_producer_args_t;
+
+static int ring_producer(void* arg) {
+    ring_producer_args_t* args = arg;
+    fifo_ring_t ring;
+    if (fifo_ring_init(&ring, args->fifo) != NO_ERROR)
+        return -1;
+    for (uint64_t i = 0; i < args->count;) {
+        uint32_t actual;
+        mx_status_t status = fifo_ring_write(&ring, &i, sizeof(i), &actual);
+        if (status == ERR_SHOULD_WAIT)
+            status = fifo_ring_wait_writable(&ring, MX_TIME_INFINITE);
+        else if (status == NO_ERROR)
+            i++;
+        if (status != NO_ERROR)
+            break;
+    }
+    fifo_ring_destroy(&ring);
+    return 0;
+}
+
+// Entries stream through a small ring between two threads, so both sides
+// spend most of their time sleeping on each other.
+static bool shared_ring_wakeup_test(void) {
+    BEGIN_TEST;
+    mx_handle_t a, b;
+    ASSERT_EQ(mx_fifo_create(4, 8, MX_FIFO_SHARED_RING, &a, &b), NO_ERROR, "");
+
+    ring_producer_args_t args = {a, 100000u};
+    thrd_t producer;
+    ASSERT_EQ(thrd_create(&producer, ring_producer, &args), thrd_success, "");
+
+    fifo_ring_t ring;
+    ASSERT_EQ(fifo_ring_init(&ring, b), NO_ERROR, "");
+    uint64_t expected = 0u;
+    while (expected < args.count) {
+        uint64_t n[3];
+        uint32_t actual;
+        mx_status_t status = fifo_ring_read(&ring, n, sizeof(n), &actual);
+        if (status == ERR_SHOULD_WAIT) {
+            ASSERT_EQ(fifo_ring_wait_readable(&ring, MX_TIME_INFINITE), NO_ERROR, "");
+            continue;
+        }
+        ASSERT_EQ(status, NO_ERROR, "");
+        for (uint32_t i = 0; i < actual; i++) {
+            ASSERT_EQ(n[i], expected++, "");
+        }
+    }
+    thrd_join(producer, NULL);
+
+    fifo_ring_destroy(&ring);
+    mx_handle_close(a);
+    mx_handle_close(b);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(fifo_tests)
 RUN_TEST(basic_test)
+RUN_TEST(shared_ring_test)
+RUN_TEST(shared_ring_wakeup_test)
 END_TEST_CASE(fifo_tests)
 
 #ifndef BUILD_COMBINED_TESTS
 int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+        return fifo_run_benchmark();
     return unittest_run_all_tests(argc, argv) ? 0 : -1;
 }
 #endif
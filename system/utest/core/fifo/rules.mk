@@ -10,10 +10,14 @@ MODULE_TYPE := usertest
 
 MODULE_USERTEST_GROUP := core
 
-MODULE_SRCS += $(LOCAL_DIR)/fifo.c
+MODULE_SRCS += \
+    $(LOCAL_DIR)/bench.c \
+    $(LOCAL_DIR)/fifo.c \
 
 MODULE_NAME := fifo-test
 
+MODULE_STATIC_LIBS := system/ulib/fifo-ring
+
 MODULE_LIBS := system/ulib/unittest system/ulib/mxio system/ulib/magenta system/ulib/c
 
 include make/module.mk
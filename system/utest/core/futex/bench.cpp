@@ -0,0 +1,113 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include <magenta/syscalls.h>
+
+#include "bench.h"
+
+// Measures how futex operations on unrelated futexes in one process scale
+// with the number of threads.  Every thread (or pair of threads) has its own
+// futex, so any slowdown as threads are added comes from contention inside
+// the kernel rather than from the workload.
+
+static constexpr int kMaxPairs = 32;
+static constexpr int kWakeIterations = 100000;
+static constexpr int kPingPongIterations = 20000;
+
+// Keep each futex on its own cache line so that userspace false sharing
+// doesn't muddy the numbers.
+struct alignas(64) PaddedFutex {
+    mx_futex_t value;
+};
+
+static PaddedFutex futexes[kMaxPairs];
+
+static mx_time_t now() {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+// Waking a futex nobody waits on is the cheapest futex operation, so it is
+// the one most exposed to lock contention.
+static int wake_thread(void* arg) {
+    mx_futex_t* futex = &static_cast<PaddedFutex*>(arg)->value;
+    for (int i = 0; i < kWakeIterations; i++)
+        mx_futex_wake(futex, 1);
+    return 0;
+}
+
+struct PingPongArgs {
+    mx_futex_t* futex;
+    int side;
+};
+
+// The two threads of a pair take turns: each waits for the futex to hold its
+// side, flips it to the other side and wakes the other thread.
+static int pingpong_thread(void* arg) {
+    auto args = static_cast<PingPongArgs*>(arg);
+    mx_futex_t* futex = args->futex;
+    int mine = args->side;
+    int other = !mine;
+    for (int i = 0; i < kPingPongIterations; i++) {
+        while (__atomic_load_n(futex, __ATOMIC_ACQUIRE) != mine)
+            mx_futex_wait(futex, other, MX_TIME_INFINITE);
+        __atomic_store_n(futex, other, __ATOMIC_RELEASE);
+        mx_futex_wake(futex, 1);
+    }
+    return 0;
+}
+
+static int run_wake(int num_threads) {
+    thrd_t threads[kMaxPairs];
+    mx_time_t start = now();
+    for (int i = 0; i < num_threads; i++) {
+        if (thrd_create_with_name(&threads[i], wake_thread, &futexes[i], "wake") != thrd_success)
+            return -1;
+    }
+    for (int i = 0; i < num_threads; i++)
+        thrd_join(threads[i], NULL);
+    mx_time_t elapsed = now() - start;
+
+    uint64_t ops = (uint64_t)num_threads * kWakeIterations;
+    printf("wake      %2d threads: %8" PRIu64 " ns/op, %10" PRIu64 " ops/s\n",
+           num_threads, elapsed / ops, ops * MX_SEC(1) / elapsed);
+    return 0;
+}
+
+static int run_pingpong(int num_pairs) {
+    thrd_t threads[kMaxPairs * 2];
+    PingPongArgs args[kMaxPairs * 2];
+    mx_time_t start = now();
+    for (int i = 0; i < num_pairs * 2; i++) {
+        futexes[i / 2].value = 0;
+        args[i].futex = &futexes[i / 2].value;
+        args[i].side = i % 2;
+        if (thrd_create_with_name(&threads[i], pingpong_thread, &args[i], "pingpong") !=
+            thrd_success)
+            return -1;
+    }
+    for (int i = 0; i < num_pairs * 2; i++)
+        thrd_join(threads[i], NULL);
+    mx_time_t elapsed = now() - start;
+
+    uint64_t ops = (uint64_t)num_pairs * kPingPongIterations * 2;
+    printf("pingpong  %2d pairs:   %8" PRIu64 " ns/op, %10" PRIu64 " ops/s\n",
+           num_pairs, elapsed / ops, ops * MX_SEC(1) / elapsed);
+    return 0;
+}
+
+int futex_run_benchmark(void) {
+    for (int n = 1; n <= kMaxPairs; n *= 2) {
+        if (run_wake(n))
+            return -1;
+    }
+    for (int n = 1; n <= kMaxPairs; n *= 2) {
+        if (run_pingpong(n))
+            return -1;
+    }
+    return 0;
+}
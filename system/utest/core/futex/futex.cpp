@@ -15,6 +15,8 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "bench.h"
+
 
 static bool test_futex_wait_value_mismatch() {
     BEGIN_TEST;
@@ -519,6 +521,8 @@ END_TEST_CASE(futex_tests)
 
 #ifndef BUILD_COMBINED_TESTS
 int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+        return futex_run_benchmark();
     bool success = unittest_run_all_tests(argc, argv);
     return success ? 0 : -1;
 }
@@ -6,6 +6,7 @@
 #include <magenta/status.h>
 #include <magenta/syscalls.h>
 #include <magenta/syscalls/object.h>
+#include <magenta/threads.h>
 #include <mini-process/mini-process.h>
 #include <unittest/unittest.h>
 
@@ -13,6 +14,7 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <threads.h>
 
 #define LOCAL_TRACE 0
 #define LTRACEF(str, x...)                                  \
@@ -31,6 +33,46 @@ bool info_task_stats_smoke(void) {
               NO_ERROR, "");
     ASSERT_GT(info.mem_committed_bytes, 0u, "");
     ASSERT_GE(info.mem_mapped_bytes, info.mem_committed_bytes, "");
+    // At least the stack and data pages of this process were faulted in.
+    ASSERT_GT(info.page_faults, 0u, "");
+    END_TEST;
+}
+
+// Tests that MX_INFO_THREAD_STATS seems to work.
+bool info_thread_stats_smoke(void) {
+    BEGIN_TEST;
+    mx_info_thread_stats_t info;
+    ASSERT_EQ(mx_object_get_info(thrd_get_mx_handle(thrd_current()), MX_INFO_THREAD_STATS,
+                                 &info, sizeof(info), NULL, NULL),
+              NO_ERROR, "");
+    // This thread is running, so it has been scheduled at least once.
+    ASSERT_GT(info.total_runtime, 0u, "");
+    ASSERT_GT(info.context_switches, 0u, "");
+    END_TEST;
+}
+
+// Tests that MX_INFO_TASK_RUNTIME sums threads into their process.
+bool info_task_runtime_smoke(void) {
+    BEGIN_TEST;
+    mx_info_task_runtime_t thread_info;
+    ASSERT_EQ(mx_object_get_info(thrd_get_mx_handle(thrd_current()), MX_INFO_TASK_RUNTIME,
+                                 &thread_info, sizeof(thread_info), NULL, NULL),
+              NO_ERROR, "");
+    mx_info_task_runtime_t process_info;
+    ASSERT_EQ(mx_object_get_info(mx_process_self(), MX_INFO_TASK_RUNTIME,
+                                 &process_info, sizeof(process_info), NULL, NULL),
+              NO_ERROR, "");
+    ASSERT_GT(thread_info.cpu_time, 0u, "");
+    ASSERT_GE(process_info.cpu_time, thread_info.cpu_time, "");
+    ASSERT_GE(process_info.context_switches, thread_info.context_switches, "");
+
+    // Events are not tasks.
+    mx_handle_t event;
+    ASSERT_EQ(mx_event_create(0u, &event), NO_ERROR, "");
+    EXPECT_EQ(mx_object_get_info(event, MX_INFO_TASK_RUNTIME,
+                                 &process_info, sizeof(process_info), NULL, NULL),
+              ERR_WRONG_TYPE, "");
+    mx_handle_close(event);
     END_TEST;
 }
 
@@ -806,6 +848,8 @@ bool info_job_children_bad_avail_fails(void) {
 
 BEGIN_TEST_CASE(object_info_tests)
 RUN_TEST(info_task_stats_smoke);
+RUN_TEST(info_thread_stats_smoke);
+RUN_TEST(info_task_runtime_smoke);
 RUN_TEST(info_process_maps_smoke);
 RUN_TEST(info_process_maps_self_fails);
 RUN_TEST(info_process_maps_invalid_handle_fails);
@@ -0,0 +1,142 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <threads.h>
+
+#include <magenta/compiler.h>
+#include <magenta/syscalls.h>
+#include <magenta/syscalls/port.h>
+
+#include "bench.h"
+
+static const uint32_t kMaxBatch = 64u;
+static const uint32_t kRounds = 2000u;
+
+static mx_time_t now() {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+static bool queue_packets(mx_handle_t port, uint32_t count) {
+    const mx_port_packet_t in = {1ull, MX_PKT_TYPE_USER, 0, {{}}};
+    for (uint32_t i = 0; i < count; i++) {
+        if (mx_port_queue(port, &in, 0u) != NO_ERROR)
+            return false;
+    }
+    return true;
+}
+
+// Drains |kMaxBatch| queued packets per round, |batch| packets per syscall
+// (zero means one mx_port_wait() per packet), and reports the dequeue cost.
+static void drain(mx_handle_t port, uint32_t batch) {
+    mx_port_packet_t packets[kMaxBatch];
+    mx_time_t elapsed = 0;
+
+    for (uint32_t round = 0; round < kRounds; round++) {
+        if (!queue_packets(port, kMaxBatch)) {
+            printf("\tfailed to queue packets\n");
+            return;
+        }
+
+        mx_time_t t = now();
+        uint32_t left = kMaxBatch;
+        while (left > 0u) {
+            mx_status_t status;
+            uint32_t actual = 1u;
+            if (batch == 0u) {
+                status = mx_port_wait(port, 0ull, &packets[0], 0u);
+            } else {
+                uint32_t count = batch < left ? batch : left;
+                status = mx_port_wait_many(port, 0ull, packets, count, &actual);
+            }
+            if (status != NO_ERROR) {
+                printf("\tport wait failed: %d\n", status);
+                return;
+            }
+            left -= actual;
+        }
+        elapsed += now() - t;
+    }
+
+    uint64_t packets_total = static_cast<uint64_t>(kRounds) * kMaxBatch;
+    if (batch == 0u) {
+        printf("\tmx_port_wait:                %" PRIu64 " ns/packet\n",
+               elapsed / packets_total);
+    } else {
+        printf("\tmx_port_wait_many(%2" PRIu32 "):       %" PRIu64 " ns/packet\n",
+               batch, elapsed / packets_total);
+    }
+}
+
+struct ProducerArgs {
+    mx_handle_t port;
+    uint64_t count;
+};
+
+static int producer_thread(void* arg) {
+    ProducerArgs* args = static_cast<ProducerArgs*>(arg);
+    const mx_port_packet_t in = {2ull, MX_PKT_TYPE_USER, 0, {{}}};
+    for (uint64_t i = 0; i < args->count; i++) {
+        if (mx_port_queue(args->port, &in, 0u) != NO_ERROR)
+            return -1;
+    }
+    return 0;
+}
+
+// A producer thread queues packets as fast as it can while this thread
+// consumes them; reports end to end throughput.
+static void producer_consumer(mx_handle_t port, uint32_t batch) {
+    static const uint64_t kPackets = 200000u;
+    mx_port_packet_t packets[kMaxBatch];
+
+    ProducerArgs args = {port, kPackets};
+    thrd_t producer;
+    mx_time_t t = now();
+    if (thrd_create(&producer, producer_thread, &args) != thrd_success) {
+        printf("\tfailed to create producer thread\n");
+        return;
+    }
+
+    uint64_t received = 0u;
+    while (received < kPackets) {
+        uint32_t actual = 1u;
+        mx_status_t status = (batch == 0u) ?
+            mx_port_wait(port, MX_TIME_INFINITE, &packets[0], 0u) :
+            mx_port_wait_many(port, MX_TIME_INFINITE, packets, batch, &actual);
+        if (status != NO_ERROR) {
+            printf("\tport wait failed: %d\n", status);
+            break;
+        }
+        received += actual;
+    }
+    t = now() - t;
+    thrd_join(producer, nullptr);
+
+    printf("\tproducer/consumer, batch %2" PRIu32 ": %" PRIu64 " packets/sec\n",
+           batch, static_cast<uint64_t>(received * 1000000000ull / t));
+}
+
+int port_run_benchmark() {
+    mx_handle_t port;
+    if (mx_port_create(MX_PORT_OPT_V2, &port) != NO_ERROR) {
+        printf("failed to create port\n");
+        return -1;
+    }
+
+    printf("starting port benchmark\n");
+
+    drain(port, 0u);
+    for (uint32_t batch = 4u; batch <= kMaxBatch; batch *= 2u)
+        drain(port, batch);
+
+    producer_consumer(port, 0u);
+    for (uint32_t batch = 4u; batch <= kMaxBatch; batch *= 2u)
+        producer_consumer(port, batch);
+
+    mx_handle_close(port);
+
+    printf("done with benchmark\n");
+    return 0;
+}
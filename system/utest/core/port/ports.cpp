@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <stdio.h>
+#include <string.h>
 #include <threads.h>
 
 #include <magenta/syscalls.h>
@@ -10,6 +11,8 @@
 
 #include <unittest/unittest.h>
 
+#include "bench.h"
+
 static bool basic_test(void) {
     BEGIN_TEST;
     mx_status_t status;
@@ -76,6 +79,53 @@ static bool queue_and_close_test(void) {
     END_TEST;
 }
 
+static bool wait_many_test(void) {
+    BEGIN_TEST;
+    mx_status_t status;
+
+    mx_handle_t port;
+    status = mx_port_create(MX_PORT_OPT_V2, &port);
+    EXPECT_EQ(status, NO_ERROR, "could not create port v2");
+
+    mx_port_packet_t out[4] = {};
+    uint32_t actual = 0u;
+
+    status = mx_port_wait_many(port, 0ull, out, 0u, &actual);
+    EXPECT_EQ(status, ERR_INVALID_ARGS, "");
+
+    status = mx_port_wait_many(port, mx_deadline_after(MX_USEC(1)), out, 4u, &actual);
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    for (uint64_t key = 0u; key < 6u; key++) {
+        const mx_port_packet_t in = {key, MX_PKT_TYPE_USER, 0, { {} }};
+        status = mx_port_queue(port, &in, 0u);
+        EXPECT_EQ(status, NO_ERROR, "");
+    }
+
+    // Packets come out in fifo order, at most |count| at a time.
+    status = mx_port_wait_many(port, MX_TIME_INFINITE, out, 4u, &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, 4u, "");
+    for (uint32_t i = 0u; i < 4u; i++) {
+        EXPECT_EQ(out[i].key, i, "");
+        EXPECT_EQ(out[i].type, MX_PKT_TYPE_USER, "");
+    }
+
+    status = mx_port_wait_many(port, MX_TIME_INFINITE, out, 4u, &actual);
+    EXPECT_EQ(status, NO_ERROR, "");
+    EXPECT_EQ(actual, 2u, "");
+    EXPECT_EQ(out[0].key, 4u, "");
+    EXPECT_EQ(out[1].key, 5u, "");
+
+    status = mx_port_wait_many(port, mx_deadline_after(MX_USEC(1)), out, 4u, &actual);
+    EXPECT_EQ(status, ERR_TIMED_OUT, "");
+
+    status = mx_handle_close(port);
+    EXPECT_EQ(status, NO_ERROR, "");
+
+    END_TEST;
+}
+
 static bool async_wait_channel_test(void) {
     BEGIN_TEST;
     mx_status_t status;
@@ -480,6 +530,7 @@ static bool threads_event_repeat() {
 BEGIN_TEST_CASE(port_tests)
 RUN_TEST(basic_test)
 RUN_TEST(queue_and_close_test)
+RUN_TEST(wait_many_test)
 RUN_TEST(async_wait_channel_test)
 RUN_TEST(async_wait_event_test_single)
 RUN_TEST(async_wait_event_test_repeat)
@@ -499,6 +550,8 @@ END_TEST_CASE(port_tests)
 
 #ifndef BUILD_COMBINED_TESTS
 int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+        return port_run_benchmark();
     return unittest_run_all_tests(argc, argv) ? 0 : -1;
 }
 #endif
@@ -0,0 +1,172 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include <magenta/process.h>
+#include <magenta/syscalls.h>
+
+#include "bench.h"
+
+static const size_t kTotalBytes = 256u * 1024u * 1024u;
+
+typedef struct {
+    mx_handle_t socket;
+    size_t chunk;
+    bool use_vmo;
+} writer_args_t;
+
+static mx_time_t now(void) {
+    return mx_time_get(MX_CLOCK_MONOTONIC);
+}
+
+// Stands in for producing (or consuming) a chunk of data: touch one word per
+// page, so that pages moved out of the vmo get faulted back in.
+static void touch(volatile uint64_t* buf, size_t len) {
+    for (size_t off = 0; off < len; off += PAGE_SIZE)
+        buf[off / sizeof(uint64_t)] += 1u;
+}
+
+typedef struct {
+    void* buf;
+    mx_handle_t vmo;
+    uintptr_t mapping;
+} chunk_t;
+
+static bool chunk_init(chunk_t* c, size_t len, bool use_vmo) {
+    c->vmo = MX_HANDLE_INVALID;
+    c->buf = NULL;
+    if (!use_vmo) {
+        c->buf = malloc(len);
+        return c->buf != NULL;
+    }
+    if (mx_vmo_create(len, 0u, &c->vmo) != NO_ERROR)
+        return false;
+    if (mx_vmar_map(mx_vmar_root_self(), 0, c->vmo, 0, len,
+                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &c->mapping) != NO_ERROR) {
+        mx_handle_close(c->vmo);
+        return false;
+    }
+    c->buf = (void*)c->mapping;
+    return true;
+}
+
+static void chunk_destroy(chunk_t* c, size_t len) {
+    if (c->vmo == MX_HANDLE_INVALID) {
+        free(c->buf);
+        return;
+    }
+    mx_vmar_unmap(mx_vmar_root_self(), c->mapping, len);
+    mx_handle_close(c->vmo);
+}
+
+// Moves one chunk through |socket| in the given direction, waiting as needed.
+static mx_status_t transfer(mx_handle_t socket, chunk_t* c, size_t len, bool write) {
+    size_t done = 0u;
+    while (done < len) {
+        size_t actual;
+        mx_status_t status;
+        if (c->vmo != MX_HANDLE_INVALID) {
+            status = write ?
+                mx_socket_write_vmo(socket, 0u, c->vmo, done, len - done, &actual) :
+                mx_socket_read_vmo(socket, 0u, c->vmo, done, len - done, &actual);
+        } else {
+            status = write ?
+                mx_socket_write(socket, 0u, (char*)c->buf + done, len - done, &actual) :
+                mx_socket_read(socket, 0u, (char*)c->buf + done, len - done, &actual);
+        }
+        if (status == ERR_SHOULD_WAIT) {
+            mx_signals_t signal = write ? MX_SOCKET_WRITABLE : MX_SOCKET_READABLE;
+            status = mx_object_wait_one(socket, signal | MX_SOCKET_PEER_CLOSED,
+                                        MX_TIME_INFINITE, NULL);
+            if (status != NO_ERROR)
+                return status;
+            continue;
+        }
+        if (status != NO_ERROR)
+            return status;
+        done += actual;
+    }
+    return NO_ERROR;
+}
+
+static int writer_thread(void* arg) {
+    writer_args_t* args = arg;
+    chunk_t c;
+    if (!chunk_init(&c, args->chunk, args->use_vmo))
+        return -1;
+    int ret = 0;
+    for (size_t sent = 0u; sent < kTotalBytes; sent += args->chunk) {
+        touch(c.buf, args->chunk);
+        if (transfer(args->socket, &c, args->chunk, true) != NO_ERROR) {
+            ret = -1;
+            break;
+        }
+    }
+    chunk_destroy(&c, args->chunk);
+    return ret;
+}
+
+// A writer thread streams |kTotalBytes| to this thread, |chunk| bytes at a
+// time, either copied through mx_socket_write()/mx_socket_read() or moved
+// with the vmo variants; reports throughput.
+static void stream(size_t chunk, bool use_vmo) {
+    mx_handle_t h0, h1;
+    if (mx_socket_create(0u, &h0, &h1) != NO_ERROR) {
+        printf("\tfailed to create socket\n");
+        return;
+    }
+
+    chunk_t c;
+    if (!chunk_init(&c, chunk, use_vmo)) {
+        printf("\tfailed to allocate buffer\n");
+        goto close;
+    }
+
+    writer_args_t args = {h0, chunk, use_vmo};
+    thrd_t writer;
+    mx_time_t t = now();
+    if (thrd_create(&writer, writer_thread, &args) != thrd_success) {
+        printf("\tfailed to create writer thread\n");
+        chunk_destroy(&c, chunk);
+        goto close;
+    }
+
+    size_t received = 0u;
+    for (; received < kTotalBytes; received += chunk) {
+        mx_status_t status = transfer(h1, &c, chunk, false);
+        if (status != NO_ERROR) {
+            printf("\tsocket read failed: %d\n", status);
+            break;
+        }
+        touch(c.buf, chunk);
+    }
+    t = now() - t;
+    thrd_join(writer, NULL);
+    chunk_destroy(&c, chunk);
+
+    printf("\t%-6s chunk %4zuKB: %" PRIu64 " MB/sec\n", use_vmo ? "vmo" : "copy",
+           chunk / 1024u, (uint64_t)(received * 1000000000ull / t / (1024u * 1024u)));
+
+close:
+    mx_handle_close(h0);
+    mx_handle_close(h1);
+}
+
+int socket_run_benchmark(void) {
+    printf("starting socket benchmark\n");
+
+    for (size_t chunk = 4096u; chunk <= 128u * 1024u; chunk *= 4u) {
+        stream(chunk, false);
+        stream(chunk, true);
+    }
+
+    printf("done with benchmark\n");
+    return 0;
+}
@@ -11,6 +11,7 @@ MODULE_TYPE := usertest
 MODULE_USERTEST_GROUP := core
 
 MODULE_SRCS += \
+    $(LOCAL_DIR)/bench.c \
     $(LOCAL_DIR)/socket.c \
 
 MODULE_NAME := socket-test
@@ -3,13 +3,17 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <limits.h>
 #include <magenta/syscalls.h>
 #include <unittest/unittest.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "bench.h"
+
 static mx_signals_t get_satisfied_signals(mx_handle_t handle) {
     mx_signals_t pending = 0;
     mx_object_wait_one(handle, 0u, 0u, &pending);
@@ -332,6 +336,85 @@ static bool socket_short_write(void) {
     END_TEST;
 }
 
+static bool fill_vmo(mx_handle_t vmo, size_t size, uint8_t seed) {
+    uint8_t* buf = malloc(size);
+    if (!buf)
+        return false;
+    for (size_t i = 0; i < size; i++)
+        buf[i] = (uint8_t)(seed + i * 7);
+    size_t actual;
+    mx_status_t status = mx_vmo_write(vmo, buf, 0, size, &actual);
+    free(buf);
+    return status == NO_ERROR && actual == size;
+}
+
+static bool check_bytes(const uint8_t* buf, size_t size, uint8_t seed) {
+    for (size_t i = 0; i < size; i++) {
+        if (buf[i] != (uint8_t)(seed + i * 7))
+            return false;
+    }
+    return true;
+}
+
+static bool socket_vmo(void) {
+    BEGIN_TEST;
+
+    const size_t kSize = 8 * PAGE_SIZE;
+    mx_handle_t h0, h1, src, dst;
+    size_t count;
+    ASSERT_EQ(mx_socket_create(0, &h0, &h1), NO_ERROR, "");
+    ASSERT_EQ(mx_vmo_create(kSize, 0, &src), NO_ERROR, "");
+    ASSERT_EQ(mx_vmo_create(kSize, 0, &dst), NO_ERROR, "");
+    uint8_t* buf = malloc(kSize);
+    ASSERT_NONNULL(buf, "");
+
+    EXPECT_EQ(mx_socket_write_vmo(h0, 0u, src, PAGE_SIZE, kSize, &count), ERR_OUT_OF_RANGE, "");
+    EXPECT_EQ(mx_socket_read_vmo(h1, 0u, dst, 0u, kSize, &count), ERR_SHOULD_WAIT, "");
+
+    // page aligned: the pages move, leaving the source range decommitted
+    ASSERT_TRUE(fill_vmo(src, kSize, 1u), "");
+    ASSERT_EQ(mx_socket_write_vmo(h0, 0u, src, 0u, kSize, &count), NO_ERROR, "");
+    ASSERT_EQ(count, kSize, "");
+    EXPECT_EQ(get_satisfied_signals(h1),
+              MX_SOCKET_READABLE | MX_SOCKET_WRITABLE | MX_SIGNAL_LAST_HANDLE, "");
+    ASSERT_EQ(mx_vmo_read(src, buf, 0u, kSize, &count), NO_ERROR, "");
+    for (size_t i = 0; i < kSize; i++) {
+        ASSERT_EQ(buf[i], 0u, "");
+    }
+
+    ASSERT_EQ(mx_socket_read_vmo(h1, 0u, dst, 0u, kSize, &count), NO_ERROR, "");
+    ASSERT_EQ(count, kSize, "");
+    ASSERT_EQ(mx_vmo_read(dst, buf, 0u, kSize, &count), NO_ERROR, "");
+    EXPECT_TRUE(check_bytes(buf, kSize, 1u), "");
+    EXPECT_EQ(get_satisfied_signals(h1), MX_SOCKET_WRITABLE | MX_SIGNAL_LAST_HANDLE, "");
+
+    // mixed with an unaligned byte write: copied, in order, source untouched
+    ASSERT_EQ(mx_socket_write(h0, 0u, "abc", 3u, &count), NO_ERROR, "");
+    ASSERT_TRUE(fill_vmo(src, kSize, 2u), "");
+    ASSERT_EQ(mx_socket_write_vmo(h0, 0u, src, 0u, 2 * PAGE_SIZE, &count), NO_ERROR, "");
+    ASSERT_EQ(count, 2 * PAGE_SIZE, "");
+    ASSERT_EQ(mx_vmo_read(src, buf, 0u, 2 * PAGE_SIZE, &count), NO_ERROR, "");
+    EXPECT_TRUE(check_bytes(buf, 2 * PAGE_SIZE, 2u), "");
+
+    ASSERT_EQ(mx_socket_read(h1, 0u, buf, 3u, &count), NO_ERROR, "");
+    ASSERT_EQ(count, 3u, "");
+    EXPECT_EQ(memcmp(buf, "abc", 3), 0, "");
+    ASSERT_EQ(mx_socket_read_vmo(h1, 0u, dst, 0u, kSize, &count), NO_ERROR, "");
+    ASSERT_EQ(count, 2 * PAGE_SIZE, "");
+    ASSERT_EQ(mx_vmo_read(dst, buf, 0u, 2 * PAGE_SIZE, &count), NO_ERROR, "");
+    EXPECT_TRUE(check_bytes(buf, 2 * PAGE_SIZE, 2u), "");
+
+    mx_handle_close(h1);
+    EXPECT_EQ(mx_socket_write_vmo(h0, 0u, src, 0u, kSize, &count), ERR_PEER_CLOSED, "");
+
+    free(buf);
+    mx_handle_close(src);
+    mx_handle_close(dst);
+    mx_handle_close(h0);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(socket_tests)
 RUN_TEST(socket_basic)
 RUN_TEST(socket_signals)
@@ -339,10 +422,13 @@ RUN_TEST(socket_half_close)
 RUN_TEST(socket_bytes_outstanding)
 RUN_TEST(socket_bytes_outstanding_half_close)
 RUN_TEST(socket_short_write)
+RUN_TEST(socket_vmo)
 END_TEST_CASE(socket_tests)
 
 #ifndef BUILD_COMBINED_TESTS
 int main(int argc, char** argv) {
+    if (argc > 1 && !strcmp(argv[1], "bench"))
+        return socket_run_benchmark();
     return unittest_run_all_tests(argc, argv) ? 0 : -1;
 }
 #endif
@@ -4,8 +4,10 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stdalign.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include <magenta/process.h>
@@ -1593,6 +1595,154 @@ bool protect_over_demand_paged_test() {
     END_TEST;
 }
 
+// Fill a region with an increasing number of small mappings and report how
+// long each placement takes.  Finding a gap should take logarithmic time in
+// the number of mappings, so the cost per map should stay roughly flat as the
+// region fills up, including once it is fragmented with holes too small for
+// the mappings being placed.
+bool allocation_scaling_test() {
+    BEGIN_TEST;
+
+    mx_handle_t process;
+    mx_handle_t vmar;
+    mx_handle_t vmo;
+    mx_handle_t region;
+    uintptr_t region_addr;
+
+    ASSERT_EQ(mx_process_create(mx_job_default(), kProcessName, sizeof(kProcessName) - 1,
+                                0, &process, &vmar), NO_ERROR, "");
+
+    const size_t kMaxMappings = 16384;
+    const size_t map_size = 2 * PAGE_SIZE;
+    const size_t region_size = kMaxMappings * 2 * map_size;
+
+    ASSERT_EQ(mx_vmo_create(map_size, 0, &vmo), NO_ERROR, "");
+    ASSERT_EQ(mx_vmar_allocate(vmar, 0, region_size, MX_VM_FLAG_CAN_MAP_READ,
+                               &region, &region_addr),
+              NO_ERROR, "");
+
+    uintptr_t* addrs = static_cast<uintptr_t*>(malloc(kMaxMappings * sizeof(uintptr_t)));
+    ASSERT_NONNULL(addrs, "");
+
+    size_t mapped = 0;
+    for (size_t target = 1024; target <= kMaxMappings; target *= 2) {
+        const size_t count = target - mapped;
+        mx_time_t t = mx_time_get(MX_CLOCK_MONOTONIC);
+        for (; mapped < target; ++mapped) {
+            ASSERT_EQ(mx_vmar_map(region, 0, vmo, 0, map_size, MX_VM_FLAG_PERM_READ,
+                                  &addrs[mapped]),
+                      NO_ERROR, "");
+        }
+        t = mx_time_get(MX_CLOCK_MONOTONIC) - t;
+        unittest_printf("%zu mappings: %" PRIu64 " ns per map\n", target, t / count);
+    }
+
+    for (size_t i = 0; i < mapped; ++i) {
+        EXPECT_GE(addrs[i], region_addr, "");
+        EXPECT_LE(addrs[i] + map_size, region_addr + region_size, "");
+    }
+
+    // Punch a one page hole at the start of every mapping, then place more
+    // mappings, none of which fit in those holes.
+    for (size_t i = 0; i < mapped; ++i) {
+        ASSERT_EQ(mx_vmar_unmap(region, addrs[i], PAGE_SIZE), NO_ERROR, "");
+    }
+    const size_t extra = 1024;
+    mx_time_t t = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (size_t i = 0; i < extra; ++i) {
+        uintptr_t addr;
+        ASSERT_EQ(mx_vmar_map(region, 0, vmo, 0, map_size, MX_VM_FLAG_PERM_READ, &addr),
+                  NO_ERROR, "");
+    }
+    t = mx_time_get(MX_CLOCK_MONOTONIC) - t;
+    unittest_printf("%zu fragmented mappings: %" PRIu64 " ns per map\n", mapped, t / extra);
+
+    free(addrs);
+    EXPECT_EQ(mx_vmar_destroy(region), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(region), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmar), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(process), NO_ERROR, "");
+
+    END_TEST;
+}
+
+// Fragments a region into single page gaps around a few larger ones, and checks
+// that allocations which only fit a larger gap land in it.  This exercises the
+// subtree gap summary the kernel uses to find space, including its updates on
+// map and unmap, at the start, middle and end of the region.
+bool gap_allocation_test() {
+    BEGIN_TEST;
+
+    mx_handle_t process;
+    mx_handle_t vmar;
+    mx_handle_t vmo;
+    mx_handle_t region;
+    uintptr_t region_addr;
+
+    ASSERT_EQ(mx_process_create(mx_job_default(), kProcessName, sizeof(kProcessName) - 1,
+                                0, &process, &vmar), NO_ERROR, "");
+
+    const size_t kPages = 512;
+    // The only free range longer than a page, once the region is fragmented.
+    const size_t kGapPage = 101;
+    const size_t kGapPages = 5;
+
+    ASSERT_EQ(mx_vmo_create(kGapPages * PAGE_SIZE, 0, &vmo), NO_ERROR, "");
+    ASSERT_EQ(mx_vmar_allocate(vmar, 0, kPages * PAGE_SIZE,
+                               MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_SPECIFIC,
+                               &region, &region_addr),
+              NO_ERROR, "");
+
+    // Map every even page, except in [kGapPage, kGapPage + kGapPages).
+    for (size_t page = 0; page < kPages; page += 2) {
+        if (page >= kGapPage && page < kGapPage + kGapPages)
+            continue;
+        uintptr_t addr;
+        ASSERT_EQ(mx_vmar_map(region, page * PAGE_SIZE, vmo, 0, PAGE_SIZE,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_SPECIFIC, &addr),
+                  NO_ERROR, "");
+    }
+
+    uintptr_t addr;
+    EXPECT_EQ(mx_vmar_map(region, 0, vmo, 0, kGapPages * PAGE_SIZE, MX_VM_FLAG_PERM_READ,
+                          &addr),
+              NO_ERROR, "");
+    EXPECT_EQ(addr, region_addr + kGapPage * PAGE_SIZE, "");
+    EXPECT_EQ(mx_vmar_map(region, 0, vmo, 0, 2 * PAGE_SIZE, MX_VM_FLAG_PERM_READ, &addr),
+              ERR_NO_MEMORY, "");
+
+    // Unmapping a page merges it with the free pages on either side.  Open
+    // gaps in the middle, at the start and at the end of the region.
+    struct {
+        size_t unmap_page;
+        size_t gap_page;
+        size_t gap_pages;
+    } holes[] = {
+        {300, 299, 3},
+        {0, 0, 2},
+        {kPages - 2, kPages - 3, 3},
+    };
+    for (const auto& hole : holes) {
+        ASSERT_EQ(mx_vmar_unmap(region, region_addr + hole.unmap_page * PAGE_SIZE, PAGE_SIZE),
+                  NO_ERROR, "");
+        EXPECT_EQ(mx_vmar_map(region, 0, vmo, 0, hole.gap_pages * PAGE_SIZE,
+                              MX_VM_FLAG_PERM_READ, &addr),
+                  NO_ERROR, "");
+        EXPECT_EQ(addr, region_addr + hole.gap_page * PAGE_SIZE, "");
+        EXPECT_EQ(mx_vmar_map(region, 0, vmo, 0, 2 * PAGE_SIZE, MX_VM_FLAG_PERM_READ, &addr),
+                  ERR_NO_MEMORY, "");
+    }
+
+    EXPECT_EQ(mx_vmar_destroy(region), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(region), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmo), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(vmar), NO_ERROR, "");
+    EXPECT_EQ(mx_handle_close(process), NO_ERROR, "");
+
+    END_TEST;
+}
+
 }
 
 BEGIN_TEST_CASE(vmar_tests)
@@ -1616,6 +1766,8 @@ RUN_TEST(map_specific_overwrite_test);
 RUN_TEST(protect_split_test);
 RUN_TEST(protect_multiple_test);
 RUN_TEST(protect_over_demand_paged_test);
+RUN_TEST(allocation_scaling_test);
+RUN_TEST(gap_allocation_test);
 END_TEST_CASE(vmar_tests)
 
 #ifndef BUILD_COMBINED_TESTS
@@ -3,6 +3,7 @@
 // found in the LICENSE file.
 
 #include <math.h>
+#include <mxtl/algorithm.h>
 #include <mxtl/intrusive_wavl_tree.h>
 #include <mxtl/tests/intrusive_containers/intrusive_wavl_tree_checker.h>
 #include <mxtl/tests/intrusive_containers/ordered_associative_container_test_environment.h>
@@ -138,6 +139,16 @@ public:
     static void RecordEraseRotation()           { ++op_counts_.erase_rotations_; }
     static void RecordEraseDoubleRotation()     { ++op_counts_.erase_double_rotations_; }
 
+    template <typename TreeType>
+    static void AugmentInsert(typename TreeType::RawPtrType node) { }
+
+    template <typename TreeType>
+    static void AugmentErase(typename TreeType::RawPtrType parent) { }
+
+    template <typename TreeType>
+    static void AugmentRotate(typename TreeType::RawPtrType old_top,
+                              typename TreeType::RawPtrType new_top) { }
+
     template <typename TreeType>
     static bool VerifyRankRule(const TreeType& tree, typename TreeType::RawPtrType node) {
         BEGIN_TEST;
@@ -421,6 +432,278 @@ static bool WAVLBalanceTest() {
     END_TEST;
 }
 
+// Objects for the augmentation test.  Each one covers the range of addresses
+// [base, base + size) and keeps a summary of its subtree, maintained through
+// the observer's Augment hooks the same way the kernel's VMAR subregion tree
+// does: the lowest base, the highest last address and the largest gap between
+// two address-adjacent ranges in the subtree.  As with the balance test, the
+// objects are allocated as a block and the tree holds unique pointers with a
+// no-op delete.
+class GapTestObj;
+
+using GapTestObjPtr = unique_ptr<GapTestObj>;
+using GapTestTraits = DefaultWAVLTreeTraits<GapTestObjPtr, bool>;
+using GapTestPtrTraits = ::mxtl::internal::ContainerPtrTraits<GapTestObjPtr>;
+
+class GapTestObj {
+public:
+    void Init(uint64_t base, uint64_t size) {
+        base_ = base;
+        size_ = size;
+    }
+
+    uint64_t GetKey() const { return base_; }
+    uint64_t base() const { return base_; }
+    uint64_t last() const { return base_ + size_ - 1; }
+
+    bool InContainer() const { return wavl_node_state_.InContainer(); }
+
+    uint64_t subtree_min_base_ = 0;
+    uint64_t subtree_max_last_ = 0;
+    uint64_t subtree_max_gap_ = 0;
+
+private:
+    friend GapTestTraits;
+
+    static void operator delete(void* ptr) {
+        // Deliberate no-op
+    }
+    friend class mxtl::unique_ptr<GapTestObj[]>;
+    friend class mxtl::unique_ptr<GapTestObj>;
+
+    uint64_t base_ = 0;
+    uint64_t size_ = 1;
+    WAVLTreeNodeState<GapTestObjPtr, bool> wavl_node_state_;
+};
+
+struct GapTestObserver : public DefaultWAVLTreeObserver {
+    static void UpdateSubtree(GapTestObj* node) {
+        const auto& ns = GapTestTraits::node_state(*node);
+
+        node->subtree_min_base_ = node->base();
+        node->subtree_max_last_ = node->last();
+        node->subtree_max_gap_ = 0;
+
+        if (GapTestPtrTraits::IsValid(ns.left_)) {
+            const GapTestObj* left = ns.left_.get();
+            node->subtree_min_base_ = left->subtree_min_base_;
+            node->subtree_max_gap_ = mxtl::max(left->subtree_max_gap_,
+                                               node->base() - left->subtree_max_last_ - 1);
+        }
+        if (GapTestPtrTraits::IsValid(ns.right_)) {
+            const GapTestObj* right = ns.right_.get();
+            node->subtree_max_last_ = right->subtree_max_last_;
+            node->subtree_max_gap_ = mxtl::max(node->subtree_max_gap_,
+                                               mxtl::max(right->subtree_max_gap_,
+                                                         right->subtree_min_base_ - node->last() - 1));
+        }
+    }
+
+    static void PropagateSubtree(GapTestObj* node) {
+        while (GapTestPtrTraits::IsValid(node)) {
+            UpdateSubtree(node);
+            node = GapTestTraits::node_state(*node).parent_;
+        }
+    }
+
+    template <typename TreeType>
+    static void AugmentInsert(GapTestObj* node) { PropagateSubtree(node); }
+
+    template <typename TreeType>
+    static void AugmentErase(GapTestObj* parent) { PropagateSubtree(parent); }
+
+    template <typename TreeType>
+    static void AugmentRotate(GapTestObj* old_top, GapTestObj* new_top) {
+        UpdateSubtree(old_top);
+        UpdateSubtree(new_top);
+    }
+};
+
+using GapTestTree = WAVLTree<uint64_t,
+                             GapTestObjPtr,
+                             DefaultKeyedObjectTraits<uint64_t, GapTestObj>,
+                             GapTestTraits,
+                             GapTestObserver>;
+
+// The ranges live in [0, kGapTestSlots * kGapTestSlotSize), at most one per
+// slot, so they never overlap.  The gap in front of the first range is
+// measured from address 0.
+static constexpr size_t kGapTestSlots = 512;
+static constexpr uint64_t kGapTestSlotSize = 64;
+static constexpr size_t kGapTestOps = 4096;
+
+// Recompute the summary of the subtree at |node| from scratch and check it
+// against the one the observer maintained.
+static bool CheckGapSubtree(const GapTestObj* node, uint64_t* min_base, uint64_t* max_last,
+                            uint64_t* max_gap) {
+    BEGIN_TEST;
+
+    const auto& ns = GapTestTraits::node_state(*const_cast<GapTestObj*>(node));
+    uint64_t lo = node->base();
+    uint64_t hi = node->last();
+    uint64_t gap = 0;
+
+    if (GapTestPtrTraits::IsValid(ns.left_)) {
+        uint64_t l_min, l_max, l_gap;
+        ASSERT_TRUE(CheckGapSubtree(ns.left_.get(), &l_min, &l_max, &l_gap), "");
+        lo = l_min;
+        gap = mxtl::max(l_gap, node->base() - l_max - 1);
+    }
+    if (GapTestPtrTraits::IsValid(ns.right_)) {
+        uint64_t r_min, r_max, r_gap;
+        ASSERT_TRUE(CheckGapSubtree(ns.right_.get(), &r_min, &r_max, &r_gap), "");
+        hi = r_max;
+        gap = mxtl::max(gap, mxtl::max(r_gap, r_min - node->last() - 1));
+    }
+
+    ASSERT_EQ(lo, node->subtree_min_base_, "stale subtree min base");
+    ASSERT_EQ(hi, node->subtree_max_last_, "stale subtree max last");
+    ASSERT_EQ(gap, node->subtree_max_gap_, "stale subtree max gap");
+
+    *min_base = lo;
+    *max_last = hi;
+    *max_gap = gap;
+    END_TEST;
+}
+
+static bool CheckGapTree(GapTestTree& tree) {
+    BEGIN_TEST;
+
+    if (tree.is_empty())
+        return true;
+
+    // The root is the ancestor of every node, so climb to it from any one.
+    GapTestObj* root = &(*tree.begin());
+    while (GapTestPtrTraits::IsValid(GapTestTraits::node_state(*root).parent_))
+        root = GapTestTraits::node_state(*root).parent_;
+
+    uint64_t min_base, max_last, max_gap;
+    ASSERT_TRUE(CheckGapSubtree(root, &min_base, &max_last, &max_gap), "");
+    EXPECT_EQ(tree.begin()->base(), min_base, "");
+    EXPECT_EQ((--tree.end())->last(), max_last, "");
+
+    END_TEST;
+}
+
+// Find the first range with base >= |from| whose gap to the previous range is
+// at least |size|, using the subtree summaries the same way the VMAR allocator
+// does.  Returns nullptr if there is none.
+static GapTestObj* FindGap(GapTestTree& tree, uint64_t from, uint64_t size) {
+    auto gap_fits = [size](uint64_t prev_last, uint64_t base) -> bool {
+        return base - prev_last - 1 >= size;
+    };
+    auto subtree_fits = [&gap_fits, size](const GapTestObj* node, uint64_t prev_last) -> bool {
+        return node->subtree_max_gap_ >= size || gap_fits(prev_last, node->subtree_min_base_);
+    };
+    auto descend = [&gap_fits, &subtree_fits](GapTestObj* node,
+                                              uint64_t prev_last) -> GapTestObj* {
+        while (GapTestPtrTraits::IsValid(node)) {
+            const auto& ns = GapTestTraits::node_state(*node);
+            if (GapTestPtrTraits::IsValid(ns.left_)) {
+                if (subtree_fits(ns.left_.get(), prev_last)) {
+                    node = ns.left_.get();
+                    continue;
+                }
+                prev_last = ns.left_->subtree_max_last_;
+            }
+            if (gap_fits(prev_last, node->base()))
+                return node;
+            prev_last = node->last();
+            node = GapTestPtrTraits::IsValid(ns.right_) ? ns.right_.get() : nullptr;
+        }
+        return nullptr;
+    };
+
+    auto itr = tree.lower_bound(from);
+    if (!itr.IsValid())
+        return nullptr;
+    {
+        auto prev = itr;
+        --prev;
+        const uint64_t prev_last = prev.IsValid() ? prev->last() : static_cast<uint64_t>(-1);
+        if (gap_fits(prev_last, itr->base()))
+            return &(*itr);
+    }
+
+    GapTestObj* node = &(*itr);
+    while (true) {
+        const auto& ns = GapTestTraits::node_state(*node);
+        if (GapTestPtrTraits::IsValid(ns.right_) && subtree_fits(ns.right_.get(), node->last()))
+            return descend(ns.right_.get(), node->last());
+
+        GapTestObj* child;
+        do {
+            child = node;
+            node = GapTestTraits::node_state(*child).parent_;
+            if (!GapTestPtrTraits::IsValid(node))
+                return nullptr;
+        } while (GapTestTraits::node_state(*node).left_.get() != child);
+
+        if (gap_fits(child->subtree_max_last_, node->base()))
+            return node;
+    }
+}
+
+// The same search as a linear scan over the ranges in address order.
+static GapTestObj* FindGapBruteForce(GapTestTree& tree, uint64_t from, uint64_t size) {
+    uint64_t prev_last = static_cast<uint64_t>(-1);
+    for (auto& obj : tree) {
+        if (obj.base() >= from && obj.base() - prev_last - 1 >= size)
+            return &obj;
+        prev_last = obj.last();
+    }
+    return nullptr;
+}
+
+static bool WAVLAugmentedGapTest() {
+    BEGIN_TEST;
+
+    // As in the balance test, the objects are declared before the tree so the
+    // tree is cleaned up first.
+    unique_ptr<GapTestObj[]> objects;
+    GapTestTree tree;
+
+    {
+        AllocChecker ac;
+        objects.reset(new (&ac) GapTestObj[kGapTestSlots]);
+        ASSERT_TRUE(ac.check(), "Failed to allocate test objects!");
+    }
+
+    Lfsr<uint64_t> rng(0x6a1c3f0e9d2b4857u);
+    for (size_t op = 0; op < kGapTestOps; ++op) {
+        // Toggle a random slot, giving it a new random range on the way in.
+        // Erases go by key or by object to cover both paths.
+        size_t slot = static_cast<size_t>(rng.GetNext() % kGapTestSlots);
+        GapTestObj& obj = objects[slot];
+        if (obj.InContainer()) {
+            GapTestObjPtr erased = (op & 1) ? tree.erase(obj.GetKey()) : tree.erase(obj);
+            ASSERT_EQ(&obj, erased.get(), "");
+        } else {
+            uint64_t size = 1 + rng.GetNext() % kGapTestSlotSize;
+            uint64_t offset = rng.GetNext() % (kGapTestSlotSize - size + 1);
+            obj.Init(slot * kGapTestSlotSize + offset, size);
+            ASSERT_TRUE(tree.insert_or_find(GapTestObjPtr(&obj)), "");
+        }
+
+        ASSERT_TRUE(CheckGapTree(tree), "");
+
+        // Compare the search with a scan for a few random queries.
+        for (size_t q = 0; q < 4; ++q) {
+            uint64_t from = rng.GetNext() % (kGapTestSlots * kGapTestSlotSize);
+            uint64_t size = 1 + rng.GetNext() % (4 * kGapTestSlotSize);
+            ASSERT_EQ(FindGapBruteForce(tree, from, size), FindGap(tree, from, size), "");
+        }
+    }
+
+    // Drain the tree in address order, checking as it shrinks.
+    while (!tree.is_empty()) {
+        tree.pop_front();
+        ASSERT_TRUE(CheckGapTree(tree), "");
+    }
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(wavl_tree_tests)
 //////////////////////////////////////////
 // General container specific tests.
@@ -540,6 +823,7 @@ RUN_NAMED_TEST("LowerBound (RefPtr)",            RPTE::LowerBoundTest)
 // WAVLTree specific tests.
 ////////////////////////////
 RUN_NAMED_TEST("BalanceTest", WAVLBalanceTest)
+RUN_NAMED_TEST("AugmentedGapTest", WAVLAugmentedGapTest)
 
 END_TEST_CASE(wavl_tree_tests);
 
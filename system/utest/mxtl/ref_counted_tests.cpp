@@ -56,6 +56,38 @@ static bool ref_counted_test() {
     END_TEST;
 }
 
+// Checks the count from its own destructor, which is where a weak lookup
+// could race with the last reference going away.
+class WeakTracker : public mxtl::RefCounted<WeakTracker> {
+public:
+    explicit WeakTracker(bool* added_in_destructor)
+        : added_in_destructor_(added_in_destructor) {}
+    ~WeakTracker() { *added_in_destructor_ = AddRefMaybeInDestructor(); }
+
+private:
+    bool* added_in_destructor_;
+};
+
+static bool add_ref_maybe_in_destructor_test() {
+    BEGIN_TEST;
+
+    bool added_in_destructor = true;
+    {
+        AllocChecker ac;
+        mxtl::RefPtr<WeakTracker> ptr =
+            mxtl::AdoptRef(new (&ac) WeakTracker(&added_in_destructor));
+        EXPECT_TRUE(ac.check(), "");
+
+        // While alive, a reference can be added and must be dropped again.
+        WeakTracker* raw = ptr.get();
+        EXPECT_TRUE(raw->AddRefMaybeInDestructor(), "should add a ref while alive");
+        EXPECT_FALSE(raw->Release(), "should not be the last ref");
+    }
+    EXPECT_FALSE(added_in_destructor, "should not add a ref once the count hit zero");
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(ref_counted_tests)
 RUN_NAMED_TEST("Ref Counted", ref_counted_test)
+RUN_NAMED_TEST("AddRefMaybeInDestructor", add_ref_maybe_in_destructor_test)
 END_TEST_CASE(ref_counted_tests);
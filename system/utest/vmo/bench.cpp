@@ -7,11 +7,14 @@
 #include <inttypes.h>
 #include <sys/types.h>
 #include <stdlib.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <magenta/compiler.h>
 #include <magenta/process.h>
 #include <magenta/syscalls.h>
+#include <magenta/syscalls/object.h>
+#include <mxtl/atomic.h>
 
 #include "bench.h"
 
@@ -32,6 +35,99 @@ inline mx_time_t time_it(T func) {
     return mx_time_get(MX_CLOCK_MONOTONIC) - t;
 }
 
+static uint64_t page_fault_count() {
+    mx_info_task_stats_t info;
+    if (mx_object_get_info(mx_process_self(), MX_INFO_TASK_STATS,
+                           &info, sizeof(info), nullptr, nullptr) != NO_ERROR)
+        return 0;
+    return info.page_faults;
+}
+
+// map |vmo| with |map_flags|, touch every page of it in order and report the
+// number of page faults taken per MB
+static void fault_scan(const char* what, mx_handle_t vmo, size_t size, uint32_t map_flags,
+                       bool write) {
+    uintptr_t ptr;
+    if (mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size, map_flags, &ptr) != NO_ERROR) {
+        printf("\tfailed to map vmo for %s\n", what);
+        return;
+    }
+
+    uint64_t faults = page_fault_count();
+    mx_time_t t = time_it([&](){
+        for (size_t i = 0; i < size; i += PAGE_SIZE) {
+            if (write) {
+                ((volatile char *)ptr)[i] = 99;
+            } else {
+                __UNUSED char a = ((volatile char *)ptr)[i];
+            }
+        }
+    });
+    faults = page_fault_count() - faults;
+
+    printf("\t%" PRIu64 " traps per MB, took %" PRIu64 " nsecs to %s\n",
+           faults * (1024 * 1024) / size, t, what);
+
+    mx_vmar_unmap(mx_vmar_root_self(), ptr, size);
+}
+
+struct FaultThreadArgs {
+    mxtl::atomic<int>* go;
+    uintptr_t ptr;
+    size_t size;
+};
+
+static int fault_thread(void* arg) {
+    auto args = static_cast<FaultThreadArgs*>(arg);
+    while (!args->go->load())
+        ;
+    for (size_t i = 0; i < args->size; i += PAGE_SIZE) {
+        ((volatile char *)args->ptr)[i] = 99;
+    }
+    return 0;
+}
+
+static const size_t kMaxFaultThreads = 8;
+
+// write fault in a separate fresh vmo on each of |num_threads| threads at
+// once and report the wall time per fault.  Faults on disjoint mappings don't
+// serialize on the address space, so this should scale with the cpu count.
+static void concurrent_fault(size_t num_threads, size_t size_per_thread) {
+    mxtl::atomic<int> go(0);
+    FaultThreadArgs args[kMaxFaultThreads];
+    thrd_t threads[kMaxFaultThreads];
+    mx_handle_t vmos[kMaxFaultThreads];
+
+    for (size_t i = 0; i < num_threads; i++) {
+        mx_vmo_create(size_per_thread, 0, &vmos[i]);
+        args[i].go = &go;
+        args[i].size = size_per_thread;
+        mx_vmar_map(mx_vmar_root_self(), 0, vmos[i], 0, size_per_thread,
+                    MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &args[i].ptr);
+    }
+
+    size_t started = 0;
+    mx_time_t t = time_it([&](){
+        for (; started < num_threads; started++) {
+            if (thrd_create(&threads[started], fault_thread, &args[started]) != thrd_success)
+                break;
+        }
+        go.store(1);
+        for (size_t i = 0; i < started; i++) {
+            thrd_join(threads[i], nullptr);
+        }
+    });
+
+    size_t faults = started * (size_per_thread / PAGE_SIZE);
+    printf("\t%zu threads: took %" PRIu64 " nsecs to write fault %zu pages, %" PRIu64
+           " nsecs per fault\n", started, t, faults, faults ? t / faults : 0);
+
+    for (size_t i = 0; i < num_threads; i++) {
+        mx_vmar_unmap(mx_vmar_root_self(), args[i].ptr, size_per_thread);
+        mx_handle_close(vmos[i]);
+    }
+}
+
 int vmo_run_benchmark() {
     mx_time_t t;
     //mx_handle_t vmo;
@@ -142,6 +238,72 @@ int vmo_run_benchmark() {
 
     mx_handle_close(vmo);
 
+    // count the traps taken by sequential scans; without fault-around or
+    // prefaulting every page costs one trap, which is 256 traps per MB
+    printf("\ttraps per MB without fault-around would be %zu\n", (size_t)(1024 * 1024 / PAGE_SIZE));
+
+    mx_vmo_create(size, 0, &vmo);
+    mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, size, nullptr, 0);
+
+    fault_scan("read scan committed vmo (fault-around)", vmo, size,
+               MX_VM_FLAG_PERM_READ, false);
+    fault_scan("read scan committed vmo with sequential prefault", vmo, size,
+               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PREFAULT_SEQUENTIAL, false);
+    fault_scan("write scan committed vmo (fault-around)", vmo, size,
+               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, true);
+
+    mx_handle_close(vmo);
+
+    mx_vmo_create(size, 0, &vmo);
+    fault_scan("write scan fresh vmo", vmo, size,
+               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, true);
+    mx_handle_close(vmo);
+
+    mx_vmo_create(size, 0, &vmo);
+    fault_scan("write scan fresh vmo with sequential prefault", vmo, size,
+               MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | MX_VM_FLAG_PREFAULT_SEQUENTIAL, true);
+    mx_handle_close(vmo);
+
+    // repeatedly change the protection of and unmap small mapped ranges, each
+    // of which needs a tlb shootdown
+    const size_t small_size = 16 * PAGE_SIZE;
+    const int iterations = 1000;
+    mx_vmo_create(small_size, 0, &vmo);
+    mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, small_size,
+                MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &ptr);
+    for (size_t i = 0; i < small_size; i += PAGE_SIZE) {
+        ((volatile char *)ptr)[i] = 99;
+    }
+
+    t = time_it([&](){
+        for (int i = 0; i < iterations; i++) {
+            mx_vmar_protect(mx_vmar_root_self(), ptr, small_size, MX_VM_FLAG_PERM_READ);
+            mx_vmar_protect(mx_vmar_root_self(), ptr, small_size,
+                            MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE);
+        }
+    });
+    printf("\ttook %" PRIu64 " nsecs per protect of a %zu page mapping\n",
+           t / (2 * iterations), small_size / PAGE_SIZE);
+
+    mx_vmar_unmap(mx_vmar_root_self(), ptr, small_size);
+
+    t = time_it([&](){
+        for (int i = 0; i < iterations; i++) {
+            mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, small_size,
+                        MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | MX_VM_FLAG_MAP_RANGE, &ptr);
+            mx_vmar_unmap(mx_vmar_root_self(), ptr, small_size);
+        }
+    });
+    printf("\ttook %" PRIu64 " nsecs per map and unmap of a %zu page mapping\n",
+           t / iterations, small_size / PAGE_SIZE);
+
+    mx_handle_close(vmo);
+
+    // fault in disjoint mappings from an increasing number of threads
+    for (size_t num_threads = 1; num_threads <= kMaxFaultThreads; num_threads *= 2) {
+        concurrent_fault(num_threads, 8 * 1024 * 1024);
+    }
+
     // create a vmo and commit and decommit it directly
     mx_vmo_create(size, 0, &vmo);
 
@@ -866,6 +866,131 @@ bool vmo_clone_test_4() {
     END_TEST;
 }
 
+static uint64_t page_fault_count() {
+    mx_info_task_stats_t info;
+    if (mx_object_get_info(mx_process_self(), MX_INFO_TASK_STATS,
+                           &info, sizeof(info), nullptr, nullptr) != NO_ERROR)
+        return 0;
+    return info.page_faults;
+}
+
+bool vmo_prefault_sequential_test() {
+    BEGIN_TEST;
+
+    const size_t size = 256 * PAGE_SIZE;
+    mx_handle_t vmo;
+    EXPECT_EQ(NO_ERROR, mx_vmo_create(size, 0, &vmo), "vm_object_create");
+
+    // the flag only makes sense on mappings
+    mx_handle_t sub_vmar;
+    uintptr_t sub_addr;
+    EXPECT_EQ(ERR_INVALID_ARGS,
+              mx_vmar_allocate(mx_vmar_root_self(), 0, size,
+                               MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_PREFAULT_SEQUENTIAL,
+                               &sub_vmar, &sub_addr),
+              "allocate with prefault flag");
+
+    uintptr_t ptr;
+    EXPECT_EQ(NO_ERROR,
+              mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE |
+                          MX_VM_FLAG_PREFAULT_SEQUENTIAL, &ptr),
+              "map with prefault flag");
+
+    // write a forward scan through the mapping
+    volatile uint32_t* p = reinterpret_cast<volatile uint32_t*>(ptr);
+    uint64_t faults = page_fault_count();
+    for (size_t i = 0; i < size / PAGE_SIZE; i++) {
+        p[i * PAGE_SIZE / sizeof(uint32_t)] = static_cast<uint32_t>(i);
+    }
+    faults = page_fault_count() - faults;
+    EXPECT_LT(faults, size / PAGE_SIZE / 4, "sequential scan should prefault most pages");
+
+    // the prefaulted pages must be the ones backing the vmo
+    for (size_t i = 0; i < size / PAGE_SIZE; i++) {
+        uint32_t val;
+        size_t actual;
+        EXPECT_EQ(NO_ERROR, mx_vmo_read(vmo, &val, i * PAGE_SIZE, sizeof(val), &actual), "read");
+        if (val != i) {
+            EXPECT_EQ(i, val, "reading back prefaulted page");
+            break;
+        }
+    }
+
+    EXPECT_EQ(NO_ERROR, mx_vmar_unmap(mx_vmar_root_self(), ptr, size), "unmap");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
+static uint64_t large_page_count() {
+    mx_info_task_stats_t info;
+    if (mx_object_get_info(mx_process_self(), MX_INFO_TASK_STATS,
+                           &info, sizeof(info), nullptr, nullptr) != NO_ERROR)
+        return 0;
+    return info.mem_large_pages;
+}
+
+bool vmo_large_pages_test() {
+    BEGIN_TEST;
+
+    const size_t large_page_size = 2 * 1024 * 1024;
+    const size_t size = 2 * large_page_size;
+    mx_handle_t vmo;
+    EXPECT_EQ(ERR_INVALID_ARGS, mx_vmo_create(size, MX_VMO_LARGE_PAGES << 1, &vmo),
+              "unknown create option");
+    EXPECT_EQ(NO_ERROR, mx_vmo_create(size, MX_VMO_LARGE_PAGES, &vmo), "vm_object_create");
+    EXPECT_EQ(NO_ERROR, mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, 0, size, nullptr, 0), "commit");
+
+    // map it at a large page aligned address
+    mx_handle_t sub_vmar;
+    uintptr_t sub_addr;
+    EXPECT_EQ(NO_ERROR,
+              mx_vmar_allocate(mx_vmar_root_self(), 0, size + large_page_size,
+                               MX_VM_FLAG_CAN_MAP_READ | MX_VM_FLAG_CAN_MAP_WRITE |
+                               MX_VM_FLAG_CAN_MAP_SPECIFIC,
+                               &sub_vmar, &sub_addr),
+              "vmar_allocate");
+    const size_t offset = ((sub_addr + large_page_size - 1) & ~(large_page_size - 1)) - sub_addr;
+
+    uint64_t large_pages = large_page_count();
+
+    uintptr_t ptr;
+    EXPECT_EQ(NO_ERROR,
+              mx_vmar_map(sub_vmar, offset, vmo, 0, size,
+                          MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE | MX_VM_FLAG_SPECIFIC,
+                          &ptr),
+              "map");
+
+    volatile uint32_t* p = reinterpret_cast<volatile uint32_t*>(ptr);
+    for (size_t i = 0; i < size / PAGE_SIZE; i++) {
+        p[i * PAGE_SIZE / sizeof(uint32_t)] = static_cast<uint32_t>(i);
+    }
+    EXPECT_GT(large_page_count(), large_pages, "expected large page mappings");
+
+    for (size_t i = 0; i < size / PAGE_SIZE; i++) {
+        uint32_t val;
+        size_t actual;
+        EXPECT_EQ(NO_ERROR, mx_vmo_read(vmo, &val, i * PAGE_SIZE, sizeof(val), &actual), "read");
+        if (val != i) {
+            EXPECT_EQ(i, val, "reading back through large page mapping");
+            break;
+        }
+    }
+
+    // punching a hole in the large page must leave the rest of it intact
+    EXPECT_EQ(NO_ERROR, mx_vmar_unmap(sub_vmar, ptr + PAGE_SIZE, PAGE_SIZE), "unmap page");
+    EXPECT_EQ(0u, p[0], "page before hole");
+    EXPECT_EQ(2u, p[2 * PAGE_SIZE / sizeof(uint32_t)], "page after hole");
+
+    EXPECT_EQ(NO_ERROR, mx_vmar_destroy(sub_vmar), "vmar_destroy");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(sub_vmar), "handle_close");
+    EXPECT_EQ(large_pages, large_page_count(), "large pages left after destroy");
+    EXPECT_EQ(NO_ERROR, mx_handle_close(vmo), "handle_close");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(vmo_tests)
 RUN_TEST(vmo_create_test);
 RUN_TEST(vmo_read_write_test);
@@ -880,6 +1005,8 @@ RUN_TEST(vmo_clone_test_1);
 RUN_TEST(vmo_clone_test_2);
 RUN_TEST(vmo_clone_test_3);
 RUN_TEST(vmo_clone_test_4);
+RUN_TEST(vmo_prefault_sequential_test);
+RUN_TEST(vmo_large_pages_test);
 END_TEST_CASE(vmo_tests)
 
 int main(int argc, char** argv) {